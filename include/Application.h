@@ -11,6 +11,18 @@
 #include "AudioSystem.h"
 #include "Stage.h"
 #include "Dummy.h"
+#include "DeferredRenderer.h"
+#include "GpuTimer.h"
+#include "Lightmap.h"
+#include "TransformHierarchy.h"
+#include "CollisionWorld.h"
+#include "DrumTrigger.h"
+#include "EmitterSystem.h"
+#include "AudioAnalyzer.h"
+#include "Sequencer.h"
+#include "Reverb.h"
+#include "Piano.h"
+#include "EventLog.h"
 #include "common.h"
 
 using namespace std;
@@ -20,26 +32,73 @@ using namespace std;
 #define SHADOW_WIDTH  4096
 #define SHADOW_HEIGHT 4096
 
+// Shadow filtering modes, compiled into the lit shader as SHADOW_MODE
+#define SHADOW_MODE_NONE 0
+#define SHADOW_MODE_HARD 1
+#define SHADOW_MODE_PCF  2
+
+// Camera modes the pre-pass timings are grouped by
+#define CAMERA_MODE_FREE     0
+#define CAMERA_MODE_DRUMS    1
+#define CAMERA_MODE_OVERHEAD 2
+#define CAMERA_MODE_COUNT    3
+
+// Keys across one octave of the piano, C to C
+#define PIANO_KEYBOARD_KEYS 13
+
+// Seconds between pre-pass timing reports
+#define TIMING_REPORT_INTERVAL 5.0f
+
+// Fixed-rate simulation, independent of the render rate
+#define SIMULATION_RATE      120                        // Ticks per second
+#define SIMULATION_STEP      (1.0f / SIMULATION_RATE)
+#define MAX_SIMULATION_STEPS 8                          // Per frame, any backlog beyond is dropped
+
+// Ticks between the state checkpoints in a recording, one a second
+#define RECORD_CHECKPOINT_TICKS SIMULATION_RATE
+
+struct PassTiming {
+	double depthTime = 0.0;
+	unsigned int depthFrames = 0;
+	double litTime = 0.0;
+	unsigned int litFrames = 0;
+};
+
 struct DrumPiece {
-	unsigned int source_id;
-	
-	bool playLeft = false;
-	unsigned int leftFrameCount = 0;
-	
-	bool playRight = false;
-	unsigned int rightFrameCount = 0;
+	unsigned int buffer;
+	int priority;       // Voice stealing order, higher survives longer
+};
+
+// What rendering interpolates between the last two simulation ticks
+struct SimulationState {
+	glm::vec3 playerPosition;
+	double time;
+	unsigned int tick;          // Ticks run so far, recorded input is stamped with it
 };
 
 class Application : public EventCallbacks
 {
 public:
     WindowManager *windowManager = nullptr;
+	bool headless = false;      // No GL context, geometry stays on the CPU
             
     // Our shader programs
 	shared_ptr<Program> prog;
 	shared_ptr<Program> skyProg;
 	shared_ptr<Program> shadowProg;
 
+	// Deferred shading path (toggled at runtime)
+	DeferredRenderer deferred;
+	bool useDeferred = false;
+
+	// Depth pre-pass for the forward lit pass
+	shared_ptr<Program> depthProg;
+	bool useDepthPrepass = true;
+	GpuTimer depthTimer;
+	GpuTimer litTimer;
+	PassTiming passTimings[CAMERA_MODE_COUNT][2];   // [camera mode][pre-pass off/on]
+	float lastTimingReport = 0.0f;
+
 	// Set pieces
 	shared_ptr<Model> skysphere;
 	shared_ptr<Model> drum_set;
@@ -48,30 +107,68 @@ public:
 	shared_ptr<Model> amplifier2;
 	shared_ptr<Model> piano;
 
+	// Placement of everything static, updated once per frame
+	TransformHierarchy transforms;
+	TransformNode spotlightNodes[3];
+	TransformNode bulbNodes[3];
+	TransformNode drumSetNode;
+	TransformNode amplifier1Node;
+	TransformNode amplifier2Node;
+	TransformNode pianoNode;
+
+	// Static set pieces, stage walls and the player
+	CollisionWorld collisionWorld;
+	ColliderId playerCollider = NO_COLLIDER;
+
 	// Dummies
 	Dummy dummies;
 	bool playGuitar = false;
 	float guitaristRadius = 1.0f;
-	unsigned int guitar_riff;
+	EmitterHandle guitarRiff = 0;     // Only used without the mixer
+	bool useGuitarEmitter = false;
 
 	// Textures
 	unsigned int skysphere_texture;
 
 	// Lights
 	LightingSystem lightingSystem;
-	vector<unsigned int> stageLights;
+	vector<LightHandle> stageLights;
+
+	// Baked lighting for static geometry
+	LightmapSet lightmaps;
 
 	// Shadow mapping
-	unsigned int shadowFBO[10];
+	unsigned int shadowFBO[MAX_LIGHTS];
+	unsigned int lightLayout = 0;       // LightingSystem layout the shaders were specialized for
 	unsigned int shadowMaps;
 
+	// Drum sequencer, declared before audioSystem so the mixer stops calling it before it goes
+	Sequencer sequencer;
+	Sequence drumGroove;
+	long lastSequencerBeat = -1;
+
+	// Room sound on the mix and the piano's voices, also before audioSystem since the mixer thread runs them
+	Reverb venueReverb;
+	Piano pianoInstrument;
+
 	// Audio
 	AudioSystem audioSystem;
 
-	// Drum Set audio
+	// Sounds placed in the scene, after audioSystem so their sources go before the context
+	EmitterSystem emitters;
+
+	// Drum Set audio, declared after audioSystem so the trigger thread stops first
 	DrumPiece snare;
 	DrumPiece hi_hat;
 	DrumPiece kick;
+	DrumTrigger drumTrigger;
+
+	// Analysis of the mixed output, the stage lights react to it
+	AudioAnalyzer audioAnalyzer;
+	AudioFeatures audioFeatures;
+	unsigned int lastBeat = 0;
+	float beatHue = 0.0f;
+	float guitarSweep = 0.0f;
 
 	// Stage
 	const glm::vec3 stageCenter = glm::vec3(0.0f, 0.0f, -3.0f);
@@ -79,6 +176,10 @@ public:
 	const float stageDepth = 7.0f;
 	const float stageHeight = 5.0f;
 	Stage stage = Stage(stageCenter, stageWidth, stageDepth, stageHeight);
+	BoundingBox stageBB = {
+		stageCenter + glm::vec3(-stageWidth/2.0f - 1.0f, -1.0f, -stageDepth/2.0f - 1.0f),
+		stageCenter + glm::vec3( stageWidth/2.0f + 1.0f, stageHeight + 1.0f, stageDepth/2.0f + 1.0f)
+	};
 
 	// Cameras
 	Camera camera;
@@ -103,11 +204,24 @@ public:
 	glm::vec2 useDrumsCenter = glm::vec2(0.0f, -1.0f);
 	float     useDrumsRadius = 0.8f;
 
+	// Piano Interaction
+	bool      usePiano = false;
+	glm::vec2 usePianoCenter = glm::vec2(2.5f, -4.0f);
+	float     usePianoRadius = 1.2f;
+	int       pianoOctave = 0;                          // From middle C
+	int       pianoKeyNotes[PIANO_KEYBOARD_KEYS];       // Note each key is holding, -1 when up
+
 	// Frame Timing
 	float deltaTime = 0.0f;
 	float lastFrame = 0.0f;
 	float timePassed = 0.0f;
 
+	// Simulation
+	SimulationState prevState;
+	SimulationState currState;
+	float accumulator = 0.0f;       // Frame time not yet simulated
+	glm::vec3 viewPosition;         // Interpolated eye position for this frame
+
 	// Key States
 	bool pressedUp    = false;
 	bool pressedDown  = false;
@@ -115,6 +229,13 @@ public:
 	bool pressedRight = false;
 	bool pressedUse   = false;
 
+	// Session recording and replay
+	EventLog eventLog;
+	bool recording = false;
+	bool replaying = false;
+	size_t replayCursor = 0;
+	unsigned int replayMismatches = 0;  // Checkpoints the replay didn't reproduce
+
     /* Callbacks*/
     void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods);
     void mouseCallback(GLFWwindow *window, double xpos, double ypos);
@@ -123,12 +244,35 @@ public:
     /* Initialization */
     void init();
     void initShaders(const string shaderDirectory);
+    void specializeLights();
     void initGeometry(const string objectDirectory);
     void initTextures(const string textureDirectory);
 	void initAudio(const string audioDirectory);
     void initLights();
 	void initShadows();
 	void initCameras();
+	void initLightmaps(const string objectDirectory);
+	void initTransforms();
+	void initCollisions();
+
+	/* Offline tools */
+	void bakeLightmaps(const string objectDirectory, const string textureDirectory,
+	                   unsigned int threads, unsigned int samples);
+	void benchmarkRays(unsigned int rays, unsigned int threads);
+	void benchmarkMixer(const string audioDirectory, unsigned int voices);
+	void benchmarkSequencer();
+	void benchmarkReverb();
+	void benchmarkPiano();
+	void benchmarkEmitters();
+	void benchmarkAudio(const string audioDirectory, const string capturePath);
+
+	/* Recording and replay */
+	void startRecording();
+	void saveRecording(const string path);
+	bool startReplay(const string path);
+	bool replayFinished() const { return replaying && currState.tick >= eventLog.length; }
+	void replayHeadless();
+	void reportReplay(unsigned int frames, double seconds);
 
 	void render();
 
@@ -138,13 +282,27 @@ private:
 	void renderScene(shared_ptr<Program> prog, bool useMaterials = true);
 	void renderObjects(shared_ptr<Program> prog, bool useMaterials = true);
 	void renderShadowMaps(float aspect);
+	void renderForward(const glm::mat4 &P, const glm::mat4 &V, float aspect);
+	void renderDeferred(const glm::mat4 &P, const glm::mat4 &V, float aspect, int width, int height);
+	void renderLightBulbs(shared_ptr<Program> prog);
+	void collectTimings();
+	void reportTimings();
+	int getCameraMode() const;
 	
+	/* Input, live or replayed */
+	void handleKey(int key, int action, int mods);
+	void handleCursor(float xpos, float ypos);
+	void replayTick();
+
 	/* Logic */
+	void simulate();
+	void step();
 	void sceneLogic();
-	void drumLogic();
+	void audioLogic();
 	void checkDrumInteraction();
 	void checkGuitaristInteraction();
-	bool checkPlayerCollisions();
+	void checkPianoInteraction();
+	void releasePianoKeys();
 };
 
 #endif
\ No newline at end of file
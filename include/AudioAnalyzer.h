@@ -0,0 +1,113 @@
+#ifndef AUDIOANALYZER_H
+#define AUDIOANALYZER_H
+
+#include <atomic>
+#include <complex>
+#include <thread>
+
+#include "FFT.h"
+#include "Mixer.h"
+#include "TripleBuffer.h"
+
+using namespace std;
+
+// Window of mixed audio per spectrum, and how far it moves between spectra
+#define AUDIO_FFT_SIZE 1024
+#define AUDIO_FFT_HOP  512
+
+// Frequency bands, edges in AUDIO_BAND_EDGES
+#define AUDIO_BAND_BASS     0
+#define AUDIO_BAND_LOW_MID  1
+#define AUDIO_BAND_HIGH_MID 2
+#define AUDIO_BAND_TREBLE   3
+#define AUDIO_BAND_COUNT    4
+#define AUDIO_BAND_EDGES    {20.0f, 150.0f, 600.0f, 3000.0f, 12000.0f}
+
+// Hops of spectral flux averaged for the onset threshold (~0.5 s)
+#define AUDIO_ONSET_HISTORY 48
+
+// Flux must beat the recent average by this factor to count as an onset
+#define AUDIO_ONSET_SENSITIVITY 1.5f
+
+// Least spectral flux that can be an onset, keeps near-silence from triggering
+#define AUDIO_ONSET_FLOOR 1.0f
+
+// Seconds after an onset before another can be detected
+#define AUDIO_ONSET_COOLDOWN 0.1
+
+// Per hop decay of each band's peak (half-life ~3 s), and the quietest peak it decays to
+#define AUDIO_PEAK_DECAY 0.998f
+#define AUDIO_BAND_FLOOR 0.05f
+
+// Per hop fade of a band once its energy drops, it rises instantly
+#define AUDIO_BAND_RELEASE 0.8f
+
+// Longest the analysis thread sleeps before checking for new audio, in microseconds
+#define AUDIO_ANALYZER_WAIT_US 2000
+
+struct AudioFeatures {
+    float bands[AUDIO_BAND_COUNT] = {0.0f};     // 0 to 1, relative to each band's recent peak
+    float level = 0.0f;                         // RMS of the last hop
+    unsigned int beats = 0;                     // Onsets so far, a change means a new one
+    double time = 0.0;                          // Seconds of audio analyzed
+};
+
+/*
+ * Listens to the mixer's output on its own thread. Every hop it takes a
+ * Hann windowed FFT of the last AUDIO_FFT_SIZE samples, measures the energy
+ * in each band against that band's decaying peak, and detects onsets from
+ * spectral flux above an adaptive threshold. The results are published
+ * through a triple buffer, so the main thread always reads the newest
+ * complete set without waiting on the analysis.
+ *
+ * Analysis time per hop is recorded and reported when it stops.
+ */
+class AudioAnalyzer
+{
+    public:
+        AudioAnalyzer();
+        ~AudioAnalyzer();
+
+        void start(Mixer &mixer);
+        void stop();
+
+        // Main thread: newest features, false when nothing changed since the last call
+        bool read(AudioFeatures &features);
+
+        // Analyzes mono samples on the calling thread, for when there is no mixer thread to tap
+        void process(const float *samples, unsigned int count);
+
+    private:
+        Mixer *mixer = nullptr;
+        thread worker;
+        atomic<bool> running{false};
+
+        TripleBuffer<AudioFeatures> snapshot;
+        AudioFeatures current;
+
+        // Input window, filled up to AUDIO_FFT_SIZE then shifted by a hop
+        float input[AUDIO_FFT_SIZE];
+        unsigned int filled = 0;
+
+        FFT fft;
+        float window[AUDIO_FFT_SIZE];
+        complex<float> spectrum[AUDIO_FFT_SIZE];
+        unsigned int bandBins[AUDIO_BAND_COUNT + 1];
+
+        float magnitude[AUDIO_FFT_SIZE / 2];
+        float bandPeaks[AUDIO_BAND_COUNT];
+        float flux[AUDIO_ONSET_HISTORY] = {0.0f};
+        unsigned int fluxIndex = 0;
+        double lastOnset = -1.0;
+
+        // Timing, since start
+        unsigned long hops = 0;
+        double totalTime = 0.0;             // Microseconds
+        float maxTime = 0.0f;
+
+        void run();
+        void analyze();
+        void report();
+};
+
+#endif
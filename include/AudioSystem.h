@@ -1,29 +1,110 @@
 #ifndef AUDIOSYSTEM_H
 #define AUDIOSYSTEM_H
 
+#include <atomic>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <AL/al.h>
 #include <AL/alc.h>
+#include <AL/alext.h>
 #include <AudioFile.h>
 
+#include "Mixer.h"
+
 using namespace std;
 
+// Pre-created sources shared by every one-shot sound
+#define AUDIO_VOICE_COUNT 16
+
 class AudioSystem 
 {
     public:
-        ALCdevice* openALDevice;
-        ALCcontext* openALContext;
+        ALCdevice* openALDevice = nullptr;
+        ALCcontext* openALContext = nullptr;
 
         vector<ALuint> audioBuffers;
         vector<ALuint> audioSources;
 
-        AudioSystem();
+        // One-shots are mixed here once it is running, see playVoice
+        Mixer mixer;
+
         ~AudioSystem();
+
+        /*
+         * Opens the default device, or with loopback an OpenAL Soft loopback
+         * device that plays nothing by itself: renderLoopback pulls the
+         * output into memory as fast as it is called, mixer included, so it
+         * runs with no sound card and faster than real time. The default
+         * device falls back to a loopback one when there is no sound card;
+         * the game then calls advanceLoopback every frame, so the mixer,
+         * its clock and everything listening to it run as usual, silently.
+         */
+        bool init(bool loopback = false);
+        bool isLoopback() const { return renderSamples != nullptr; }
+
+        // Loopback only: the next frames of everything playing, interleaved stereo float
+        void renderLoopback(float *out, unsigned int frames);
+
+        // Loopback only: renderLoopback without servicing the mixer, for timing the two apart
+        void renderDevice(float *out, unsigned int frames);
+
+        // Loopback only: renders and drops as much as a device would have played in seconds
+        void advanceLoopback(double seconds);
+
         ALuint loadFile(string path);
+
+        // A buffer from interleaved float frames, mixer copy included, as loadFile makes
+        ALuint createBuffer(const vector<float> &frames, unsigned int channels, unsigned int sampleRate);
+
+        // Length of a buffer in seconds
+        static float getDuration(ALuint buffer);
+
+        // The mixer's copy of a loaded buffer, -1 when the mixer isn't running
+        int getMixerSample(ALuint buffer) const;
+
+        // Decodes a file to interleaved float frames, no device needed
+        static bool decodeFile(string path, vector<float> &frames, unsigned int &channels, unsigned int &sampleRate);
+
         ALuint createSource(float x, float y, float z);
         void bind(ALuint source, ALuint buffer);
         void play(ALuint source);
+
+        /*
+         * Voice pool: one-shots borrow a source from a fixed set created up
+         * front, so overlapping hits keep ringing and nothing is allocated at
+         * play time. When every voice is busy, the lowest priority voice is
+         * stolen, the oldest first; a sound never steals from a higher
+         * priority one. With the mixer running the same rule is applied on
+         * its thread and playVoice only queues the hit. Play from one thread
+         * only, the counts can be read from any thread.
+         */
+        void initVoices(unsigned int count = AUDIO_VOICE_COUNT);
+        bool playVoice(ALuint buffer, int priority = 0, float gain = 0.5f);
+        unsigned int getActiveVoices() const;
+        unsigned int getVoiceCount() const;
+        unsigned int getVoicesStolen() const;
+        unsigned int getVoicesDropped() const;     // Not played, everything busy was higher priority
+
+    private:
+        struct Voice {
+            ALuint source;
+            int priority;
+            unsigned long started;   // Play order, lower is older
+        };
+
+        LPALCRENDERSAMPLESSOFT renderSamples = nullptr;
+        double loopbackDue = 0.0;           // Frames owed to advanceLoopback
+        vector<float> loopbackScratch;
+        bool openLoopback();
+
+        vector<Voice> voices;
+        unsigned long voiceClock = 0;
+        atomic<unsigned int> voicesStolen{0};
+        atomic<unsigned int> voicesDropped{0};
+
+        unordered_map<ALuint, unsigned int> mixerSamples;   // Buffer to the same sound in the mixer
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,99 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BoundingVolume.h"
+#include "Model.h"
+
+using namespace std;
+
+// Split candidates per axis when binning centroids
+#define BVH_BINS 16
+
+// Leaves stop splitting at this size, or earlier if the SAH says a split isn't worth it
+#define BVH_MAX_LEAF_SIZE 8
+
+// Ranges smaller than this are built on the thread that reached them
+#define BVH_PARALLEL_THRESHOLD 8192
+
+// Deepest a leaf can be, nodes there stay leaves whatever their size. Also the traversal stack size
+#define BVH_MAX_DEPTH 64
+
+// Relative cost of a box test against a triangle test for the SAH
+#define BVH_TRAVERSAL_COST 1.0f
+
+// Children are allocated in pairs, the right child sits right after the left
+struct BVHNode {
+    glm::vec3 min;
+    unsigned int leftFirst;     // First primitive for leaves, left child otherwise
+    glm::vec3 max;
+    unsigned int count;         // Primitives in a leaf, 0 for internal nodes
+};
+
+struct TraceHit {
+    float t;
+    unsigned int instance;      // Index into the SceneBVH, 0 for a lone TriangleBVH
+    unsigned int mesh;          // Mesh of the model
+    unsigned int triangle;      // Triangle of the mesh
+    float u, v;                 // Barycentrics of the hit
+};
+
+/*
+ * Bottom-level BVH over the triangles of one model, in the model's vertex
+ * space. Built top-down with a binned surface area heuristic; big subtrees
+ * are split across threads, and nodes come from a shared pool so no thread
+ * waits on another. Traversal visits the nearer child first and uses SSE for
+ * the box tests.
+ */
+class TriangleBVH
+{
+    public:
+        void build(const Model &model, unsigned int threads = 0);
+        bool trace(const glm::vec3 &origin, const glm::vec3 &dir, float maxT, TraceHit &hit,
+                   bool anyHit = false) const;
+
+        const BoundingBox &getBounds() const { return bounds; }
+        size_t getNodeCount() const { return nodes.size(); }
+        size_t getTriangleCount() const { return triangles.size(); }
+
+    private:
+        struct Triangle {
+            glm::vec3 p0, e1, e2;
+        };
+
+        vector<BVHNode> nodes;
+        vector<Triangle> triangles;     // Sorted into leaf order by build
+        vector<unsigned int> meshOf;    // Per sorted triangle, mesh and triangle index
+        vector<unsigned int> indexOf;
+        BoundingBox bounds = Bounds::empty();
+};
+
+/*
+ * Top-level BVH over placed TriangleBVHs. Rays are moved into each
+ * instance's space with its inverse matrix, so moving an instance only
+ * means rebuilding this small tree.
+ */
+class SceneBVH
+{
+    public:
+        unsigned int add(const TriangleBVH *blas, const glm::mat4 &M);
+        void setTransform(unsigned int instance, const glm::mat4 &M);
+        void build();
+        bool trace(const glm::vec3 &origin, const glm::vec3 &dir, float maxT, TraceHit &hit,
+                   bool anyHit = false) const;
+
+    private:
+        struct Instance {
+            const TriangleBVH *blas;
+            glm::mat4 M;
+            glm::mat4 invM;
+        };
+
+        vector<Instance> instances;
+        vector<BVHNode> nodes;
+        vector<unsigned int> order;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef BOUNDING_VOLUME_H
+#define BOUNDING_VOLUME_H
+
+#include <cstddef>
+#include <cmath>
+#include <glm/glm.hpp>
+
+struct BoundingBox {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+struct BoundingSphere {
+    glm::vec3 center;
+    float radius;
+};
+
+// Box with its own axes, the tight world-space form of a transformed AABB
+struct OrientedBox {
+    glm::vec3 center;
+    glm::vec3 axes[3];      // Unit axes
+    glm::vec3 halfExtents;  // Along each axis
+};
+
+/*
+ * World bounds are derived from local-space bounds and a transform, never
+ * from the vertices: a transformed AABB is re-boxed from its center and half
+ * extents, so moving an object costs a fixed handful of multiply-adds per
+ * mesh. The array versions process many boxes per call with SSE.
+ */
+namespace Bounds
+{
+    inline BoundingBox empty() { return {glm::vec3(INFINITY), glm::vec3(-INFINITY)}; }
+    inline bool isEmpty(const BoundingBox &bb) { return bb.min.x > bb.max.x; }
+    BoundingBox merge(const BoundingBox &a, const BoundingBox &b);
+    bool overlaps(const BoundingBox &a, const BoundingBox &b);
+
+    BoundingBox transform(const glm::mat4 &M, const BoundingBox &local);
+    BoundingSphere transform(const glm::mat4 &M, const BoundingSphere &local);
+    OrientedBox orient(const glm::mat4 &M, const BoundingBox &local);
+
+    // Many boxes under one transform (the meshes of a model)
+    void transform(const glm::mat4 &M, const BoundingBox *local, BoundingBox *world, size_t count);
+    // One box under many transforms (instances of a mesh)
+    void transform(const glm::mat4 *M, const BoundingBox &local, BoundingBox *world, size_t count);
+
+    BoundingSphere sphereOf(const BoundingBox &bb);
+    BoundingBox boxOf(const OrientedBox &obb);
+}
+
+#endif
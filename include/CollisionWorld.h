@@ -0,0 +1,101 @@
+#ifndef COLLISION_WORLD_H
+#define COLLISION_WORLD_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "BoundingVolume.h"
+
+using namespace std;
+
+#define NO_COLLIDER 0xFFFFFFFFu
+
+// Side of a spatial hash cell, a bit larger than the player
+#define COLLISION_CELL_SIZE 1.0f
+
+// Gap kept between a moving box and whatever it stopped against
+#define COLLISION_SKIN 0.001f
+
+// Contacts resolved per slide before the rest of the movement is dropped
+#define COLLISION_SLIDE_ITERATIONS 3
+
+typedef unsigned int ColliderId;
+
+struct SweepHit {
+    float time;            // Fraction of the movement completed at contact
+    glm::vec3 normal;      // Face of the collider that was hit
+    ColliderId collider;
+};
+
+struct RayHit {
+    float distance;
+    glm::vec3 point;
+    glm::vec3 normal;
+    ColliderId collider;
+};
+
+/*
+ * Broadphase for axis-aligned colliders. Each collider is listed in every
+ * uniform grid cell its box touches, and the cells live in a hash map, so
+ * the world has no fixed extent and a query only visits the colliders near
+ * it, however many there are. Queries dedupe colliders spanning several
+ * cells with a per-query stamp, which makes them unsafe to run concurrently.
+ */
+class CollisionWorld
+{
+    public:
+        CollisionWorld(float cellSize = COLLISION_CELL_SIZE) : cellSize(cellSize) {}
+
+        // Static colliders never move, dynamic ones are moved with update
+        ColliderId add(const BoundingBox &bb, bool dynamic = false, unsigned int tag = 0);
+        void update(ColliderId id, const BoundingBox &bb);
+        void remove(ColliderId id);
+
+        const BoundingBox &getBounds(ColliderId id) const { return colliders[id].box; }
+        unsigned int getTag(ColliderId id) const { return colliders[id].tag; }
+        bool isDynamic(ColliderId id) const { return colliders[id].dynamic; }
+
+        // Every collider touching bb
+        bool overlaps(const BoundingBox &bb, ColliderId ignore = NO_COLLIDER) const;
+        void query(const BoundingBox &bb, vector<ColliderId> &hits, ColliderId ignore = NO_COLLIDER) const;
+
+        // Nearest collider along a box's movement, colliders it starts inside are ignored
+        bool sweep(const BoundingBox &bb, const glm::vec3 &delta, SweepHit &hit,
+                   ColliderId ignore = NO_COLLIDER) const;
+
+        // How far the box actually gets, sliding along whatever it hits
+        glm::vec3 slide(const BoundingBox &bb, glm::vec3 delta, ColliderId ignore = NO_COLLIDER) const;
+
+        // Nearest collider along a ray, dir must be normalized
+        bool raycast(const glm::vec3 &origin, const glm::vec3 &dir, float maxDistance, RayHit &hit,
+                     ColliderId ignore = NO_COLLIDER) const;
+
+    private:
+        struct Collider {
+            BoundingBox box;
+            glm::ivec3 cellMin;
+            glm::ivec3 cellMax;
+            unsigned int tag;
+            bool dynamic;
+            bool alive;
+        };
+
+        float cellSize;
+        vector<Collider> colliders;
+        vector<ColliderId> freeIds;
+        unordered_map<uint64_t, vector<ColliderId>> cells;
+        BoundingBox worldBounds = Bounds::empty();   // Everything ever added, for clipping rays
+
+        mutable vector<unsigned int> stamps;
+        mutable unsigned int stamp = 0;
+
+        glm::ivec3 cellOf(const glm::vec3 &p) const;
+        static uint64_t key(int x, int y, int z);
+        void insert(ColliderId id);
+        void erase(ColliderId id);
+        void gather(const BoundingBox &bb, ColliderId ignore, vector<ColliderId> &candidates) const;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef DEFERREDRENDERER_H
+#define DEFERREDRENDERER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Program.h"
+#include "LightingSystem.h"
+#include "Mesh.h"
+
+using namespace std;
+
+class DeferredRenderer
+{
+    public:
+        // G-buffer
+        unsigned int gBuffer = 0;
+        unsigned int gNormal = 0;
+        unsigned int gAlbedo = 0;
+        unsigned int gSpecular = 0;
+        unsigned int gDepth = 0;
+        int width = 0;
+        int height = 0;
+
+        // Shader programs
+        shared_ptr<Program> geometryProg;
+        shared_ptr<Program> lightProg;
+
+        // Light pass statistics for the last frame
+        unsigned int lightPasses = 0;
+        unsigned long litPixels = 0;
+
+        void init(const string shaderDirectory, unsigned int numLights, int shadowMode);
+        void resize(int width, int height);
+
+        /* Geometry pass, scene is drawn with geometryProg in between */
+        void beginGeometryPass(const glm::mat4 &P, const glm::mat4 &V);
+        void endGeometryPass();
+
+        /* Shade the G-buffer into the currently bound framebuffer */
+        void renderLighting(LightingSystem &lightingSystem, const vector<LightHandle> &lights,
+                            const glm::mat4 &P, const glm::mat4 &V, float aspect,
+                            unsigned int shadowMaps, const BoundingBox &sceneBounds);
+
+        /* Copy G-buffer depth so forward passes can be composited on top */
+        void copyDepth(unsigned int framebuffer = 0);
+
+    private:
+        unsigned int quadVAO = 0;
+
+        void createTargets();
+        void destroyTargets();
+        bool computeScissor(const BoundingBox &bb, const glm::mat4 &PV, glm::ivec4 &rect) const;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef DRAWDATA_H
+#define DRAWDATA_H
+
+#include <glm/glm.hpp>
+
+#include "RingBuffer.h"
+
+// Uniform block binding points shared by every shader
+#define FRAME_DATA_BINDING 0
+#define DRAW_DATA_BINDING  1
+
+// Bytes of per-frame draw data, per ring buffer section
+#define DRAW_DATA_SECTION_SIZE (1 << 20)
+
+/*
+ * Per-pass and per-draw shader inputs, streamed through a RingBuffer into
+ * the FrameData and DrawData uniform blocks instead of individual
+ * glUniform calls. Each set call appends a block to the ring and binds it,
+ * so every draw after it reads that block by offset.
+ */
+namespace DrawData
+{
+    // std140 layouts of the blocks declared in the shaders
+    struct Frame {
+        glm::mat4 P;
+        glm::mat4 V;
+    };
+
+    struct Draw {
+        glm::mat4 M;
+        glm::vec4 emissive;
+    };
+
+    void init();
+    void beginFrame();
+    void endFrame();
+
+    void setCamera(const glm::mat4 &P, const glm::mat4 &V);
+    void setModel(const glm::mat4 &M, const glm::vec3 &emissive = glm::vec3(0.0f));
+
+    const RingBuffer &getBuffer();
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef DRUMTRIGGER_H
+#define DRUMTRIGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <AL/al.h>
+
+#include "SPSCQueue.h"
+#include "AudioSystem.h"
+
+using namespace std;
+
+// Drum pads, one per key
+#define DRUM_PAD_SNARE_LEFT   0
+#define DRUM_PAD_SNARE_RIGHT  1
+#define DRUM_PAD_HIHAT_LEFT   2
+#define DRUM_PAD_HIHAT_RIGHT  3
+#define DRUM_PAD_KICK         4
+#define DRUM_PAD_COUNT        5
+
+// Seconds before the same pad can sound again, filters key bounce
+#define DRUM_RETRIGGER_TIME 0.03
+
+// Hits between latency reports
+#define DRUM_LATENCY_REPORT_HITS 64
+
+// Longest the trigger thread sleeps before rechecking the queue, in microseconds
+#define DRUM_TRIGGER_WAIT_US 1000
+
+/*
+ * Plays drum hits from a dedicated thread as soon as their key events
+ * arrive, instead of waiting for the next simulation tick to poll the
+ * keyboard. keyCallback timestamps each hit and pushes it through a
+ * lock-free queue; the trigger thread applies the per-pad cooldown in
+ * wall-clock time and plays the pad's sample on a pooled voice.
+ *
+ * Every hit's key-event-to-alSourcePlay time is recorded, and percentiles
+ * are logged every DRUM_LATENCY_REPORT_HITS hits and on shutdown.
+ */
+class DrumTrigger
+{
+    public:
+        typedef chrono::steady_clock Clock;
+
+        ~DrumTrigger();
+
+        void setPad(unsigned int pad, ALuint buffer, int priority);
+        void start(AudioSystem &audio);
+        void stop();
+
+        // Main thread: a pad was hit at the current time
+        void trigger(unsigned int pad);
+
+    private:
+        struct Hit {
+            unsigned int pad;
+            Clock::time_point time;
+        };
+
+        AudioSystem *audio = nullptr;
+        ALuint buffers[DRUM_PAD_COUNT] = {0};
+        int priorities[DRUM_PAD_COUNT] = {0};
+        Clock::time_point lastPlayed[DRUM_PAD_COUNT];
+
+        SPSCQueue<Hit, 256> hits;           // keyCallback to trigger thread
+
+        thread worker;
+        atomic<bool> running{false};
+        mutex wakeMutex;
+        condition_variable wake;
+
+        vector<float> latencies;            // Milliseconds, since the last report
+
+        void run();
+        void reportLatency();
+};
+
+#endif
@@ -50,6 +50,9 @@ class Dummy
         Mesh *l_wrist;
         Mesh *l_hand;
 
+        // Simulation time the animation is posed at, set every frame
+        double animationTime = 0.0;
+
         // Dummy properities
         glm::vec3 guitaristPos = glm::vec3(-2.0f, 0.35f, -4.0f);
         BoundingBox guitaristBB = {
@@ -0,0 +1,129 @@
+#ifndef EMITTERSYSTEM_H
+#define EMITTERSYSTEM_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <AL/al.h>
+#include <glm/glm.hpp>
+
+#include "TransformHierarchy.h"
+
+using namespace std;
+
+typedef unsigned int EmitterHandle;
+
+// Real OpenAL sources shared by every emitter
+#define EMITTER_REAL_SOURCES 16
+
+// Side of a grid cell on the ground plane, and the farthest any emitter can be heard from
+#define EMITTER_CELL_SIZE    4.0f
+#define EMITTER_MAX_DISTANCE 24.0f
+
+// Quietest an emitter can be and still get a source (-60 dB)
+#define EMITTER_AUDIBLE_LEVEL 0.001f
+
+// A real emitter counts this much louder when ranked, so near ties don't swap sources every frame
+#define EMITTER_HYSTERESIS 1.25f
+
+struct EmitterStats {
+    unsigned int nearby = 0;            // Emitters in the cells around the listener last update
+    unsigned int audible = 0;
+    unsigned int real = 0;
+    unsigned int playing = 0;           // Real and virtual
+    unsigned long promotions = 0;       // Since start
+    unsigned long demotions = 0;
+};
+
+/*
+ * Positional sound emitters with virtual voices. Any number of emitters can
+ * play at once, but only the EMITTER_REAL_SOURCES most important audible
+ * ones have an OpenAL source; the rest are virtual and cost nothing. A
+ * virtual emitter keeps time from when it started, so when it is promoted
+ * its source picks up where the sound would be.
+ *
+ * Emitters are bucketed in a grid on the ground plane, and each update only
+ * looks at the cells within EMITTER_MAX_DISTANCE of the listener, so the
+ * per-frame cost follows how many emitters are near, not how many exist.
+ * Importance is priority, then loudness at the listener with the same
+ * linear distance model OpenAL is set to. Emitters attached to a transform
+ * node follow it when the hierarchy reports it moved.
+ *
+ * Without a current OpenAL context no sources are made and only the
+ * selection runs, which is how the benchmark drives it.
+ */
+class EmitterSystem
+{
+    public:
+        ~EmitterSystem();
+
+        // Makes the real sources and sets the distance model, if there is a current context
+        void init(unsigned int sources = EMITTER_REAL_SOURCES);
+
+        // Buffers should be mono to be positioned, duration is the buffer's length in seconds
+        EmitterHandle add(ALuint buffer, float duration, glm::vec3 position, float gain = 1.0f,
+                          float referenceDistance = 1.0f, float maxDistance = EMITTER_MAX_DISTANCE,
+                          int priority = 0, bool loop = true);
+
+        // Follows the node's world transform from the next update, offset in the node's space
+        void attach(EmitterHandle emitter, TransformNode node, glm::vec3 offset = glm::vec3(0.0f));
+        void setPosition(EmitterHandle emitter, glm::vec3 position);
+        void setGain(EmitterHandle emitter, float gain);
+
+        void play(EmitterHandle emitter);
+        void stop(EmitterHandle emitter);
+        bool isPlaying(EmitterHandle emitter) const { return emitters[emitter].playing; }
+        bool isReal(EmitterHandle emitter) const { return emitters[emitter].source >= 0; }
+
+        // Once per frame after transforms.update(), time in seconds from any steady clock
+        void update(const TransformHierarchy &transforms, double time, glm::vec3 listener,
+                    glm::vec3 forward, glm::vec3 up);
+
+        const EmitterStats &getStats() const { return stats; }
+        size_t size() const { return emitters.size(); }
+
+    private:
+        struct Emitter {
+            ALuint buffer;
+            float duration;
+            glm::vec3 position;
+            float gain;
+            float referenceDistance;
+            float maxDistance;
+            int priority;
+            bool loop;
+
+            TransformNode node = TRANSFORM_ROOT;
+            glm::vec3 offset;
+
+            bool playing = false;
+            double started = 0.0;           // Time play was called
+            int source = -1;                // Index into sources, -1 while virtual
+            int64_t cell;
+            float loudness = 0.0f;          // At the listener, last update
+            unsigned long chosen = 0;       // Last update it ranked high enough for a source
+        };
+
+        vector<Emitter> emitters;
+        vector<ALuint> sources;
+        vector<EmitterHandle> owners;       // Emitter on each source
+        vector<unsigned int> freeSources;
+
+        unordered_map<int64_t, vector<EmitterHandle>> cells;
+        vector<vector<EmitterHandle>> nodeEmitters;     // Attached emitters by node
+        vector<EmitterHandle> pending;                  // Attached since the last update
+
+        vector<EmitterHandle> candidates;
+        unsigned long updates = 0;
+        double now = 0.0;
+        EmitterStats stats;
+
+        static int64_t cellOf(glm::vec3 position);
+        void move(EmitterHandle emitter, glm::vec3 position);
+        bool outranks(const Emitter &a, const Emitter &b) const;
+        void start(Emitter &emitter);
+        void promote(EmitterHandle emitter);
+        void demote(EmitterHandle emitter);
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef EVENTLOG_H
+#define EVENTLOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Logged event types
+#define EVENT_KEY        0      // key, action, mods
+#define EVENT_CURSOR     1      // x, y
+#define EVENT_CHECKPOINT 2      // Player position (x, y, z) when the tick starts
+
+#define EVENT_LOG_MAGIC   0x574F4853u     // "SHOW"
+#define EVENT_LOG_VERSION 1
+
+// 24 bytes, with no padding so the log is written as is
+struct LoggedEvent {
+    uint32_t tick;              // Simulation tick the event is applied before
+    uint8_t type;
+    uint8_t action;
+    uint16_t mods;
+    int32_t key;
+    float x, y, z;
+};
+
+/*
+ * A recorded session: every input event stamped with the simulation tick it
+ * landed on, plus periodic checkpoints of the simulated state. Replaying
+ * the events tick for tick from the same starting state reproduces the
+ * session exactly, and the checkpoints show where it doesn't. Saved as a
+ * small header followed by the raw events, in the recording machine's byte
+ * order.
+ */
+class EventLog
+{
+    public:
+        uint32_t rate = 0;              // Ticks per second it was recorded at
+        uint32_t length = 0;            // Ticks recorded
+        vector<LoggedEvent> events;
+
+        void clear(uint32_t rate);
+        void add(uint32_t tick, uint8_t type, int32_t key = 0, uint8_t action = 0, uint16_t mods = 0,
+                 float x = 0.0f, float y = 0.0f, float z = 0.0f);
+
+        bool save(const string &path) const;
+        bool load(const string &path);
+};
+
+#endif
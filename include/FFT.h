@@ -0,0 +1,32 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <vector>
+
+using namespace std;
+
+/*
+ * In-place radix-2 complex FFT with its bit reversal and twiddle tables
+ * built once up front. Sizes must be powers of two.
+ */
+class FFT
+{
+    public:
+        explicit FFT(unsigned int size);
+
+        unsigned int getSize() const { return size; }
+
+        // Natural order in and out, the inverse is scaled by 1/size
+        void forward(complex<float> *data) const;
+        void inverse(complex<float> *data) const;
+
+    private:
+        unsigned int size;
+        vector<unsigned int> reversed;
+        vector<complex<float>> twiddles;
+
+        void transform(complex<float> *data, bool inverse) const;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+#ifndef GLDEBUG_H
+#define GLDEBUG_H
+
+#include <glad/glad.h>
+
+// Identical messages reported before the rest are dropped
+#define GL_DEBUG_MAX_REPEATS 5
+
+/*
+ * GL diagnostics through KHR_debug. The driver reports errors and warnings
+ * to a callback instead of the app polling glGetError after every call,
+ * which stalls the pipeline.
+ *
+ * In debug builds, output is synchronous and CHECKED_GL_CALL records which
+ * call is running, so each message points at the source line that caused
+ * it. Release builds (NDEBUG) compile the call-site tracking out and keep
+ * asynchronous output for high severity messages only.
+ */
+namespace GLDebug
+{
+	struct CallSite {
+		const char *call = nullptr;
+		const char *file = nullptr;
+		int line = 0;
+	};
+
+	extern CallSite callSite;
+	extern bool active;
+
+	// Call after the context is current and glad is loaded
+	bool init();
+
+	// Messages below this severity are discarded by the driver
+	// (GL_DEBUG_SEVERITY_HIGH/MEDIUM/LOW/NOTIFICATION)
+	void setMinSeverity(GLenum severity);
+
+	/* Annotations for frame debuggers and profilers */
+	void pushGroup(const char *name);
+	void popGroup();
+	void label(GLenum identifier, GLuint name, const char *label);
+
+	// Marks a render pass for the lifetime of the scope
+	struct Group {
+		Group(const char *name) { pushGroup(name); }
+		~Group() { popGroup(); }
+	};
+
+	inline void enter(const char *call, const char *file, int line)
+	{
+		callSite.call = call;
+		callSite.file = file;
+		callSite.line = line;
+	}
+
+	void leave();
+}
+
+#endif
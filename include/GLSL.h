@@ -11,6 +11,8 @@
 #include <glad/glad.h>
 #include <string>
 
+#include "GLDebug.h"
+
 
 namespace GLSL
 {
@@ -28,8 +30,9 @@ namespace GLSL
 }
 
 
-#ifndef DISABLE_OPENGL_ERROR_CHECKS
-#define CHECKED_GL_CALL(x) do { GLSL::printOpenGLErrors("{{BEFORE}} "#x, __FILE__, __LINE__); (x); GLSL::printOpenGLErrors(#x, __FILE__, __LINE__); } while (0)
+// Errors are reported through GLDebug, this only tags them with the call site
+#if !defined(NDEBUG) && !defined(DISABLE_OPENGL_ERROR_CHECKS)
+#define CHECKED_GL_CALL(x) do { GLDebug::enter(#x, __FILE__, __LINE__); (x); GLDebug::leave(); } while (0)
 #else
 #define CHECKED_GL_CALL(x) (x)
 #endif
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#include <glad/glad.h>
+
+// Texture units we shadow, enough for the shadow map (100) and lightmap (99) units
+#define GL_STATE_TEXTURE_UNITS 128
+
+/*
+ * Shadow copy of the GL state the renderer touches. Each function mirrors
+ * the GL call of the same name, but only reaches the driver when the value
+ * actually changes. All binding and render state changes should go through
+ * here, or the shadow copy goes stale; call reset() after code that bypasses it.
+ *
+ * Objects must be deleted through here too, because GL recycles names and a
+ * new object could otherwise look like it was already bound.
+ */
+namespace GLState
+{
+	struct Counters {
+		unsigned long issued = 0;       // Calls that reached the driver
+		unsigned long filtered = 0;     // Redundant calls that were dropped
+	};
+
+	// Counts for the frame in progress and the last finished frame
+	extern Counters frame;
+	extern Counters lastFrame;
+
+	void endFrame();
+
+	// Forget everything, the next call of each kind is always issued
+	void reset();
+
+	// Bookkeeping for filters that live elsewhere (e.g. Program's uniform cache)
+	inline void countIssued() { frame.issued++; }
+	inline void countFiltered() { frame.filtered++; }
+
+	/* Bindings */
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	void activeTexture(GLenum unit);
+	void bindTexture(GLenum target, GLuint texture);
+	void bindFramebuffer(GLenum target, GLuint framebuffer);
+
+	/* Fixed function state */
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void enable(GLenum capability);
+	void disable(GLenum capability);
+	void blendFunc(GLenum source, GLenum destination);
+	void depthFunc(GLenum func);
+	void depthMask(GLboolean mask);
+	void cullFace(GLenum mode);
+	void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+
+	/* Deletion */
+	void deleteProgram(GLuint program);
+	void deleteVertexArrays(GLsizei n, const GLuint *vaos);
+	void deleteTextures(GLsizei n, const GLuint *textures);
+	void deleteFramebuffers(GLsizei n, const GLuint *framebuffers);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <glad/glad.h>
+
+// Frames of queries kept in flight so reading a result never stalls the GPU
+#define GPU_TIMER_FRAMES 4
+
+/*
+ * Measures GPU time spent between begin() and end() with GL_TIME_ELAPSED
+ * queries. Results arrive a few frames late, so each measurement carries a
+ * caller supplied tag identifying what was being timed.
+ */
+class GpuTimer
+{
+    public:
+        void init();
+
+        void begin(int tag = 0);
+        void end();
+
+        // Returns the oldest finished measurement, false if none is ready
+        bool poll(double &milliseconds, int &tag);
+
+    private:
+        GLuint queries[GPU_TIMER_FRAMES];
+        int tags[GPU_TIMER_FRAMES];
+        bool pending[GPU_TIMER_FRAMES] = { false };
+        unsigned int head = 0;   // Next query to issue
+        unsigned int tail = 0;   // Oldest query not yet read
+};
+
+#endif
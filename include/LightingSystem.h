@@ -1,52 +1,157 @@
 #ifndef LIGHTINGSYSTEM_H
 #define LIGHTINGSYSTEM_H
 
+#include <string>
 #include <vector>
 #include <memory>
 #include <glm/glm.hpp>
 
 #include "Light.h"
+#include "Mesh.h"
 #include "Program.h"
 
 using namespace std;
 
-struct LightSource {
-    unsigned int id;
-    bool enabled;
-    shared_ptr<Light> light;
-};
-
+/*
+ * Owns every light in the scene. Lights of each type are packed into their
+ * own structure-of-arrays pool and addressed through generational handles,
+ * so every update and query is a couple of array lookups with no allocation.
+ */
 class LightingSystem
 {
     public:
 
-        vector<LightSource> lights;
-
-        unsigned int spawnDirectLight(glm::vec3 color, 
-                                      glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f));
+        LightHandle spawnDirectLight(glm::vec3 color, 
+                                     glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f));
         
-        unsigned int spawnPointLight(glm::vec3 color, 
-                                     glm::vec3 position = glm::vec3(0.0f));
+        LightHandle spawnPointLight(glm::vec3 color, 
+                                    glm::vec3 position = glm::vec3(0.0f));
        
-        unsigned int spawnSpotLight(glm::vec3 color, 
-                                    float inner_cutoff,
-                                    float outer_cutoff,
-                                    glm::vec3 position = glm::vec3(0.0f),
-                                    glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f));
+        LightHandle spawnSpotLight(glm::vec3 color, 
+                                   float inner_cutoff,
+                                   float outer_cutoff,
+                                   glm::vec3 position = glm::vec3(0.0f),
+                                   glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f));
 
-        void renderLights(shared_ptr<Program> prog, glm::mat4 view) const;
+        void destroyLight(LightHandle light);
+        bool isValid(LightHandle light) const;
+
+        void renderLights(shared_ptr<Program> prog, const glm::mat4 &view) const;
         
-        void setPosition(unsigned int id, glm::vec3 position);
-        void setDirection(unsigned int id, glm::vec3 direction);
-        void setColor(unsigned int id, glm::vec3 color);
+        /* Setters */
+        void setPosition(LightHandle light, glm::vec3 position);
+        void setDirection(LightHandle light, glm::vec3 direction);
+        void setColor(LightHandle light, glm::vec3 color);
+        void setAttenuation(LightHandle light, float constant, float linear, float quadratic);
+        void setCutoffs(LightHandle light, float inner, float outer);
+        void setEnabled(LightHandle light, bool enabled);
+        void setBaked(LightHandle light, bool baked);
     
-        glm::vec3 getPosition(unsigned int id);
-        glm::vec3 getDirection(unsigned int id);
-        glm::vec3 getColor(unsigned int id);
-        glm::mat4 getSpaceMatrix(unsigned int id, float aspect);
+        /* Getters */
+        int getType(LightHandle light) const;
+        glm::vec3 getPosition(LightHandle light) const;
+        glm::vec3 getDirection(LightHandle light) const;
+        glm::vec3 getColor(LightHandle light) const;
+        Attenuation getAttenuation(LightHandle light) const;
+        void getCutoffs(LightHandle light, float &inner, float &outer) const;
+        bool isEnabled(LightHandle light) const;
+        bool isBaked(LightHandle light) const;      // Placement lives in the lightmaps, color stays live
+
+        // Cached, only rebuilt after the light moves or the aspect ratio changes
+        const glm::mat4 &getSpaceMatrix(LightHandle light, float aspect);
+
+        // World space region the light can visibly reach, false if unbounded
+        bool getBounds(LightHandle light, BoundingBox &bb) const;
+
+        /* Shader slots */
+        unsigned int getSlotCount() const { return slots.size(); }
+        unsigned int getSlot(LightHandle light) const { return light & LIGHT_SLOT_MASK; }
+        LightHandle getHandle(unsigned int slot) const;   // INVALID_LIGHT for empty slots
+
+        // Changes on every spawn and destroy, when the slot count or type list may have too
+        unsigned int getLayoutVersion() const { return layoutVersion; }
+
+        // Comma separated shader light types, one per light slot
+        string getTypeList() const;
+
+        /*
+         * Reactions: a light's color follows one of a set of inputs between
+         * 0 and 1, from floor * color at 0 up to the full color at 1.
+         * react() applies every reaction with the current inputs. Only the
+         * color changes, so baked lights can react too: the lightmap channel
+         * is scaled by it.
+         */
+        void addReaction(LightHandle light, unsigned int input, glm::vec3 color, float floor);
+        void setReactionColor(LightHandle light, glm::vec3 color);
+        void react(const float *inputs);
         
     private:
-        shared_ptr<Light> search(unsigned int id);
+        struct Slot {
+            unsigned int generation = 0;
+            int type = -1;                  // -1 while the slot is free
+            unsigned int index = 0;         // Position in the type's pool
+            bool enabled = true;
+            bool baked = false;
+        };
+
+        // Uniform names for a slot, built once instead of every frame
+        struct SlotUniforms {
+            string valid, baked, type;
+            string position, direction, inner_cutoff, outer_cutoff;
+            string ambient, diffuse, specular;
+            string constant, linear, quadratic;
+        };
+
+        struct DirectPool {
+            vector<unsigned int> slot;
+            vector<glm::vec3> color;
+            vector<glm::vec3> direction;
+        };
+
+        struct PointPool {
+            vector<unsigned int> slot;
+            vector<glm::vec3> color;
+            vector<glm::vec3> position;
+            vector<Attenuation> attenuation;
+        };
+
+        struct SpotPool {
+            vector<unsigned int> slot;
+            vector<glm::vec3> color;
+            vector<glm::vec3> position;
+            vector<glm::vec3> direction;
+            vector<Attenuation> attenuation;
+            vector<float> inner_cutoff;     // Degrees
+            vector<float> outer_cutoff;
+            vector<float> inner_cos;
+            vector<float> outer_cos;
+
+            // Shadow mapping matrices, rebuilt lazily
+            vector<glm::mat4> view;
+            vector<glm::mat4> spaceMatrix;
+            vector<float> aspect;
+            vector<bool> dirty;
+        };
+
+        struct Reaction {
+            LightHandle light;
+            unsigned int input;
+            glm::vec3 color;
+            float floor;
+        };
+
+        vector<Slot> slots;
+        vector<SlotUniforms> uniforms;
+        vector<Reaction> reactions;
+        vector<unsigned int> freeSlots;
+        unsigned int layoutVersion = 0;
+
+        DirectPool direct;
+        PointPool point;
+        SpotPool spot;
+
+        LightHandle allocate(int type, unsigned int index);
+        const Slot *lookup(LightHandle light) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,40 @@
+#ifndef LIGHTMAP_H
+#define LIGHTMAP_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "Program.h"
+
+using namespace std;
+
+// Texture unit the bound lightmap lives on
+#define LIGHTMAP_UNIT 99
+
+// Baked lights a lightmap holds, one per channel in slot order; frag.glsl has the same limit
+#define LIGHTMAP_CHANNELS 3
+
+// File extension of baked lightmaps (Radiance HDR)
+#define LIGHTMAP_EXTENSION ".hdr"
+
+/*
+ * Baked lightmaps loaded at runtime, one texture per static instance. Binding
+ * one switches the program to its LIGHTMAP variant, which lights baked
+ * lights from it in their current color and adds their ambient.
+ */
+class LightmapSet
+{
+    public:
+        bool enabled = true;
+        map<string, unsigned int> textures;
+
+        // Loads every lightmap in the directory, keyed by file name
+        void load(const string directory);
+
+        // Binds the named instance's lightmap, or unbinds if it has none
+        void bind(shared_ptr<Program> prog, const string &name) const;
+        void unbind(shared_ptr<Program> prog) const;
+};
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef LIGHTMAPPER_H
+#define LIGHTMAPPER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "LightingSystem.h"
+#include "Model.h"
+#include "Plane.h"
+
+using namespace std;
+
+// Offset along the surface normal that keeps rays from hitting their origin
+#define LIGHTMAP_RAY_EPSILON 0.001f
+
+// Triangles per BVH leaf
+#define LIGHTMAP_BVH_LEAF_SIZE 4
+
+// Passes that grow baked texels into the padding around each chart
+#define LIGHTMAP_DILATE_PASSES 2
+
+/*
+ * Offline CPU lightmap baker. Static lights and static geometry are gathered
+ * into a ray tracing scene, then every lightmap texel gets each light's
+ * diffuse term (with ray traced shadows) plus one diffuse bounce. Lights are
+ * baked white, each into its own channel, and the shaders scale the channel
+ * by the light's current color, so baked lights can still change color and
+ * brightness; the bounce takes the brightness of what it hits, not its hue.
+ * Ambient isn't baked, the shaders add it with the surface's own ambient
+ * color.
+ *
+ * Texel rows are handed out to worker threads one at a time and each texel
+ * seeds its own random numbers from where it is, so the bake scales across
+ * cores and the result doesn't depend on how many there are.
+ */
+class Lightmapper
+{
+    public:
+        unsigned int threads = 0;       // 0 uses every hardware thread
+        unsigned int samples = 64;      // Hemisphere rays per texel for the bounce
+
+        // Every light marked as baked, up to LIGHTMAP_CHANNELS in slot order
+        void addLights(const LightingSystem &lightingSystem);
+
+        // Every mesh of the model shares one lightmap (see MODEL_LIGHTMAP_UVS)
+        void addModel(const string name, const Model &model, const glm::mat4 &M);
+        void addPlane(const string name, const Plane &plane, const glm::vec3 &albedo);
+
+        void bake();
+        bool save(const string directory) const;
+
+    private:
+        struct BakeLight {
+            int type;                   // Same codes as the shaders
+            glm::vec3 position;
+            glm::vec3 direction;        // Normalized, pointing away from the light
+            unsigned int channel;       // Of the lightmap
+            Attenuation attenuation;
+            float inner_cutoff;         // Cosines
+            float outer_cutoff;
+        };
+
+        struct Triangle {
+            glm::vec3 p0, e1, e2;       // World space corner and edges
+            glm::vec3 n0, n1, n2;       // World space vertex normals
+            glm::vec2 uv0, uv1, uv2;    // Lightmap coords
+            glm::vec3 albedo;
+        };
+
+        struct Texel {
+            int triangle = -1;          // Triangle covering the texel center, -1 if none
+            glm::vec2 barycentric;
+        };
+
+        struct Instance {
+            string name;
+            unsigned int size;
+            vector<Texel> texels;
+            vector<glm::vec3> lightmap;
+        };
+
+        // Internal nodes keep their left child right after them, leaves have count > 0
+        struct Node {
+            glm::vec3 min;
+            unsigned int start;         // First triangle for leaves, right child otherwise
+            glm::vec3 max;
+            unsigned int count;
+        };
+
+        struct Hit {
+            float t;
+            unsigned int triangle;
+            float b1, b2;
+        };
+
+        vector<BakeLight> lights;
+        vector<Triangle> triangles;
+        vector<Instance> instances;
+
+        vector<Node> nodes;
+        vector<unsigned int> order;     // Triangle indices sorted into BVH leaves
+
+        void addTriangles(Instance &instance, const vector<Vertex> &vertices,
+                          const vector<unsigned int> &indices, const glm::mat4 &M,
+                          const glm::vec3 &albedo);
+        void rasterize(Instance &instance, unsigned int first);
+
+        void buildBVH();
+        unsigned int buildNode(unsigned int start, unsigned int count, const vector<glm::vec3> &centroids);
+        bool trace(const glm::vec3 &origin, const glm::vec3 &dir, float maxT, bool anyHit, Hit &hit) const;
+
+        glm::vec3 directLight(const glm::vec3 &p, const glm::vec3 &n) const;
+        glm::vec3 bakeTexel(const Texel &texel, unsigned int seed) const;
+        void dilate(Instance &instance) const;
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include <memory>
 
 #include "Program.h" 
+#include "BoundingVolume.h"
 
 using namespace std;
 
@@ -14,6 +15,7 @@ struct Vertex {
     glm::vec3 Position;
     glm::vec3 Normal;
     glm::vec2 TexCoords;
+    glm::vec2 LightmapCoords;
 };
 
 struct Material {
@@ -28,11 +30,6 @@ struct Texture {
     string path;
 };
 
-struct BoundingBox {
-    glm::vec3 min;
-    glm::vec3 max;
-};
-
 class Mesh {
     public:
         // Mesh data
@@ -41,21 +38,22 @@ class Mesh {
         vector<Texture>      textures;
         Material             material;
 
-        // Mesh metadata
-        BoundingBox bb = {glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+        // Local-space bounds, measured once when the mesh is built
+        BoundingBox bb = Bounds::empty();
+        BoundingSphere sphere = {glm::vec3(0.0f), 0.0f};
 
-        Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Material material);
+        Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Material material,
+             bool upload = true);
+        void setupMesh();   // Sends the geometry to the GPU
         void Draw(const shared_ptr<Program> prog, bool drawMaterials=true) const;
         void measure();
-        void measure(glm::mat4 M);
         glm::vec3 moveToZero();
         unsigned int getVAO() { return VAO; }
 
     private:
         // Render data
-        unsigned int VAO, VBO, EBO;
+        unsigned int VAO = 0, VBO = 0, EBO = 0;
 
-        void setupMesh();
         void setMaterials(const shared_ptr<Program> prog) const;
 };
 
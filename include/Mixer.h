@@ -0,0 +1,208 @@
+#ifndef MIXER_H
+#define MIXER_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <AL/al.h>
+
+#include "SPSCQueue.h"
+
+using namespace std;
+
+// Output format, always interleaved stereo
+#define MIXER_SAMPLE_RATE 48000
+#define MIXER_BLOCK_FRAMES 256
+
+// Blocks queued on the output source, sets the mix latency (4 x 256 frames ~ 21 ms)
+#define MIXER_OUTPUT_BUFFERS 4
+
+#define MIXER_MAX_VOICES  64
+#define MIXER_MAX_SAMPLES 64
+
+// Buses, each with its own gain before the master
+#define MIXER_BUS_SFX        0
+#define MIXER_BUS_MUSIC      1
+#define MIXER_BUS_INSTRUMENT 2
+#define MIXER_BUS_COUNT      3
+
+// Commands sent to the mixer thread
+#define MIXER_PLAY      0
+#define MIXER_STOP_ALL  1
+
+// Mixed blocks kept for the tap before the oldest are dropped
+#define MIXER_TAP_BLOCKS 32
+
+struct MixerCommand {
+    int type;
+    unsigned int sample;
+    unsigned int bus;
+    float gain;
+    float pan;                  // -1 left to 1 right
+    float pitch;                // Playback rate, 1 is the sample's own rate
+    int priority;
+    bool loop;
+};
+
+// One mixed block, downmixed to mono for analysis
+struct MixerTapBlock {
+    float samples[MIXER_BLOCK_FRAMES];
+    unsigned int frames;
+};
+
+class Mixer;
+class Reverb;
+
+// Starts voices at exact frames, called on the mixer thread before every block is mixed
+class MixerScheduler
+{
+    public:
+        virtual ~MixerScheduler() {}
+        virtual void schedule(Mixer &mixer, uint64_t blockStart, unsigned int frames) = 0;
+};
+
+// Renders its own voices into the instrument bus, called on the mixer thread after the scheduler
+class MixerInstrument
+{
+    public:
+        virtual ~MixerInstrument() {}
+        virtual void render(float *out, unsigned int frames) = 0;   // Adds to out, interleaved stereo
+};
+
+/*
+ * Engine-side software mixer. Voices are mixed in float on the mixer thread,
+ * summed into buses and a master, and streamed to OpenAL through a single
+ * queued source, so OpenAL never mixes more than one stream.
+ *
+ * The game side only ever pushes commands into a lock-free SPSC ring (one
+ * producer thread), and voices are allocated, stolen and retired by the
+ * mixer itself, with the same priority-then-age rule as the OpenAL voice
+ * pool. Bus gain and pause are atomics instead, so any thread can set them.
+ * A scheduler can also start voices from the mixer thread itself, at any
+ * frame inside the block about to be mixed, an instrument with its own
+ * voice engine renders into a bus of its own, and each bus can send to a
+ * shared convolution reverb that is mixed back in after the buses. render() can also be called directly with no device open, which is
+ * how headless tools and the benchmark drive it; given the same commands
+ * it produces the same output every time.
+ */
+class Mixer
+{
+    public:
+        Mixer();
+        ~Mixer();
+
+        // Samples are copied in, frames interleaved. Safe to add from one thread while mixing
+        unsigned int addSample(const vector<float> &frames, unsigned int channels, unsigned int sampleRate);
+
+        // Game side, both just queue a command
+        bool play(unsigned int sample, float gain = 1.0f, float pan = 0.0f, float pitch = 1.0f,
+                  int priority = 0, unsigned int bus = MIXER_BUS_SFX, bool loop = false);
+        void stopAll();
+
+        // Any thread, a paused bus holds its voices where they are
+        void setBusGain(unsigned int bus, float gain);
+        void pauseBus(unsigned int bus, bool paused);
+
+        // Mixer thread only, from a scheduler: starts a voice offset frames into the current block
+        void startAt(unsigned int offset, unsigned int sample, float gain = 1.0f, float pan = 0.0f,
+                     float pitch = 1.0f, int priority = 0, unsigned int bus = MIXER_BUS_SFX);
+
+        // Used from the next block on, and must outlive the mixer thread
+        void setScheduler(MixerScheduler *scheduler) { this->scheduler = scheduler; }
+
+        // Same rule as the scheduler for both. Sends are any thread, 0 (dry) by default
+        void setInstrument(MixerInstrument *instrument) { this->instrument = instrument; }
+        void setReverb(Reverb *reverb) { this->reverb = reverb; }
+        void setReverbSend(unsigned int bus, float send);
+
+        // Frames mixed so far, and the frame the device is playing now (the same while headless)
+        uint64_t getFramesMixed() const { return framesMixed; }
+        uint64_t getPlaybackFrame() const { return running ? playbackFrame.load() : framesMixed.load(); }
+
+        // Copies of the mixed output for one reader thread, dropped while it falls behind
+        void enableTap(bool enabled) { tapEnabled = enabled; }
+        bool popTap(MixerTapBlock &block) { return tap.pop(block); }
+
+        // Streams through an OpenAL source, needs a current AL context. Without the thread, whoever
+        // renders the device calls service between renders, as a loopback device does
+        bool start(bool threaded = true);
+        void stop();
+        bool isRunning() const { return running; }
+
+        // Refills the buffers the device has played, mixing a block for each
+        void service();
+
+        // Mixes the next frames into out (interleaved stereo), applying any queued commands first
+        void render(float *out, unsigned int frames);
+
+        unsigned int getActiveVoices() const { return activeVoices; }
+        atomic<unsigned int> voicesStolen{0};
+        atomic<unsigned int> voicesDropped{0};
+        atomic<unsigned int> underruns{0};
+
+    private:
+        struct Sample {
+            vector<float> data;
+            unsigned int channels;
+            unsigned int frames;
+            double rate;                // Sample rate over the mix rate
+        };
+
+        struct Voice {
+            bool active = false;
+            unsigned int sample;
+            unsigned int bus;
+            double position;            // In sample frames
+            double step;                // Sample frames per output frame
+            float gainL, gainR;
+            int priority;
+            unsigned long started;
+            bool loop;
+            unsigned int delay;         // Frames into the next block before it starts
+        };
+
+        Sample samples[MIXER_MAX_SAMPLES];
+        atomic<unsigned int> sampleCount{0};
+
+        SPSCQueue<MixerCommand, 1024> commands;
+        Voice voices[MIXER_MAX_VOICES];
+        unsigned long voiceClock = 0;
+        atomic<unsigned int> activeVoices{0};
+        atomic<float> busGains[MIXER_BUS_COUNT];
+        atomic<bool> busPaused[MIXER_BUS_COUNT];
+
+        SPSCQueue<MixerTapBlock, MIXER_TAP_BLOCKS> tap;
+        atomic<bool> tapEnabled{false};
+
+        atomic<MixerInstrument *> instrument{nullptr};
+        atomic<Reverb *> reverb{nullptr};
+        atomic<float> reverbSends[MIXER_BUS_COUNT];
+
+        // Clocks, in frames
+        atomic<MixerScheduler *> scheduler{nullptr};
+        atomic<uint64_t> framesMixed{0};
+        atomic<uint64_t> playbackFrame{0};
+        uint64_t framesPlayed = 0;          // Whole blocks the output source has finished
+
+        // Mixing scratch, a block at a time
+        alignas(16) float voiceBlock[MIXER_BLOCK_FRAMES * 2];
+        alignas(16) float busBlocks[MIXER_BUS_COUNT][MIXER_BLOCK_FRAMES * 2];
+        alignas(16) float sendBlock[MIXER_BLOCK_FRAMES];
+        alignas(16) float wetBlock[MIXER_BLOCK_FRAMES * 2];
+
+        // Output stream
+        thread worker;
+        atomic<bool> running{false};
+        ALuint source = 0;
+        ALuint buffers[MIXER_OUTPUT_BUFFERS] = {0};
+
+        void applyCommands();
+        void startVoice(const MixerCommand &command, unsigned int delay = 0);
+        unsigned int fetch(Voice &voice, unsigned int frames);
+        void mixBlock(float *out, unsigned int frames);
+        void fillBuffer(ALuint buffer);
+        void run();
+};
+
+#endif
@@ -12,6 +12,15 @@
 
 using namespace std;
 
+// Model loading flags
+#define MODEL_NO_UPLOAD    (1 << 0)   // Keep geometry on the CPU only (headless tools)
+#define MODEL_LIGHTMAP_UVS (1 << 1)   // Generate a second UV set for baked lighting
+
+// Lightmap atlas layout
+#define LIGHTMAP_CELL_TEXELS 6        // Texels along each side of a two-triangle chart
+#define LIGHTMAP_MIN_SIZE    64
+#define LIGHTMAP_MAX_SIZE    1024
+
 class Model
 {
     public:
@@ -21,37 +30,47 @@ class Model
         string directory;
 
         // Model metadata
-        BoundingBox bb = {glm::vec3(INFINITY), glm::vec3(-INFINITY)};
+        BoundingBox bb = Bounds::empty();
+        BoundingBox meshBB = Bounds::empty();   // Raw vertex bounds, before M_o
+        vector<BoundingBox> meshWorldBounds;    // Per mesh, as of the last updateBoundingBox
         glm::mat4 M_o = glm::mat4(1.0f); // Composite matrix to scale+center model
+        unsigned int lightmapSize = 0;   // Lightmap resolution, 0 if there are no lightmap UVs
 
         // Model transformations
         glm::mat4 T_w = glm::mat4(1.0f);
         glm::mat4 R_w = glm::mat4(1.0f);
         glm::mat4 S_w = glm::mat4(1.0f);
 
-        Model(string path)
+        Model(string path, unsigned int flags = 0)
         {
-            loadModel(path);
+            loadModel(path, flags);
         }
         void Draw(const shared_ptr<Program> prog, bool drawMaterials=true) const;
         void normalize();
 
         // Model transformations
-        void translate(glm::vec3 translate) { T_w = glm::translate(glm::mat4(1.0f), translate); }
-        void rotate(glm::mat4 rotate) { R_w = rotate; };
-        void scale(float scale) { S_w = glm::scale(glm::mat4(1.0f), glm::vec3(scale)); }
-        void scale(glm::vec3 scale) { S_w = glm::scale(glm::mat4(1.0f), scale); }
+        void translate(glm::vec3 translate) { T_w = glm::translate(glm::mat4(1.0f), translate); updateTransform(); }
+        void rotate(glm::mat4 rotate) { R_w = rotate; updateTransform(); };
+        void scale(float scale) { S_w = glm::scale(glm::mat4(1.0f), glm::vec3(scale)); updateTransform(); }
+        void scale(glm::vec3 scale) { S_w = glm::scale(glm::mat4(1.0f), scale); updateTransform(); }
         
         glm::mat4 getNormalizedMat() { return M_o; }
-        glm::mat4 getTransformMat() { return T_w * R_w * S_w * M_o; }
+        const glm::mat4 &getTransformMat() const { return transform; }
         void updateBoundingBox(glm::mat4 M = glm::mat4(1.0f));
 
     private:
-        void loadModel(string path);
+        bool upload = true;
+        glm::mat4 transform = glm::mat4(1.0f); // T_w * R_w * S_w * M_o, rebuilt when a part changes
+        vector<BoundingBox> meshBounds;         // Local bounds of each mesh, packed for batching
+
+        void updateTransform() { transform = T_w * R_w * S_w * M_o; }
+
+        void loadModel(string path, unsigned int flags);
         void processNode(aiNode *node, const aiScene *scene);
         Mesh processMesh(aiMesh *mesh, const aiScene *scene);
         vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, 
                                              string typeName);
+        void generateLightmapUVs();
 };
 
 #endif
\ No newline at end of file
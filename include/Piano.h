@@ -0,0 +1,144 @@
+#ifndef PIANO_H
+#define PIANO_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "Mixer.h"
+#include "SPSCQueue.h"
+
+using namespace std;
+
+// The 88 keys, as MIDI notes
+#define PIANO_LOWEST_NOTE  21       // A0
+#define PIANO_HIGHEST_NOTE 108      // C8
+
+// Sounding voices, and the extra slots stolen voices fade out in
+#define PIANO_MAX_VOICES   88
+#define PIANO_STEAL_SLOTS  16
+#define PIANO_VOICE_SLOTS  (PIANO_MAX_VOICES + PIANO_STEAL_SLOTS)
+
+// Frames a stolen voice takes to fade out (-60 dB), and seconds a released key takes
+#define PIANO_STEAL_FRAMES    64
+#define PIANO_RELEASE_SECONDS 0.3f
+
+// Voice blocks a block may cost by default, enough for every slot, and the fewest, where
+// every voice can still fade out inside it
+#define PIANO_VOICE_BUDGET PIANO_VOICE_SLOTS
+#define PIANO_MIN_BUDGET   (PIANO_VOICE_SLOTS * PIANO_STEAL_FRAMES / MIXER_BLOCK_FRAMES)
+
+// Semitones between synthesized zones, and their longest length in seconds
+#define PIANO_ZONE_SPACING 3
+#define PIANO_ZONE_SECONDS 6.0f
+
+// Left to right across the keyboard, 1 is fully panned at the ends
+#define PIANO_STEREO_WIDTH 0.6f
+
+// Events
+#define PIANO_NOTE_ON  0            // value is the velocity, 0 to 1
+#define PIANO_NOTE_OFF 1
+#define PIANO_SUSTAIN  2            // value above 0.5 is pedal down
+
+// Events from a scheduler per block, any more are dropped
+#define PIANO_BLOCK_EVENTS 128
+
+struct PianoEvent {
+    uint8_t type;
+    uint8_t note;
+    uint16_t offset;                // Frames into the block
+    float value;
+};
+
+/*
+ * Sampled piano, played as an instrument on the mixer thread. Each note
+ * resamples the nearest zone (a recorded or synthesized note) to its
+ * pitch, and is held by its key or the sustain pedal until it is released
+ * with a damper tail. Voices render four frames at a time with the
+ * interpolation, envelope and pan in one pass.
+ *
+ * Cost is bounded per block in voice frames: voices are ranked held, then
+ * sustained, then released, louder first, and the ones that don't fit the
+ * budget are stolen, fading out over PIANO_STEAL_FRAMES instead of cutting.
+ * The budget always leaves room for those fades, so a block never renders
+ * more than it allows. Running out of voices steals the same way.
+ *
+ * Notes come from one game thread through a lock-free queue and start with
+ * the next block, or from a scheduler on the mixer thread at exact frames.
+ */
+class Piano : public MixerInstrument
+{
+    public:
+        Piano();
+
+        // Before the mixer renders it. Frames are interleaved and mixed down to mono
+        void addZone(int root, const vector<float> &frames, unsigned int channels, unsigned int sampleRate);
+        void synthesize(unsigned int spacing = PIANO_ZONE_SPACING);
+        bool hasZones() const { return !zones.empty(); }
+
+        // Game thread, applied at the start of the next block
+        bool noteOn(int note, float velocity);
+        bool noteOff(int note);
+        bool setSustain(bool down);
+
+        // Any thread: full voice blocks rendered per block, at least PIANO_MIN_BUDGET
+        void setVoiceBudget(unsigned int voices);
+
+        // Mixer thread only, from a scheduler: an event offset frames into the block about to be rendered
+        void scheduleEvent(unsigned int offset, int type, int note, float value = 0.0f);
+
+        // Mixer thread
+        void render(float *out, unsigned int frames) override;
+
+        unsigned int getActiveVoices() const { return activeVoices; }
+        atomic<unsigned int> voicesStolen{0};       // For a new note
+        atomic<unsigned int> voicesShed{0};         // Over the budget
+
+    private:
+        struct Zone {
+            vector<float> data;
+            unsigned int frames;
+            int root;
+            double rate;                // Sample rate over the mix rate
+        };
+
+        struct Voice {
+            bool active = false;
+            int note;
+            int state;
+            const Zone *zone;
+            double position;            // In zone frames
+            double step;
+            float gain;                 // From the velocity
+            float level;                // Envelope, starts at gain
+            float gainL, gainR;
+            unsigned int delay;         // Frames into this block before it starts
+            int nextState;              // Changes offset frames into this block, -1 for none
+            unsigned int changeAt;
+            unsigned int fadeLeft;      // Frames until a stolen voice is silent
+            unsigned long started;
+        };
+
+        vector<Zone> zones;
+        int noteZones[128];
+
+        Voice voices[PIANO_VOICE_SLOTS];
+        unsigned long voiceClock = 0;
+        bool sustain = false;
+
+        SPSCQueue<PianoEvent, 256> incoming;
+        PianoEvent scheduled[PIANO_BLOCK_EVENTS];
+        unsigned int scheduledCount = 0;
+
+        atomic<unsigned int> budget{PIANO_VOICE_BUDGET};
+        atomic<unsigned int> activeVoices{0};
+
+        void apply(const PianoEvent &event);
+        void startNote(int note, float velocity, unsigned int offset);
+        void changeState(Voice &voice, int state, unsigned int offset);
+        float rank(const Voice &voice) const;
+        void enforceBudget(unsigned int frames);
+        void renderVoice(Voice &voice, float *out, unsigned int frames);
+};
+
+#endif
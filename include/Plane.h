@@ -3,8 +3,10 @@
 
 #include <glm/glm.hpp>
 #include <memory>
+#include <vector>
 
 #include "Program.h"
+#include "Mesh.h"
 
 using namespace std;
 
@@ -14,13 +16,16 @@ class Plane
         float groundX = 5.0f;
         float groundZ = 5.0f;
         float groundTex = 5.0f;
+        unsigned int lightmapSize = 256;
+
+        vector<Vertex> vertices;
 
         unsigned int VBO;
         unsigned int VAO;
 
         glm::mat4 M = glm::mat4(1.0f);
         
-        void init();
+        void init(bool upload = true);
         void render(shared_ptr<Program> prog, bool useMaterials, int texture = -1);
 };
 
@@ -6,8 +6,10 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 
 std::string readFileAsString(const std::string &fileName);
@@ -22,14 +24,67 @@ public:
 
 	void setShaderNames(const std::string &v, const std::string &f);
 	virtual bool init();
-	virtual void bind();
+	virtual bool bind();   // false when nothing could be built, skip the draws
 	virtual void unbind();
 
 	void addAttribute(const std::string &name);
 	void addUniform(const std::string &name);
+	void addUniformBlock(const std::string &name, GLuint binding);
 	GLint getAttribute(const std::string &name) const;
 	GLint getUniform(const std::string &name) const;
 
+	/* Permutations */
+
+	// Defines shared by every variant (e.g. light counts, shadow mode).
+	// Changing a value throws away all compiled variants.
+	void setDefine(const std::string &name, const std::string &value = "");
+
+	// Registers an optional feature, compiled in as "#define <name>" when
+	// its bit is set in the active feature mask. Returns the feature's bit.
+	unsigned addFeature(const std::string &name);
+	unsigned getFeatureBit(const std::string &name) const;
+
+	// Selects the variant compiled for the given feature mask. Variants are
+	// compiled on first use and cached; if the program is bound, the new
+	// variant is bound immediately.
+	void setFeatures(unsigned mask);
+	unsigned getFeatures() const { return features; }
+
+	// Starts building a variant ahead of its first use
+	void prepare(unsigned mask);
+
+	/* Uniforms */
+
+	// Values set through these are remembered and replayed when a
+	// different variant becomes active, so callers never need to know
+	// which variant they are talking to.
+	void setInt(const std::string &name, GLint value);
+	void setFloat(const std::string &name, GLfloat value);
+	void setVec3(const std::string &name, const glm::vec3 &value);
+	void setMat4(const std::string &name, const glm::mat4 &value);
+
+	/* Binary cache */
+
+	// Linked programs are saved here and reloaded on later runs instead of
+	// being compiled again. Binaries are keyed by the specialized sources
+	// and the driver, so edits and driver updates miss the cache. Empty
+	// (the default) disables the cache.
+	static void setBinaryCache(const std::string &directory);
+	static unsigned cacheHits;
+	static unsigned cacheMisses;
+
+	/* Asynchronous compilation */
+
+	// When enabled, init() and prepare() only submit the compile and link,
+	// and the program is waited on the first time it is bound. Loading
+	// assets in between hides the compile time. Uses
+	// KHR_parallel_shader_compile when the driver has it.
+	static void setAsyncCompile(bool enabled);
+	static bool isAsyncCompile() { return asyncCompile; }
+
+	// True once binding the active variant won't stall
+	bool isReady() const;
+
 protected:
 
 	std::string vShaderName;
@@ -37,11 +92,58 @@ protected:
 
 private:
 
-	GLuint pid = 0;
-	std::map<std::string, GLint> attributes;
-	std::map<std::string, GLint> uniforms;
+	struct UniformValue {
+		GLenum type;
+		GLint i;
+		GLfloat f[16];
+		unsigned long version;
+	};
+
+	struct Variant {
+		GLuint pid = 0;
+		GLuint VS = 0;
+		GLuint FS = 0;
+		bool pending = false;       // Submitted, results not checked yet
+		std::string cachePath;      // Where to save the binary once linked
+		std::map<std::string, GLint> attributes;
+		std::map<std::string, GLint> uniforms;
+		unsigned long synced = 0;   // Last uniform version written to this variant
+		std::map<GLint, UniformValue> written;  // Last value sent to each location
+	};
+
+	std::map<unsigned, Variant> variants;
+	Variant *active = nullptr;
+	bool bound = false;
+
+	std::vector<std::string> attributeNames;
+	std::vector<std::string> uniformNames;
+	std::vector<std::pair<std::string, GLuint>> uniformBlocks;
+	std::map<std::string, std::string> defines;
+	std::map<std::string, unsigned> featureBits;
+	unsigned features = 0;
+
+	std::map<std::string, UniformValue> values;
+	unsigned long version = 0;
+
 	bool verbose = true;
 
+	static std::string cacheDirectory;
+	static bool asyncCompile;
+
+	std::string buildHeader(unsigned mask) const;
+	bool compile(unsigned mask, Variant &variant);
+	bool start(unsigned mask, Variant &variant);
+	bool finish(Variant &variant);
+	void resolve(Variant &variant) const;
+	GLuint loadBinary(const std::string &path) const;
+	void saveBinary(const std::string &path, GLuint pid) const;
+	Variant *getVariant(unsigned mask);
+	void activate(Variant *variant);
+	void sync(Variant *variant);
+	void write(Variant *variant, const std::string &name, const UniformValue &value) const;
+	UniformValue &record(const std::string &name, GLenum type);
+	void clearVariants();
+
 };
 
 #endif // LAB471_PROGRAM_H_INCLUDED
@@ -0,0 +1,73 @@
+#ifndef REVERB_H
+#define REVERB_H
+
+#include <complex>
+#include <vector>
+
+#include "FFT.h"
+
+using namespace std;
+
+// Partition length in frames, also the block size the convolution runs at
+#define REVERB_PARTITION 256
+#define REVERB_FFT_SIZE  (2 * REVERB_PARTITION)
+
+// Spectrum bins kept per partition (DC to Nyquist), padded to a multiple of four
+#define REVERB_BINS        (REVERB_PARTITION + 1)
+#define REVERB_BINS_PADDED ((REVERB_BINS + 3) & ~3)
+
+/*
+ * Convolution reverb using uniformly partitioned overlap-save convolution.
+ * The impulse response is cut into REVERB_PARTITION long pieces and each is
+ * transformed once when it is set. Every block of input is transformed once
+ * into a frequency-domain delay line. Each output channel is then a complex
+ * multiply-accumulate of that line against the partitions, done four bins
+ * at a time, and one inverse transform. Spectra are stored as separate
+ * real and imaginary arrays so the accumulate vectorizes.
+ *
+ * Input is mono and output is stereo, taken from a one or two channel
+ * response. process() takes any number of frames. It buffers up to a whole
+ * partition, so the wet signal comes out one partition late.
+ */
+class Reverb
+{
+    public:
+        Reverb();
+
+        // Not while process runs. Resampled to outputRate if needed and normalized to unit energy
+        void setImpulse(const vector<float> &frames, unsigned int channels, unsigned int sampleRate,
+                        unsigned int outputRate);
+
+        // Decaying stereo noise, for when there is no recorded response; decay is the RT60 in seconds
+        static void makeImpulse(vector<float> &frames, float seconds, float decay, unsigned int sampleRate,
+                                unsigned int seed = 1);
+
+        // Mono in, interleaved stereo out
+        void process(const float *input, float *output, unsigned int frames);
+
+        unsigned int getPartitionCount() const { return partitions; }
+
+    private:
+        FFT fft;
+        unsigned int partitions = 0;
+
+        // Response spectra, [channel][partition * REVERB_BINS_PADDED + bin]
+        vector<float> responseRe[2], responseIm[2];
+
+        // Input spectra, newest at head, same layout
+        vector<float> historyRe, historyIm;
+        unsigned int head = 0;
+
+        // Previous and current input partition, and the buffering around each block
+        float window[REVERB_FFT_SIZE];
+        float pending[REVERB_PARTITION];
+        float ready[REVERB_PARTITION * 2];
+        unsigned int filled = 0;
+
+        complex<float> scratch[REVERB_FFT_SIZE];
+        float accumRe[REVERB_BINS_PADDED], accumIm[REVERB_BINS_PADDED];
+
+        void convolve();
+};
+
+#endif
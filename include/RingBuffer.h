@@ -0,0 +1,55 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <cstddef>
+#include <glad/glad.h>
+
+// Frames the CPU may run ahead of the GPU, one buffer section each
+#define RING_BUFFER_FRAMES 3
+
+/*
+ * GPU buffer for data that changes every frame. It is split into one
+ * section per frame in flight, and each frame's data is written linearly
+ * into its section. A fence per section keeps the CPU from overwriting data
+ * the GPU hasn't consumed yet.
+ *
+ * With ARB_buffer_storage the buffer is persistently and coherently mapped,
+ * so writes land directly in GPU visible memory. Otherwise each push falls
+ * back to glBufferSubData into the same (fence protected) section.
+ *
+ * A frame that outgrows its section stalls on the GPU before reusing it,
+ * and the sections double in size at the next frame.
+ */
+class RingBuffer
+{
+    public:
+        GLuint buffer = 0;
+        GLenum target = GL_UNIFORM_BUFFER;
+
+        // Largest section usage seen so far, for sizing
+        size_t peakUsage = 0;
+
+        void init(GLenum target, size_t sectionSize, size_t alignment);
+        void destroy();
+
+        // Waits until the GPU is done with the section this frame writes to
+        void beginFrame();
+        void endFrame();
+
+        // Copies data into the current section and returns its buffer offset
+        GLintptr push(const void *data, size_t size);
+
+        // Pushes data and binds it to an indexed binding point (e.g. a uniform block)
+        void bindRange(GLuint index, const void *data, size_t size);
+
+    private:
+        char *mapped = nullptr;     // Persistent mapping, null on the fallback path
+        size_t sectionSize = 0;
+        size_t alignment = 1;
+        unsigned int section = 0;
+        size_t used = 0;
+        bool overflowed = false;
+        GLsync fences[RING_BUFFER_FRAMES] = { 0 };
+};
+
+#endif
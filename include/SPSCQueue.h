@@ -0,0 +1,55 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Fixed-size lock-free queue for exactly one producer thread and one
+ * consumer thread. Neither side ever blocks or allocates: push fails when
+ * the queue is full and pop fails when it is empty. Capacity must be a
+ * power of two, and one slot is always left empty.
+ */
+template <typename T, size_t Capacity>
+class SPSCQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+    public:
+        bool push(const T &item)
+        {
+            size_t tail = this->tail.load(std::memory_order_relaxed);
+            size_t next = (tail + 1) & (Capacity - 1);
+            if (next == head.load(std::memory_order_acquire))
+                return false;
+
+            items[tail] = item;
+            this->tail.store(next, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T &item)
+        {
+            size_t head = this->head.load(std::memory_order_relaxed);
+            if (head == tail.load(std::memory_order_acquire))
+                return false;
+
+            item = items[head];
+            this->head.store((head + 1) & (Capacity - 1), std::memory_order_release);
+            return true;
+        }
+
+        bool empty() const
+        {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+
+    private:
+        T items[Capacity];
+
+        // On separate cache lines so the two threads don't contend
+        alignas(64) std::atomic<size_t> head{0};    // Next item to pop, owned by the consumer
+        alignas(64) std::atomic<size_t> tail{0};    // Next slot to fill, owned by the producer
+};
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <atomic>
+#include <bitset>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Mixer.h"
+#include "SPSCQueue.h"
+#include "TripleBuffer.h"
+#include "DrumTrigger.h"
+#include "Piano.h"
+
+using namespace std;
+
+// Ticks per beat for step patterns
+#define SEQUENCER_PPQ 480
+
+// Sequence events
+#define SEQUENCER_HIT      0    // value is the velocity, 0 to 1
+#define SEQUENCER_TEMPO    1    // value is the new tempo in beats per minute
+#define SEQUENCER_NOTE_ON  2    // Piano, value is the velocity
+#define SEQUENCER_NOTE_OFF 3
+#define SEQUENCER_SUSTAIN  4    // value above 0.5 is pedal down
+
+struct SequencerEvent {
+    uint64_t tick;
+    uint8_t type;
+    uint8_t pad;                // Or the note, for piano events
+    float value;
+};
+
+// Events sorted by tick, looped every length ticks
+struct Sequence {
+    vector<SequencerEvent> events;
+    unsigned int ppq = SEQUENCER_PPQ;
+    uint64_t length = 0;
+    float bpm = 120.0f;             // Tempo at the first tick
+};
+
+// Where the sequence was at a mixed frame, and how fast it moves from there
+struct SequencerClock {
+    uint64_t frame = 0;
+    double beat = 0.0;
+    double framesPerBeat = 0.0;
+    bool playing = false;
+};
+
+/*
+ * Plays drum sequences, and any piano part with them, through the mixer's
+ * scheduler hook. Every block the
+ * mixer thread works out which hits fall inside it from the tempo clock,
+ * which counts mixed frames rather than wall time, and starts their voices
+ * at the exact frame. Nothing on that path allocates or locks: sequences
+ * are built on the main thread and handed over through lock-free queues,
+ * and the mixer thread hands them back to be freed.
+ *
+ * The clock is published once per block, and getBeat() extrapolates it to
+ * the frame the device is playing, so lighting and animation can follow
+ * what is heard.
+ */
+class Sequencer : public MixerScheduler
+{
+    public:
+        ~Sequencer();
+
+        // Before play, pads are read by the mixer thread
+        void setPad(unsigned int pad, unsigned int sample, int priority, float gain = 0.5f);
+        void setPiano(Piano *piano) { this->piano = piano; }
+
+        // Main thread
+        void play(const Sequence &sequence);
+        void stop();
+        bool isPlaying() const { return playing; }
+        void setTempo(float bpm);           // Overrides the sequence's tempo until its next change
+
+        // Main thread: beats since the sequence started, at the sample being played; negative when stopped
+        double getBeat(const Mixer &mixer);
+
+        // Building sequences
+        static void addSteps(Sequence &sequence, unsigned int pad, const string &steps, unsigned int stepsPerBeat = 4);
+        static void addChord(Sequence &sequence, const vector<int> &notes, uint64_t tick, uint64_t length,
+                             float velocity = 0.6f);
+        static bool loadMidi(const string &path, Sequence &sequence);
+
+        // Mixer thread
+        void schedule(Mixer &mixer, uint64_t blockStart, unsigned int frames) override;
+
+    private:
+        struct Pad {
+            bool set = false;
+            unsigned int sample;
+            int priority;
+            float gain;
+        };
+        Pad pads[DRUM_PAD_COUNT];
+        Piano *piano = nullptr;
+
+        SPSCQueue<Sequence *, 16> incoming;     // Main thread to the mixer thread
+        SPSCQueue<Sequence *, 16> retired;      // And back, to be deleted
+        atomic<bool> playing{false};
+        atomic<float> tempo{0.0f};              // 0 follows the sequence
+
+        // Mixer thread
+        Sequence *active = nullptr;
+        bool started = false;
+        size_t cursor = 0;
+        uint64_t loopBase = 0;                  // Ticks before the current pass through the sequence
+        double anchorFrame = 0.0;               // Tempo segment start, frame(tick) is linear from here
+        double anchorTick = 0.0;
+        double framesPerTick = 0.0;
+        float currentTempo = 0.0f;
+        float appliedOverride = 0.0f;
+        bitset<128> heldNotes;                  // Piano notes and pedal to let go of when it stops
+        bool heldSustain = false;
+        TripleBuffer<SequencerClock> clock;
+
+        // Main thread
+        SequencerClock lastClock;
+
+        void setAnchor(double frame, double tick, float bpm);
+        void collect();
+        void releaseNotes();
+        static void sortEvents(Sequence &sequence);
+};
+
+#endif
@@ -5,6 +5,8 @@
 #include "Model.h"
 #include "Program.h"
 #include "Plane.h"
+#include "Lightmap.h"
+#include "TransformHierarchy.h"
 
 using namespace std;
 
@@ -27,15 +29,21 @@ class Stage
         Plane ground;
         Plane back_wall;
 
-        // Vertical stage trusses
-        vector<glm::mat4> trusses_M;
+        // Stage trusses, under the root node at the stage center
+        TransformHierarchy *transforms = nullptr;
+        TransformNode root;
+        vector<TransformNode> trussNodes;
 
         Stage(glm::vec3 center, float width, float depth, float height) :
         center(center), width(width), depth(depth), height(height) {};
         
 
-        void initStage();
-        void renderStage(shared_ptr<Program> prog, bool useMaterials = true);
+        void initStage(TransformHierarchy &transforms, bool upload = true);
+        void renderStage(shared_ptr<Program> prog, bool useMaterials = true,
+                         const LightmapSet *lightmaps = nullptr);
+
+    private:
+        void addTrussRow(glm::vec3 position, glm::mat4 rotation, float length, float start, float trussHeight);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+#ifndef TRANSFORM_HIERARCHY_H
+#define TRANSFORM_HIERARCHY_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BoundingVolume.h"
+
+using namespace std;
+
+// Parent index of top-level nodes
+#define TRANSFORM_ROOT 0xFFFFFFFFu
+
+typedef unsigned int TransformNode;
+
+/*
+ * Flat scene graph. Nodes are stored in creation order, and a parent always
+ * exists before its children, so one forward pass over the arrays updates
+ * every world matrix top-down. Each node's local matrix is T * R * S * offset,
+ * where the offset is a fixed inner transform such as Model::getTransformMat.
+ *
+ * Only nodes marked dirty since the last update (and their descendants) are
+ * recomputed, and update returns immediately when nothing moved, so static
+ * nodes cost nothing per frame. Nodes with local bounds get their world AABB
+ * refreshed in the same pass. The nodes each update recomputed are listed
+ * until the next one, for anything that follows them.
+ */
+class TransformHierarchy
+{
+    public:
+        TransformNode add(TransformNode parent = TRANSFORM_ROOT,
+                          const glm::mat4 &offset = glm::mat4(1.0f));
+
+        void setTranslation(TransformNode node, const glm::vec3 &translation);
+        void setRotation(TransformNode node, const glm::mat4 &rotation);
+        void setScale(TransformNode node, const glm::vec3 &scale);
+        void setScale(TransformNode node, float scale) { setScale(node, glm::vec3(scale)); }
+        void setOffset(TransformNode node, const glm::mat4 &offset);
+        void setBounds(TransformNode node, const BoundingBox &localBounds);
+
+        // Recomputes the world matrices and bounds of everything that moved
+        void update();
+
+        const glm::mat4 &getWorld(TransformNode node) const { return worlds[node]; }
+        const BoundingBox &getWorldBounds(TransformNode node) const { return worldBounds[node]; }
+        TransformNode getParent(TransformNode node) const { return parents[node]; }
+        const vector<TransformNode> &getMoved() const { return moved; }
+        size_t size() const { return parents.size(); }
+
+    private:
+        // Structure of arrays, indexed by node
+        vector<TransformNode> parents;
+        vector<glm::vec3> translations;
+        vector<glm::mat4> rotations;
+        vector<glm::vec3> scales;
+        vector<glm::mat4> offsets;
+        vector<glm::mat4> locals;
+        vector<glm::mat4> worlds;
+        vector<BoundingBox> localBounds;
+        vector<BoundingBox> worldBounds;
+        vector<unsigned char> dirty;
+        vector<TransformNode> moved;
+
+        // Lowest dirty index, nodes before it are untouched by update
+        size_t firstDirty = 0;
+
+        void markDirty(TransformNode node);
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+/*
+ * Latest-value snapshot shared by exactly one writer thread and one reader
+ * thread. The writer fills back() and publishes it; the reader swaps in the
+ * newest published value with update() and reads front(). Neither side ever
+ * blocks or copies, and values published between two reads are skipped.
+ */
+template <typename T>
+class TripleBuffer
+{
+    public:
+        // Writer
+        T &back() { return buffers[backIndex]; }
+
+        void publish()
+        {
+            backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // Reader, false when nothing was published since the last update
+        bool update()
+        {
+            if (!(middle.load(std::memory_order_relaxed) & FRESH))
+                return false;
+
+            frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+            return true;
+        }
+
+        const T &front() const { return buffers[frontIndex]; }
+
+    private:
+        static const unsigned int INDEX = 3;
+        static const unsigned int FRESH = 4;
+
+        T buffers[3];
+        unsigned int backIndex = 0;             // Owned by the writer
+        unsigned int frontIndex = 1;            // Owned by the reader
+        std::atomic<unsigned int> middle{2};    // Handed between them, FRESH once published
+};
+
+#endif
@@ -2,10 +2,12 @@
 #define COMMON_H
 
 #include <string>
+#include <glm/glm.hpp>
 
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory);
+glm::vec3 AverageColorFromFile(const char *path, const string &directory);
 void saveImage(const char *path, int width, int height, unsigned int shadowMaps);
 float random();
 
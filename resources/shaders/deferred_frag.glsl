@@ -0,0 +1,162 @@
+#version 330 core
+
+/*
+ * Permutation defines (injected by Program):
+ *   NUM_LIGHTS   - number of light slots
+ *   SHADOW_MODE  - 0: no shadows, 1: single tap, 2: 5x5 PCF
+ *   AMBIENT_PASS - sum every light's ambient term instead of shading light[lightIndex]
+ */
+
+#define DIRECT_LIGHT 0
+#define POINT_LIGHT  1
+#define SPOT_LIGHT   2
+
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS 10
+#endif
+
+#ifndef SHADOW_MODE
+#define SHADOW_MODE 2
+#endif
+
+struct Light {
+	bool valid;
+	int type;
+	vec3 position;  // must be in view space
+	vec3 direction;
+	float inner_cutoff;
+	float outer_cutoff;
+
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+
+	float constant;
+	float linear;
+	float quadratic;
+};
+
+in vec2 texCoords;
+
+out vec4 color;
+
+uniform sampler2D gNormal;
+uniform sampler2D gAlbedo;
+uniform sampler2D gSpecular;
+uniform sampler2D gDepth;
+uniform sampler2DArrayShadow shadowMaps;
+
+uniform mat4 invP;
+uniform mat4 invV;
+
+uniform Light light[NUM_LIGHTS];
+uniform mat4 lightSpaceMatrix[NUM_LIGHTS];
+uniform int lightIndex;
+
+float computeAttenuation(Light light, vec3 fragPos);
+float computeIntensity(Light light, vec3 fragPos);
+float shadowCalculation(vec4 ls_fragPos, int shadowMap);
+
+void main()
+{
+	float depth = texture(gDepth, texCoords).r;
+
+	// Nothing was drawn here, leave the sky alone
+	if (depth == 1.0)
+		discard;
+
+	// Reconstruct view space position from depth
+	vec4 fragPos = invP * vec4(vec3(texCoords, depth) * 2.0 - 1.0, 1.0);
+	vec3 v_fragPos = fragPos.xyz / fragPos.w;
+
+	vec4 albedo = texture(gAlbedo, texCoords);
+
+#ifdef AMBIENT_PASS
+	vec3 surfaceAmbient = (albedo.a > 0.5) ? albedo.rgb : vec3(1.0);
+
+	vec3 result = vec3(0.0);
+	for (int i = 0; i < NUM_LIGHTS; i++) {
+		if (light[i].valid) {
+			vec3 ambient = light[i].ambient * surfaceAmbient;
+
+			if (light[i].type == POINT_LIGHT || light[i].type == SPOT_LIGHT)
+				ambient *= computeAttenuation(light[i], v_fragPos);
+
+			result += ambient;
+		}
+	}
+	color = vec4(result, 1.0);
+#else
+	Light l = light[lightIndex];
+
+	vec3 normal     = texture(gNormal, texCoords).xyz;
+	vec4 specular   = texture(gSpecular, texCoords);
+	vec3 lightDir   = normalize(l.position - v_fragPos);
+	vec3 viewDir    = normalize(-v_fragPos);
+	vec3 reflectDir = reflect(-lightDir, normal);
+
+	// Diffuse
+	float diff = max(dot(normal, lightDir), 0.0);
+	vec3 result = l.diffuse * diff * albedo.rgb;
+
+	// Specular
+	float spec = pow(max(dot(viewDir, reflectDir), 0.0), specular.a);
+	result += l.specular * spec * specular.rgb;
+
+	// Attenuation away from a point light or spot light
+	if (l.type == POINT_LIGHT || l.type == SPOT_LIGHT)
+		result *= computeAttenuation(l, v_fragPos);
+
+	// Intensity at edges of spotlight
+	if (l.type == SPOT_LIGHT)
+		result *= computeIntensity(l, v_fragPos);
+
+	// Shadows from light source
+#if SHADOW_MODE > 0
+	vec4 m_fragPos = invV * vec4(v_fragPos, 1.0);
+	result *= 1.0 - shadowCalculation(lightSpaceMatrix[lightIndex] * m_fragPos, lightIndex);
+#endif
+
+	color = vec4(result, 1.0);
+#endif
+}
+
+float computeAttenuation(Light light, vec3 fragPos)
+{
+	float distance = length(light.position - fragPos);
+	return 1.0/ (light.constant + light.linear*distance + light.quadratic*(distance*distance));
+}
+
+float computeIntensity(Light light, vec3 fragPos)
+{
+	vec3 lightDir   = normalize(light.position - fragPos);
+	float theta     = dot(lightDir, normalize(-light.direction));
+	float epsilon   = light.inner_cutoff - light.outer_cutoff;
+	return clamp((theta - light.outer_cutoff) / epsilon, 0.0, 1.0);
+}
+
+float shadowCalculation(vec4 ls_fragPos, int shadowMap)
+{
+	float bias = 0.000005;
+
+	vec3 projCoords = ls_fragPos.xyz / ls_fragPos.w;
+	projCoords = projCoords * 0.5 + 0.5;
+	float currentDepth = projCoords.z;
+
+#if SHADOW_MODE == 1
+	return texture(shadowMaps, vec4(projCoords.xy, shadowMap, currentDepth - bias));
+#else
+	vec2 texelSize = 1.0 / vec2(textureSize(shadowMaps, 0).xy);
+
+	float shadow = 0.0;
+	for (int x = -2; x <= 2; ++x)
+	{
+		for (int y = -2; y <= 2; ++y)
+			shadow += texture(shadowMaps, vec4(projCoords.xy + vec2(x,y) * texelSize, shadowMap, currentDepth - bias));
+	}
+
+	shadow /= 25.0;
+
+	return shadow;
+#endif
+}
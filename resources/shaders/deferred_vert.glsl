@@ -0,0 +1,12 @@
+#version  330 core
+
+// Full screen triangle, generated from the vertex index
+out vec2 texCoords;
+
+void main()
+{
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	texCoords = pos;
+
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,21 @@
+#version  330 core
+layout(location = 0) in vec3 vertPos;
+
+// Must match the lit shader bit for bit, it is drawn with GL_EQUAL afterwards
+invariant gl_Position;
+
+// Streamed per pass and per draw (see DrawData.h)
+layout(std140) uniform FrameData {
+	mat4 P;
+	mat4 V;
+};
+
+layout(std140) uniform DrawData {
+	mat4 M;
+	vec4 emissive;
+};
+
+void main()
+{
+	gl_Position = P * V * M * vec4(vertPos, 1.0);
+}
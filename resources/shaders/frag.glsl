@@ -1,28 +1,46 @@
 #version 330 core
 
+/*
+ * Permutation defines (injected by Program):
+ *   NUM_LIGHTS       - number of light slots to evaluate
+ *   LIGHT_TYPES      - comma separated type per slot, lets the compiler fold type branches
+ *   SHADOW_MODE      - 0: no shadows, 1: single tap, 2: 5x5 PCF
+ *   TEXTURE_DIFFUSE  - material has a diffuse map
+ *   TEXTURE_SPECULAR - material has a specular map
+ *   EMISSIVE         - output the draw's emissive color only (light bulbs)
+ *   LIGHTMAP         - baked lights' diffuse and bounce come from the lightmap, one channel per light, only their ambient is computed
+ */
+
 #define DIRECT_LIGHT 0
 #define POINT_LIGHT  1
 #define SPOT_LIGHT   2
 
-#define MAX_LIGHTS 10
+// Baked lights per lightmap, see Lightmap.h
+#define LIGHTMAP_CHANNELS 3
+
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS 10
+#endif
+
+#ifndef SHADOW_MODE
+#define SHADOW_MODE 2
+#endif
 
 struct Material {
 	vec3 diffuse;
 	vec3 specular;
-	vec3 emissive;
 	float shininess;
 
-	bool texture_diffuse_enable;
 	sampler2D texture_diffuse1;
-	bool texture_specular_enable;
 	sampler2D texture_specular1;
 };
 
 struct Light {
 	bool valid;
+	bool baked;
 	int type;
 	vec3 position;  // must be in view space
-	vec3 direction; 
+	vec3 direction;
 	float inner_cutoff;
 	float outer_cutoff;
 
@@ -38,78 +56,147 @@ struct Light {
 in vec3 v_fragPos;
 in vec3 v_fragNor;
 in vec2 texCoords;
-in vec4 fragPosLightSpace[MAX_LIGHTS];
+#ifdef LIGHTMAP
+in vec2 lightmapCoords;
+#endif
+#if NUM_LIGHTS > 0 && SHADOW_MODE > 0
+in vec4 fragPosLightSpace[NUM_LIGHTS];
+#endif
 
 out vec4 color;
 
 uniform Material material;
-uniform Light light[MAX_LIGHTS];
-uniform sampler2DArrayShadow shadowMaps;
-uniform bool lightsEnabled;
 
+#ifdef EMISSIVE
+// Streamed per draw (see DrawData.h)
+layout(std140) uniform DrawData {
+	mat4 M;
+	vec4 emissive;
+};
+#endif
+
+#if NUM_LIGHTS > 0
+uniform Light light[NUM_LIGHTS];
+#endif
+uniform sampler2DArrayShadow shadowMaps;
+#ifdef LIGHTMAP
+uniform sampler2D lightmap;
+#endif
+
+#if defined(LIGHT_TYPES) && NUM_LIGHTS > 0
+const int lightType[NUM_LIGHTS] = int[NUM_LIGHTS](LIGHT_TYPES);
+#define LIGHT_TYPE(i) lightType[i]
+#else
+#define LIGHT_TYPE(i) light[i].type
+#endif
+
+// Per-fragment surface properties, fetched once before the light loop
+struct Surface {
+	vec3 normal;
+	vec3 viewDir;
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+};
 
-void computeLight(Light light, out vec3 ambient, out vec3 diffuse, out vec3 specular);
+#if NUM_LIGHTS > 0
+void computeLight(Light light, Surface surface, out vec3 ambient, out vec3 diffuse, out vec3 specular);
 void computeAttenuation(Light light, inout vec3 ambient, inout vec3 diffuse, inout vec3 specular);
 void computeIntensity(Light light, inout vec3 diffuse, inout vec3 specular);
+#endif
 float shadowCalculation(vec4 ls_fragPos, int shadowMap);
 
 void main()
 {
+#ifdef EMISSIVE
+	color = vec4(emissive.rgb, 1.0);
+#else
+	Surface surface;
+	surface.normal  = normalize(v_fragNor);
+	surface.viewDir = normalize(-v_fragPos);
+
+#ifdef TEXTURE_DIFFUSE
+	surface.diffuse = vec3(texture(material.texture_diffuse1, texCoords));
+	surface.ambient = surface.diffuse;
+#else
+	surface.diffuse = material.diffuse;
+	surface.ambient = vec3(1.0);
+#endif
+
+#ifdef TEXTURE_SPECULAR
+	surface.specular = vec3(texture(material.texture_specular1, texCoords));
+#else
+	surface.specular = material.specular;
+#endif
+
 	vec3 result = vec3(0.0f);
-	if (lightsEnabled) {
-		for (int i = 0; i < MAX_LIGHTS; i++) {
-			if (light[i].valid && lightsEnabled) {
-				// Compute lighting
-				vec3 ambient, diffuse, specular;
-				computeLight(light[i], ambient, diffuse, specular);
-				
-				// Compute attenuation away from a point light or spot light
-				if (light[i].type == POINT_LIGHT || light[i].type == SPOT_LIGHT)
-					computeAttenuation(light[i], ambient, diffuse, specular);
-
-				// Compute intensity at edges of spotlight
-				if (light[i].type == SPOT_LIGHT)
-					computeIntensity(light[i], diffuse, specular);
-				
-				// Compute shadows from light source
-				float shadow = shadowCalculation(fragPosLightSpace[i], i);
-
-				result += (ambient + (1.0 - shadow) * (diffuse + specular));
+#ifdef LIGHTMAP
+	// Diffuse and bounced light of each baked light for white, in slot order
+	vec3 baked = texture(lightmap, lightmapCoords).rgb;
+	int channel = 0;
+#endif
+#if NUM_LIGHTS > 0
+	for (int i = 0; i < NUM_LIGHTS; i++) {
+#ifdef LIGHTMAP
+		// Scaled by the light's color as it is now; ambient takes the surface's ambient color, which
+		// the lightmap can't
+		if (light[i].baked && channel < LIGHTMAP_CHANNELS) {
+			if (light[i].valid) {
+				vec3 ambient = light[i].ambient * surface.ambient;
+				if (LIGHT_TYPE(i) == POINT_LIGHT || LIGHT_TYPE(i) == SPOT_LIGHT) {
+					float distance = length(light[i].position - v_fragPos);
+					ambient /= light[i].constant + light[i].linear*distance + light[i].quadratic*(distance*distance);
+				}
+				result += ambient + baked[channel] * light[i].diffuse * surface.diffuse;
 			}
+			channel++;
+			continue;
+		}
+#endif
+		if (light[i].valid) {
+			// Compute lighting
+			vec3 ambient, diffuse, specular;
+			computeLight(light[i], surface, ambient, diffuse, specular);
+
+			// Compute attenuation away from a point light or spot light
+			if (LIGHT_TYPE(i) == POINT_LIGHT || LIGHT_TYPE(i) == SPOT_LIGHT)
+				computeAttenuation(light[i], ambient, diffuse, specular);
+
+			// Compute intensity at edges of spotlight
+			if (LIGHT_TYPE(i) == SPOT_LIGHT)
+				computeIntensity(light[i], diffuse, specular);
+
+			// Compute shadows from light source
+#if SHADOW_MODE > 0
+			float shadow = shadowCalculation(fragPosLightSpace[i], i);
+#else
+			float shadow = 0.0;
+#endif
+
+			result += (ambient + (1.0 - shadow) * (diffuse + specular));
 		}
 	}
-	else {
-		result = material.emissive;
-	}
+#endif
 	color = vec4(result, 1.0);
+#endif
 }
 
-void computeLight(Light light, out vec3 ambient, out vec3 diffuse, out vec3 specular)
+#if NUM_LIGHTS > 0
+void computeLight(Light light, Surface surface, out vec3 ambient, out vec3 diffuse, out vec3 specular)
 {
-	vec3 normal     = normalize(v_fragNor);
 	vec3 lightDir   = normalize(light.position - v_fragPos);
-	vec3 viewDir    = normalize(-v_fragPos);
-	vec3 reflectDir = reflect(-lightDir, normal);
-	
+	vec3 reflectDir = reflect(-lightDir, surface.normal);
+
 	// Ambient
-	if (material.texture_diffuse_enable)
-		ambient = light.ambient * vec3(texture(material.texture_diffuse1, texCoords));
-	else
-		ambient = light.ambient;
+	ambient = light.ambient * surface.ambient;
 
 	// Diffuse
-	float diff = max(dot(normal, lightDir), 0.0);
-	if (material.texture_diffuse_enable) 
-		diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, texCoords));
-	else
-		diffuse = light.diffuse * diff * material.diffuse;
-	
-	// Specular 
-	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-	if (material.texture_specular_enable)
-		specular = light.specular * spec * vec3(texture(material.texture_specular1, texCoords));
-	else
-		specular = light.specular * spec * material.specular;
+	float diff = max(dot(surface.normal, lightDir), 0.0);
+	diffuse = light.diffuse * diff * surface.diffuse;
+
+	// Specular
+	float spec = pow(max(dot(surface.viewDir, reflectDir), 0.0), material.shininess);
+	specular = light.specular * spec * surface.specular;
 }
 
 void computeAttenuation(Light light, inout vec3 ambient, inout vec3 diffuse, inout vec3 specular)
@@ -132,25 +219,30 @@ void computeIntensity(Light light, inout vec3 diffuse, inout vec3 specular)
 	diffuse  *= intensity;
 	specular *= intensity;
 }
+#endif
 
 float shadowCalculation(vec4 ls_fragPos, int shadowMap)
-{	
+{
 	float bias = 0.000005;
-	vec2 texelSize = 1 / textureSize(shadowMaps, 0).xy;
-	
+
 	vec3 projCoords = ls_fragPos.xyz / ls_fragPos.w;
 	projCoords = projCoords * 0.5 + 0.5;
 	float currentDepth = projCoords.z;
-	
-	
+
+#if SHADOW_MODE == 1
+	return texture(shadowMaps, vec4(projCoords.xy, shadowMap, currentDepth - bias));
+#else
+	vec2 texelSize = 1.0 / vec2(textureSize(shadowMaps, 0).xy);
+
 	float shadow = 0.0;
 	for (int x = -2; x <= 2; ++x)
 	{
 		for (int y = -2; y <= 2; ++y)
 			shadow += texture(shadowMaps, vec4(projCoords.xy + vec2(x,y) * texelSize, shadowMap, currentDepth - bias));
 	}
-	
+
 	shadow /= 25.0;
-	
+
 	return shadow;
-}
\ No newline at end of file
+#endif
+}
@@ -0,0 +1,42 @@
+#version 330 core
+
+/*
+ * Permutation defines (injected by Program):
+ *   TEXTURE_DIFFUSE  - material has a diffuse map
+ *   TEXTURE_SPECULAR - material has a specular map
+ */
+
+struct Material {
+	vec3 diffuse;
+	vec3 specular;
+	float shininess;
+
+	sampler2D texture_diffuse1;
+	sampler2D texture_specular1;
+};
+
+in vec3 v_fragNor;
+in vec2 texCoords;
+
+layout(location = 0) out vec3 gNormal;    // view space normal
+layout(location = 1) out vec4 gAlbedo;    // rgb: diffuse, a: 1 if ambient is tinted by the diffuse map
+layout(location = 2) out vec4 gSpecular;  // rgb: specular, a: shininess
+
+uniform Material material;
+
+void main()
+{
+	gNormal = normalize(v_fragNor);
+
+#ifdef TEXTURE_DIFFUSE
+	gAlbedo = vec4(vec3(texture(material.texture_diffuse1, texCoords)), 1.0);
+#else
+	gAlbedo = vec4(material.diffuse, 0.0);
+#endif
+
+#ifdef TEXTURE_SPECULAR
+	gSpecular = vec4(vec3(texture(material.texture_specular1, texCoords)), material.shininess);
+#else
+	gSpecular = vec4(material.specular, material.shininess);
+#endif
+}
@@ -0,0 +1,27 @@
+#version  330 core
+layout(location = 0) in vec3 vertPos;
+layout(location = 1) in vec3 vertNor;
+layout(location = 2) in vec2 vertTex;
+
+// Normal is in the view space
+out vec3 v_fragNor;
+out vec2 texCoords;
+
+// Streamed per pass and per draw (see DrawData.h)
+layout(std140) uniform FrameData {
+	mat4 P;
+	mat4 V;
+};
+
+layout(std140) uniform DrawData {
+	mat4 M;
+	vec4 emissive;
+};
+
+void main()
+{	
+	v_fragNor = vec3(V * M * vec4(vertNor, 0.0));
+	texCoords = vertTex;
+
+	gl_Position = P * V * M * vec4(vertPos, 1.0);
+}
@@ -4,7 +4,12 @@
 
 layout (location = 0) in vec3 vertPos;
 
-uniform mat4 M;
+// Streamed per draw (see DrawData.h)
+layout(std140) uniform DrawData {
+	mat4 M;
+	vec4 emissive;
+};
+
 uniform mat4 lightSpaceMatrix;
 
 void main()
@@ -4,9 +4,16 @@ layout(location = 2) in vec2 vertTex;
 
 out vec2 texCoords;
 
-uniform mat4 P;
-uniform mat4 V;
-uniform mat4 M;
+// Streamed per pass and per draw (see DrawData.h)
+layout(std140) uniform FrameData {
+	mat4 P;
+	mat4 V;
+};
+
+layout(std140) uniform DrawData {
+	mat4 M;
+	vec4 emissive;
+};
 
 void main()
 {	
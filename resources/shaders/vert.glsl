@@ -1,21 +1,45 @@
 #version  330 core
 
-#define MAX_LIGHTS 10
+#ifndef NUM_LIGHTS
+#define NUM_LIGHTS 10
+#endif
+
+#ifndef SHADOW_MODE
+#define SHADOW_MODE 2
+#endif
 
 layout(location = 0) in vec3 vertPos;
 layout(location = 1) in vec3 vertNor;
 layout(location = 2) in vec2 vertTex;
+layout(location = 3) in vec2 vertLightmap;
+
+// Must match depth_vert.glsl bit for bit for the GL_EQUAL depth test
+invariant gl_Position;
 
 // These values are in the view space
 out vec3 v_fragPos;
 out vec3 v_fragNor;
 out vec2 texCoords;
-out vec4 fragPosLightSpace[MAX_LIGHTS];
+#ifdef LIGHTMAP
+out vec2 lightmapCoords;
+#endif
+#if NUM_LIGHTS > 0 && SHADOW_MODE > 0
+out vec4 fragPosLightSpace[NUM_LIGHTS];
+#endif
+
+// Streamed per pass and per draw (see DrawData.h)
+layout(std140) uniform FrameData {
+	mat4 P;
+	mat4 V;
+};
 
-uniform mat4 P;
-uniform mat4 V;
-uniform mat4 M;
-uniform mat4 lightSpaceMatrix[MAX_LIGHTS];
+layout(std140) uniform DrawData {
+	mat4 M;
+	vec4 emissive;
+};
+#if NUM_LIGHTS > 0 && SHADOW_MODE > 0
+uniform mat4 lightSpaceMatrix[NUM_LIGHTS];
+#endif
 
 void main()
 {	
@@ -28,10 +52,15 @@ void main()
 	v_fragNor = vec3(V * vec4(m_fragNor, 0.0));
 
 	texCoords = vertTex;
+#ifdef LIGHTMAP
+	lightmapCoords = vertLightmap;
+#endif
 
 	// Compute Fragment position in all light spaces
-	for (int i = 0; i < MAX_LIGHTS; i++)
+#if NUM_LIGHTS > 0 && SHADOW_MODE > 0
+	for (int i = 0; i < NUM_LIGHTS; i++)
 		fragPosLightSpace[i] = lightSpaceMatrix[i] * vec4(m_fragPos, 1.0);
+#endif
 	
 	gl_Position = P * V * M * vec4(vertPos, 1.0);
 }
@@ -0,0 +1,159 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "AudioAnalyzer.h"
+
+AudioAnalyzer::AudioAnalyzer() : fft(AUDIO_FFT_SIZE)
+{
+    const float pi = 3.14159265f;
+
+    for (unsigned int i = 0; i < AUDIO_FFT_SIZE; i++)
+        window[i] = 0.5f - 0.5f * cosf(2.0f * pi * i / AUDIO_FFT_SIZE);
+
+    const float edges[AUDIO_BAND_COUNT + 1] = AUDIO_BAND_EDGES;
+    for (unsigned int b = 0; b <= AUDIO_BAND_COUNT; b++) {
+        unsigned int bin = (unsigned int)(edges[b] * AUDIO_FFT_SIZE / MIXER_SAMPLE_RATE + 0.5f);
+        bandBins[b] = min(max(bin, 1u), (unsigned int)AUDIO_FFT_SIZE / 2);
+    }
+
+    for (auto &peak : bandPeaks)
+        peak = AUDIO_BAND_FLOOR;
+    for (auto &m : magnitude)
+        m = 0.0f;
+}
+
+AudioAnalyzer::~AudioAnalyzer()
+{
+    stop();
+}
+
+void AudioAnalyzer::start(Mixer &mixer)
+{
+    if (running) return;
+    this->mixer = &mixer;
+
+    mixer.enableTap(true);
+    running = true;
+    worker = thread(&AudioAnalyzer::run, this);
+}
+
+void AudioAnalyzer::stop()
+{
+    if (!running) return;
+
+    running = false;
+    worker.join();
+    mixer->enableTap(false);
+    report();
+}
+
+bool AudioAnalyzer::read(AudioFeatures &features)
+{
+    if (!snapshot.update())
+        return false;
+
+    features = snapshot.front();
+    return true;
+}
+
+void AudioAnalyzer::process(const float *samples, unsigned int count)
+{
+    while (count > 0)
+    {
+        unsigned int n = min(count, AUDIO_FFT_SIZE - filled);
+        memcpy(input + filled, samples, n * sizeof(float));
+        filled += n;
+        samples += n;
+        count -= n;
+
+        if (filled == AUDIO_FFT_SIZE) {
+            analyze();
+            memmove(input, input + AUDIO_FFT_HOP, (AUDIO_FFT_SIZE - AUDIO_FFT_HOP) * sizeof(float));
+            filled = AUDIO_FFT_SIZE - AUDIO_FFT_HOP;
+        }
+    }
+}
+
+void AudioAnalyzer::run()
+{
+    const chrono::microseconds wait(AUDIO_ANALYZER_WAIT_US);
+
+    while (running)
+    {
+        MixerTapBlock block;
+        while (mixer->popTap(block))
+            process(block.samples, block.frames);
+
+        this_thread::sleep_for(wait);
+    }
+}
+
+void AudioAnalyzer::analyze()
+{
+    auto start = chrono::steady_clock::now();
+
+    for (unsigned int i = 0; i < AUDIO_FFT_SIZE; i++)
+        spectrum[i] = complex<float>(input[i] * window[i], 0.0f);
+    fft.forward(spectrum);
+
+    // Spectral flux, the rise in log magnitude summed over every bin
+    float onset = 0.0f;
+    for (unsigned int k = 0; k < AUDIO_FFT_SIZE / 2; k++) {
+        float m = log1pf(abs(spectrum[k]));
+        onset += max(m - magnitude[k], 0.0f);
+        magnitude[k] = m;
+    }
+
+    // Band energy against its own decaying peak, so quiet and loud passages both use the full range
+    for (unsigned int b = 0; b < AUDIO_BAND_COUNT; b++) {
+        float energy = 0.0f;
+        for (unsigned int k = bandBins[b]; k < bandBins[b + 1]; k++)
+            energy += norm(spectrum[k]);
+        energy /= max(bandBins[b + 1] - bandBins[b], 1u);
+
+        bandPeaks[b] = max(max(energy, bandPeaks[b] * AUDIO_PEAK_DECAY), AUDIO_BAND_FLOOR);
+        float value = sqrtf(energy / bandPeaks[b]);
+
+        float &band = current.bands[b];
+        band = value > band ? value : band * AUDIO_BAND_RELEASE + value * (1.0f - AUDIO_BAND_RELEASE);
+    }
+
+    // Onset when the flux clearly beats its recent average
+    float average = 0.0f;
+    for (float f : flux)
+        average += f;
+    average /= AUDIO_ONSET_HISTORY;
+
+    if (onset > max(average * AUDIO_ONSET_SENSITIVITY, AUDIO_ONSET_FLOOR) &&
+        current.time - lastOnset >= AUDIO_ONSET_COOLDOWN) {
+        current.beats++;
+        lastOnset = current.time;
+    }
+    flux[fluxIndex] = onset;
+    fluxIndex = (fluxIndex + 1) % AUDIO_ONSET_HISTORY;
+
+    float power = 0.0f;
+    for (unsigned int i = AUDIO_FFT_SIZE - AUDIO_FFT_HOP; i < AUDIO_FFT_SIZE; i++)
+        power += input[i] * input[i];
+    current.level = sqrtf(power / AUDIO_FFT_HOP);
+    current.time += (double)AUDIO_FFT_HOP / MIXER_SAMPLE_RATE;
+
+    snapshot.back() = current;
+    snapshot.publish();
+
+    chrono::duration<float, micro> elapsed = chrono::steady_clock::now() - start;
+    hops++;
+    totalTime += elapsed.count();
+    maxTime = max(maxTime, elapsed.count());
+}
+
+void AudioAnalyzer::report()
+{
+    if (hops == 0) return;
+
+    cout << "[AudioAnalyzer] " << hops << " hops analyzed, mean " << totalTime / hops
+         << " us, max " << maxTime << " us, " << current.beats << " onsets" << endl;
+}
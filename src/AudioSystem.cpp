@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include "AudioSystem.h"
 
@@ -16,32 +17,93 @@ int16_t floatToInt16(float val)
     return newVal; 
 }
 
-AudioSystem::AudioSystem()
+// Opens the device here rather than on construction, so headless tools never touch audio
+bool AudioSystem::init(bool loopback)
 {
     // Attempt to open default audio device
-    openALDevice = alcOpenDevice(nullptr);
-
-    if (!openALDevice) {
-        cerr << "Failed to open default audio device" << endl;
-        exit(2);
+    if (!loopback) {
+        openALDevice = alcOpenDevice(nullptr);
+        if (!openALDevice)
+            cerr << "Failed to open default audio device, continuing without sound" << endl;
     }
 
-    // Create a context
-    openALContext = alcCreateContext(openALDevice, nullptr);
+    if (!openALDevice && !openLoopback())
+        return false;
+
+    // Create a context, a loopback device has to be told the format it renders
+    ALCint attributes[] = {
+        ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+        ALC_FORMAT_TYPE_SOFT, ALC_FLOAT_SOFT,
+        ALC_FREQUENCY, MIXER_SAMPLE_RATE,
+        0
+    };
+    openALContext = alcCreateContext(openALDevice, isLoopback() ? attributes : nullptr);
     if (!openALContext) {
         cerr << "Failed to create audio context" << endl;
-        exit(2);
+        return false;
     }
 
     // Make the newly created context current
     if (!alcMakeContextCurrent(openALContext)) {
         cerr << "Failed to make audio context current" << endl;
-        exit(2);
+        return false;
+    }
+
+    // Falls back to the OpenAL voice pool if the stream can't be created. A loopback device
+    // refills the stream as it renders, instead of a thread racing it
+    mixer.start(!isLoopback());
+    return true;
+}
+
+bool AudioSystem::openLoopback()
+{
+    if (!alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback")) {
+        cerr << "No loopback device, ALC_SOFT_loopback is missing" << endl;
+        return false;
+    }
+
+    auto openDevice = (LPALCLOOPBACKOPENDEVICESOFT)alcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT");
+    auto isSupported = (LPALCISRENDERFORMATSUPPORTEDSOFT)alcGetProcAddress(nullptr, "alcIsRenderFormatSupportedSOFT");
+    auto render = (LPALCRENDERSAMPLESSOFT)alcGetProcAddress(nullptr, "alcRenderSamplesSOFT");
+
+    openALDevice = openDevice(nullptr);
+    if (!openALDevice) {
+        cerr << "Failed to open loopback audio device" << endl;
+        return false;
+    }
+    if (!isSupported(openALDevice, MIXER_SAMPLE_RATE, ALC_STEREO_SOFT, ALC_FLOAT_SOFT)) {
+        cerr << "Loopback audio device can't render stereo float at " << MIXER_SAMPLE_RATE << " Hz" << endl;
+        alcCloseDevice(openALDevice);
+        openALDevice = nullptr;
+        return false;
+    }
+
+    renderSamples = render;
+    return true;
+}
+
+void AudioSystem::renderLoopback(float *out, unsigned int frames)
+{
+    // A block at a time, so the mixer's stream is topped up before the device reaches its end
+    for (unsigned int done = 0; done < frames; done += MIXER_BLOCK_FRAMES) {
+        unsigned int count = min(frames - done, (unsigned int)MIXER_BLOCK_FRAMES);
+        if (mixer.isRunning())
+            mixer.service();
+        renderDevice(out + 2 * done, count);
     }
 }
 
+void AudioSystem::renderDevice(float *out, unsigned int frames)
+{
+    renderSamples(openALDevice, out, frames);
+}
+
 AudioSystem::~AudioSystem()
 {
+    if (!openALDevice) return;
+
+    mixer.stop();
+
     // Delete sources and buffers
     alDeleteSources(audioSources.size(), audioSources.data());
     alDeleteBuffers(audioBuffers.size(), audioBuffers.data());
@@ -55,7 +117,7 @@ AudioSystem::~AudioSystem()
     alcCloseDevice(openALDevice);
 }
 
-ALuint AudioSystem::loadFile(string path)
+bool AudioSystem::decodeFile(string path, vector<float> &frames, unsigned int &channels, unsigned int &sampleRate)
 {
     // Load audio file
     cout << "\nLoading Audio File: " + path << endl;
@@ -63,49 +125,95 @@ ALuint AudioSystem::loadFile(string path)
 
     if (audioFile.load(path)) 
         cout << "Sucessfully loaded audio" << endl;
-    else
+    else {
         cerr << "Failed to load audio: " + path << endl;
+        return false;
+    }
 
     // audioFile.printSummary();
 
-    // Set audio format
-    ALenum format;
-    int channels = audioFile.getNumChannels();
-    int bitDepth = audioFile.getBitDepth();
-    if (channels == 1 && bitDepth == 16)
-        format = AL_FORMAT_MONO16;
-    else if (channels == 2 && bitDepth == 16)
-        format = AL_FORMAT_STEREO16;
-    else {
+    channels = audioFile.getNumChannels();
+    sampleRate = audioFile.getSampleRate();
+    if (channels < 1 || channels > 2) {
         cerr << "Unsupported format" << endl;
-        return 0;
+        return false;
     }
 
+    // Interleave data if necessary
+    int length = audioFile.getNumSamplesPerChannel();
+    frames.resize(length * channels);
+    for (int i = 0; i < length; i++)
+        for (unsigned int c = 0; c < channels; c++)
+            frames[i * channels + c] = audioFile.samples[c][i];
+
+    return true;
+}
+
+ALuint AudioSystem::loadFile(string path)
+{
+    vector<float> frames;
+    unsigned int channels, sampleRate;
+    if (!decodeFile(path, frames, channels, sampleRate))
+        return 0;
+
+    return createBuffer(frames, channels, sampleRate);
+}
+
+ALuint AudioSystem::createBuffer(const vector<float> &frames, unsigned int channels, unsigned int sampleRate)
+{
+    // Set audio format
+    ALenum format = channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+
     // Generate and setup audio buffer
     ALuint buffer;
     alGenBuffers(1, &buffer);
-    vector<int16_t> audioData;
-
-    // Interleave data if necessary
-    if (channels = 2) {
-        for (int i = 0; i < audioFile.getNumSamplesPerChannel(); i++) {
-            audioData.push_back(floatToInt16(audioFile.samples[0][i]));
-            audioData.push_back(floatToInt16(audioFile.samples[1][i]));
-        }
-    }
-    else {
-        for (int i = 0; i < audioFile.getNumSamplesPerChannel(); i++) 
-            audioData.push_back(floatToInt16(audioFile.samples[0][i]));
-    }
+    vector<int16_t> audioData(frames.size());
+    for (size_t i = 0; i < frames.size(); i++)
+        audioData[i] = floatToInt16(frames[i]);
 
     alBufferData(buffer, format, (ALvoid*) audioData.data(), 
-        audioData.size()*sizeof(int16_t), audioFile.getSampleRate());
+        audioData.size()*sizeof(int16_t), sampleRate);
 
-    
     audioBuffers.push_back(buffer);
+
+    // The mixer keeps its own float copy
+    if (mixer.isRunning())
+        mixerSamples[buffer] = mixer.addSample(frames, channels, sampleRate);
+
     return buffer;
 }
 
+float AudioSystem::getDuration(ALuint buffer)
+{
+    ALint size, channels, bits, frequency;
+    alGetBufferi(buffer, AL_SIZE, &size);
+    alGetBufferi(buffer, AL_CHANNELS, &channels);
+    alGetBufferi(buffer, AL_BITS, &bits);
+    alGetBufferi(buffer, AL_FREQUENCY, &frequency);
+    if (channels <= 0 || bits <= 0 || frequency <= 0)
+        return 0.0f;
+
+    return (float)size / (channels * (bits / 8)) / frequency;
+}
+
+void AudioSystem::advanceLoopback(double seconds)
+{
+    // At most a quarter second at once, a long stall isn't made up in one go
+    loopbackDue = min(loopbackDue + seconds * MIXER_SAMPLE_RATE, MIXER_SAMPLE_RATE / 4.0);
+    unsigned int frames = (unsigned int)loopbackDue;
+    loopbackDue -= frames;
+
+    loopbackScratch.resize(MIXER_BLOCK_FRAMES * 2);
+    for (unsigned int done = 0; done < frames; done += MIXER_BLOCK_FRAMES)
+        renderLoopback(loopbackScratch.data(), min(frames - done, (unsigned int)MIXER_BLOCK_FRAMES));
+}
+
+int AudioSystem::getMixerSample(ALuint buffer) const
+{
+    auto sample = mixerSamples.find(buffer);
+    return sample != mixerSamples.end() ? (int)sample->second : -1;
+}
+
 ALuint AudioSystem::createSource(float x, float y, float z)
 {
     ALuint source;
@@ -129,4 +237,88 @@ void AudioSystem::bind(ALuint source, ALuint buffer)
 void AudioSystem::play(ALuint source)
 {
     alSourcePlay(source);
-}
\ No newline at end of file
+}
+
+void AudioSystem::initVoices(unsigned int count)
+{
+    // On the listener wherever it goes, positioned sounds are emitters
+    for (unsigned int i = 0; i < count; i++) {
+        voices.push_back({createSource(0.0f, 0.0f, 0.0f), 0, 0});
+        alSourcei(voices.back().source, AL_SOURCE_RELATIVE, AL_TRUE);
+    }
+}
+
+bool AudioSystem::playVoice(ALuint buffer, int priority, float gain)
+{
+    if (mixer.isRunning()) {
+        auto sample = mixerSamples.find(buffer);
+        return sample != mixerSamples.end() && mixer.play(sample->second, gain, 0.0f, 1.0f, priority);
+    }
+
+    if (voices.empty()) return false;
+
+    // Any voice that has finished, otherwise the least important and oldest
+    int chosen = -1;
+    int victim = 0;
+    for (unsigned int i = 0; i < voices.size(); i++) {
+        ALint state;
+        alGetSourcei(voices[i].source, AL_SOURCE_STATE, &state);
+        if (state != AL_PLAYING) {
+            chosen = i;
+            break;
+        }
+
+        const Voice &v = voices[i];
+        const Voice &best = voices[victim];
+        if (v.priority < best.priority || (v.priority == best.priority && v.started < best.started))
+            victim = i;
+    }
+
+    if (chosen < 0) {
+        if (voices[victim].priority > priority) {
+            voicesDropped++;
+            return false;
+        }
+        alSourceStop(voices[victim].source);
+        voicesStolen++;
+        chosen = victim;
+    }
+
+    Voice &voice = voices[chosen];
+    voice.priority = priority;
+    voice.started = ++voiceClock;
+    alSourcei(voice.source, AL_BUFFER, buffer);
+    alSourcef(voice.source, AL_GAIN, gain);
+    alSourcePlay(voice.source);
+    return true;
+}
+
+unsigned int AudioSystem::getActiveVoices() const
+{
+    if (mixer.isRunning())
+        return mixer.getActiveVoices();
+
+    unsigned int active = 0;
+    for (auto &voice : voices) {
+        ALint state;
+        alGetSourcei(voice.source, AL_SOURCE_STATE, &state);
+        if (state == AL_PLAYING)
+            active++;
+    }
+    return active;
+}
+
+unsigned int AudioSystem::getVoiceCount() const
+{
+    return mixer.isRunning() ? MIXER_MAX_VOICES : voices.size();
+}
+
+unsigned int AudioSystem::getVoicesStolen() const
+{
+    return voicesStolen + mixer.voicesStolen;
+}
+
+unsigned int AudioSystem::getVoicesDropped() const
+{
+    return voicesDropped + mixer.voicesDropped;
+}
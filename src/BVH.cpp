@@ -0,0 +1,405 @@
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BVH_SSE
+#endif
+
+#include "BVH.h"
+
+/*
+ * Binned SAH builder, shared by both levels
+ */
+struct BVHBuild {
+    const vector<BoundingBox> &boxes;
+    vector<glm::vec3> centroids;
+    vector<unsigned int> &order;
+    vector<BVHNode> &nodes;
+    atomic<unsigned int> nodesUsed;
+    atomic<int> spareThreads;
+
+    BVHBuild(const vector<BoundingBox> &boxes, vector<unsigned int> &order, vector<BVHNode> &nodes) :
+        boxes(boxes), order(order), nodes(nodes), nodesUsed(0), spareThreads(0) {}
+};
+
+static float surfaceArea(const BoundingBox &bb)
+{
+    if (Bounds::isEmpty(bb)) return 0.0f;
+    glm::vec3 d = bb.max - bb.min;
+    return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static void subdivide(BVHBuild &build, unsigned int index, unsigned int first, unsigned int count,
+    unsigned int depth)
+{
+    BoundingBox bounds = Bounds::empty();
+    BoundingBox centroidBounds = Bounds::empty();
+    for (unsigned int i = first; i < first + count; i++) {
+        bounds = Bounds::merge(bounds, build.boxes[build.order[i]]);
+        glm::vec3 c = build.centroids[build.order[i]];
+        centroidBounds = Bounds::merge(centroidBounds, {c, c});
+    }
+
+    BVHNode &node = build.nodes[index];
+    node.min = bounds.min;
+    node.max = bounds.max;
+    node.leftFirst = first;
+    node.count = count;
+    if (count <= 1 || depth + 1 >= BVH_MAX_DEPTH)
+        return;
+
+    // Cheapest bin boundary over all three axes
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = INFINITY;
+    glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    for (int axis = 0; axis < 3; axis++) {
+        if (extent[axis] <= 0.0f) continue;
+
+        BoundingBox binBounds[BVH_BINS];
+        unsigned int binCounts[BVH_BINS] = {0};
+        for (int b = 0; b < BVH_BINS; b++)
+            binBounds[b] = Bounds::empty();
+
+        float scale = BVH_BINS / extent[axis];
+        for (unsigned int i = first; i < first + count; i++) {
+            unsigned int prim = build.order[i];
+            int b = (std::min)(BVH_BINS - 1, (int)((build.centroids[prim][axis] - centroidBounds.min[axis]) * scale));
+            binCounts[b]++;
+            binBounds[b] = Bounds::merge(binBounds[b], build.boxes[prim]);
+        }
+
+        // Left sides swept forward, right sides backward
+        float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+        unsigned int leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+        BoundingBox left = Bounds::empty(), right = Bounds::empty();
+        unsigned int leftSum = 0, rightSum = 0;
+        for (int b = 0; b < BVH_BINS - 1; b++) {
+            leftSum += binCounts[b];
+            left = Bounds::merge(left, binBounds[b]);
+            leftCount[b] = leftSum;
+            leftArea[b] = surfaceArea(left);
+
+            rightSum += binCounts[BVH_BINS - 1 - b];
+            right = Bounds::merge(right, binBounds[BVH_BINS - 1 - b]);
+            rightCount[BVH_BINS - 2 - b] = rightSum;
+            rightArea[BVH_BINS - 2 - b] = surfaceArea(right);
+        }
+
+        for (int b = 0; b < BVH_BINS - 1; b++) {
+            float cost = leftArea[b] * leftCount[b] + rightArea[b] * rightCount[b];
+            if (leftCount[b] > 0 && rightCount[b] > 0 && cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b + 1;
+            }
+        }
+    }
+
+    // Keep the leaf when splitting costs more than testing every triangle
+    float area = surfaceArea(bounds);
+    float splitCost = BVH_TRAVERSAL_COST + (area > 0.0f ? bestCost / area : 0.0f);
+    if (count <= BVH_MAX_LEAF_SIZE && (bestAxis < 0 || splitCost >= (float)count))
+        return;
+
+    unsigned int *begin = build.order.data() + first;
+    unsigned int *end = begin + count;
+    unsigned int *middle;
+    if (bestAxis >= 0) {
+        float scale = BVH_BINS / extent[bestAxis];
+        float origin = centroidBounds.min[bestAxis];
+        middle = partition(begin, end, [&](unsigned int prim) {
+            int b = (std::min)(BVH_BINS - 1, (int)((build.centroids[prim][bestAxis] - origin) * scale));
+            return b < bestSplit;
+        });
+    }
+    else {
+        // Every centroid coincides, any halving is as good as another
+        middle = begin + count / 2;
+    }
+
+    unsigned int leftCount = (unsigned int)(middle - begin);
+    unsigned int left = build.nodesUsed.fetch_add(2);
+    node.leftFirst = left;
+    node.count = 0;
+
+    if (count > BVH_PARALLEL_THRESHOLD && build.spareThreads.fetch_sub(1) > 0) {
+        thread worker(subdivide, ref(build), left, first, leftCount, depth + 1);
+        subdivide(build, left + 1, first + leftCount, count - leftCount, depth + 1);
+        worker.join();
+        build.spareThreads++;
+    }
+    else {
+        if (count > BVH_PARALLEL_THRESHOLD)
+            build.spareThreads++;
+        subdivide(build, left, first, leftCount, depth + 1);
+        subdivide(build, left + 1, first + leftCount, count - leftCount, depth + 1);
+    }
+}
+
+static void buildNodes(const vector<BoundingBox> &boxes, vector<BVHNode> &nodes, vector<unsigned int> &order,
+    unsigned int threads)
+{
+    order.resize(boxes.size());
+    nodes.clear();
+    if (boxes.empty())
+        return;
+
+    // A binary tree with one primitive per leaf is the most nodes a build can use
+    nodes.resize(2 * boxes.size());
+
+    BVHBuild build(boxes, order, nodes);
+    build.centroids.resize(boxes.size());
+    for (unsigned int i = 0; i < boxes.size(); i++) {
+        build.centroids[i] = 0.5f * (boxes[i].min + boxes[i].max);
+        order[i] = i;
+    }
+
+    if (threads == 0) threads = thread::hardware_concurrency();
+    build.spareThreads = (int)(std::max)(threads, 1u) - 1;
+
+    // Node 1 stays unused so every pair of children starts on an even index
+    build.nodesUsed = 2;
+    subdivide(build, 0, 0, (unsigned int)boxes.size(), 0);
+    nodes.resize(build.nodesUsed);
+    nodes.shrink_to_fit();
+}
+
+/*
+ * Traversal
+ */
+struct BVHRay {
+    glm::vec3 origin;
+    glm::vec3 dir;
+    glm::vec3 invDir;
+#ifdef BVH_SSE
+    __m128 o4, invDir4;
+#endif
+
+    BVHRay(const glm::vec3 &origin, const glm::vec3 &dir) : origin(origin), dir(dir)
+    {
+        invDir = glm::vec3(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+#ifdef BVH_SSE
+        o4 = _mm_setr_ps(origin.x, origin.y, origin.z, 0.0f);
+        invDir4 = _mm_setr_ps(invDir.x, invDir.y, invDir.z, 0.0f);
+#endif
+    }
+};
+
+// Entry distance into the node's box, INFINITY on a miss
+static inline float hitBox(const BVHNode &node, const BVHRay &ray, float maxT)
+{
+#ifdef BVH_SSE
+    // The fourth lane holds leftFirst/count bits, masked out before the reductions
+    const __m128 lanes = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.min.x), ray.o4), ray.invDir4);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&node.max.x), ray.o4), ray.invDir4);
+    __m128 tmin = _mm_min_ps(t0, t1);
+    __m128 tmax = _mm_max_ps(t0, t1);
+    tmin = _mm_or_ps(_mm_and_ps(lanes, tmin), _mm_andnot_ps(lanes, _mm_set1_ps(-INFINITY)));
+    tmax = _mm_or_ps(_mm_and_ps(lanes, tmax), _mm_andnot_ps(lanes, _mm_set1_ps(INFINITY)));
+
+    tmin = _mm_max_ps(tmin, _mm_shuffle_ps(tmin, tmin, _MM_SHUFFLE(2, 3, 0, 1)));
+    tmin = _mm_max_ps(tmin, _mm_shuffle_ps(tmin, tmin, _MM_SHUFFLE(1, 0, 3, 2)));
+    tmax = _mm_min_ps(tmax, _mm_shuffle_ps(tmax, tmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    tmax = _mm_min_ps(tmax, _mm_shuffle_ps(tmax, tmax, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    float tNear = (std::max)(_mm_cvtss_f32(tmin), 0.0f);
+    float tFar = (std::min)(_mm_cvtss_f32(tmax), maxT);
+#else
+    float tNear = 0.0f, tFar = maxT;
+    for (int axis = 0; axis < 3; axis++) {
+        float t0 = (node.min[axis] - ray.origin[axis]) * ray.invDir[axis];
+        float t1 = (node.max[axis] - ray.origin[axis]) * ray.invDir[axis];
+        if (t0 > t1) std::swap(t0, t1);
+        tNear = (std::max)(tNear, t0);
+        tFar = (std::min)(tFar, t1);
+    }
+#endif
+    return tNear <= tFar ? tNear : INFINITY;
+}
+
+// Visits leaves front to back, the callback tests a leaf's primitives and may shorten maxT
+template <typename LeafTest>
+static bool traverse(const vector<BVHNode> &nodes, const BVHRay &ray, float &maxT, bool anyHit, LeafTest test)
+{
+    if (nodes.empty() || hitBox(nodes[0], ray, maxT) == INFINITY)
+        return false;
+
+    bool found = false;
+    // One far child per level at most, build() keeps the tree within BVH_MAX_DEPTH
+    unsigned int stack[BVH_MAX_DEPTH];
+    int top = 0;
+    unsigned int index = 0;
+
+    while (true)
+    {
+        const BVHNode &node = nodes[index];
+        if (node.count > 0) {
+            if (test(node.leftFirst, node.count)) {
+                found = true;
+                if (anyHit) return true;
+            }
+        }
+        else {
+            unsigned int near = node.leftFirst, far = node.leftFirst + 1;
+            float tNear = hitBox(nodes[near], ray, maxT);
+            float tFar = hitBox(nodes[far], ray, maxT);
+            if (tFar < tNear) {
+                std::swap(near, far);
+                std::swap(tNear, tFar);
+            }
+
+            if (tNear != INFINITY) {
+                if (tFar != INFINITY)
+                    stack[top++] = far;
+                index = near;
+                continue;
+            }
+        }
+
+        if (top == 0)
+            break;
+        index = stack[--top];
+    }
+
+    return found;
+}
+
+/*
+ * Bottom level
+ */
+void TriangleBVH::build(const Model &model, unsigned int threads)
+{
+    vector<Triangle> unsorted;
+    vector<unsigned int> meshes, indices;
+    vector<BoundingBox> boxes;
+
+    for (unsigned int m = 0; m < model.meshes.size(); m++) {
+        const Mesh &mesh = model.meshes[m];
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3) {
+            glm::vec3 p0 = mesh.vertices[mesh.indices[i]].Position;
+            glm::vec3 p1 = mesh.vertices[mesh.indices[i + 1]].Position;
+            glm::vec3 p2 = mesh.vertices[mesh.indices[i + 2]].Position;
+
+            unsorted.push_back({p0, p1 - p0, p2 - p0});
+            meshes.push_back(m);
+            indices.push_back(i / 3);
+            boxes.push_back({(glm::min)((glm::min)(p0, p1), p2), (glm::max)((glm::max)(p0, p1), p2)});
+        }
+    }
+
+    vector<unsigned int> order;
+    buildNodes(boxes, nodes, order, threads);
+
+    // Store the triangles in leaf order so leaves read them sequentially
+    triangles.resize(order.size());
+    meshOf.resize(order.size());
+    indexOf.resize(order.size());
+    for (unsigned int i = 0; i < order.size(); i++) {
+        triangles[i] = unsorted[order[i]];
+        meshOf[i] = meshes[order[i]];
+        indexOf[i] = indices[order[i]];
+    }
+
+    bounds = nodes.empty() ? Bounds::empty() : BoundingBox{nodes[0].min, nodes[0].max};
+}
+
+bool TriangleBVH::trace(const glm::vec3 &origin, const glm::vec3 &dir, float maxT, TraceHit &hit,
+    bool anyHit) const
+{
+    BVHRay ray(origin, dir);
+    float closest = maxT;
+
+    bool found = traverse(nodes, ray, closest, anyHit, [&](unsigned int first, unsigned int count) {
+        bool leafHit = false;
+
+        // Moller-Trumbore against each triangle of the leaf
+        for (unsigned int i = first; i < first + count; i++) {
+            const Triangle &t = triangles[i];
+
+            glm::vec3 pvec = glm::cross(dir, t.e2);
+            float det = glm::dot(t.e1, pvec);
+            if (fabs(det) < 1e-12f) continue;
+
+            float invDet = 1.0f / det;
+            glm::vec3 tvec = origin - t.p0;
+            float u = glm::dot(tvec, pvec) * invDet;
+            if (u < 0.0f || u > 1.0f) continue;
+
+            glm::vec3 qvec = glm::cross(tvec, t.e1);
+            float v = glm::dot(dir, qvec) * invDet;
+            if (v < 0.0f || u + v > 1.0f) continue;
+
+            float d = glm::dot(t.e2, qvec) * invDet;
+            if (d <= 0.0f || d >= closest) continue;
+
+            closest = d;
+            hit.t = d;
+            hit.instance = 0;
+            hit.mesh = meshOf[i];
+            hit.triangle = indexOf[i];
+            hit.u = u;
+            hit.v = v;
+            leafHit = true;
+            if (anyHit) break;
+        }
+        return leafHit;
+    });
+
+    return found;
+}
+
+/*
+ * Top level
+ */
+unsigned int SceneBVH::add(const TriangleBVH *blas, const glm::mat4 &M)
+{
+    instances.push_back({blas, M, glm::inverse(M)});
+    return (unsigned int)instances.size() - 1;
+}
+
+void SceneBVH::setTransform(unsigned int instance, const glm::mat4 &M)
+{
+    instances[instance].M = M;
+    instances[instance].invM = glm::inverse(M);
+}
+
+void SceneBVH::build()
+{
+    vector<BoundingBox> boxes;
+    for (auto &instance : instances)
+        boxes.push_back(Bounds::transform(instance.M, instance.blas->getBounds()));
+    buildNodes(boxes, nodes, order, 1);
+}
+
+bool SceneBVH::trace(const glm::vec3 &origin, const glm::vec3 &dir, float maxT, TraceHit &hit,
+    bool anyHit) const
+{
+    BVHRay ray(origin, dir);
+    float closest = maxT;
+
+    return traverse(nodes, ray, closest, anyHit, [&](unsigned int first, unsigned int count) {
+        bool leafHit = false;
+        for (unsigned int i = first; i < first + count; i++) {
+            const Instance &instance = instances[order[i]];
+
+            // An unnormalized local direction keeps t the same in both spaces
+            glm::vec3 localOrigin = glm::vec3(instance.invM * glm::vec4(origin, 1.0f));
+            glm::vec3 localDir = glm::vec3(instance.invM * glm::vec4(dir, 0.0f));
+
+            TraceHit local;
+            if (instance.blas->trace(localOrigin, localDir, closest, local, anyHit)) {
+                closest = local.t;
+                hit = local;
+                hit.instance = order[i];
+                leafHit = true;
+                if (anyHit) break;
+            }
+        }
+        return leafHit;
+    });
+}
@@ -0,0 +1,148 @@
+#include <algorithm>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BOUNDS_SSE
+#endif
+
+#include "BoundingVolume.h"
+
+namespace Bounds
+{
+#ifdef BOUNDS_SSE
+    // Matrix columns, plus the absolute upper 3x3 for the extents
+    struct Columns {
+        __m128 c[4];
+        __m128 a[3];
+    };
+
+    static inline Columns load(const glm::mat4 &M)
+    {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        Columns cols;
+        for (int i = 0; i < 4; i++)
+            cols.c[i] = _mm_loadu_ps(&M[i][0]);
+        for (int i = 0; i < 3; i++)
+            cols.a[i] = _mm_andnot_ps(signMask, cols.c[i]);
+        return cols;
+    }
+
+    static inline void transformBox(const Columns &cols, const BoundingBox &local, BoundingBox &world)
+    {
+        const __m128 half = _mm_set1_ps(0.5f);
+        __m128 lo = _mm_setr_ps(local.min.x, local.min.y, local.min.z, 0.0f);
+        __m128 hi = _mm_setr_ps(local.max.x, local.max.y, local.max.z, 0.0f);
+        __m128 center  = _mm_mul_ps(_mm_add_ps(lo, hi), half);
+        __m128 extents = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+
+        __m128 c = cols.c[3];
+        c = _mm_add_ps(c, _mm_mul_ps(cols.c[0], _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0))));
+        c = _mm_add_ps(c, _mm_mul_ps(cols.c[1], _mm_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1))));
+        c = _mm_add_ps(c, _mm_mul_ps(cols.c[2], _mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2))));
+
+        __m128 e = _mm_mul_ps(cols.a[0], _mm_shuffle_ps(extents, extents, _MM_SHUFFLE(0, 0, 0, 0)));
+        e = _mm_add_ps(e, _mm_mul_ps(cols.a[1], _mm_shuffle_ps(extents, extents, _MM_SHUFFLE(1, 1, 1, 1))));
+        e = _mm_add_ps(e, _mm_mul_ps(cols.a[2], _mm_shuffle_ps(extents, extents, _MM_SHUFFLE(2, 2, 2, 2))));
+
+        float out[2][4];
+        _mm_storeu_ps(out[0], _mm_sub_ps(c, e));
+        _mm_storeu_ps(out[1], _mm_add_ps(c, e));
+        world.min = glm::vec3(out[0][0], out[0][1], out[0][2]);
+        world.max = glm::vec3(out[1][0], out[1][1], out[1][2]);
+    }
+#endif
+
+    BoundingBox merge(const BoundingBox &a, const BoundingBox &b)
+    {
+        return { (glm::min)(a.min, b.min), (glm::max)(a.max, b.max) };
+    }
+
+    bool overlaps(const BoundingBox &a, const BoundingBox &b)
+    {
+        return a.min.x <= b.max.x && b.min.x <= a.max.x &&
+               a.min.y <= b.max.y && b.min.y <= a.max.y &&
+               a.min.z <= b.max.z && b.min.z <= a.max.z;
+    }
+
+    BoundingBox transform(const glm::mat4 &M, const BoundingBox &local)
+    {
+        if (isEmpty(local))
+            return local;
+
+        glm::vec3 center = 0.5f * (local.min + local.max);
+        glm::vec3 extents = 0.5f * (local.max - local.min);
+
+        glm::vec3 worldCenter = glm::vec3(M * glm::vec4(center, 1.0f));
+        glm::vec3 worldExtents;
+        for (int i = 0; i < 3; i++)
+            worldExtents[i] = fabsf(M[0][i]) * extents.x + fabsf(M[1][i]) * extents.y + fabsf(M[2][i]) * extents.z;
+
+        return { worldCenter - worldExtents, worldCenter + worldExtents };
+    }
+
+    BoundingSphere transform(const glm::mat4 &M, const BoundingSphere &local)
+    {
+        // The largest axis scale bounds any non-uniform stretch
+        float scale = (std::max)((std::max)(glm::length(glm::vec3(M[0])), glm::length(glm::vec3(M[1]))),
+                                 glm::length(glm::vec3(M[2])));
+        return { glm::vec3(M * glm::vec4(local.center, 1.0f)), local.radius * scale };
+    }
+
+    OrientedBox orient(const glm::mat4 &M, const BoundingBox &local)
+    {
+        OrientedBox obb;
+        glm::vec3 extents = 0.5f * (local.max - local.min);
+        obb.center = glm::vec3(M * glm::vec4(0.5f * (local.min + local.max), 1.0f));
+        for (int i = 0; i < 3; i++) {
+            glm::vec3 axis = glm::vec3(M[i]);
+            float length = glm::length(axis);
+            obb.axes[i] = length > 0.0f ? axis / length : axis;
+            obb.halfExtents[i] = extents[i] * length;
+        }
+        return obb;
+    }
+
+    void transform(const glm::mat4 &M, const BoundingBox *local, BoundingBox *world, size_t count)
+    {
+#ifdef BOUNDS_SSE
+        Columns cols = load(M);
+        for (size_t i = 0; i < count; i++) {
+            if (isEmpty(local[i]))
+                world[i] = local[i];
+            else
+                transformBox(cols, local[i], world[i]);
+        }
+#else
+        for (size_t i = 0; i < count; i++)
+            world[i] = transform(M, local[i]);
+#endif
+    }
+
+    void transform(const glm::mat4 *M, const BoundingBox &local, BoundingBox *world, size_t count)
+    {
+#ifdef BOUNDS_SSE
+        if (isEmpty(local)) {
+            std::fill(world, world + count, local);
+            return;
+        }
+        for (size_t i = 0; i < count; i++)
+            transformBox(load(M[i]), local, world[i]);
+#else
+        for (size_t i = 0; i < count; i++)
+            world[i] = transform(M[i], local);
+#endif
+    }
+
+    BoundingSphere sphereOf(const BoundingBox &bb)
+    {
+        return { 0.5f * (bb.min + bb.max), 0.5f * glm::length(bb.max - bb.min) };
+    }
+
+    BoundingBox boxOf(const OrientedBox &obb)
+    {
+        glm::vec3 extents = glm::vec3(0.0f);
+        for (int i = 0; i < 3; i++)
+            extents += glm::abs(obb.axes[i]) * obb.halfExtents[i];
+        return { obb.center - extents, obb.center + extents };
+    }
+}
@@ -0,0 +1,298 @@
+#include <algorithm>
+#include <cmath>
+
+#include "CollisionWorld.h"
+
+// Entry distance of a ray into a box along [0, maxT], false if it misses or starts inside
+static bool enterBox(const glm::vec3 &origin, const glm::vec3 &dir, const BoundingBox &bb, float maxT,
+    float &t, glm::vec3 &normal)
+{
+    float tEnter = -INFINITY;
+    float tExit = INFINITY;
+    int enterAxis = 0;
+
+    for (int i = 0; i < 3; i++) {
+        if (fabsf(dir[i]) < 1e-8f) {
+            // Parallel, grazing a face doesn't count as a hit
+            if (origin[i] <= bb.min[i] || origin[i] >= bb.max[i])
+                return false;
+            continue;
+        }
+
+        float t1 = (bb.min[i] - origin[i]) / dir[i];
+        float t2 = (bb.max[i] - origin[i]) / dir[i];
+        if (t1 > t2) std::swap(t1, t2);
+
+        if (t1 > tEnter) {
+            tEnter = t1;
+            enterAxis = i;
+        }
+        tExit = (std::min)(tExit, t2);
+    }
+
+    if (tEnter > tExit || tEnter < 0.0f || tEnter > maxT)
+        return false;
+
+    t = tEnter;
+    normal = glm::vec3(0.0f);
+    normal[enterAxis] = dir[enterAxis] > 0.0f ? -1.0f : 1.0f;
+    return true;
+}
+
+glm::ivec3 CollisionWorld::cellOf(const glm::vec3 &p) const
+{
+    return glm::ivec3((int)floorf(p.x / cellSize), (int)floorf(p.y / cellSize), (int)floorf(p.z / cellSize));
+}
+
+uint64_t CollisionWorld::key(int x, int y, int z)
+{
+    const uint64_t mask = (1 << 21) - 1;
+    return (((uint64_t)x & mask) << 42) | (((uint64_t)y & mask) << 21) | ((uint64_t)z & mask);
+}
+
+ColliderId CollisionWorld::add(const BoundingBox &bb, bool dynamic, unsigned int tag)
+{
+    ColliderId id;
+    if (!freeIds.empty()) {
+        id = freeIds.back();
+        freeIds.pop_back();
+    }
+    else {
+        id = (ColliderId)colliders.size();
+        colliders.push_back(Collider());
+        stamps.push_back(0);
+    }
+
+    Collider &collider = colliders[id];
+    collider.box = bb;
+    collider.tag = tag;
+    collider.dynamic = dynamic;
+    collider.alive = true;
+    worldBounds = Bounds::merge(worldBounds, bb);
+
+    insert(id);
+    return id;
+}
+
+void CollisionWorld::update(ColliderId id, const BoundingBox &bb)
+{
+    Collider &collider = colliders[id];
+    collider.box = bb;
+    worldBounds = Bounds::merge(worldBounds, bb);
+
+    // Most moves stay within the same cells
+    if (cellOf(bb.min) == collider.cellMin && cellOf(bb.max) == collider.cellMax)
+        return;
+
+    erase(id);
+    insert(id);
+}
+
+void CollisionWorld::remove(ColliderId id)
+{
+    erase(id);
+    colliders[id].alive = false;
+    freeIds.push_back(id);
+}
+
+void CollisionWorld::insert(ColliderId id)
+{
+    Collider &collider = colliders[id];
+    collider.cellMin = cellOf(collider.box.min);
+    collider.cellMax = cellOf(collider.box.max);
+
+    for (int x = collider.cellMin.x; x <= collider.cellMax.x; x++)
+        for (int y = collider.cellMin.y; y <= collider.cellMax.y; y++)
+            for (int z = collider.cellMin.z; z <= collider.cellMax.z; z++)
+                cells[key(x, y, z)].push_back(id);
+}
+
+void CollisionWorld::erase(ColliderId id)
+{
+    const Collider &collider = colliders[id];
+    for (int x = collider.cellMin.x; x <= collider.cellMax.x; x++)
+        for (int y = collider.cellMin.y; y <= collider.cellMax.y; y++)
+            for (int z = collider.cellMin.z; z <= collider.cellMax.z; z++) {
+                auto cell = cells.find(key(x, y, z));
+                if (cell == cells.end())
+                    continue;
+
+                vector<ColliderId> &ids = cell->second;
+                auto it = find(ids.begin(), ids.end(), id);
+                if (it != ids.end()) {
+                    *it = ids.back();
+                    ids.pop_back();
+                }
+                if (ids.empty())
+                    cells.erase(cell);
+            }
+}
+
+void CollisionWorld::gather(const BoundingBox &bb, ColliderId ignore, vector<ColliderId> &candidates) const
+{
+    if (++stamp == 0) {
+        fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+
+    glm::ivec3 lo = cellOf(bb.min);
+    glm::ivec3 hi = cellOf(bb.max);
+    for (int x = lo.x; x <= hi.x; x++)
+        for (int y = lo.y; y <= hi.y; y++)
+            for (int z = lo.z; z <= hi.z; z++) {
+                auto cell = cells.find(key(x, y, z));
+                if (cell == cells.end())
+                    continue;
+
+                for (ColliderId id : cell->second) {
+                    if (id == ignore || stamps[id] == stamp)
+                        continue;
+                    stamps[id] = stamp;
+                    candidates.push_back(id);
+                }
+            }
+}
+
+bool CollisionWorld::overlaps(const BoundingBox &bb, ColliderId ignore) const
+{
+    vector<ColliderId> candidates;
+    gather(bb, ignore, candidates);
+    for (ColliderId id : candidates) {
+        if (Bounds::overlaps(bb, colliders[id].box))
+            return true;
+    }
+    return false;
+}
+
+void CollisionWorld::query(const BoundingBox &bb, vector<ColliderId> &hits, ColliderId ignore) const
+{
+    vector<ColliderId> candidates;
+    gather(bb, ignore, candidates);
+    for (ColliderId id : candidates) {
+        if (Bounds::overlaps(bb, colliders[id].box))
+            hits.push_back(id);
+    }
+}
+
+bool CollisionWorld::sweep(const BoundingBox &bb, const glm::vec3 &delta, SweepHit &hit, ColliderId ignore) const
+{
+    // Everything the box could touch on the way
+    BoundingBox path = Bounds::merge(bb, { bb.min + delta, bb.max + delta });
+    vector<ColliderId> candidates;
+    gather(path, ignore, candidates);
+
+    // Sweeping a box against a box is a ray against the box grown by the mover's half size
+    glm::vec3 halfSize = 0.5f * (bb.max - bb.min);
+    glm::vec3 center = 0.5f * (bb.min + bb.max);
+
+    hit.time = INFINITY;
+    for (ColliderId id : candidates) {
+        const BoundingBox &box = colliders[id].box;
+        BoundingBox grown = { box.min - halfSize, box.max + halfSize };
+
+        float t;
+        glm::vec3 normal;
+        if (enterBox(center, delta, grown, 1.0f, t, normal) && t < hit.time) {
+            hit.time = t;
+            hit.normal = normal;
+            hit.collider = id;
+        }
+    }
+
+    return hit.time <= 1.0f;
+}
+
+glm::vec3 CollisionWorld::slide(const BoundingBox &bb, glm::vec3 delta, ColliderId ignore) const
+{
+    glm::vec3 moved = glm::vec3(0.0f);
+    for (int i = 0; i < COLLISION_SLIDE_ITERATIONS; i++) {
+        if (glm::dot(delta, delta) <= 0.0f)
+            break;
+
+        SweepHit hit;
+        BoundingBox box = { bb.min + moved, bb.max + moved };
+        if (!sweep(box, delta, hit, ignore)) {
+            moved += delta;
+            break;
+        }
+
+        // Stop just short of the contact, then keep the part of the move along it
+        moved += delta * hit.time + hit.normal * COLLISION_SKIN;
+        delta *= 1.0f - hit.time;
+        delta -= hit.normal * glm::dot(delta, hit.normal);
+    }
+    return moved;
+}
+
+bool CollisionWorld::raycast(const glm::vec3 &origin, const glm::vec3 &dir, float maxDistance, RayHit &hit,
+    ColliderId ignore) const
+{
+    // Clip the ray to the populated region so the cell walk ends quickly
+    float start = 0.0f;
+    glm::vec3 unused;
+    bool inside = Bounds::overlaps({origin, origin}, worldBounds);
+    if (Bounds::isEmpty(worldBounds) || (!inside && !enterBox(origin, dir, worldBounds, maxDistance, start, unused)))
+        return false;
+
+    if (++stamp == 0) {
+        fill(stamps.begin(), stamps.end(), 0);
+        stamp = 1;
+    }
+
+    // Walk the cells along the ray in order, front to back
+    glm::vec3 entry = origin + dir * start;
+    glm::ivec3 cell = cellOf(entry);
+    glm::ivec3 step;
+    glm::vec3 tNext, tDelta;
+    for (int i = 0; i < 3; i++) {
+        step[i] = dir[i] > 0.0f ? 1 : -1;
+        if (fabsf(dir[i]) < 1e-8f) {
+            tNext[i] = INFINITY;
+            tDelta[i] = INFINITY;
+            continue;
+        }
+        float boundary = (cell[i] + (dir[i] > 0.0f ? 1 : 0)) * cellSize;
+        tNext[i] = start + (boundary - entry[i]) / dir[i];
+        tDelta[i] = cellSize / fabsf(dir[i]);
+    }
+
+    glm::ivec3 lastCell = cellOf(worldBounds.max);
+    glm::ivec3 firstCell = cellOf(worldBounds.min);
+    hit.distance = INFINITY;
+    float t = start;
+    while (t <= maxDistance) {
+        auto found = cells.find(key(cell.x, cell.y, cell.z));
+        if (found != cells.end()) {
+            for (ColliderId id : found->second) {
+                if (id == ignore || stamps[id] == stamp)
+                    continue;
+                stamps[id] = stamp;
+
+                float distance;
+                glm::vec3 normal;
+                if (enterBox(origin, dir, colliders[id].box, maxDistance, distance, normal) && distance < hit.distance) {
+                    hit.distance = distance;
+                    hit.normal = normal;
+                    hit.collider = id;
+                }
+            }
+        }
+
+        // Nothing in a later cell can be closer than a hit inside this one
+        int axis = tNext.x < tNext.y ? (tNext.x < tNext.z ? 0 : 2) : (tNext.y < tNext.z ? 1 : 2);
+        if (hit.distance <= tNext[axis])
+            break;
+
+        t = tNext[axis];
+        tNext[axis] += tDelta[axis];
+        cell[axis] += step[axis];
+        if (cell[axis] < firstCell[axis] || cell[axis] > lastCell[axis])
+            break;
+    }
+
+    if (hit.distance > maxDistance)
+        return false;
+
+    hit.point = origin + dir * hit.distance;
+    return true;
+}
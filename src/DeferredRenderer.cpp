@@ -0,0 +1,315 @@
+#include <cmath>
+#include <iostream>
+#include <glad/glad.h>
+
+#include "DeferredRenderer.h"
+#include "GLDebug.h"
+#include "GLState.h"
+#include "DrawData.h"
+
+using namespace std;
+
+// Matches the near plane of the camera projection
+#define NEAR_PLANE 0.01f
+
+void DeferredRenderer::init(const string shaderDirectory, unsigned int numLights, int shadowMode)
+{
+    // Geometry pass, writes surface attributes into the G-buffer
+    geometryProg = make_shared<Program>();
+    geometryProg->setVerbose(true);
+    geometryProg->setShaderNames(shaderDirectory + "/gbuffer_vert.glsl", shaderDirectory + "/gbuffer_frag.glsl");
+    geometryProg->addFeature("TEXTURE_DIFFUSE");
+    geometryProg->addFeature("TEXTURE_SPECULAR");
+    geometryProg->init();
+    geometryProg->addUniformBlock("FrameData", FRAME_DATA_BINDING);
+    geometryProg->addUniformBlock("DrawData", DRAW_DATA_BINDING);
+    geometryProg->addUniform("material.diffuse");
+    geometryProg->addUniform("material.specular");
+    geometryProg->addUniform("material.shininess");
+    geometryProg->addUniform("material.texture_diffuse1");
+    geometryProg->addUniform("material.texture_specular1");
+
+    // Lighting passes, one full screen ambient pass and one scissored pass per light
+    lightProg = make_shared<Program>();
+    lightProg->setVerbose(true);
+    lightProg->setShaderNames(shaderDirectory + "/deferred_vert.glsl", shaderDirectory + "/deferred_frag.glsl");
+    lightProg->setDefine("NUM_LIGHTS", to_string(numLights > 0 ? numLights : 1));
+    lightProg->setDefine("SHADOW_MODE", to_string(shadowMode));
+    lightProg->addFeature("AMBIENT_PASS");
+    lightProg->init();
+    lightProg->prepare(lightProg->getFeatureBit("AMBIENT_PASS"));
+    lightProg->addUniform("gNormal");
+    lightProg->addUniform("gAlbedo");
+    lightProg->addUniform("gSpecular");
+    lightProg->addUniform("gDepth");
+    lightProg->addUniform("shadowMaps");
+    lightProg->addUniform("invP");
+    lightProg->addUniform("invV");
+    lightProg->addUniform("lightIndex");
+
+    for (unsigned int i = 0; i < MAX_LIGHTS; i++) {
+        string index = ("[" + to_string(i) + "]");
+        lightProg->addUniform("light" + index + ".valid");
+        lightProg->addUniform("light" + index + ".baked");
+        lightProg->addUniform("light" + index + ".type");
+        lightProg->addUniform("light" + index + ".position");
+        lightProg->addUniform("light" + index + ".direction");
+        lightProg->addUniform("light" + index + ".inner_cutoff");
+        lightProg->addUniform("light" + index + ".outer_cutoff");
+        lightProg->addUniform("light" + index + ".ambient");
+        lightProg->addUniform("light" + index + ".diffuse");
+        lightProg->addUniform("light" + index + ".specular");
+        lightProg->addUniform("light" + index + ".constant");
+        lightProg->addUniform("light" + index + ".linear");
+        lightProg->addUniform("light" + index + ".quadratic");
+        lightProg->addUniform("lightSpaceMatrix" + index);
+    }
+
+    // Core profile needs a VAO bound even though the triangle has no attributes
+    glGenVertexArrays(1, &quadVAO);
+}
+
+void DeferredRenderer::createTargets()
+{
+    glGenFramebuffers(1, &gBuffer);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+
+    // View space normals
+    glGenTextures(1, &gNormal);
+    GLState::bindTexture(GL_TEXTURE_2D, gNormal);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gNormal, 0);
+
+    // Diffuse color
+    glGenTextures(1, &gAlbedo);
+    GLState::bindTexture(GL_TEXTURE_2D, gAlbedo);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gAlbedo, 0);
+
+    // Specular color and shininess (shininess can go well past 1.0)
+    glGenTextures(1, &gSpecular);
+    GLState::bindTexture(GL_TEXTURE_2D, gSpecular);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gSpecular, 0);
+
+    // Depth, same format as the default framebuffer so it can be blitted
+    glGenTextures(1, &gDepth);
+    GLState::bindTexture(GL_TEXTURE_2D, gDepth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0,
+        GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gDepth, 0);
+
+    unsigned int attachments[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+    glDrawBuffers(3, attachments);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        cerr << "[DeferredRenderer] G-buffer is incomplete" << endl;
+
+    // Names shown in frame debuggers
+    GLDebug::label(GL_FRAMEBUFFER, gBuffer, "G-buffer");
+    GLDebug::label(GL_TEXTURE, gNormal, "G-buffer normal");
+    GLDebug::label(GL_TEXTURE, gAlbedo, "G-buffer albedo");
+    GLDebug::label(GL_TEXTURE, gSpecular, "G-buffer specular");
+    GLDebug::label(GL_TEXTURE, gDepth, "G-buffer depth");
+
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DeferredRenderer::destroyTargets()
+{
+    if (!gBuffer) return;
+
+    unsigned int textures[4] = { gNormal, gAlbedo, gSpecular, gDepth };
+    GLState::deleteTextures(4, textures);
+    GLState::deleteFramebuffers(1, &gBuffer);
+    gBuffer = 0;
+}
+
+void DeferredRenderer::resize(int width, int height)
+{
+    if (gBuffer && width == this->width && height == this->height)
+        return;
+
+    destroyTargets();
+    this->width = width;
+    this->height = height;
+    createTargets();
+}
+
+void DeferredRenderer::beginGeometryPass(const glm::mat4 &P, const glm::mat4 &V)
+{
+    GLDebug::pushGroup("G-buffer");
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+    GLState::viewport(0, 0, width, height);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Blending would mix attributes of overlapping surfaces
+    GLState::disable(GL_BLEND);
+
+    geometryProg->bind();
+    DrawData::setCamera(P, V);
+}
+
+void DeferredRenderer::endGeometryPass()
+{
+    geometryProg->unbind();
+    GLDebug::popGroup();
+
+    GLState::enable(GL_BLEND);
+    glClearColor(.12f, .34f, .56f, 1.0f);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+bool DeferredRenderer::computeScissor(const BoundingBox &bb, const glm::mat4 &PV, glm::ivec4 &rect) const
+{
+    // Box corners in clip space
+    glm::vec4 corners[8];
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner((i & 1) ? bb.max.x : bb.min.x,
+                         (i & 2) ? bb.max.y : bb.min.y,
+                         (i & 4) ? bb.max.z : bb.min.z);
+        corners[i] = PV * glm::vec4(corner, 1.0f);
+    }
+
+    glm::vec2 lo = glm::vec2(INFINITY);
+    glm::vec2 hi = glm::vec2(-INFINITY);
+    bool visible = false;
+
+    auto include = [&](const glm::vec4 &p) {
+        glm::vec2 ndc = glm::vec2(p.x, p.y) / p.w;
+        lo = (glm::min)(lo, ndc);
+        hi = (glm::max)(hi, ndc);
+        visible = true;
+    };
+
+    // Corners in front of the camera, plus where edges cross the near plane
+    for (int i = 0; i < 8; i++) {
+        if (corners[i].w >= NEAR_PLANE)
+            include(corners[i]);
+
+        for (int bit = 1; bit < 8; bit <<= 1) {
+            if (i & bit) continue;
+
+            const glm::vec4 &a = corners[i];
+            const glm::vec4 &b = corners[i | bit];
+            if ((a.w < NEAR_PLANE) != (b.w < NEAR_PLANE)) {
+                float t = (NEAR_PLANE - a.w) / (b.w - a.w);
+                include(a + (b - a) * t);
+            }
+        }
+    }
+
+    if (!visible) return false;
+
+    lo = glm::clamp(lo, glm::vec2(-1.0f), glm::vec2(1.0f));
+    hi = glm::clamp(hi, glm::vec2(-1.0f), glm::vec2(1.0f));
+    if (lo.x >= hi.x || lo.y >= hi.y) return false;
+
+    int x0 = (int) floor((lo.x * 0.5f + 0.5f) * width);
+    int y0 = (int) floor((lo.y * 0.5f + 0.5f) * height);
+    int x1 = (int) ceil((hi.x * 0.5f + 0.5f) * width);
+    int y1 = (int) ceil((hi.y * 0.5f + 0.5f) * height);
+    rect = glm::ivec4(x0, y0, x1 - x0, y1 - y0);
+
+    return true;
+}
+
+void DeferredRenderer::renderLighting(LightingSystem &lightingSystem, const vector<LightHandle> &lights,
+    const glm::mat4 &P, const glm::mat4 &V, float aspect, unsigned int shadowMaps, const BoundingBox &sceneBounds)
+{
+    GLDebug::Group group("Deferred lighting");
+    lightPasses = 0;
+    litPixels = 0;
+
+    GLState::disable(GL_DEPTH_TEST);
+    GLState::depthMask(GL_FALSE);
+
+    lightProg->bind();
+
+    // Bind G-buffer and shadow maps
+    unsigned int targets[4] = { gNormal, gAlbedo, gSpecular, gDepth };
+    const char *names[4] = { "gNormal", "gAlbedo", "gSpecular", "gDepth" };
+    for (int i = 0; i < 4; i++) {
+        GLState::activeTexture(GL_TEXTURE0 + i);
+        GLState::bindTexture(GL_TEXTURE_2D, targets[i]);
+        lightProg->setInt(names[i], i);
+    }
+    GLState::activeTexture(GL_TEXTURE0 + 100);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, shadowMaps);
+    lightProg->setInt("shadowMaps", 100);
+
+    lightProg->setMat4("invP", glm::inverse(P));
+    lightProg->setMat4("invV", glm::inverse(V));
+    lightingSystem.renderLights(lightProg, V);
+    for (unsigned int i = 0; i < lights.size(); i++) {
+        string index = "[" + to_string(lightingSystem.getSlot(lights[i])) + "]";
+        lightProg->setMat4("lightSpaceMatrix" + index, lightingSystem.getSpaceMatrix(lights[i], aspect));
+    }
+
+    GLState::bindVertexArray(quadVAO);
+
+    // Ambient reaches every lit surface and overwrites whatever was behind it
+    GLState::disable(GL_BLEND);
+    lightProg->setFeatures(lightProg->getFeatureBit("AMBIENT_PASS"));
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    // Each light only touches the pixels its volume covers
+    GLState::enable(GL_BLEND);
+    GLState::blendFunc(GL_ONE, GL_ONE);
+    GLState::enable(GL_SCISSOR_TEST);
+    lightProg->setFeatures(0);
+
+    glm::mat4 PV = P * V;
+    for (unsigned int i = 0; i < lights.size(); i++) {
+        if (!lightingSystem.isEnabled(lights[i])) continue;
+
+        glm::ivec4 rect = glm::ivec4(0, 0, width, height);
+
+        BoundingBox bb;
+        if (lightingSystem.getBounds(lights[i], bb)) {
+            // Nothing outside of the scene can be lit
+            bb.min = (glm::max)(bb.min, sceneBounds.min);
+            bb.max = (glm::min)(bb.max, sceneBounds.max);
+            if (bb.min.x > bb.max.x || bb.min.y > bb.max.y || bb.min.z > bb.max.z)
+                continue;
+
+            if (!computeScissor(bb, PV, rect))
+                continue;
+        }
+
+        glScissor(rect.x, rect.y, rect.z, rect.w);
+        lightProg->setInt("lightIndex", lightingSystem.getSlot(lights[i]));
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        lightPasses++;
+        litPixels += (unsigned long) rect.z * rect.w;
+    }
+
+    GLState::disable(GL_SCISSOR_TEST);
+    GLState::bindVertexArray(0);
+    lightProg->unbind();
+
+    // Restore default state
+    GLState::blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    GLState::depthMask(GL_TRUE);
+    GLState::enable(GL_DEPTH_TEST);
+}
+
+void DeferredRenderer::copyDepth(unsigned int framebuffer)
+{
+    GLDebug::Group group("Copy depth");
+    GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+    GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
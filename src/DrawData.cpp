@@ -0,0 +1,42 @@
+#include <glad/glad.h>
+
+#include "DrawData.h"
+
+namespace DrawData
+{
+    static RingBuffer ring;
+
+    void init()
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        ring.init(GL_UNIFORM_BUFFER, DRAW_DATA_SECTION_SIZE, alignment);
+    }
+
+    void beginFrame()
+    {
+        ring.beginFrame();
+    }
+
+    void endFrame()
+    {
+        ring.endFrame();
+    }
+
+    void setCamera(const glm::mat4 &P, const glm::mat4 &V)
+    {
+        Frame frame = { P, V };
+        ring.bindRange(FRAME_DATA_BINDING, &frame, sizeof(frame));
+    }
+
+    void setModel(const glm::mat4 &M, const glm::vec3 &emissive)
+    {
+        Draw draw = { M, glm::vec4(emissive, 1.0f) };
+        ring.bindRange(DRAW_DATA_BINDING, &draw, sizeof(draw));
+    }
+
+    const RingBuffer &getBuffer()
+    {
+        return ring;
+    }
+}
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <iostream>
+
+#include "DrumTrigger.h"
+
+DrumTrigger::~DrumTrigger()
+{
+    stop();
+}
+
+void DrumTrigger::setPad(unsigned int pad, ALuint buffer, int priority)
+{
+    buffers[pad] = buffer;
+    priorities[pad] = priority;
+}
+
+void DrumTrigger::start(AudioSystem &audio)
+{
+    if (running) return;
+    this->audio = &audio;
+
+    for (auto &time : lastPlayed)
+        time = Clock::time_point();
+    latencies.reserve(DRUM_LATENCY_REPORT_HITS);
+
+    running = true;
+    worker = thread(&DrumTrigger::run, this);
+}
+
+void DrumTrigger::stop()
+{
+    if (!running) return;
+
+    running = false;
+    wake.notify_one();
+    worker.join();
+    reportLatency();
+}
+
+void DrumTrigger::trigger(unsigned int pad)
+{
+    if (!running || pad >= DRUM_PAD_COUNT) return;
+
+    // A full queue means the trigger thread is stalled, dropping the hit is all we can do
+    if (hits.push({pad, Clock::now()}))
+        wake.notify_one();
+}
+
+void DrumTrigger::run()
+{
+    const chrono::duration<double> cooldown(DRUM_RETRIGGER_TIME);
+
+    while (running)
+    {
+        Hit hit;
+        while (hits.pop(hit))
+        {
+            if (hit.time - lastPlayed[hit.pad] < cooldown)
+                continue;
+            lastPlayed[hit.pad] = hit.time;
+
+            audio->playVoice(buffers[hit.pad], priorities[hit.pad]);
+
+            chrono::duration<float, milli> latency = Clock::now() - hit.time;
+            latencies.push_back(latency.count());
+
+            if (latencies.size() >= DRUM_LATENCY_REPORT_HITS)
+                reportLatency();
+        }
+
+        // Woken by trigger, the timeout only covers a notify that lands before the wait
+        unique_lock<mutex> lock(wakeMutex);
+        wake.wait_for(lock, chrono::microseconds(DRUM_TRIGGER_WAIT_US),
+            [this] { return !running || !hits.empty(); });
+    }
+}
+
+void DrumTrigger::reportLatency()
+{
+    if (latencies.empty()) return;
+
+    sort(latencies.begin(), latencies.end());
+    auto percentile = [&](float p) {
+        return latencies[(size_t)(p * (latencies.size() - 1) + 0.5f)];
+    };
+
+    cout << "[DrumTrigger] Key to play latency over " << latencies.size() << " hits: p50 "
+         << percentile(0.5f) << " ms, p95 " << percentile(0.95f) << " ms, p99 "
+         << percentile(0.99f) << " ms, max " << latencies.back() << " ms; "
+         << audio->getActiveVoices() << "/" << audio->getVoiceCount() << " voices active, "
+         << audio->getVoicesStolen() << " stolen, " << audio->getVoicesDropped() << " dropped" << endl;
+    latencies.clear();
+}
@@ -7,6 +7,7 @@
 #include "MatrixStack.h"
 #include "Application.h"
 #include "common.h"
+#include "DrawData.h"
 
 using namespace std;
 
@@ -69,16 +70,16 @@ void Dummy::renderGuitarist(shared_ptr<Program> prog, bool playGuitar, bool useM
         Model.pushMatrix();
 
             Model.translate(torso->moveToZero());
-            glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+            DrawData::setModel(Model.topMatrix());
             torso->Draw(prog, useMaterials);
 
             // Neck
             Model.pushMatrix();
                 Model.translate(-1.0f * neck->moveToZero());
                 if (playGuitar)
-                    Model.rotate(0.5f*sin(3.0f*glfwGetTime()) - 0.5f, glm::vec3(0.0f, 0.0f, 1.0f));
+                    Model.rotate(0.5f*sin(3.0f*animationTime) - 0.5f, glm::vec3(0.0f, 0.0f, 1.0f));
                 Model.translate(neck->moveToZero());
-                glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+                DrawData::setModel(Model.topMatrix());
                 neck->Draw(prog, useMaterials);
                 head->Draw(prog, useMaterials);
             Model.popMatrix();
@@ -89,7 +90,7 @@ void Dummy::renderGuitarist(shared_ptr<Program> prog, bool playGuitar, bool useM
                 Model.translate(-1.0f * l_shoulder->moveToZero());
                 Model.rotate(glm::radians(-90.0f), glm::vec3(1.0f, 0.3f, 0.0f));
                 Model.translate(l_shoulder->moveToZero());
-                glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+                DrawData::setModel(Model.topMatrix());
                 l_shoulder->Draw(prog, useMaterials);
                 l_upper_arm->Draw(prog, useMaterials);
 
@@ -98,7 +99,7 @@ void Dummy::renderGuitarist(shared_ptr<Program> prog, bool playGuitar, bool useM
                     Model.translate(-1.0f * l_elbow->moveToZero());
                     Model.rotate(glm::radians(120.0f), glm::vec3(1.0f, -0.7f, 0.0f));
                     Model.translate(l_elbow->moveToZero());
-                    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+                    DrawData::setModel(Model.topMatrix());
                     l_elbow->Draw(prog, useMaterials);
                     l_forearm->Draw(prog, useMaterials);
                     
@@ -108,7 +109,7 @@ void Dummy::renderGuitarist(shared_ptr<Program> prog, bool playGuitar, bool useM
                         Model.rotate(glm::radians(40.0f), glm::vec3(1.0f, 0.0f, 0.0f));
                         Model.rotate(glm::radians(160.0f), glm::vec3(0.0f, 0.0f, 1.0f));
                         Model.translate(l_wrist->moveToZero());
-                        glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+                        DrawData::setModel(Model.topMatrix());
                         l_wrist->Draw(prog, useMaterials);
                         l_hand->Draw(prog, useMaterials);
                     Model.popMatrix();
@@ -122,7 +123,7 @@ void Dummy::renderGuitarist(shared_ptr<Program> prog, bool playGuitar, bool useM
                 Model.rotate(glm::radians(65.0f), glm::vec3(0.0f, 1.0f, 0.0f));
                 Model.rotate(glm::radians(50.0f), glm::vec3(1.0f, 0.0f, 0.0f));
                 Model.translate(r_shoulder->moveToZero());
-                glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+                DrawData::setModel(Model.topMatrix());
                 r_shoulder->Draw(prog, useMaterials);
                 r_upper_arm->Draw(prog, useMaterials);
 
@@ -131,24 +132,24 @@ void Dummy::renderGuitarist(shared_ptr<Program> prog, bool playGuitar, bool useM
                     Model.translate(-1.0f * r_elbow->moveToZero());
                     
                     if (playGuitar)
-                        Model.rotate(0.5f * sin(5.0f*glfwGetTime()) - 0.3f, glm::vec3(0.0f, 1.0f, 1.0f));
+                        Model.rotate(0.5f * sin(5.0f*animationTime) - 0.3f, glm::vec3(0.0f, 1.0f, 1.0f));
                     
                     Model.rotate(glm::radians(110.0f), glm::vec3(0.0f, 1.0f, 0.0f));
                     Model.translate(r_elbow->moveToZero());
-                    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+                    DrawData::setModel(Model.topMatrix());
                     r_elbow->Draw(prog, useMaterials);
                     r_forearm->Draw(prog, useMaterials);
                     
                     // Right hand
                     Model.pushMatrix();
-                        glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+                        DrawData::setModel(Model.topMatrix());
                         r_wrist->Draw(prog, useMaterials);
                         r_hand->Draw(prog, useMaterials);
                     Model.popMatrix();
                 Model.popMatrix();
             Model.popMatrix();
 
-             glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+             DrawData::setModel(Model.topMatrix());
             hip->Draw(prog, useMaterials);
             waist->Draw(prog, useMaterials);
             
@@ -177,7 +178,7 @@ void Dummy::renderGuitarist(shared_ptr<Program> prog, bool playGuitar, bool useM
         Model.rotate(glm::radians(-55.0f), glm::vec3(1.0f, 0.0f, 0.0f));
         Model.rotate(glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         Model.multMatrix(guitar->getNormalizedMat());
-        glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+        DrawData::setModel(Model.topMatrix());
         guitar->Draw(prog, useMaterials);
     Model.popMatrix();
 }
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <AL/alc.h>
+
+#include "EmitterSystem.h"
+
+EmitterSystem::~EmitterSystem()
+{
+    if (!sources.empty() && sources[0])
+        alDeleteSources(sources.size(), sources.data());
+}
+
+void EmitterSystem::init(unsigned int count)
+{
+    sources.assign(count, 0);
+    if (alcGetCurrentContext()) {
+        alGetError();
+        alGenSources(count, sources.data());
+        if (alGetError() != AL_NO_ERROR) {
+            cerr << "[Emitters] Failed to create " << count << " sources, every emitter stays virtual" << endl;
+            sources.clear();
+        }
+
+        // Fades to silence at each source's max distance, the same as the culling
+        alDistanceModel(AL_LINEAR_DISTANCE_CLAMPED);
+    }
+
+    owners.assign(sources.size(), 0);
+    freeSources.clear();
+    for (unsigned int i = sources.size(); i > 0; i--)
+        freeSources.push_back(i - 1);
+}
+
+EmitterHandle EmitterSystem::add(ALuint buffer, float duration, glm::vec3 position, float gain,
+    float referenceDistance, float maxDistance, int priority, bool loop)
+{
+    Emitter emitter;
+    emitter.buffer = buffer;
+    emitter.duration = duration;
+    emitter.position = position;
+    emitter.gain = gain;
+    emitter.referenceDistance = referenceDistance;
+    emitter.maxDistance = min(maxDistance, EMITTER_MAX_DISTANCE);
+    emitter.priority = priority;
+    emitter.loop = loop;
+    emitter.cell = cellOf(position);
+
+    EmitterHandle handle = emitters.size();
+    emitters.push_back(emitter);
+    cells[emitter.cell].push_back(handle);
+    return handle;
+}
+
+int64_t EmitterSystem::cellOf(glm::vec3 position)
+{
+    int32_t x = (int32_t)floorf(position.x / EMITTER_CELL_SIZE);
+    int32_t z = (int32_t)floorf(position.z / EMITTER_CELL_SIZE);
+    return ((int64_t)x << 32) | (uint32_t)z;
+}
+
+void EmitterSystem::move(EmitterHandle handle, glm::vec3 position)
+{
+    Emitter &emitter = emitters[handle];
+    emitter.position = position;
+
+    int64_t cell = cellOf(position);
+    if (cell != emitter.cell) {
+        vector<EmitterHandle> &old = cells[emitter.cell];
+        old.erase(find(old.begin(), old.end(), handle));
+        cells[cell].push_back(handle);
+        emitter.cell = cell;
+    }
+
+    if (emitter.source >= 0 && sources[emitter.source])
+        alSource3f(sources[emitter.source], AL_POSITION, position.x, position.y, position.z);
+}
+
+void EmitterSystem::attach(EmitterHandle emitter, TransformNode node, glm::vec3 offset)
+{
+    if (nodeEmitters.size() <= node)
+        nodeEmitters.resize(node + 1);
+    nodeEmitters[node].push_back(emitter);
+    emitters[emitter].node = node;
+    emitters[emitter].offset = offset;
+    pending.push_back(emitter);
+}
+
+void EmitterSystem::setPosition(EmitterHandle emitter, glm::vec3 position)
+{
+    move(emitter, position);
+}
+
+void EmitterSystem::setGain(EmitterHandle handle, float gain)
+{
+    Emitter &emitter = emitters[handle];
+    emitter.gain = gain;
+    if (emitter.source >= 0 && sources[emitter.source])
+        alSourcef(sources[emitter.source], AL_GAIN, gain);
+}
+
+void EmitterSystem::play(EmitterHandle handle)
+{
+    Emitter &emitter = emitters[handle];
+    if (!emitter.playing)
+        stats.playing++;
+    emitter.playing = true;
+    emitter.started = now;
+
+    // Already real, so it starts over now rather than on the next update
+    if (emitter.source >= 0)
+        start(emitter);
+}
+
+void EmitterSystem::stop(EmitterHandle handle)
+{
+    Emitter &emitter = emitters[handle];
+    if (!emitter.playing) return;
+
+    emitter.playing = false;
+    stats.playing--;
+    if (emitter.source >= 0)
+        demote(handle);
+}
+
+// Higher priority first, then louder, with real emitters given the benefit of the doubt
+bool EmitterSystem::outranks(const Emitter &a, const Emitter &b) const
+{
+    if (a.priority != b.priority)
+        return a.priority > b.priority;
+    float loudnessA = a.source >= 0 ? a.loudness * EMITTER_HYSTERESIS : a.loudness;
+    float loudnessB = b.source >= 0 ? b.loudness * EMITTER_HYSTERESIS : b.loudness;
+    return loudnessA > loudnessB;
+}
+
+// Plays the emitter's sound on its source from where it would be by now
+void EmitterSystem::start(Emitter &emitter)
+{
+    ALuint source = sources[emitter.source];
+    if (!source) return;
+
+    double elapsed = now - emitter.started;
+    if (emitter.loop && emitter.duration > 0.0f)
+        elapsed = fmod(elapsed, (double)emitter.duration);
+
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, emitter.buffer);
+    alSourcei(source, AL_LOOPING, emitter.loop ? AL_TRUE : AL_FALSE);
+    alSourcei(source, AL_SOURCE_RELATIVE, AL_FALSE);
+    alSourcef(source, AL_GAIN, emitter.gain);
+    alSourcef(source, AL_REFERENCE_DISTANCE, emitter.referenceDistance);
+    alSourcef(source, AL_MAX_DISTANCE, emitter.maxDistance);
+    alSourcef(source, AL_ROLLOFF_FACTOR, 1.0f);
+    alSource3f(source, AL_POSITION, emitter.position.x, emitter.position.y, emitter.position.z);
+    alSourcef(source, AL_SEC_OFFSET, (float)elapsed);
+    alSourcePlay(source);
+}
+
+void EmitterSystem::promote(EmitterHandle handle)
+{
+    Emitter &emitter = emitters[handle];
+    emitter.source = freeSources.back();
+    freeSources.pop_back();
+    owners[emitter.source] = handle;
+    start(emitter);
+    stats.promotions++;
+}
+
+void EmitterSystem::demote(EmitterHandle handle)
+{
+    Emitter &emitter = emitters[handle];
+    ALuint source = sources[emitter.source];
+    if (source) {
+        alSourceStop(source);
+        alSourcei(source, AL_BUFFER, 0);
+    }
+    freeSources.push_back(emitter.source);
+    emitter.source = -1;
+    stats.demotions++;
+}
+
+void EmitterSystem::update(const TransformHierarchy &transforms, double time, glm::vec3 listener,
+    glm::vec3 forward, glm::vec3 up)
+{
+    now = time;
+    updates++;
+
+    if (!sources.empty() && sources[0]) {
+        float orientation[6] = { forward.x, forward.y, forward.z, up.x, up.y, up.z };
+        alListener3f(AL_POSITION, listener.x, listener.y, listener.z);
+        alListenerfv(AL_ORIENTATION, orientation);
+    }
+
+    // Attached emitters follow the nodes that moved, and pick up their node's place when first attached
+    for (TransformNode node : transforms.getMoved()) {
+        if (node >= nodeEmitters.size()) continue;
+        for (EmitterHandle handle : nodeEmitters[node])
+            move(handle, glm::vec3(transforms.getWorld(node) * glm::vec4(emitters[handle].offset, 1.0f)));
+    }
+    for (EmitterHandle handle : pending) {
+        const Emitter &emitter = emitters[handle];
+        move(handle, glm::vec3(transforms.getWorld(emitter.node) * glm::vec4(emitter.offset, 1.0f)));
+    }
+    pending.clear();
+
+    // Loudness of every playing emitter in the cells within reach of the listener
+    candidates.clear();
+    stats.nearby = 0;
+    int range = (int)ceilf(EMITTER_MAX_DISTANCE / EMITTER_CELL_SIZE);
+    int32_t cx = (int32_t)floorf(listener.x / EMITTER_CELL_SIZE);
+    int32_t cz = (int32_t)floorf(listener.z / EMITTER_CELL_SIZE);
+    for (int32_t x = cx - range; x <= cx + range; x++) {
+        for (int32_t z = cz - range; z <= cz + range; z++)
+        {
+            auto cell = cells.find(((int64_t)x << 32) | (uint32_t)z);
+            if (cell == cells.end()) continue;
+
+            for (EmitterHandle handle : cell->second)
+            {
+                stats.nearby++;
+                Emitter &emitter = emitters[handle];
+                if (!emitter.playing) continue;
+
+                // One-shots end on their own, real or not
+                if (!emitter.loop && now - emitter.started >= emitter.duration) {
+                    stop(handle);
+                    continue;
+                }
+
+                // Same as AL_LINEAR_DISTANCE_CLAMPED
+                float distance = glm::length(emitter.position - listener);
+                float span = emitter.maxDistance - emitter.referenceDistance;
+                float clamped = min(max(distance, emitter.referenceDistance), emitter.maxDistance);
+                float attenuation = span > 0.0f ? 1.0f - (clamped - emitter.referenceDistance) / span : 1.0f;
+                emitter.loudness = emitter.gain * attenuation;
+
+                if (emitter.loudness >= EMITTER_AUDIBLE_LEVEL)
+                    candidates.push_back(handle);
+            }
+        }
+    }
+    stats.audible = candidates.size();
+
+    // The most important get the sources, only as far into the ranking as there are sources
+    size_t chosen = min(candidates.size(), sources.size());
+    partial_sort(candidates.begin(), candidates.begin() + chosen, candidates.end(),
+        [this](EmitterHandle a, EmitterHandle b) { return outranks(emitters[a], emitters[b]); });
+    for (size_t i = 0; i < chosen; i++)
+        emitters[candidates[i]].chosen = updates;
+
+    // Everything real that didn't make it, out of reach or outranked, goes virtual first
+    for (unsigned int i = 0; i < sources.size(); i++) {
+        if (find(freeSources.begin(), freeSources.end(), i) != freeSources.end()) continue;
+        if (emitters[owners[i]].chosen != updates)
+            demote(owners[i]);
+    }
+    for (size_t i = 0; i < chosen; i++) {
+        if (emitters[candidates[i]].source < 0)
+            promote(candidates[i]);
+    }
+
+    stats.real = sources.size() - freeSources.size();
+}
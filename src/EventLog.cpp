@@ -0,0 +1,68 @@
+#include <fstream>
+#include <iostream>
+
+#include "EventLog.h"
+
+static_assert(sizeof(LoggedEvent) == 24, "LoggedEvent must not be padded");
+
+struct EventLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t rate;
+    uint32_t length;
+    uint32_t count;
+};
+
+void EventLog::clear(uint32_t rate)
+{
+    this->rate = rate;
+    length = 0;
+    events.clear();
+}
+
+void EventLog::add(uint32_t tick, uint8_t type, int32_t key, uint8_t action, uint16_t mods, float x, float y, float z)
+{
+    events.push_back({tick, type, action, mods, key, x, y, z});
+}
+
+bool EventLog::save(const string &path) const
+{
+    ofstream file(path, ios::binary);
+    if (!file.is_open()) {
+        cerr << "[EventLog] Can't write " << path << endl;
+        return false;
+    }
+
+    EventLogHeader header = {EVENT_LOG_MAGIC, EVENT_LOG_VERSION, rate, length, (uint32_t)events.size()};
+    file.write((const char *) &header, sizeof(header));
+    file.write((const char *) events.data(), events.size() * sizeof(LoggedEvent));
+    return file.good();
+}
+
+bool EventLog::load(const string &path)
+{
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) {
+        cerr << "[EventLog] Can't read " << path << endl;
+        return false;
+    }
+
+    EventLogHeader header;
+    file.read((char *) &header, sizeof(header));
+    if (!file || header.magic != EVENT_LOG_MAGIC || header.version != EVENT_LOG_VERSION) {
+        cerr << "[EventLog] " << path << " is not a version " << EVENT_LOG_VERSION << " recording" << endl;
+        return false;
+    }
+
+    events.resize(header.count);
+    file.read((char *) events.data(), events.size() * sizeof(LoggedEvent));
+    if (!file) {
+        cerr << "[EventLog] " << path << " is truncated" << endl;
+        events.clear();
+        return false;
+    }
+
+    rate = header.rate;
+    length = header.length;
+    return true;
+}
@@ -0,0 +1,62 @@
+#include "FFT.h"
+
+FFT::FFT(unsigned int size) : size(size), reversed(size), twiddles(size / 2)
+{
+    const float pi = 3.14159265f;
+
+    unsigned int bits = 0;
+    while ((1u << bits) < size)
+        bits++;
+
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned int r = 0;
+        for (unsigned int b = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        reversed[i] = r;
+    }
+
+    for (unsigned int k = 0; k < size / 2; k++)
+        twiddles[k] = polar(1.0f, -2.0f * pi * k / size);
+}
+
+void FFT::forward(complex<float> *data) const
+{
+    transform(data, false);
+}
+
+void FFT::inverse(complex<float> *data) const
+{
+    transform(data, true);
+
+    float scale = 1.0f / size;
+    for (unsigned int i = 0; i < size; i++)
+        data[i] *= scale;
+}
+
+void FFT::transform(complex<float> *data, bool inverse) const
+{
+    for (unsigned int i = 0; i < size; i++) {
+        if (i < reversed[i])
+            swap(data[i], data[reversed[i]]);
+    }
+
+    float sign = inverse ? -1.0f : 1.0f;
+    for (unsigned int length = 2; length <= size; length *= 2)
+    {
+        unsigned int half = length / 2;
+        unsigned int step = size / length;
+        for (unsigned int start = 0; start < size; start += length) {
+            for (unsigned int k = 0; k < half; k++) {
+                float wr = twiddles[k * step].real();
+                float wi = sign * twiddles[k * step].imag();
+                complex<float> &a = data[start + k];
+                complex<float> &b = data[start + k + half];
+
+                // Written out, std::complex multiplication checks for NaNs and infinities
+                complex<float> t(wr * b.real() - wi * b.imag(), wr * b.imag() + wi * b.real());
+                b = a - t;
+                a += t;
+            }
+        }
+    }
+}
@@ -0,0 +1,150 @@
+#include "GLDebug.h"
+#include "GLSL.h"
+
+#include <iostream>
+#include <map>
+
+namespace GLDebug
+{
+
+CallSite callSite;
+bool active = false;
+
+static GLenum minSeverity = GL_DEBUG_SEVERITY_LOW;
+static std::map<std::pair<GLenum, GLuint>, unsigned> repeats;
+
+static const char *sourceString(GLenum source)
+{
+	switch (source) {
+	case GL_DEBUG_SOURCE_API:             return "API";
+	case GL_DEBUG_SOURCE_WINDOW_SYSTEM:   return "window system";
+	case GL_DEBUG_SOURCE_SHADER_COMPILER: return "shader compiler";
+	case GL_DEBUG_SOURCE_THIRD_PARTY:     return "third party";
+	case GL_DEBUG_SOURCE_APPLICATION:     return "application";
+	default:                              return "other";
+	}
+}
+
+static const char *typeString(GLenum type)
+{
+	switch (type) {
+	case GL_DEBUG_TYPE_ERROR:               return "error";
+	case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated";
+	case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:  return "undefined behavior";
+	case GL_DEBUG_TYPE_PORTABILITY:         return "portability";
+	case GL_DEBUG_TYPE_PERFORMANCE:         return "performance";
+	case GL_DEBUG_TYPE_MARKER:              return "marker";
+	default:                                return "other";
+	}
+}
+
+static const char *severityString(GLenum severity)
+{
+	switch (severity) {
+	case GL_DEBUG_SEVERITY_HIGH:   return "HIGH";
+	case GL_DEBUG_SEVERITY_MEDIUM: return "MEDIUM";
+	case GL_DEBUG_SEVERITY_LOW:    return "LOW";
+	default:                       return "NOTE";
+	}
+}
+
+// Higher is more severe, the enums themselves aren't ordered
+static int severityRank(GLenum severity)
+{
+	switch (severity) {
+	case GL_DEBUG_SEVERITY_HIGH:   return 3;
+	case GL_DEBUG_SEVERITY_MEDIUM: return 2;
+	case GL_DEBUG_SEVERITY_LOW:    return 1;
+	default:                       return 0;
+	}
+}
+
+static void APIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+	GLsizei length, const GLchar *message, const void *userParam)
+{
+	// Our own debug groups echo back as notifications
+	if (type == GL_DEBUG_TYPE_PUSH_GROUP || type == GL_DEBUG_TYPE_POP_GROUP)
+		return;
+	if (severityRank(severity) < severityRank(minSeverity))
+		return;
+
+	unsigned count = ++repeats[std::make_pair(source, id)];
+	if (count > GL_DEBUG_MAX_REPEATS)
+		return;
+
+	std::cerr << "[GL] " << severityString(severity) << " " << typeString(type)
+	          << " (" << sourceString(source) << ", id " << id << "): " << message << std::endl;
+	if (callSite.call)
+		std::cerr << "    at " << callSite.file << ":" << callSite.line << " in " << callSite.call << std::endl;
+	if (count == GL_DEBUG_MAX_REPEATS)
+		std::cerr << "    (further messages with id " << id << " suppressed)" << std::endl;
+}
+
+bool init()
+{
+	if (!GLAD_GL_KHR_debug)
+	{
+		std::cerr << "KHR_debug not available, falling back to glGetError checks" << std::endl;
+		return false;
+	}
+
+	glEnable(GL_DEBUG_OUTPUT);
+#ifndef NDEBUG
+	// Report from inside the offending call so the call site is still current
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	setMinSeverity(GL_DEBUG_SEVERITY_LOW);
+#else
+	setMinSeverity(GL_DEBUG_SEVERITY_HIGH);
+#endif
+	glDebugMessageCallback(callback, nullptr);
+
+	active = true;
+	return true;
+}
+
+void setMinSeverity(GLenum severity)
+{
+	minSeverity = severity;
+	if (!GLAD_GL_KHR_debug)
+		return;
+
+	const GLenum severities[] = {
+		GL_DEBUG_SEVERITY_NOTIFICATION, GL_DEBUG_SEVERITY_LOW,
+		GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_HIGH
+	};
+
+	// Have the driver skip generating messages we'd throw away
+	for (GLenum s : severities)
+	{
+		GLboolean enabled = severityRank(s) >= severityRank(severity);
+		glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, s, 0, nullptr, enabled);
+	}
+}
+
+void pushGroup(const char *name)
+{
+	if (active)
+		glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, name);
+}
+
+void popGroup()
+{
+	if (active)
+		glPopDebugGroup();
+}
+
+void label(GLenum identifier, GLuint name, const char *label)
+{
+	if (active)
+		glObjectLabel(identifier, name, -1, label);
+}
+
+void leave()
+{
+	// Without a debug callback, errors still have to be polled for
+	if (!active)
+		GLSL::printOpenGLErrors(callSite.call, callSite.file, callSite.line);
+	callSite.call = nullptr;
+}
+
+}
@@ -0,0 +1,254 @@
+#include "GLState.h"
+
+namespace GLState
+{
+
+Counters frame;
+Counters lastFrame;
+
+// Never a valid name or enum, so the first call after a reset always goes through
+static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+// Targets tracked per texture unit, others are passed straight through
+static const GLenum textureTargets[] = { GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP };
+#define TEXTURE_TARGETS (sizeof(textureTargets) / sizeof(textureTargets[0]))
+
+// Capabilities tracked by enable/disable
+static const GLenum trackedCapabilities[] = { GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST };
+#define CAPABILITIES (sizeof(trackedCapabilities) / sizeof(trackedCapabilities[0]))
+
+static struct {
+	GLuint program;
+	GLuint vao;
+	GLuint activeUnit;
+	GLuint textures[GL_STATE_TEXTURE_UNITS][TEXTURE_TARGETS];
+	GLuint readFramebuffer;
+	GLuint drawFramebuffer;
+	GLint viewport[4];
+	GLuint capabilities[CAPABILITIES];
+	GLuint blendSource, blendDestination;
+	GLuint depthFunc;
+	GLuint depthMask;
+	GLuint cullFace;
+	GLuint colorMask;
+} state;
+
+static struct Init { Init() { reset(); } } init;
+
+static int targetIndex(GLenum target)
+{
+	for (unsigned i = 0; i < TEXTURE_TARGETS; i++)
+		if (textureTargets[i] == target)
+			return i;
+	return -1;
+}
+
+static int capabilityIndex(GLenum capability)
+{
+	for (unsigned i = 0; i < CAPABILITIES; i++)
+		if (trackedCapabilities[i] == capability)
+			return i;
+	return -1;
+}
+
+// Returns true if the call has to be issued, and remembers the new value
+static bool change(GLuint &current, GLuint value)
+{
+	if (current == value)
+	{
+		frame.filtered++;
+		return false;
+	}
+
+	current = value;
+	frame.issued++;
+	return true;
+}
+
+void endFrame()
+{
+	lastFrame = frame;
+	frame = Counters();
+}
+
+void reset()
+{
+	state.program = UNKNOWN;
+	state.vao = UNKNOWN;
+	state.activeUnit = UNKNOWN;
+	for (auto &unit : state.textures)
+		for (auto &texture : unit)
+			texture = UNKNOWN;
+	state.readFramebuffer = UNKNOWN;
+	state.drawFramebuffer = UNKNOWN;
+	state.viewport[0] = state.viewport[1] = state.viewport[2] = state.viewport[3] = -1;
+	for (auto &capability : state.capabilities)
+		capability = UNKNOWN;
+	state.blendSource = state.blendDestination = UNKNOWN;
+	state.depthFunc = UNKNOWN;
+	state.depthMask = UNKNOWN;
+	state.cullFace = UNKNOWN;
+	state.colorMask = UNKNOWN;
+}
+
+void useProgram(GLuint program)
+{
+	if (change(state.program, program))
+		glUseProgram(program);
+}
+
+void bindVertexArray(GLuint vao)
+{
+	if (change(state.vao, vao))
+		glBindVertexArray(vao);
+}
+
+void activeTexture(GLenum unit)
+{
+	if (change(state.activeUnit, unit))
+		glActiveTexture(unit);
+}
+
+void bindTexture(GLenum target, GLuint texture)
+{
+	GLuint unit = state.activeUnit - GL_TEXTURE0;
+	int index = targetIndex(target);
+	if (state.activeUnit == UNKNOWN || unit >= GL_STATE_TEXTURE_UNITS || index < 0)
+	{
+		frame.issued++;
+		glBindTexture(target, texture);
+		return;
+	}
+
+	if (change(state.textures[unit][index], texture))
+		glBindTexture(target, texture);
+}
+
+void bindFramebuffer(GLenum target, GLuint framebuffer)
+{
+	if (target == GL_FRAMEBUFFER)
+	{
+		if (state.readFramebuffer == framebuffer && state.drawFramebuffer == framebuffer)
+		{
+			frame.filtered++;
+			return;
+		}
+		state.readFramebuffer = state.drawFramebuffer = framebuffer;
+		frame.issued++;
+		glBindFramebuffer(target, framebuffer);
+	}
+	else if (target == GL_READ_FRAMEBUFFER)
+	{
+		if (change(state.readFramebuffer, framebuffer))
+			glBindFramebuffer(target, framebuffer);
+	}
+	else if (change(state.drawFramebuffer, framebuffer))
+		glBindFramebuffer(target, framebuffer);
+}
+
+void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	GLint *v = state.viewport;
+	if (v[0] == x && v[1] == y && v[2] == width && v[3] == height)
+	{
+		frame.filtered++;
+		return;
+	}
+
+	v[0] = x; v[1] = y; v[2] = width; v[3] = height;
+	frame.issued++;
+	glViewport(x, y, width, height);
+}
+
+void enable(GLenum capability)
+{
+	int index = capabilityIndex(capability);
+	if (index < 0 || change(state.capabilities[index], GL_TRUE))
+		glEnable(capability);
+}
+
+void disable(GLenum capability)
+{
+	int index = capabilityIndex(capability);
+	if (index < 0 || change(state.capabilities[index], GL_FALSE))
+		glDisable(capability);
+}
+
+void blendFunc(GLenum source, GLenum destination)
+{
+	if (state.blendSource == source && state.blendDestination == destination)
+	{
+		frame.filtered++;
+		return;
+	}
+
+	state.blendSource = source;
+	state.blendDestination = destination;
+	frame.issued++;
+	glBlendFunc(source, destination);
+}
+
+void depthFunc(GLenum func)
+{
+	if (change(state.depthFunc, func))
+		glDepthFunc(func);
+}
+
+void depthMask(GLboolean mask)
+{
+	if (change(state.depthMask, mask))
+		glDepthMask(mask);
+}
+
+void cullFace(GLenum mode)
+{
+	if (change(state.cullFace, mode))
+		glCullFace(mode);
+}
+
+void colorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+	GLuint mask = (red ? 1 : 0) | (green ? 2 : 0) | (blue ? 4 : 0) | (alpha ? 8 : 0);
+	if (change(state.colorMask, mask))
+		glColorMask(red, green, blue, alpha);
+}
+
+// GL unbinds deleted objects, so a recycled name has to look unbound
+void deleteProgram(GLuint program)
+{
+	glDeleteProgram(program);
+	if (state.program == program)
+		state.program = UNKNOWN;
+}
+
+void deleteVertexArrays(GLsizei n, const GLuint *vaos)
+{
+	glDeleteVertexArrays(n, vaos);
+	for (GLsizei i = 0; i < n; i++)
+		if (state.vao == vaos[i])
+			state.vao = UNKNOWN;
+}
+
+void deleteTextures(GLsizei n, const GLuint *textures)
+{
+	glDeleteTextures(n, textures);
+	for (GLsizei i = 0; i < n; i++)
+		for (auto &unit : state.textures)
+			for (auto &texture : unit)
+				if (texture == textures[i])
+					texture = UNKNOWN;
+}
+
+void deleteFramebuffers(GLsizei n, const GLuint *framebuffers)
+{
+	glDeleteFramebuffers(n, framebuffers);
+	for (GLsizei i = 0; i < n; i++)
+	{
+		if (state.readFramebuffer == framebuffers[i])
+			state.readFramebuffer = UNKNOWN;
+		if (state.drawFramebuffer == framebuffers[i])
+			state.drawFramebuffer = UNKNOWN;
+	}
+}
+
+}
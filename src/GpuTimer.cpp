@@ -0,0 +1,49 @@
+#include "GpuTimer.h"
+
+void GpuTimer::init()
+{
+    glGenQueries(GPU_TIMER_FRAMES, queries);
+}
+
+void GpuTimer::begin(int tag)
+{
+    unsigned int slot = head % GPU_TIMER_FRAMES;
+
+    // Every query is in flight, throw the oldest result away to make room
+    if (pending[slot]) {
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        pending[slot] = false;
+        tail++;
+    }
+
+    tags[slot] = tag;
+    glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+}
+
+void GpuTimer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[head % GPU_TIMER_FRAMES] = true;
+    head++;
+}
+
+bool GpuTimer::poll(double &milliseconds, int &tag)
+{
+    if (tail == head) return false;
+
+    unsigned int slot = tail % GPU_TIMER_FRAMES;
+
+    GLint available = 0;
+    glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) return false;
+
+    GLuint64 elapsed;
+    glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+    pending[slot] = false;
+    tail++;
+
+    milliseconds = elapsed / 1.0e6;
+    tag = tags[slot];
+    return true;
+}
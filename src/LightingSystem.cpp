@@ -1,186 +1,540 @@
+#include <cmath>
 #include <iostream>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
-#include "Light.h"
 #include "LightingSystem.h"
 
 using namespace std;
 
+// Smallest contribution that still changes an 8-bit color channel
+#define LIGHT_THRESHOLD (1.0f / 256.0f)
+
 
 /*
  * Helper Functions
  */
-shared_ptr<Light> LightingSystem::search(unsigned int id)
+template <typename T>
+static void swapRemove(vector<T> &values, unsigned int i)
+{
+    values[i] = values.back();
+    values.pop_back();
+}
+
+// Distance at which the attenuated light drops below visible intensity
+static float lightRange(const glm::vec3 &color, const Attenuation &attenuation)
 {
-    for (auto light : lights) {
-        if (light.id == id)
-            return light.light;
+    // Specular is always full white, so the brightest channel is at least 1
+    float intensity = glm::max(glm::max(color.r, color.g), glm::max(color.b, 1.0f));
+
+    // Solve constant + linear*d + quadratic*d^2 = intensity / threshold for d
+    float c = attenuation.constant - intensity / LIGHT_THRESHOLD;
+    float b = attenuation.linear;
+    float a = attenuation.quadratic;
+
+    if (a > 0.0f)
+        return (-b + sqrt(b*b - 4.0f*a*c)) / (2.0f*a);
+    if (b > 0.0f)
+        return -c / b;
+
+    return INFINITY;
+}
+
+LightHandle LightingSystem::allocate(int type, unsigned int index)
+{
+    unsigned int slot;
+
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        if (slots.size() >= MAX_LIGHTS) {
+            cerr << "[LightingSystem] Out of light slots!" << endl;
+            return INVALID_LIGHT;
+        }
+
+        slot = slots.size();
+        slots.push_back(Slot());
+
+        string light = ("light[" + to_string(slot) + "]");
+        SlotUniforms names;
+        names.valid        = light + ".valid";
+        names.baked        = light + ".baked";
+        names.type         = light + ".type";
+        names.position     = light + ".position";
+        names.direction    = light + ".direction";
+        names.inner_cutoff = light + ".inner_cutoff";
+        names.outer_cutoff = light + ".outer_cutoff";
+        names.ambient      = light + ".ambient";
+        names.diffuse      = light + ".diffuse";
+        names.specular     = light + ".specular";
+        names.constant     = light + ".constant";
+        names.linear       = light + ".linear";
+        names.quadratic    = light + ".quadratic";
+        uniforms.push_back(names);
     }
 
-    cerr << "[LightingSystem] ID " << id << " not found!" << endl;
-    return NULL;
+    slots[slot].type = type;
+    slots[slot].index = index;
+    slots[slot].enabled = true;
+    slots[slot].baked = false;
+    layoutVersion++;
+
+    return (slots[slot].generation << LIGHT_SLOT_BITS) | slot;
+}
+
+bool LightingSystem::isValid(LightHandle light) const
+{
+    unsigned int slot = light & LIGHT_SLOT_MASK;
+
+    return slot < slots.size() && slots[slot].type >= 0 &&
+           slots[slot].generation == (light >> LIGHT_SLOT_BITS);
+}
+
+const LightingSystem::Slot *LightingSystem::lookup(LightHandle light) const
+{
+    if (!isValid(light)) {
+        cerr << "[LightingSystem] Handle " << light << " is not a live light!" << endl;
+        return nullptr;
+    }
+
+    return &slots[light & LIGHT_SLOT_MASK];
 }
 
 /*
  *  Spawning Functions
  */
-unsigned int LightingSystem::spawnDirectLight(glm::vec3 color, glm::vec3 direction)
+LightHandle LightingSystem::spawnDirectLight(glm::vec3 color, glm::vec3 direction)
 {
-    LightSource light;
-    
-    light.id = lights.size();
-    light.enabled = true;
-    light.light = make_shared<DirectLight>(color, direction);
+    LightHandle light = allocate(DIRECT_LIGHT, direct.slot.size());
+    if (light == INVALID_LIGHT) return light;
 
-    lights.push_back(light);
-    return light.id;
+    direct.slot.push_back(getSlot(light));
+    direct.color.push_back(color);
+    direct.direction.push_back(direction);
+
+    return light;
 }
 
-unsigned int LightingSystem::spawnPointLight(glm::vec3 color, glm::vec3 position)
+LightHandle LightingSystem::spawnPointLight(glm::vec3 color, glm::vec3 position)
 {
-    LightSource light;
-    
-    light.id = lights.size();
-    light.enabled = true;
-    light.light = make_shared<PointLight>(color, position);
+    LightHandle light = allocate(POINT_LIGHT, point.slot.size());
+    if (light == INVALID_LIGHT) return light;
+
+    point.slot.push_back(getSlot(light));
+    point.color.push_back(color);
+    point.position.push_back(position);
+    point.attenuation.push_back({1.0f, 0.045f, 0.0075f});
 
-    lights.push_back(light);
-    return light.id;
+    return light;
 }
 
-unsigned int LightingSystem::spawnSpotLight(glm::vec3 color, float inner_cutoff,
+LightHandle LightingSystem::spawnSpotLight(glm::vec3 color, float inner_cutoff,
     float outer_cutoff, glm::vec3 position, glm::vec3 direction)
 {
-    LightSource light;
-    
-    light.id = lights.size();
-    light.enabled = true;
-    light.light = make_shared<SpotLight>(color, position, direction, 
-        inner_cutoff, outer_cutoff);
+    LightHandle light = allocate(SPOT_LIGHT, spot.slot.size());
+    if (light == INVALID_LIGHT) return light;
+
+    spot.slot.push_back(getSlot(light));
+    spot.color.push_back(color);
+    spot.position.push_back(position);
+    spot.direction.push_back(direction);
+    spot.attenuation.push_back({1.0f, 0.045f, 0.0075f});
+    spot.inner_cutoff.push_back(inner_cutoff);
+    spot.outer_cutoff.push_back(outer_cutoff);
+    spot.inner_cos.push_back(glm::cos(glm::radians(inner_cutoff)));
+    spot.outer_cos.push_back(glm::cos(glm::radians(outer_cutoff)));
+    spot.view.push_back(glm::mat4(1.0f));
+    spot.spaceMatrix.push_back(glm::mat4(1.0f));
+    spot.aspect.push_back(0.0f);
+    spot.dirty.push_back(true);
+
+    return light;
+}
+
+void LightingSystem::destroyLight(LightHandle light)
+{
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return;
+
+    // Fill the hole with the pool's last light, then point its slot at the new spot
+    unsigned int index = slot->index;
+    unsigned int moved = 0;
+    bool wasLast = false;
+
+    switch (slot->type) {
+        case DIRECT_LIGHT:
+            moved = direct.slot.back();
+            wasLast = (index == direct.slot.size() - 1);
+            swapRemove(direct.slot, index);
+            swapRemove(direct.color, index);
+            swapRemove(direct.direction, index);
+            break;
+
+        case POINT_LIGHT:
+            moved = point.slot.back();
+            wasLast = (index == point.slot.size() - 1);
+            swapRemove(point.slot, index);
+            swapRemove(point.color, index);
+            swapRemove(point.position, index);
+            swapRemove(point.attenuation, index);
+            break;
+
+        case SPOT_LIGHT:
+            moved = spot.slot.back();
+            wasLast = (index == spot.slot.size() - 1);
+            swapRemove(spot.slot, index);
+            swapRemove(spot.color, index);
+            swapRemove(spot.position, index);
+            swapRemove(spot.direction, index);
+            swapRemove(spot.attenuation, index);
+            swapRemove(spot.inner_cutoff, index);
+            swapRemove(spot.outer_cutoff, index);
+            swapRemove(spot.inner_cos, index);
+            swapRemove(spot.outer_cos, index);
+            swapRemove(spot.view, index);
+            swapRemove(spot.spaceMatrix, index);
+            swapRemove(spot.aspect, index);
+            swapRemove(spot.dirty, index);
+            break;
+    }
+
+    if (!wasLast)
+        slots[moved].index = index;
 
-    lights.push_back(light);
-    return light.id;
+    // Bump the generation so outstanding handles to this light go stale
+    unsigned int id = getSlot(light);
+    slots[id].type = -1;
+    slots[id].generation = (slots[id].generation + 1) & LIGHT_SLOT_MASK;
+    freeSlots.push_back(id);
+    layoutVersion++;
 }
 
 /*
  * Setter Functions
  */
-void LightingSystem::setPosition(unsigned int id, glm::vec3 position)
+void LightingSystem::setPosition(LightHandle light, glm::vec3 position)
 {
-    auto light = search(id);
-    
-    if (light == NULL) return;
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return;
 
-    if (auto pointLight = dynamic_pointer_cast<PointLight>(light))
-        pointLight->setPosition(position);
-    if (auto spotLight = dynamic_pointer_cast<SpotLight>(light))
-        spotLight->setPosition(position);
+    if (slot->type == POINT_LIGHT)
+        point.position[slot->index] = position;
+
+    if (slot->type == SPOT_LIGHT) {
+        spot.position[slot->index] = position;
+        spot.dirty[slot->index] = true;
+    }
 }
 
-void LightingSystem::setDirection(unsigned int id, glm::vec3 direction)
+void LightingSystem::setDirection(LightHandle light, glm::vec3 direction)
 {
-    auto light = search(id);
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return;
 
-    if (light == NULL) return;
+    if (slot->type == DIRECT_LIGHT)
+        direct.direction[slot->index] = direction;
 
-    if (auto directLight = dynamic_pointer_cast<DirectLight>(light))
-        directLight->setDirection(direction);
-    if (auto spotLight = dynamic_pointer_cast<SpotLight>(light))
-        spotLight->setDirection(direction);
+    if (slot->type == SPOT_LIGHT) {
+        spot.direction[slot->index] = direction;
+        spot.dirty[slot->index] = true;
+    }
 }
 
-void LightingSystem::setColor(unsigned int id, glm::vec3 color)
+void LightingSystem::setColor(LightHandle light, glm::vec3 color)
 {
-    auto light = search(id);
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return;
 
-    if (light == NULL) return;
+    switch (slot->type) {
+        case DIRECT_LIGHT: direct.color[slot->index] = color; break;
+        case POINT_LIGHT:  point.color[slot->index]  = color; break;
+        case SPOT_LIGHT:   spot.color[slot->index]   = color; break;
+    }
+}
 
-    light->setColor(color);
+void LightingSystem::setAttenuation(LightHandle light, float constant, float linear, float quadratic)
+{
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return;
+
+    Attenuation attenuation = {constant, linear, quadratic};
+    if (slot->type == POINT_LIGHT)
+        point.attenuation[slot->index] = attenuation;
+    if (slot->type == SPOT_LIGHT)
+        spot.attenuation[slot->index] = attenuation;
+}
+
+void LightingSystem::setCutoffs(LightHandle light, float inner, float outer)
+{
+    const Slot *slot = lookup(light);
+    if (slot == nullptr || slot->type != SPOT_LIGHT) return;
+
+    spot.inner_cutoff[slot->index] = inner;
+    spot.outer_cutoff[slot->index] = outer;
+    spot.inner_cos[slot->index] = glm::cos(glm::radians(inner));
+    spot.outer_cos[slot->index] = glm::cos(glm::radians(outer));
+}
+
+void LightingSystem::setEnabled(LightHandle light, bool enabled)
+{
+    if (lookup(light))
+        slots[getSlot(light)].enabled = enabled;
+}
+
+void LightingSystem::setBaked(LightHandle light, bool baked)
+{
+    if (lookup(light))
+        slots[getSlot(light)].baked = baked;
 }
 
 /* 
  * Getter Functions 
  */
-glm::vec3 LightingSystem::getPosition(unsigned int id)
+int LightingSystem::getType(LightHandle light) const
+{
+    const Slot *slot = lookup(light);
+    return slot ? slot->type : -1;
+}
+
+glm::vec3 LightingSystem::getPosition(LightHandle light) const
+{
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return glm::vec3(0.0f);
+
+    if (slot->type == POINT_LIGHT) return point.position[slot->index];
+    if (slot->type == SPOT_LIGHT)  return spot.position[slot->index];
+
+    return glm::vec3(0.0f);
+}
+
+glm::vec3 LightingSystem::getDirection(LightHandle light) const
 {
-    auto light = search(id);
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return glm::vec3(0.0f);
+
+    if (slot->type == DIRECT_LIGHT) return direct.direction[slot->index];
+    if (slot->type == SPOT_LIGHT)   return spot.direction[slot->index];
 
-    if (light == NULL) return glm::vec3(0.0f);
-    
-    if (auto pointLight = dynamic_pointer_cast<PointLight>(light))
-        return pointLight->getPosition();
-    if (auto spotLight = dynamic_pointer_cast<SpotLight>(light))
-        return spotLight->getPosition();
-    
     return glm::vec3(0.0f);
 }
 
-glm::vec3 LightingSystem::getDirection(unsigned int id)
+glm::vec3 LightingSystem::getColor(LightHandle light) const
 {
-    auto light = search(id);
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return glm::vec3(0.0f);
 
-    if (light == NULL) return glm::vec3(0.0f);
-    
-    if (auto directLight = dynamic_pointer_cast<DirectLight>(light))
-        return directLight->getDirection();
-    if (auto spotLight = dynamic_pointer_cast<SpotLight>(light))
-        return spotLight->getDirection();
+    switch (slot->type) {
+        case DIRECT_LIGHT: return direct.color[slot->index];
+        case POINT_LIGHT:  return point.color[slot->index];
+        case SPOT_LIGHT:   return spot.color[slot->index];
+    }
 
     return glm::vec3(0.0f);
 }
 
-glm::mat4 LightingSystem::getSpaceMatrix(unsigned int id, float aspect)
+Attenuation LightingSystem::getAttenuation(LightHandle light) const
+{
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return {1.0f, 0.0f, 0.0f};
+
+    if (slot->type == POINT_LIGHT) return point.attenuation[slot->index];
+    if (slot->type == SPOT_LIGHT)  return spot.attenuation[slot->index];
+
+    return {1.0f, 0.0f, 0.0f};
+}
+
+void LightingSystem::getCutoffs(LightHandle light, float &inner, float &outer) const
+{
+    const Slot *slot = lookup(light);
+    if (slot == nullptr || slot->type != SPOT_LIGHT) {
+        inner = outer = 180.0f;
+        return;
+    }
+
+    inner = spot.inner_cutoff[slot->index];
+    outer = spot.outer_cutoff[slot->index];
+}
+
+bool LightingSystem::isEnabled(LightHandle light) const
 {
-    auto light = search(id);
+    const Slot *slot = lookup(light);
+    return slot && slot->enabled;
+}
+
+bool LightingSystem::isBaked(LightHandle light) const
+{
+    const Slot *slot = lookup(light);
+    return slot && slot->baked;
+}
+
+const glm::mat4 &LightingSystem::getSpaceMatrix(LightHandle light, float aspect)
+{
+    static const glm::mat4 none = glm::mat4(0.0f);
+
+    const Slot *slot = lookup(light);
+    if (slot == nullptr || slot->type != SPOT_LIGHT) return none;
+
+    unsigned int i = slot->index;
+
+    if (spot.dirty[i]) {
+        glm::vec3 front = glm::normalize(spot.direction[i]);
+        glm::vec3 right = glm::normalize(glm::cross(front, glm::vec3(0.0f, 1.0f, 0.0f)));
+        glm::vec3 up    = glm::normalize(glm::cross(right, front));
+        spot.view[i] = glm::lookAt(spot.position[i], spot.position[i] + front, up);
+    }
+
+    if (spot.dirty[i] || spot.aspect[i] != aspect) {
+        glm::mat4 projection = glm::perspective(45.0f, aspect, 0.01f, 100.0f);
+        spot.spaceMatrix[i] = projection * spot.view[i];
+        spot.aspect[i] = aspect;
+        spot.dirty[i] = false;
+    }
+
+    return spot.spaceMatrix[i];
+}
+
+bool LightingSystem::getBounds(LightHandle light, BoundingBox &bb) const
+{
+    const Slot *slot = lookup(light);
+    if (slot == nullptr) return false;
+
+    unsigned int i = slot->index;
+
+    if (slot->type == POINT_LIGHT) {
+        float range = lightRange(point.color[i], point.attenuation[i]);
+        if (isinf(range)) return false;
+
+        bb.min = point.position[i] - glm::vec3(range);
+        bb.max = point.position[i] + glm::vec3(range);
+        return true;
+    }
+
+    if (slot->type == SPOT_LIGHT) {
+        float range = lightRange(spot.color[i], spot.attenuation[i]);
+        if (isinf(range) || spot.outer_cutoff[i] >= 90.0f) return false;
 
-    if (light == NULL) return glm::mat4(0.0f);
+        // Box around the cone's apex and the disk capping it
+        glm::vec3 front = glm::normalize(spot.direction[i]);
+        glm::vec3 base = spot.position[i] + front * range;
+        float radius = range * tan(glm::radians(spot.outer_cutoff[i]));
+        glm::vec3 extent = radius * glm::sqrt((glm::max)(glm::vec3(0.0f), glm::vec3(1.0f) - front*front));
 
-    if (auto spotLight = dynamic_pointer_cast<SpotLight>(light))
-        return spotLight->getProjectionMatrix(aspect) * spotLight->getViewMatrix();
+        bb.min = (glm::min)(spot.position[i], base - extent);
+        bb.max = (glm::max)(spot.position[i], base + extent);
+        return true;
+    }
+
+    return false;
+}
+
+LightHandle LightingSystem::getHandle(unsigned int slot) const
+{
+    if (slot >= slots.size() || slots[slot].type < 0)
+        return INVALID_LIGHT;
 
-    return glm::mat4(0.0f);
+    return (slots[slot].generation << LIGHT_SLOT_BITS) | slot;
 }
 
-glm::vec3 LightingSystem::getColor(unsigned int id)
+string LightingSystem::getTypeList() const
 {
-    auto light = search(id);
+    string types;
 
-    if (light == NULL) return glm::vec3(0.0f);
+    // Free slots are never valid, any type will do
+    for (unsigned int i = 0; i < slots.size(); i++)
+    {
+        if (i > 0) types += ",";
+        types += to_string(slots[i].type >= 0 ? slots[i].type : DIRECT_LIGHT);
+    }
 
-    return light->getColor();
+    return types;
 }
 
 /*
  * Rendering
  */
-void LightingSystem::renderLights(shared_ptr<Program> prog, glm::mat4 view) const
+static void setColorTerms(const shared_ptr<Program> &prog, const string &ambient, const string &diffuse,
+    const string &specular, const glm::vec3 &color)
 {
-    for (unsigned int i = 0; i < lights.size(); i++)
+    prog->setVec3(ambient, color * glm::vec3(0.2f));
+    prog->setVec3(diffuse, color * glm::vec3(1.0f));
+    prog->setVec3(specular, glm::vec3(1.0f, 1.0f, 1.0f));
+}
+
+void LightingSystem::renderLights(shared_ptr<Program> prog, const glm::mat4 &view) const
+{
+    // Directions go through the inverse transpose of the view, positions through the view
+    glm::mat3 normalView = glm::mat3(glm::transpose(glm::inverse(view)));
+
+    for (unsigned int i = 0; i < slots.size(); i++)
     {
-        string light = ("light[" + to_string(i) + "]");
-        glUniform1i(prog->getUniform(light + ".valid"), GL_FALSE);
+        prog->setInt(uniforms[i].valid, slots[i].type >= 0 && slots[i].enabled);
+        prog->setInt(uniforms[i].baked, slots[i].baked);
+    }
 
+    // Walk each pool front to back
+    for (unsigned int i = 0; i < direct.slot.size(); i++)
+    {
+        unsigned int s = direct.slot[i];
+        if (!slots[s].enabled) continue;
 
-        if (lights[i].enabled) {
-            glUniform1i(prog->getUniform(light + ".valid"), GL_TRUE);
+        const SlotUniforms &u = uniforms[s];
+        prog->setInt(u.type, DIRECT_LIGHT);
+        setColorTerms(prog, u.ambient, u.diffuse, u.specular, direct.color[i]);
+        prog->setVec3(u.direction, normalView * direct.direction[i]);
+    }
 
-            // Render light color
-            lights[i].light->activate(i, prog);
+    for (unsigned int i = 0; i < point.slot.size(); i++)
+    {
+        unsigned int s = point.slot[i];
+        if (!slots[s].enabled) continue;
+
+        const SlotUniforms &u = uniforms[s];
+        prog->setInt(u.type, POINT_LIGHT);
+        setColorTerms(prog, u.ambient, u.diffuse, u.specular, point.color[i]);
+        prog->setVec3(u.position, glm::vec3(view * glm::vec4(point.position[i], 1.0f)));
+        prog->setFloat(u.constant, point.attenuation[i].constant);
+        prog->setFloat(u.linear, point.attenuation[i].linear);
+        prog->setFloat(u.quadratic, point.attenuation[i].quadratic);
+    }
 
-            if (auto directLight = dynamic_pointer_cast<DirectLight>(lights[i].light)) {
-                glUniform1i(prog->getUniform(light + ".type"), 0);
-                directLight->activate(i, prog, view);
-            }
+    for (unsigned int i = 0; i < spot.slot.size(); i++)
+    {
+        unsigned int s = spot.slot[i];
+        if (!slots[s].enabled) continue;
+
+        const SlotUniforms &u = uniforms[s];
+        prog->setInt(u.type, SPOT_LIGHT);
+        setColorTerms(prog, u.ambient, u.diffuse, u.specular, spot.color[i]);
+        prog->setVec3(u.position, glm::vec3(view * glm::vec4(spot.position[i], 1.0f)));
+        prog->setVec3(u.direction, normalView * spot.direction[i]);
+        prog->setFloat(u.constant, spot.attenuation[i].constant);
+        prog->setFloat(u.linear, spot.attenuation[i].linear);
+        prog->setFloat(u.quadratic, spot.attenuation[i].quadratic);
+        prog->setFloat(u.inner_cutoff, spot.inner_cos[i]);
+        prog->setFloat(u.outer_cutoff, spot.outer_cos[i]);
+    }
+}
+
+/*
+ * Reactions
+ */
+void LightingSystem::addReaction(LightHandle light, unsigned int input, glm::vec3 color, float floor)
+{
+    reactions.push_back({light, input, color, floor});
+}
 
-            if (auto pointLight = dynamic_pointer_cast<PointLight>(lights[i].light)) {
-                glUniform1i(prog->getUniform(light + ".type"), 1);
-                pointLight->activate(i, prog, view);
-            }
+void LightingSystem::setReactionColor(LightHandle light, glm::vec3 color)
+{
+    for (auto &reaction : reactions)
+        if (reaction.light == light)
+            reaction.color = color;
+}
 
-            if (auto spotLight = dynamic_pointer_cast<SpotLight>(lights[i].light)) {
-                glUniform1i(prog->getUniform(light + ".type"), 2);
-                spotLight->activate(i, prog, view);
-            }
-        }
+void LightingSystem::react(const float *inputs)
+{
+    for (auto &reaction : reactions) {
+        float value = glm::clamp(inputs[reaction.input], 0.0f, 1.0f);
+        setColor(reaction.light, reaction.color * (reaction.floor + (1.0f - reaction.floor) * value));
     }
-}
\ No newline at end of file
+}
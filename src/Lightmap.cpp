@@ -0,0 +1,69 @@
+#include <iostream>
+#include <filesystem>
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "Lightmap.h"
+#include "GLState.h"
+
+using namespace std;
+
+void LightmapSet::load(const string directory)
+{
+    if (!filesystem::is_directory(directory)) {
+        cout << "No lightmaps found in " << directory << ", run with --bake to generate them" << endl;
+        return;
+    }
+
+    for (auto &entry : filesystem::directory_iterator(directory))
+    {
+        if (entry.path().extension().string() != LIGHTMAP_EXTENSION) continue;
+
+        int width, height, nrComponents;
+        float *data = stbi_loadf(entry.path().u8string().c_str(), &width, &height, &nrComponents, 3);
+        if (!data) {
+            cerr << "[LightmapSet] Failed to load " << entry.path() << endl;
+            continue;
+        }
+
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        GLState::bindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        stbi_image_free(data);
+
+        textures[entry.path().stem().u8string()] = texture;
+    }
+
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
+    cout << "Loaded " << textures.size() << " lightmaps from " << directory << endl;
+}
+
+void LightmapSet::bind(shared_ptr<Program> prog, const string &name) const
+{
+    unsigned int lightmapBit = prog->getFeatureBit("LIGHTMAP");
+    if (!lightmapBit) return;
+
+    auto texture = textures.find(name);
+    if (!enabled || texture == textures.end()) {
+        unbind(prog);
+        return;
+    }
+
+    GLState::activeTexture(GL_TEXTURE0 + LIGHTMAP_UNIT);
+    GLState::bindTexture(GL_TEXTURE_2D, texture->second);
+
+    prog->setInt("lightmap", LIGHTMAP_UNIT);
+    prog->setFeatures(prog->getFeatures() | lightmapBit);
+}
+
+void LightmapSet::unbind(shared_ptr<Program> prog) const
+{
+    unsigned int lightmapBit = prog->getFeatureBit("LIGHTMAP");
+    if (lightmapBit)
+        prog->setFeatures(prog->getFeatures() & ~lightmapBit);
+}
@@ -0,0 +1,529 @@
+#include <cmath>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <filesystem>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <stb_image_write.h>
+
+#include "Lightmapper.h"
+#include "Lightmap.h"
+#include "common.h"
+
+using namespace std;
+
+/*
+ * Scene setup
+ */
+void Lightmapper::addLights(const LightingSystem &lightingSystem)
+{
+    for (unsigned int slot = 0; slot < lightingSystem.getSlotCount(); slot++) {
+        LightHandle light = lightingSystem.getHandle(slot);
+        if (light == INVALID_LIGHT || !lightingSystem.isBaked(light))
+            continue;
+
+        // The shaders count channels over the same baked slots, disabled or not, and light the rest live
+        if (lights.size() == LIGHTMAP_CHANNELS) {
+            cerr << "[Lightmapper] Only " << LIGHTMAP_CHANNELS << " lights can be baked, slot " << slot
+                 << " stays dynamic" << endl;
+            continue;
+        }
+
+        BakeLight bakeLight;
+
+        // Same terms the shaders use, see LightingSystem::renderLights
+        bakeLight.type = lightingSystem.getType(light);
+        bakeLight.channel = lights.size();
+        bakeLight.position = glm::vec3(0.0f);
+        bakeLight.direction = glm::vec3(0.0f, -1.0f, 0.0f);
+        bakeLight.attenuation = {1.0f, 0.0f, 0.0f};
+        bakeLight.inner_cutoff = -1.0f;
+        bakeLight.outer_cutoff = -1.0f;
+
+        if (bakeLight.type != POINT_LIGHT)
+            bakeLight.direction = glm::normalize(lightingSystem.getDirection(light));
+
+        if (bakeLight.type != DIRECT_LIGHT) {
+            bakeLight.position = lightingSystem.getPosition(light);
+            bakeLight.attenuation = lightingSystem.getAttenuation(light);
+        }
+
+        if (bakeLight.type == SPOT_LIGHT) {
+            float inner, outer;
+            lightingSystem.getCutoffs(light, inner, outer);
+            bakeLight.inner_cutoff = cos(glm::radians(inner));
+            bakeLight.outer_cutoff = cos(glm::radians(outer));
+        }
+
+        lights.push_back(bakeLight);
+    }
+}
+
+void Lightmapper::addModel(const string name, const Model &model, const glm::mat4 &M)
+{
+    if (model.lightmapSize == 0) {
+        cerr << "[Lightmapper] " << name << " has no lightmap UVs, skipping" << endl;
+        return;
+    }
+
+    Instance instance;
+    instance.name = name;
+    instance.size = model.lightmapSize;
+
+    unsigned int first = triangles.size();
+    for (auto &mesh : model.meshes)
+    {
+        // Bounced light takes on the average color of the diffuse map
+        glm::vec3 albedo = mesh.material.diffuse;
+        for (auto &texture : mesh.textures) {
+            if (texture.type == "texture_diffuse") {
+                albedo = AverageColorFromFile(texture.path.c_str(), model.directory);
+                break;
+            }
+        }
+
+        addTriangles(instance, mesh.vertices, mesh.indices, M, albedo);
+    }
+
+    rasterize(instance, first);
+    instances.push_back(instance);
+}
+
+void Lightmapper::addPlane(const string name, const Plane &plane, const glm::vec3 &albedo)
+{
+    Instance instance;
+    instance.name = name;
+    instance.size = plane.lightmapSize;
+
+    vector<unsigned int> indices;
+    for (unsigned int i = 0; i < plane.vertices.size(); i++)
+        indices.push_back(i);
+
+    unsigned int first = triangles.size();
+    addTriangles(instance, plane.vertices, indices, plane.M, albedo);
+
+    rasterize(instance, first);
+    instances.push_back(instance);
+}
+
+void Lightmapper::addTriangles(Instance &instance, const vector<Vertex> &vertices,
+    const vector<unsigned int> &indices, const glm::mat4 &M, const glm::vec3 &albedo)
+{
+    glm::mat3 N = glm::transpose(glm::inverse(glm::mat3(M)));
+
+    for (unsigned int i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const Vertex &v0 = vertices[indices[i]];
+        const Vertex &v1 = vertices[indices[i + 1]];
+        const Vertex &v2 = vertices[indices[i + 2]];
+
+        glm::vec3 p0 = glm::vec3(M * glm::vec4(v0.Position, 1.0f));
+        glm::vec3 p1 = glm::vec3(M * glm::vec4(v1.Position, 1.0f));
+        glm::vec3 p2 = glm::vec3(M * glm::vec4(v2.Position, 1.0f));
+
+        Triangle triangle;
+        triangle.p0 = p0;
+        triangle.e1 = p1 - p0;
+        triangle.e2 = p2 - p0;
+        triangle.n0 = glm::normalize(N * v0.Normal);
+        triangle.n1 = glm::normalize(N * v1.Normal);
+        triangle.n2 = glm::normalize(N * v2.Normal);
+        triangle.uv0 = v0.LightmapCoords;
+        triangle.uv1 = v1.LightmapCoords;
+        triangle.uv2 = v2.LightmapCoords;
+        triangle.albedo = albedo;
+        triangles.push_back(triangle);
+    }
+}
+
+// Finds the triangle and barycentric coords behind every texel center
+void Lightmapper::rasterize(Instance &instance, unsigned int first)
+{
+    unsigned int size = instance.size;
+    instance.texels.assign(size * size, Texel());
+    instance.lightmap.assign(size * size, glm::vec3(0.0f));
+
+    for (unsigned int i = first; i < triangles.size(); i++)
+    {
+        const Triangle &triangle = triangles[i];
+        glm::vec2 a = triangle.uv0 * (float) size;
+        glm::vec2 b = triangle.uv1 * (float) size;
+        glm::vec2 c = triangle.uv2 * (float) size;
+
+        glm::vec2 ab = b - a;
+        glm::vec2 ac = c - a;
+        float area = ab.x * ac.y - ac.x * ab.y;
+        if (fabs(area) < 1e-8f) continue;
+
+        int x0 = (glm::max)(0, (int) floor((glm::min)((glm::min)(a.x, b.x), c.x)));
+        int y0 = (glm::max)(0, (int) floor((glm::min)((glm::min)(a.y, b.y), c.y)));
+        int x1 = (glm::min)((int) size - 1, (int) ceil((glm::max)((glm::max)(a.x, b.x), c.x)));
+        int y1 = (glm::min)((int) size - 1, (int) ceil((glm::max)((glm::max)(a.y, b.y), c.y)));
+
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                glm::vec2 ap = glm::vec2(x + 0.5f, y + 0.5f) - a;
+                float b1 = (ap.x * ac.y - ac.x * ap.y) / area;
+                float b2 = (ab.x * ap.y - ap.x * ab.y) / area;
+                if (b1 < 0.0f || b2 < 0.0f || b1 + b2 > 1.0f) continue;
+
+                Texel &texel = instance.texels[y * size + x];
+                texel.triangle = i;
+                texel.barycentric = glm::vec2(b1, b2);
+            }
+        }
+    }
+}
+
+/*
+ * Ray tracing
+ */
+void Lightmapper::buildBVH()
+{
+    vector<glm::vec3> centroids(triangles.size());
+    order.resize(triangles.size());
+
+    for (unsigned int i = 0; i < triangles.size(); i++) {
+        const Triangle &t = triangles[i];
+        centroids[i] = t.p0 + (t.e1 + t.e2) / 3.0f;
+        order[i] = i;
+    }
+
+    nodes.clear();
+    nodes.reserve(2 * triangles.size() / LIGHTMAP_BVH_LEAF_SIZE + 1);
+    if (!triangles.empty())
+        buildNode(0, triangles.size(), centroids);
+}
+
+// Median split along the longest axis of the centroids
+unsigned int Lightmapper::buildNode(unsigned int start, unsigned int count, const vector<glm::vec3> &centroids)
+{
+    unsigned int index = nodes.size();
+    nodes.push_back(Node());
+
+    glm::vec3 min = glm::vec3(INFINITY), max = glm::vec3(-INFINITY);
+    glm::vec3 cmin = glm::vec3(INFINITY), cmax = glm::vec3(-INFINITY);
+    for (unsigned int i = start; i < start + count; i++) {
+        const Triangle &t = triangles[order[i]];
+        glm::vec3 p1 = t.p0 + t.e1, p2 = t.p0 + t.e2;
+        min = (glm::min)((glm::min)(min, t.p0), (glm::min)(p1, p2));
+        max = (glm::max)((glm::max)(max, t.p0), (glm::max)(p1, p2));
+        cmin = (glm::min)(cmin, centroids[order[i]]);
+        cmax = (glm::max)(cmax, centroids[order[i]]);
+    }
+
+    nodes[index].min = min;
+    nodes[index].max = max;
+
+    if (count <= LIGHTMAP_BVH_LEAF_SIZE) {
+        nodes[index].start = start;
+        nodes[index].count = count;
+        return index;
+    }
+
+    glm::vec3 extent = cmax - cmin;
+    int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+
+    unsigned int half = count / 2;
+    nth_element(order.begin() + start, order.begin() + start + half, order.begin() + start + count,
+        [&](unsigned int a, unsigned int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    buildNode(start, half, centroids);
+    unsigned int right = buildNode(start + half, count - half, centroids);
+
+    nodes[index].start = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+static bool intersectBox(const glm::vec3 &min, const glm::vec3 &max, const glm::vec3 &origin,
+    const glm::vec3 &invDir, float maxT)
+{
+    float tmin = 0.0f, tmax = maxT;
+    for (int axis = 0; axis < 3; axis++) {
+        float t0 = (min[axis] - origin[axis]) * invDir[axis];
+        float t1 = (max[axis] - origin[axis]) * invDir[axis];
+        if (t0 > t1) swap(t0, t1);
+        tmin = (glm::max)(tmin, t0);
+        tmax = (glm::min)(tmax, t1);
+        if (tmin > tmax) return false;
+    }
+    return true;
+}
+
+bool Lightmapper::trace(const glm::vec3 &origin, const glm::vec3 &dir, float maxT, bool anyHit, Hit &hit) const
+{
+    if (nodes.empty()) return false;
+
+    glm::vec3 invDir = glm::vec3(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+    bool found = false;
+    hit.t = maxT;
+
+    unsigned int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        unsigned int index = stack[--top];
+        const Node &node = nodes[index];
+        if (!intersectBox(node.min, node.max, origin, invDir, hit.t)) continue;
+
+        if (node.count == 0) {
+            stack[top++] = node.start;
+            stack[top++] = index + 1;
+            continue;
+        }
+
+        // Moller-Trumbore against each triangle of the leaf
+        for (unsigned int i = node.start; i < node.start + node.count; i++) {
+            const Triangle &t = triangles[order[i]];
+
+            glm::vec3 pvec = glm::cross(dir, t.e2);
+            float det = glm::dot(t.e1, pvec);
+            if (fabs(det) < 1e-12f) continue;
+
+            float invDet = 1.0f / det;
+            glm::vec3 tvec = origin - t.p0;
+            float b1 = glm::dot(tvec, pvec) * invDet;
+            if (b1 < 0.0f || b1 > 1.0f) continue;
+
+            glm::vec3 qvec = glm::cross(tvec, t.e1);
+            float b2 = glm::dot(dir, qvec) * invDet;
+            if (b2 < 0.0f || b1 + b2 > 1.0f) continue;
+
+            float d = glm::dot(t.e2, qvec) * invDet;
+            if (d <= 0.0f || d >= hit.t) continue;
+
+            hit.t = d;
+            hit.triangle = order[i];
+            hit.b1 = b1;
+            hit.b2 = b2;
+            found = true;
+
+            if (anyHit) return true;
+        }
+    }
+
+    return found;
+}
+
+/*
+ * Lighting
+ */
+glm::vec3 Lightmapper::directLight(const glm::vec3 &p, const glm::vec3 &n) const
+{
+    glm::vec3 result = glm::vec3(0.0f);
+    glm::vec3 origin = p + n * LIGHTMAP_RAY_EPSILON;
+
+    for (auto &light : lights)
+    {
+        glm::vec3 lightDir;
+        float distance = INFINITY;
+        float attenuation = 1.0f;
+
+        if (light.type == DIRECT_LIGHT) {
+            lightDir = -light.direction;
+        } else {
+            glm::vec3 toLight = light.position - p;
+            distance = glm::length(toLight);
+            lightDir = toLight / distance;
+            attenuation = 1.0f / (light.attenuation.constant + light.attenuation.linear * distance +
+                                  light.attenuation.quadratic * distance * distance);
+        }
+
+        float diff = glm::dot(n, lightDir);
+        if (diff <= 0.0f) continue;
+
+        float intensity = 1.0f;
+        if (light.type == SPOT_LIGHT) {
+            float theta = glm::dot(lightDir, -light.direction);
+            intensity = glm::clamp((theta - light.outer_cutoff) / (light.inner_cutoff - light.outer_cutoff), 0.0f, 1.0f);
+            if (intensity <= 0.0f) continue;
+        }
+
+        Hit hit;
+        if (trace(origin, lightDir, distance, true, hit)) continue;
+
+        result[light.channel] += diff * attenuation * intensity;
+    }
+
+    return result;
+}
+
+glm::vec3 Lightmapper::bakeTexel(const Texel &texel, unsigned int seed) const
+{
+    const Triangle &t = triangles[texel.triangle];
+    float b1 = texel.barycentric.x, b2 = texel.barycentric.y;
+
+    glm::vec3 p = t.p0 + t.e1 * b1 + t.e2 * b2;
+    glm::vec3 n = glm::normalize(t.n0 * (1.0f - b1 - b2) + t.n1 * b1 + t.n2 * b2);
+
+    glm::vec3 result = directLight(p, n);
+    if (samples == 0) return result;
+
+    // Tangent frame for sampling the hemisphere around the normal
+    glm::vec3 tangent = glm::normalize(glm::cross(n, fabs(n.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+    glm::vec3 bitangent = glm::cross(n, tangent);
+
+    minstd_rand rng(seed);
+    uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+    // Cosine weighted, so each sample's weight is just albedo * irradiance
+    glm::vec3 origin = p + n * LIGHTMAP_RAY_EPSILON;
+    glm::vec3 indirect = glm::vec3(0.0f);
+    for (unsigned int s = 0; s < samples; s++)
+    {
+        float phi = glm::two_pi<float>() * uniform(rng);
+        float r2 = uniform(rng);
+        float r = sqrt(r2);
+        glm::vec3 dir = tangent * (r * cos(phi)) + bitangent * (r * sin(phi)) + n * sqrt(1.0f - r2);
+
+        Hit hit;
+        if (!trace(origin, dir, INFINITY, false, hit)) continue;
+
+        const Triangle &h = triangles[hit.triangle];
+        glm::vec3 hitPos = origin + dir * hit.t;
+        glm::vec3 hitNor = glm::normalize(h.n0 * (1.0f - hit.b1 - hit.b2) + h.n1 * hit.b1 + h.n2 * hit.b2);
+        if (glm::dot(hitNor, dir) > 0.0f)
+            hitNor = -hitNor;
+
+        indirect += glm::dot(h.albedo, glm::vec3(0.2126f, 0.7152f, 0.0722f)) * directLight(hitPos, hitNor);
+    }
+
+    return result + indirect / (float) samples;
+}
+
+// Spreads baked texels into uncovered neighbors so filtering at chart edges stays clean
+void Lightmapper::dilate(Instance &instance) const
+{
+    int size = instance.size;
+    vector<bool> covered(size * size);
+    for (int i = 0; i < size * size; i++)
+        covered[i] = instance.texels[i].triangle >= 0;
+
+    for (int pass = 0; pass < LIGHTMAP_DILATE_PASSES; pass++)
+    {
+        vector<bool> next = covered;
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                if (covered[y * size + x]) continue;
+
+                glm::vec3 sum = glm::vec3(0.0f);
+                int count = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= size || ny >= size) continue;
+                        if (!covered[ny * size + nx]) continue;
+                        sum += instance.lightmap[ny * size + nx];
+                        count++;
+                    }
+                }
+
+                if (count > 0) {
+                    instance.lightmap[y * size + x] = sum / (float) count;
+                    next[y * size + x] = true;
+                }
+            }
+        }
+        covered = next;
+    }
+}
+
+/*
+ * Baking
+ */
+void Lightmapper::bake()
+{
+    auto start = chrono::steady_clock::now();
+
+    buildBVH();
+    cout << "[Lightmapper] " << triangles.size() << " triangles, " << nodes.size() << " BVH nodes, "
+         << lights.size() << " static lights" << endl;
+
+    // One job per texel row across every instance
+    vector<pair<unsigned int, unsigned int>> rows;
+    for (unsigned int i = 0; i < instances.size(); i++) {
+        for (unsigned int y = 0; y < instances[i].size; y++)
+            rows.push_back(make_pair(i, y));
+    }
+
+    unsigned int numThreads = threads ? threads : thread::hardware_concurrency();
+    if (numThreads == 0) numThreads = 1;
+
+    atomic<unsigned int> nextRow(0);
+    atomic<unsigned int> rowsDone(0);
+    atomic<unsigned long> texelsBaked(0);
+
+    auto worker = [&]() {
+        unsigned long baked = 0;
+        unsigned int row;
+        while ((row = nextRow++) < rows.size())
+        {
+            Instance &instance = instances[rows[row].first];
+            unsigned int y = rows[row].second;
+
+            for (unsigned int x = 0; x < instance.size; x++) {
+                unsigned int index = y * instance.size + x;
+                const Texel &texel = instance.texels[index];
+                if (texel.triangle < 0) continue;
+
+                instance.lightmap[index] = bakeTexel(texel, rows[row].first * 7919u + index * 2654435761u + 1u);
+                baked++;
+            }
+            rowsDone++;
+        }
+        texelsBaked += baked;
+    };
+
+    cout << "[Lightmapper] Baking " << instances.size() << " lightmaps on " << numThreads << " threads, "
+         << samples << " bounce samples per texel" << endl;
+
+    vector<thread> workers;
+    for (unsigned int i = 0; i < numThreads; i++)
+        workers.push_back(thread(worker));
+
+    // Report progress while the workers run
+    unsigned int lastPercent = 0;
+    while (rowsDone < rows.size()) {
+        this_thread::sleep_for(chrono::milliseconds(500));
+        unsigned int percent = (unsigned int) (100.0 * rowsDone / rows.size());
+        if (percent >= lastPercent + 10) {
+            cout << "[Lightmapper] " << percent << "%" << endl;
+            lastPercent = percent - percent % 10;
+        }
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+
+    for (auto &instance : instances)
+        dilate(instance);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "[Lightmapper] Baked " << texelsBaked << " texels in " << seconds << " s ("
+         << texelsBaked / seconds / numThreads << " texels/s per thread)" << endl;
+}
+
+bool Lightmapper::save(const string directory) const
+{
+    filesystem::create_directories(directory);
+
+    bool success = true;
+    for (auto &instance : instances)
+    {
+        string path = directory + "/" + instance.name + LIGHTMAP_EXTENSION;
+        if (!stbi_write_hdr(path.c_str(), instance.size, instance.size, 3, &instance.lightmap[0].x)) {
+            cerr << "[Lightmapper] Failed to write " << path << endl;
+            success = false;
+        }
+    }
+
+    cout << "[Lightmapper] Wrote " << instances.size() << " lightmaps to " << directory << endl;
+    return success;
+}
@@ -4,17 +4,21 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "Mesh.h"
+#include "GLState.h"
 
 using namespace std;
 
-Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Material material)
+Mesh::Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, Material material,
+    bool upload)
 {
     this->vertices = vertices;
     this->indices = indices;
     this->textures = textures;
     this->material = material;
+    measure();
 
-    setupMesh();
+    if (upload)
+        setupMesh();
 }
 
 void Mesh::setupMesh()
@@ -24,7 +28,7 @@ void Mesh::setupMesh()
     glGenBuffers(1, &VBO);
     glGenBuffers(1, &EBO);
 
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
 
     // Setup array of structs (AoS)
     // Each Vertex struct has positions, normals, and texture coordinates
@@ -47,42 +51,52 @@ void Mesh::setupMesh()
     glEnableVertexAttribArray(2);   // vertex texture coords at location 2
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
 
-    glBindVertexArray(0);
+    glEnableVertexAttribArray(3);   // lightmap coords at location 3
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapCoords));
+
+    GLState::bindVertexArray(0);
 }
 
 void Mesh::setMaterials(const shared_ptr<Program> prog) const
 {
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
+
+    // Pick the shader variant matching this mesh's textures
+    unsigned int diffuseBit  = prog->getFeatureBit("TEXTURE_DIFFUSE");
+    unsigned int specularBit = prog->getFeatureBit("TEXTURE_SPECULAR");
+    unsigned int features = prog->getFeatures() & ~(diffuseBit | specularBit);
+
+    for (auto &texture : textures)
+    {
+        if (texture.type == "texture_diffuse")
+            features |= diffuseBit;
+        else if (texture.type == "texture_specular")
+            features |= specularBit;
+    }
+    prog->setFeatures(features);
+
+    // Basic object material, used by the variants without texture maps
+    prog->setVec3("material.diffuse", material.diffuse);
+    prog->setVec3("material.specular", material.specular);
+    prog->setFloat("material.shininess", material.shininess);
     
-    // By default, disable textures and use basic object material
-    glUniform1i(prog->getUniform("material.texture_diffuse_enable"), 0);
-    glUniform1i(prog->getUniform("material.texture_specular_enable"), 0);
-    glUniform3fv(prog->getUniform("material.diffuse"), 1, value_ptr(material.diffuse));
-    glUniform3fv(prog->getUniform("material.specular"), 1, value_ptr(material.specular));
-    glUniform1f(prog->getUniform("material.shininess"), material.shininess);
-    
-    // If the mesh has diffuse and specular maps, use them instead
+    // If the mesh has diffuse and specular maps, bind them
     if (textures.size() > 0) {
         for (unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i);
+            GLState::activeTexture(GL_TEXTURE0 + i);
             string number;
             string name = textures[i].type;
 
-            if (name == "texture_diffuse") {
-                glUniform1i(prog->getUniform("material.texture_diffuse_enable"), 1);
+            if (name == "texture_diffuse")
                 number = to_string(diffuseNr++);
-            }
-            else if (name == "texture_specular") {
-                glUniform1i(prog->getUniform("material.texture_specular_enable"), 1);
+            else if (name == "texture_specular")
                 number = to_string(specularNr++);
-            }
             
-            glUniform1i(prog->getUniform(("material." + name + number).c_str()), i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            prog->setInt("material." + name + number, i);
+            GLState::bindTexture(GL_TEXTURE_2D, textures[i].id);
         }
-        glActiveTexture(GL_TEXTURE0);
     }
 }
 
@@ -92,33 +106,21 @@ void Mesh::Draw(const shared_ptr<Program> prog, bool drawMaterials) const
     if (drawMaterials)
         setMaterials(prog);
     
-    // draw mesh
-    glBindVertexArray(VAO);
+    // draw mesh, the VAO stays bound so repeated draws of it skip the bind
+    GLState::bindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
 }
 
 void Mesh::measure()
 {
     // Determine bounding box for mesh
+    bb = Bounds::empty();
     for (auto &vertex : vertices)
     {
         bb.min = (glm::min)(vertex.Position, bb.min);
         bb.max = (glm::max)(vertex.Position, bb.max);
     }
-}
-
-void Mesh::measure(glm::mat4 M)
-{
-    bb.min = glm::vec3(INFINITY);
-    bb.max = glm::vec3(-INFINITY);
-
-    for (auto &vertex : vertices)
-    {
-        glm::vec3 newVertexPos = glm::vec3(M * glm::vec4(vertex.Position, 1.0f));
-        bb.min = (glm::min)(newVertexPos, bb.min);
-        bb.max = (glm::max)(newVertexPos, bb.max);
-    }
+    sphere = Bounds::sphereOf(bb);
 }
 
 glm::vec3 Mesh::moveToZero()
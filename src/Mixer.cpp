@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MIXER_SSE
+#endif
+
+#include "Mixer.h"
+#include "Reverb.h"
+
+// Zero frames after every sample, so interpolation and 4-wide loads never read past the end
+#define SAMPLE_PADDING 4
+
+// Whole-frame playback at the mix rate, mono is spread to both channels
+static void copyFrames(const float *data, unsigned int channels, unsigned int first, float *out, unsigned int count)
+{
+    const float *in = data + first * channels;
+    if (channels == 2) {
+        memcpy(out, in, count * 2 * sizeof(float));
+        return;
+    }
+
+    unsigned int i = 0;
+#ifdef MIXER_SSE
+    for (; i + 4 <= count; i += 4) {
+        __m128 s = _mm_loadu_ps(in + i);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(s, s));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(s, s));
+    }
+#endif
+    for (; i < count; i++)
+        out[2 * i] = out[2 * i + 1] = in[i];
+}
+
+// Linear interpolation at position + i * step; the loads are gathered, the blend is four frames at a time
+static void resampleFrames(const float *data, unsigned int channels, double position, double step,
+    float *out, unsigned int count)
+{
+    unsigned int right = channels - 1;
+    unsigned int i = 0;
+#ifdef MIXER_SSE
+    for (; i + 4 <= count; i += 4) {
+        alignas(16) float a[2][4], b[2][4], f[4];
+        for (unsigned int k = 0; k < 4; k++) {
+            double p = position + (i + k) * step;
+            unsigned int index = (unsigned int)p;
+            const float *frame = data + index * channels;
+            f[k] = (float)(p - index);
+            a[0][k] = frame[0];
+            a[1][k] = frame[right];
+            b[0][k] = frame[channels];
+            b[1][k] = frame[channels + right];
+        }
+
+        __m128 frac = _mm_load_ps(f);
+        __m128 l = _mm_load_ps(a[0]);
+        __m128 r = _mm_load_ps(a[1]);
+        l = _mm_add_ps(l, _mm_mul_ps(frac, _mm_sub_ps(_mm_load_ps(b[0]), l)));
+        r = _mm_add_ps(r, _mm_mul_ps(frac, _mm_sub_ps(_mm_load_ps(b[1]), r)));
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(l, r));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(l, r));
+    }
+#endif
+    for (; i < count; i++) {
+        double p = position + i * step;
+        unsigned int index = (unsigned int)p;
+        const float *frame = data + index * channels;
+        float f = (float)(p - index);
+        out[2 * i]     = frame[0] + f * (frame[channels] - frame[0]);
+        out[2 * i + 1] = frame[right] + f * (frame[channels + right] - frame[right]);
+    }
+}
+
+// out += in * (gainL, gainR), both interleaved stereo
+static void accumulate(float *out, const float *in, float gainL, float gainR, unsigned int frames)
+{
+    unsigned int n = frames * 2;
+    unsigned int i = 0;
+#ifdef MIXER_SSE
+    __m128 gain = _mm_setr_ps(gainL, gainR, gainL, gainR);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(out + i), _mm_mul_ps(_mm_loadu_ps(in + i), gain)));
+#endif
+    for (; i < n; i += 2) {
+        out[i]     += in[i] * gainL;
+        out[i + 1] += in[i + 1] * gainR;
+    }
+}
+
+// Clipped to [-1, 1] and scaled to 16 bit
+static void toInt16(const float *in, int16_t *out, unsigned int count)
+{
+    unsigned int i = 0;
+#ifdef MIXER_SSE
+    __m128 lo = _mm_set1_ps(-1.0f);
+    __m128 hi = _mm_set1_ps(1.0f);
+    __m128 scale = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= count; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), lo), hi), scale);
+        __m128 b = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), lo), hi), scale);
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+#endif
+    for (; i < count; i++)
+        out[i] = (int16_t)lrintf(min(max(in[i], -1.0f), 1.0f) * 32767.0f);
+}
+
+Mixer::Mixer()
+{
+    for (unsigned int b = 0; b < MIXER_BUS_COUNT; b++) {
+        busGains[b] = 1.0f;
+        busPaused[b] = false;
+        reverbSends[b] = 0.0f;
+    }
+}
+
+Mixer::~Mixer()
+{
+    stop();
+}
+
+unsigned int Mixer::addSample(const vector<float> &frames, unsigned int channels, unsigned int sampleRate)
+{
+    unsigned int id = sampleCount.load(memory_order_relaxed);
+    if (id >= MIXER_MAX_SAMPLES || channels < 1 || channels > 2) {
+        cerr << "[Mixer] Can't add sample" << endl;
+        return 0;
+    }
+
+    Sample &sample = samples[id];
+    sample.channels = channels;
+    sample.frames = frames.size() / channels;
+    sample.rate = (double)sampleRate / MIXER_SAMPLE_RATE;
+    sample.data.assign(frames.begin(), frames.begin() + sample.frames * channels);
+    sample.data.resize(sample.data.size() + SAMPLE_PADDING * channels, 0.0f);
+
+    // Published to the mixer thread only once it is filled in
+    sampleCount.store(id + 1, memory_order_release);
+    return id;
+}
+
+bool Mixer::play(unsigned int sample, float gain, float pan, float pitch, int priority, unsigned int bus, bool loop)
+{
+    return commands.push({MIXER_PLAY, sample, bus, gain, pan, pitch, priority, loop});
+}
+
+void Mixer::stopAll()
+{
+    commands.push({MIXER_STOP_ALL, 0, 0, 0.0f, 0.0f, 1.0f, 0, false});
+}
+
+void Mixer::setBusGain(unsigned int bus, float gain)
+{
+    if (bus < MIXER_BUS_COUNT)
+        busGains[bus] = gain;
+}
+
+void Mixer::pauseBus(unsigned int bus, bool paused)
+{
+    if (bus < MIXER_BUS_COUNT)
+        busPaused[bus] = paused;
+}
+
+void Mixer::setReverbSend(unsigned int bus, float send)
+{
+    if (bus < MIXER_BUS_COUNT)
+        reverbSends[bus] = send;
+}
+
+void Mixer::applyCommands()
+{
+    MixerCommand command;
+    while (commands.pop(command))
+    {
+        switch (command.type) {
+            case MIXER_PLAY:
+                startVoice(command);
+                break;
+            case MIXER_STOP_ALL:
+                for (auto &voice : voices)
+                    voice.active = false;
+                break;
+        }
+    }
+}
+
+void Mixer::startAt(unsigned int offset, unsigned int sample, float gain, float pan, float pitch, int priority,
+    unsigned int bus)
+{
+    startVoice({MIXER_PLAY, sample, bus, gain, pan, pitch, priority, false}, offset);
+}
+
+void Mixer::startVoice(const MixerCommand &command, unsigned int delay)
+{
+    if (command.sample >= sampleCount.load(memory_order_acquire) || command.bus >= MIXER_BUS_COUNT)
+        return;
+
+    // A free voice, otherwise the least important and oldest, never one above our priority
+    int chosen = -1;
+    int victim = 0;
+    for (int i = 0; i < MIXER_MAX_VOICES; i++) {
+        if (!voices[i].active) {
+            chosen = i;
+            break;
+        }
+
+        const Voice &v = voices[i];
+        const Voice &best = voices[victim];
+        if (v.priority < best.priority || (v.priority == best.priority && v.started < best.started))
+            victim = i;
+    }
+
+    if (chosen < 0) {
+        if (voices[victim].priority > command.priority) {
+            voicesDropped++;
+            return;
+        }
+        voicesStolen++;
+        chosen = victim;
+    }
+
+    // Constant power pan
+    float pan = min(max(command.pan, -1.0f), 1.0f);
+    float angle = (pan + 1.0f) * 0.25f * 3.14159265f;
+
+    Voice &voice = voices[chosen];
+    voice.active = true;
+    voice.sample = command.sample;
+    voice.bus = command.bus;
+    voice.position = 0.0;
+    voice.step = samples[command.sample].rate * max(command.pitch, 0.01f);
+    voice.gainL = command.gain * cosf(angle);
+    voice.gainR = command.gain * sinf(angle);
+    voice.priority = command.priority;
+    voice.started = ++voiceClock;
+    voice.loop = command.loop;
+    voice.delay = delay;
+}
+
+// Resamples the voice's next frames into voiceBlock, fewer than asked once it ends
+unsigned int Mixer::fetch(Voice &voice, unsigned int frames)
+{
+    const Sample &sample = samples[voice.sample];
+    unsigned int produced = 0;
+
+    while (produced < frames)
+    {
+        if (voice.position >= sample.frames) {
+            if (!voice.loop || sample.frames == 0) {
+                voice.active = false;
+                break;
+            }
+            voice.position = fmod(voice.position, (double)sample.frames);
+        }
+
+        // Output frames until this voice runs off the end of the sample
+        double left = ceil((sample.frames - voice.position) / voice.step);
+        unsigned int count = (unsigned int)min(left, (double)(frames - produced));
+
+        float *out = voiceBlock + 2 * produced;
+        if (voice.step == 1.0 && voice.position == floor(voice.position))
+            copyFrames(sample.data.data(), sample.channels, (unsigned int)voice.position, out, count);
+        else
+            resampleFrames(sample.data.data(), sample.channels, voice.position, voice.step, out, count);
+
+        voice.position += count * voice.step;
+        produced += count;
+    }
+
+    return produced;
+}
+
+void Mixer::mixBlock(float *out, unsigned int frames)
+{
+    uint64_t blockStart = framesMixed.load(memory_order_relaxed);
+    MixerScheduler *scheduler = this->scheduler.load(memory_order_acquire);
+    if (scheduler)
+        scheduler->schedule(*this, blockStart, frames);
+
+    for (auto &bus : busBlocks)
+        memset(bus, 0, frames * 2 * sizeof(float));
+
+    bool paused[MIXER_BUS_COUNT];
+    for (unsigned int b = 0; b < MIXER_BUS_COUNT; b++)
+        paused[b] = busPaused[b].load(memory_order_relaxed);
+
+    unsigned int active = 0;
+    for (auto &voice : voices)
+    {
+        if (!voice.active) continue;
+        if (paused[voice.bus]) {
+            active++;
+            continue;
+        }
+
+        // Scheduled voices start part way into the block
+        unsigned int delay = min(voice.delay, frames);
+        voice.delay = 0;
+
+        unsigned int count = fetch(voice, frames - delay);
+        accumulate(busBlocks[voice.bus] + 2 * delay, voiceBlock, voice.gainL, voice.gainR, count);
+        if (voice.active)
+            active++;
+    }
+    activeVoices.store(active, memory_order_relaxed);
+
+    MixerInstrument *instrument = this->instrument.load(memory_order_acquire);
+    if (instrument && !paused[MIXER_BUS_INSTRUMENT])
+        instrument->render(busBlocks[MIXER_BUS_INSTRUMENT], frames);
+
+    memset(out, 0, frames * 2 * sizeof(float));
+    for (unsigned int b = 0; b < MIXER_BUS_COUNT; b++) {
+        float gain = busGains[b].load(memory_order_relaxed);
+        accumulate(out, busBlocks[b], gain, gain, frames);
+    }
+
+    // The reverb hears a mono sum of every bus after its gain, scaled by its send
+    Reverb *reverb = this->reverb.load(memory_order_acquire);
+    if (reverb) {
+        memset(sendBlock, 0, frames * sizeof(float));
+        for (unsigned int b = 0; b < MIXER_BUS_COUNT; b++) {
+            float send = 0.5f * reverbSends[b].load(memory_order_relaxed) * busGains[b].load(memory_order_relaxed);
+            if (send == 0.0f) continue;
+            for (unsigned int i = 0; i < frames; i++)
+                sendBlock[i] += send * (busBlocks[b][2 * i] + busBlocks[b][2 * i + 1]);
+        }
+        reverb->process(sendBlock, wetBlock, frames);
+        accumulate(out, wetBlock, 1.0f, 1.0f, frames);
+    }
+
+    if (tapEnabled.load(memory_order_relaxed)) {
+        MixerTapBlock block;
+        block.frames = frames;
+        for (unsigned int i = 0; i < frames; i++)
+            block.samples[i] = 0.5f * (out[2 * i] + out[2 * i + 1]);
+        tap.push(block);
+    }
+
+    framesMixed.store(blockStart + frames, memory_order_release);
+}
+
+void Mixer::render(float *out, unsigned int frames)
+{
+    applyCommands();
+
+    for (unsigned int done = 0; done < frames; done += MIXER_BLOCK_FRAMES)
+        mixBlock(out + 2 * done, min(frames - done, (unsigned int)MIXER_BLOCK_FRAMES));
+}
+
+void Mixer::fillBuffer(ALuint buffer)
+{
+    alignas(16) float mixed[MIXER_BLOCK_FRAMES * 2];
+    int16_t pcm[MIXER_BLOCK_FRAMES * 2];
+
+    render(mixed, MIXER_BLOCK_FRAMES);
+    toInt16(mixed, pcm, MIXER_BLOCK_FRAMES * 2);
+    alBufferData(buffer, AL_FORMAT_STEREO16, pcm, sizeof(pcm), MIXER_SAMPLE_RATE);
+}
+
+bool Mixer::start(bool threaded)
+{
+    if (running) return true;
+
+    alGetError();
+    alGenSources(1, &source);
+    alGenBuffers(MIXER_OUTPUT_BUFFERS, buffers);
+    if (alGetError() != AL_NO_ERROR) {
+        cerr << "[Mixer] Failed to create the output stream" << endl;
+        return false;
+    }
+
+    // Already mixed and panned, so it plays at the listener untouched
+    alSourcei(source, AL_SOURCE_RELATIVE, AL_TRUE);
+    alSource3f(source, AL_POSITION, 0.0f, 0.0f, 0.0f);
+    alSourcef(source, AL_GAIN, 1.0f);
+
+    for (ALuint buffer : buffers)
+        fillBuffer(buffer);
+    alSourceQueueBuffers(source, MIXER_OUTPUT_BUFFERS, buffers);
+    alSourcePlay(source);
+
+    running = true;
+    if (threaded)
+        worker = thread(&Mixer::run, this);
+    return true;
+}
+
+void Mixer::stop()
+{
+    if (!running) return;
+
+    running = false;
+    if (worker.joinable())
+        worker.join();
+
+    alSourceStop(source);
+    alDeleteSources(1, &source);
+    alDeleteBuffers(MIXER_OUTPUT_BUFFERS, buffers);
+}
+
+void Mixer::run()
+{
+    // Polls a few times per block, so a played buffer is refilled well before the queue drains
+    const chrono::microseconds wait(1000000LL * MIXER_BLOCK_FRAMES / MIXER_SAMPLE_RATE / 4);
+
+    while (running)
+    {
+        service();
+        this_thread::sleep_for(wait);
+    }
+}
+
+void Mixer::service()
+{
+    ALint processed = 0;
+    alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+    while (processed-- > 0) {
+        ALuint buffer;
+        alSourceUnqueueBuffers(source, 1, &buffer);
+        framesPlayed += MIXER_BLOCK_FRAMES;
+        fillBuffer(buffer);
+        alSourceQueueBuffers(source, 1, &buffer);
+    }
+
+    // Every queued block played before we got back here, OpenAL stops the source
+    ALint state;
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    if (state != AL_PLAYING) {
+        underruns++;
+        alSourcePlay(source);
+    }
+
+    // Where the device is inside the oldest queued block
+    ALint offset = 0;
+    alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+    playbackFrame.store(framesPlayed + offset, memory_order_relaxed);
+}
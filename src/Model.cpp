@@ -1,5 +1,6 @@
 #include <vector>
 #include <iostream>
+#include <cmath>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/string_cast.hpp>
@@ -19,8 +20,10 @@ void Model::Draw(const shared_ptr<Program> prog, bool drawMaterials) const
         meshes[i].Draw(prog, drawMaterials);
 }
 
-void Model::loadModel(string path)
+void Model::loadModel(string path, unsigned int flags)
 {
+    upload = !(flags & MODEL_NO_UPLOAD);
+
     cout << "\nLoading Model: " << path << endl;
     Assimp::Importer import;
     const aiScene *scene = import.ReadFile(path, aiProcess_Triangulate | aiProcess_GenNormals | aiProcess_FlipUVs);
@@ -34,6 +37,19 @@ void Model::loadModel(string path)
     directory = path.substr(0, path.find_last_of('/'));
 
     processNode(scene->mRootNode, scene);
+
+    // Lightmap UVs unweld the meshes, so upload once they're final
+    if (flags & MODEL_LIGHTMAP_UVS)
+        generateLightmapUVs();
+
+    if (upload) {
+        for (auto &mesh : meshes)
+            mesh.setupMesh();
+    }
+
+    for (auto &mesh : meshes)
+        meshBounds.push_back(mesh.bb);
+    meshWorldBounds = meshBounds;
 }
 
 void Model::processNode(aiNode *node, const aiScene *scene)
@@ -85,6 +101,8 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
         else
             vertex.TexCoords = glm::vec2(0.0f, 0.0f);
 
+        vertex.LightmapCoords = glm::vec2(0.0f, 0.0f);
+
         vertices.push_back(vertex);
     }
 
@@ -145,7 +163,7 @@ Mesh Model::processMesh(aiMesh *mesh, const aiScene *scene)
         cout << "[Shininess] f: " << mat.shininess << endl;
     }
 
-    return Mesh(vertices, indices, textures, mat);
+    return Mesh(vertices, indices, textures, mat, false);
 }
 
 vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
@@ -172,7 +190,7 @@ vector<Texture> Model::loadMaterialTextures(aiMaterial *mat, aiTextureType type,
         if (!skip)
         {
             Texture texture;
-            texture.id = TextureFromFile(str.C_Str(), this->directory);
+            texture.id = upload ? TextureFromFile(str.C_Str(), this->directory) : 0;
             texture.type = typeName;
             texture.path = str.C_Str();
             textures.push_back(texture);
@@ -191,12 +209,8 @@ float max3(glm::vec3 a) {
 void Model::normalize()
 {
     // Determine bounding box for entire model
-    for (auto &mesh : meshes)
-    {
-        mesh.measure();
-        bb.min = (glm::min)(mesh.bb.min, bb.min);
-        bb.max = (glm::max)(mesh.bb.max, bb.max);
-    }
+    for (auto &meshBox : meshBounds)
+        bb = Bounds::merge(bb, meshBox);
 
     // Compute composite matrix
     glm::vec3 extents = bb.max - bb.min;
@@ -205,6 +219,8 @@ void Model::normalize()
     glm::mat4 S_o = glm::scale(glm::mat4(1.0f), glm::vec3(2/max3(extents)));
 
     M_o = S_o * T_o;
+    meshBB = bb;
+    updateTransform();
 
     // Update the bounding box
     bb.min = glm::vec3(M_o * glm::vec4(bb.min, 1.0f));
@@ -212,16 +228,72 @@ void Model::normalize()
 }
 
 void Model::updateBoundingBox(glm::mat4 M)
-{   
-    glm::mat4 M_tot = T_w * R_w * S_w * M_o;
-    
-    bb.min = glm::vec3(INFINITY);
-    bb.max = glm::vec3(-INFINITY);
+{
+    // Re-box each mesh's local bounds rather than transforming its vertices
+    Bounds::transform(M * transform, meshBounds.data(), meshWorldBounds.data(), meshBounds.size());
 
+    bb = Bounds::empty();
+    for (auto &meshBox : meshWorldBounds)
+        bb = Bounds::merge(bb, meshBox);
+}
+
+/*
+ * Lays every triangle of the model out in its own chart of a shared atlas.
+ * Triangles are paired into square cells of a grid, one in each half, with a
+ * texel of padding so bilinear filtering never bleeds between charts.
+ */
+void Model::generateLightmapUVs()
+{
+    unsigned int triangles = 0;
+    for (auto &mesh : meshes)
+        triangles += mesh.indices.size() / 3;
+
+    if (triangles == 0) return;
+
+    unsigned int cells = (triangles + 1) / 2;
+    unsigned int grid = (unsigned int) ceil(sqrt((double) cells));
+
+    lightmapSize = LIGHTMAP_MIN_SIZE;
+    while (lightmapSize < grid * LIGHTMAP_CELL_TEXELS && lightmapSize < LIGHTMAP_MAX_SIZE)
+        lightmapSize *= 2;
+
+    float cellSize = 1.0f / grid;
+    float padding = 1.0f / lightmapSize;
+
+    unsigned int triangle = 0;
     for (auto &mesh : meshes)
     {
-        mesh.measure(M_tot);
-        bb.min = (glm::min)(mesh.bb.min, bb.min);
-        bb.max = (glm::max)(mesh.bb.max, bb.max);
+        // Charts can't share vertices
+        vector<Vertex> vertices;
+        vertices.reserve(mesh.indices.size());
+
+        for (unsigned int i = 0; i + 2 < mesh.indices.size(); i += 3, triangle++)
+        {
+            unsigned int cell = triangle / 2;
+            glm::vec2 lo = glm::vec2((float) (cell % grid), (float) (cell / grid)) * cellSize + glm::vec2(padding);
+            glm::vec2 hi = lo + glm::vec2(cellSize - 2.0f * padding);
+
+            // Lower left or upper right half, with a gap along the diagonal
+            glm::vec2 uv[3];
+            if (triangle % 2 == 0) {
+                uv[0] = lo;
+                uv[1] = glm::vec2(hi.x - padding, lo.y);
+                uv[2] = glm::vec2(lo.x, hi.y - padding);
+            } else {
+                uv[0] = hi;
+                uv[1] = glm::vec2(lo.x + padding, hi.y);
+                uv[2] = glm::vec2(hi.x, lo.y + padding);
+            }
+
+            for (int j = 0; j < 3; j++) {
+                Vertex vertex = mesh.vertices[mesh.indices[i + j]];
+                vertex.LightmapCoords = uv[j];
+                vertices.push_back(vertex);
+            }
+        }
+
+        mesh.vertices = vertices;
+        for (unsigned int i = 0; i < mesh.indices.size(); i++)
+            mesh.indices[i] = i;
     }
 }
\ No newline at end of file
@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define PIANO_SSE
+#endif
+
+#include "Piano.h"
+
+// Zero frames after every zone, interpolation reads one past the end
+#define ZONE_PADDING 4
+
+// Voice states, in the order a voice goes through them
+#define VOICE_HELD      0
+#define VOICE_SUSTAINED 1
+#define VOICE_RELEASED  2
+#define VOICE_STOLEN    3
+
+// Per frame envelope of a released and a stolen voice, both -60 dB by the end
+static const float releaseDecay = powf(0.001f, 1.0f / (PIANO_RELEASE_SECONDS * MIXER_SAMPLE_RATE));
+static const float stealDecay   = powf(0.001f, 1.0f / PIANO_STEAL_FRAMES);
+
+static const double pi = 3.14159265358979323846;
+
+/*
+ * Interpolates a mono zone at position + i * step, scales it by the envelope
+ * (multiplied by decay every frame) and adds it to out panned. The loads are
+ * gathered, everything after is four frames at a time. Returns the envelope
+ * after the last frame.
+ */
+static float mixVoice(const float *data, double position, double step, float level, float decay,
+    float gainL, float gainR, float *out, unsigned int count)
+{
+    unsigned int i = 0;
+#ifdef PIANO_SSE
+    float decay2 = decay * decay;
+    __m128 envelope = _mm_setr_ps(level, level * decay, level * decay2, level * decay2 * decay);
+    __m128 envelopeStep = _mm_set1_ps(decay2 * decay2);
+    __m128 left = _mm_set1_ps(gainL);
+    __m128 right = _mm_set1_ps(gainR);
+
+    for (; i + 4 <= count; i += 4) {
+        alignas(16) float a[4], b[4], f[4];
+        for (unsigned int k = 0; k < 4; k++) {
+            double p = position + (i + k) * step;
+            unsigned int index = (unsigned int)p;
+            f[k] = (float)(p - index);
+            a[k] = data[index];
+            b[k] = data[index + 1];
+        }
+
+        __m128 s = _mm_load_ps(a);
+        s = _mm_add_ps(s, _mm_mul_ps(_mm_load_ps(f), _mm_sub_ps(_mm_load_ps(b), s)));
+        s = _mm_mul_ps(s, envelope);
+        __m128 l = _mm_mul_ps(s, left);
+        __m128 r = _mm_mul_ps(s, right);
+        _mm_storeu_ps(out + 2 * i, _mm_add_ps(_mm_loadu_ps(out + 2 * i), _mm_unpacklo_ps(l, r)));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_add_ps(_mm_loadu_ps(out + 2 * i + 4), _mm_unpackhi_ps(l, r)));
+        envelope = _mm_mul_ps(envelope, envelopeStep);
+    }
+    level = _mm_cvtss_f32(envelope);
+#endif
+    for (; i < count; i++) {
+        double p = position + i * step;
+        unsigned int index = (unsigned int)p;
+        float f = (float)(p - index);
+        float s = (data[index] + f * (data[index + 1] - data[index])) * level;
+        out[2 * i]     += s * gainL;
+        out[2 * i + 1] += s * gainR;
+        level *= decay;
+    }
+    return level;
+}
+
+/*
+ * A struck string as decaying partials: stretched above the harmonics by
+ * the string's stiffness, higher ones dying faster, and two slightly
+ * detuned strings per note so it beats. Low notes ring for longer.
+ */
+static void synthesizeNote(int note, vector<float> &frames, mt19937 &rng)
+{
+    const double rate = MIXER_SAMPLE_RATE;
+    double f0 = 440.0 * pow(2.0, (note - 69) / 12.0);
+    double tau = 3.0 * pow(2.0, -(note - PIANO_LOWEST_NOTE) / 24.0);          // Fundamental, seconds to 1/e
+    double stiffness = 5e-5 * pow(2.0, (note - PIANO_LOWEST_NOTE) / 17.0);
+
+    unsigned int length = (unsigned int)(min((double)PIANO_ZONE_SECONDS, 6.9 * tau) * rate);
+    frames.assign(length, 0.0f);
+
+    // Every partial of every string, stepped together so the oscillators don't wait on each other
+    double zr[32], zi[32], wr[32], wi[32];
+    int oscillators = 0;
+    int strings = note < 33 ? 1 : 2;
+    for (int k = 1; k <= 16; k++)
+    {
+        double frequency = k * f0 * sqrt(1.0 + stiffness * k * k);
+        if (frequency > 0.45 * rate) break;
+
+        // Struck an eighth of the way along, which leaves out every eighth partial
+        double amplitude = fabs(sin(pi * k / 8.0)) / k / strings;
+        double decay = exp(-(1.0 + 0.2 * (k - 1)) / (tau * rate));
+
+        for (int s = 0; s < strings; s++) {
+            double detune = strings > 1 ? (s ? 1.0004 : 0.9996) : 1.0;
+            double angle = 2.0 * pi * frequency * detune / rate;
+            wr[oscillators] = decay * cos(angle);
+            wi[oscillators] = decay * sin(angle);
+            zr[oscillators] = amplitude;
+            zi[oscillators] = 0.0;
+            oscillators++;
+        }
+    }
+
+    for (unsigned int i = 0; i < length; i++) {
+        double sum = 0.0;
+        for (int o = 0; o < oscillators; o++) {
+            sum += zi[o];
+            double r = zr[o] * wr[o] - zi[o] * wi[o];
+            zi[o] = zr[o] * wi[o] + zi[o] * wr[o];
+            zr[o] = r;
+        }
+        frames[i] = (float)sum;
+    }
+
+    // Hammer thump, a few milliseconds of noise
+    normal_distribution<float> noise(0.0f, 1.0f);
+    unsigned int thump = min(length, (unsigned int)(0.005 * rate));
+    for (unsigned int i = 0; i < thump; i++)
+        frames[i] += 0.02f * noise(rng) * expf(-(float)i / (0.001f * (float)rate));
+
+    // A millisecond of attack, and a fade over the last tenth so a cut off tail doesn't click
+    unsigned int attack = min(length, (unsigned int)(0.001 * rate));
+    for (unsigned int i = 0; i < attack; i++)
+        frames[i] *= (float)i / attack;
+    unsigned int fade = length / 10;
+    for (unsigned int i = 0; i < fade; i++)
+        frames[length - 1 - i] *= (float)i / fade;
+
+    float peak = 0.0f;
+    for (float value : frames)
+        peak = max(peak, fabsf(value));
+    if (peak > 0.0f)
+        for (float &value : frames)
+            value *= 0.3f / peak;
+}
+
+Piano::Piano()
+{
+    for (int &zone : noteZones)
+        zone = -1;
+}
+
+void Piano::addZone(int root, const vector<float> &frames, unsigned int channels, unsigned int sampleRate)
+{
+    if (channels == 0 || sampleRate == 0) return;
+
+    Zone zone;
+    zone.frames = frames.size() / channels;
+    zone.root = root;
+    zone.rate = (double)sampleRate / MIXER_SAMPLE_RATE;
+    zone.data.assign(zone.frames + ZONE_PADDING, 0.0f);
+    for (unsigned int i = 0; i < zone.frames; i++) {
+        float sum = 0.0f;
+        for (unsigned int c = 0; c < channels; c++)
+            sum += frames[i * channels + c];
+        zone.data[i] = sum / channels;
+    }
+    zones.push_back(move(zone));
+
+    // Every note plays the zone nearest its pitch
+    for (int note = 0; note < 128; note++) {
+        int best = noteZones[note];
+        if (best < 0 || abs(zones.back().root - note) < abs(zones[best].root - note))
+            noteZones[note] = zones.size() - 1;
+    }
+}
+
+void Piano::synthesize(unsigned int spacing)
+{
+    spacing = max(spacing, 1u);
+    mt19937 rng(1);
+    vector<float> frames;
+    for (int root = PIANO_LOWEST_NOTE; root <= PIANO_HIGHEST_NOTE; root += spacing) {
+        synthesizeNote(root, frames, rng);
+        addZone(root, frames, 1, MIXER_SAMPLE_RATE);
+    }
+}
+
+bool Piano::noteOn(int note, float velocity)
+{
+    return incoming.push({PIANO_NOTE_ON, (uint8_t)note, 0, velocity});
+}
+
+bool Piano::noteOff(int note)
+{
+    return incoming.push({PIANO_NOTE_OFF, (uint8_t)note, 0, 0.0f});
+}
+
+bool Piano::setSustain(bool down)
+{
+    return incoming.push({PIANO_SUSTAIN, 0, 0, down ? 1.0f : 0.0f});
+}
+
+void Piano::setVoiceBudget(unsigned int voices)
+{
+    budget = max(voices, (unsigned int)PIANO_MIN_BUDGET);
+}
+
+void Piano::scheduleEvent(unsigned int offset, int type, int note, float value)
+{
+    if (scheduledCount < PIANO_BLOCK_EVENTS)
+        scheduled[scheduledCount++] = {(uint8_t)type, (uint8_t)note, (uint16_t)offset, value};
+}
+
+// Only ever moves a voice further along, a second change in the same block happens at the earlier frame
+void Piano::changeState(Voice &voice, int state, unsigned int offset)
+{
+    int current = voice.nextState >= 0 ? voice.nextState : voice.state;
+    if (state <= current) return;
+
+    offset = max(offset, voice.delay);
+    voice.changeAt = voice.nextState >= 0 ? min(voice.changeAt, offset) : offset;
+    voice.nextState = state;
+}
+
+// Held, then sustained, then released, louder first within each
+float Piano::rank(const Voice &voice) const
+{
+    int state = voice.nextState >= 0 ? voice.nextState : voice.state;
+    return (float)(VOICE_STOLEN - state) + min(voice.level, 0.999f);
+}
+
+void Piano::startNote(int note, float velocity, unsigned int offset)
+{
+    if (note < PIANO_LOWEST_NOTE || note > PIANO_HIGHEST_NOTE || noteZones[note] < 0)
+        return;
+
+    // Striking a key again damps what it was still ringing with
+    unsigned int sounding = 0;
+    for (auto &voice : voices) {
+        if (!voice.active) continue;
+        if (voice.note == note)
+            changeState(voice, VOICE_RELEASED, offset);
+        if (voice.state != VOICE_STOLEN && voice.nextState != VOICE_STOLEN)
+            sounding++;
+    }
+
+    // Past the polyphony, the least important voice fades out to make room
+    if (sounding >= PIANO_MAX_VOICES) {
+        Voice *victim = nullptr;
+        for (auto &voice : voices) {
+            if (!voice.active || voice.state == VOICE_STOLEN || voice.nextState == VOICE_STOLEN) continue;
+            if (!victim || rank(voice) < rank(*victim))
+                victim = &voice;
+        }
+        changeState(*victim, VOICE_STOLEN, offset);
+        voicesStolen++;
+    }
+
+    // A free slot, or with every fade slot busy too, the fade closest to silence
+    Voice *chosen = nullptr;
+    for (auto &voice : voices) {
+        if (!voice.active) {
+            chosen = &voice;
+            break;
+        }
+        if (voice.state == VOICE_STOLEN && (!chosen || voice.fadeLeft < chosen->fadeLeft))
+            chosen = &voice;
+    }
+    if (!chosen) return;
+
+    velocity = min(max(velocity, 0.0f), 1.0f);
+    const Zone &zone = zones[noteZones[note]];
+    float pan = PIANO_STEREO_WIDTH * (note - 64.5f) / 43.5f;
+    float angle = (pan + 1.0f) * 0.25f * (float)pi;
+
+    Voice &voice = *chosen;
+    voice.active = true;
+    voice.note = note;
+    voice.state = VOICE_HELD;
+    voice.zone = &zone;
+    voice.position = 0.0;
+    voice.step = zone.rate * pow(2.0, (note - zone.root) / 12.0);
+    voice.gain = velocity * velocity;
+    voice.level = voice.gain;
+    voice.gainL = cosf(angle);
+    voice.gainR = sinf(angle);
+    voice.delay = offset;
+    voice.nextState = -1;
+    voice.changeAt = 0;
+    voice.fadeLeft = 0;
+    voice.started = ++voiceClock;
+}
+
+void Piano::apply(const PianoEvent &event)
+{
+    switch (event.type)
+    {
+        case PIANO_NOTE_ON:
+            startNote(event.note, event.value, event.offset);
+            break;
+
+        case PIANO_NOTE_OFF:
+            for (auto &voice : voices) {
+                if (voice.active && voice.note == event.note && voice.state == VOICE_HELD && voice.nextState < 0)
+                    changeState(voice, sustain ? VOICE_SUSTAINED : VOICE_RELEASED, event.offset);
+            }
+            break;
+
+        case PIANO_SUSTAIN:
+            sustain = event.value > 0.5f;
+            if (sustain) break;
+            for (auto &voice : voices) {
+                int state = voice.nextState >= 0 ? voice.nextState : voice.state;
+                if (voice.active && state == VOICE_SUSTAINED)
+                    changeState(voice, VOICE_RELEASED, event.offset);
+            }
+            break;
+    }
+}
+
+/*
+ * Fits the block into the budget. Fading voices are paid for first, then
+ * the rest in rank order, each only if everything below it could still
+ * afford to fade out; any voice that doesn't fit is stolen from its first
+ * frame in this block.
+ */
+void Piano::enforceBudget(unsigned int frames)
+{
+    long remaining = (long)budget.load(memory_order_relaxed) * frames;
+    unsigned int fade = min((unsigned int)PIANO_STEAL_FRAMES, frames);
+
+    Voice *ranked[PIANO_VOICE_SLOTS];
+    unsigned int count = 0;
+    for (auto &voice : voices)
+    {
+        if (!voice.active) continue;
+        if (voice.state == VOICE_STOLEN) {
+            remaining -= min(voice.fadeLeft, frames);
+            continue;
+        }
+        if (voice.nextState == VOICE_STOLEN) {
+            remaining -= voice.changeAt - voice.delay + min(fade, frames - voice.changeAt);
+            continue;
+        }
+
+        // Insertion sort, most important first
+        float r = rank(voice);
+        unsigned int i = count++;
+        for (; i > 0 && rank(*ranked[i - 1]) < r; i--)
+            ranked[i] = ranked[i - 1];
+        ranked[i] = &voice;
+    }
+
+    for (unsigned int i = 0; i < count; i++)
+    {
+        Voice &voice = *ranked[i];
+        long below = (long)(count - i - 1) * fade;
+        long full = frames - voice.delay;
+        long fading = min(fade, frames - voice.delay);
+
+        if (remaining - full >= below) {
+            remaining -= full;
+        }
+        else if (remaining - fading >= below) {
+            changeState(voice, VOICE_STOLEN, voice.delay);
+            remaining -= fading;
+            voicesShed++;
+        }
+        else {
+            // Only when the block is shorter than a fade and the budget can't cover it
+            voice.active = false;
+            voicesShed++;
+        }
+    }
+}
+
+void Piano::renderVoice(Voice &voice, float *out, unsigned int frames)
+{
+    const Zone &zone = *voice.zone;
+    unsigned int i = voice.delay;
+    voice.delay = 0;
+
+    while (i < frames && voice.active)
+    {
+        if (voice.nextState >= 0 && voice.changeAt <= i) {
+            voice.state = voice.nextState;
+            voice.nextState = -1;
+            if (voice.state == VOICE_STOLEN)
+                voice.fadeLeft = PIANO_STEAL_FRAMES;
+        }
+
+        // Up to the next state change, the end of the fade, or the end of the zone
+        unsigned int end = voice.nextState >= 0 ? voice.changeAt : frames;
+        if (voice.state == VOICE_STOLEN)
+            end = min(end, i + voice.fadeLeft);
+        double left = ceil((zone.frames - voice.position) / voice.step);
+        unsigned int count = (unsigned int)min((double)(end - i), max(left, 0.0));
+        if (count == 0) {
+            voice.active = false;
+            break;
+        }
+
+        float decay = voice.state == VOICE_RELEASED ? releaseDecay : voice.state == VOICE_STOLEN ? stealDecay : 1.0f;
+        voice.level = mixVoice(zone.data.data(), voice.position, voice.step, voice.level, decay,
+                               voice.gainL, voice.gainR, out + 2 * i, count);
+        voice.position += count * voice.step;
+        i += count;
+
+        if (voice.state == VOICE_STOLEN) {
+            voice.fadeLeft -= count;
+            if (voice.fadeLeft == 0)
+                voice.active = false;
+        }
+        if (voice.state == VOICE_RELEASED && voice.level < 0.001f * voice.gain)
+            voice.active = false;
+        if (voice.position >= zone.frames)
+            voice.active = false;
+    }
+}
+
+void Piano::render(float *out, unsigned int frames)
+{
+    if (frames == 0) return;
+
+    // Game thread events start the block, scheduled ones land on their frame
+    PianoEvent events[256 + PIANO_BLOCK_EVENTS];
+    unsigned int count = 0;
+    PianoEvent event;
+    while (count < 256 && incoming.pop(event))
+        events[count++] = event;
+    for (unsigned int i = 0; i < scheduledCount; i++) {
+        event = scheduled[i];
+        event.offset = min((unsigned int)event.offset, frames - 1);
+
+        // Stable insertion by offset
+        unsigned int j = count++;
+        for (; j > 0 && events[j - 1].offset > event.offset; j--)
+            events[j] = events[j - 1];
+        events[j] = event;
+    }
+    scheduledCount = 0;
+
+    for (unsigned int i = 0; i < count; i++)
+        apply(events[i]);
+
+    enforceBudget(frames);
+
+    unsigned int active = 0;
+    for (auto &voice : voices) {
+        if (!voice.active) continue;
+        renderVoice(voice, out, frames);
+        if (voice.active)
+            active++;
+    }
+    activeVoices.store(active, memory_order_relaxed);
+}
@@ -1,9 +1,11 @@
 #include "Plane.h"
+#include "GLState.h"
+#include <cstddef>
 #include <iostream>
 
-void Plane::init()
+void Plane::init(bool upload)
 {
-    float vertices[] = {
+    float data[] = {
         // positions         	      // normals       	 // texture coords
         -groundX, 0.0f, -groundZ,  0.0f, 1.0f,  0.0f,       0.0f,  groundTex,
          groundX, 0.0f, -groundZ,  0.0f, 1.0f,  0.0f,  groundTex,  groundTex,
@@ -13,49 +15,67 @@ void Plane::init()
         -groundX, 0.0f, -groundZ,  0.0f, 1.0f,  0.0f,       0.0f,  groundTex,
     };
 
+    // Keep a copy on the CPU, the lightmap covers the whole plane
+    vertices.clear();
+    for (int i = 0; i < 6; i++) {
+        Vertex vertex;
+        vertex.Position  = glm::vec3(data[i*8 + 0], data[i*8 + 1], data[i*8 + 2]);
+        vertex.Normal    = glm::vec3(data[i*8 + 3], data[i*8 + 4], data[i*8 + 5]);
+        vertex.TexCoords = glm::vec2(data[i*8 + 6], data[i*8 + 7]);
+        vertex.LightmapCoords = vertex.TexCoords / groundTex;
+        vertices.push_back(vertex);
+    }
+
+    if (!upload) return;
+
     // Generate ground VAO and VBO
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
 
     // Send vertices to GPU
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
 
     // Setup attribute pointers
-    glBindVertexArray(VAO);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    GLState::bindVertexArray(VAO);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
     glEnableVertexAttribArray(2);
+    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, LightmapCoords));
+    glEnableVertexAttribArray(3);
 }
 
 void Plane::render(shared_ptr<Program> prog, bool useMaterials, int texture)
 {
-    // By default, disable texture use
     if (useMaterials) {
-        glUniform1i(prog->getUniform("material.texture_diffuse_enable"), GL_FALSE);
-        glUniform1i(prog->getUniform("material.texture_specular_enable"), GL_FALSE);
+        unsigned int diffuseBit  = prog->getFeatureBit("TEXTURE_DIFFUSE");
+        unsigned int specularBit = prog->getFeatureBit("TEXTURE_SPECULAR");
+        unsigned int features = prog->getFeatures() & ~(diffuseBit | specularBit);
 
         // Enable diffuse texturing, if available
         if (texture != -1)
         {
-            glUniform1i(prog->getUniform("material.texture_diffuse_enable"), GL_TRUE);
-            glActiveTexture(GL_TEXTURE0);
-            glUniform1i(prog->getUniform("material.texture_diffuse1"), 0);
-            glBindTexture(GL_TEXTURE_2D, texture);
+            prog->setFeatures(features | diffuseBit);
+            GLState::activeTexture(GL_TEXTURE0);
+            prog->setInt("material.texture_diffuse1", 0);
+            GLState::bindTexture(GL_TEXTURE_2D, texture);
         }
         else
-            glUniform3f(prog->getUniform("material.diffuse"), 0.5f, 0.5f, 0.5f);
+        {
+            prog->setFeatures(features);
+            prog->setVec3("material.diffuse", glm::vec3(0.5f, 0.5f, 0.5f));
+        }
 
         
         // Set specular properties
-        glUniform3f(prog->getUniform("material.specular"), 0.1f, 0.1f, 0.1f);
-        glUniform1f(prog->getUniform("material.shininess"), 32.0f);
+        prog->setVec3("material.specular", glm::vec3(0.1f, 0.1f, 0.1f));
+        prog->setFloat("material.shininess", 32.0f);
     }
 
     // Render
-    glBindVertexArray(VAO);
+    GLState::bindVertexArray(VAO);
     glDrawArrays(GL_TRIANGLES, 0, 36);
 }
@@ -2,9 +2,15 @@
 #include "Program.h"
 #include <iostream>
 #include <cassert>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <filesystem>
+#include <glm/gtc/type_ptr.hpp>
 
 #include "GLSL.h"
+#include "GLState.h"
 
 
 std::string readFileAsString(const std::string &fileName)
@@ -28,97 +34,554 @@ std::string readFileAsString(const std::string &fileName)
 	return result;
 }
 
+// Inserts a block of preprocessor lines right after the #version directive
+static std::string injectHeader(const std::string &source, const std::string &header)
+{
+	if (header.empty())
+		return source;
+
+	size_t version = source.find("#version");
+	if (version == std::string::npos)
+		return header + source;
+
+	size_t eol = source.find('\n', version);
+	if (eol == std::string::npos)
+		return source + "\n" + header;
+
+	return source.substr(0, eol + 1) + header + source.substr(eol + 1);
+}
+
+// 64-bit FNV-1a, stable across runs and platforms (unlike std::hash)
+static uint64_t hashString(const std::string &data, uint64_t hash = 14695981039346656037ull)
+{
+	for (unsigned char c : data)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Cache file for a pair of specialized sources on the current driver
+static std::string binaryPath(const std::string &directory, const std::string &vSource, const std::string &fSource)
+{
+	std::string driver;
+	driver += (const char *) glGetString(GL_VENDOR);
+	driver += (const char *) glGetString(GL_RENDERER);
+	driver += (const char *) glGetString(GL_VERSION);
+
+	uint64_t hash = hashString(driver);
+	hash = hashString(vSource, hash);
+	hash = hashString(fSource, hash);
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long) hash);
+	return directory + "/" + name;
+}
+
+std::string Program::cacheDirectory;
+bool Program::asyncCompile = false;
+unsigned Program::cacheHits = 0;
+unsigned Program::cacheMisses = 0;
+
+void Program::setAsyncCompile(bool enabled)
+{
+	asyncCompile = enabled;
+
+	// Let the driver compile on as many threads as it likes
+	if (enabled && GLAD_GL_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+}
+
+void Program::setBinaryCache(const std::string &directory)
+{
+	cacheDirectory = directory;
+	if (directory.empty())
+		return;
+
+	std::error_code error;
+	std::filesystem::create_directories(directory, error);
+	if (error)
+	{
+		std::cerr << "Can't create shader cache " << directory << ": " << error.message() << std::endl;
+		cacheDirectory.clear();
+	}
+}
+
+// Returns a linked program, or 0 if there is no binary or the driver rejects it
+GLuint Program::loadBinary(const std::string &path) const
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+		return 0;
+
+	GLenum format;
+	if (!file.read((char *) &format, sizeof(format)))
+		return 0;
+	std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (binary.empty())
+		return 0;
+
+	GLuint pid = glCreateProgram();
+	glProgramBinary(pid, format, binary.data(), (GLsizei) binary.size());
+
+	GLint rc;
+	glGetProgramiv(pid, GL_LINK_STATUS, &rc);
+	if (!rc)
+	{
+		if (isVerbose())
+			std::cout << "Cached binary for " << fShaderName << " was rejected, recompiling" << std::endl;
+		glDeleteProgram(pid);
+		return 0;
+	}
+
+	return pid;
+}
+
+void Program::saveBinary(const std::string &path, GLuint pid) const
+{
+	GLint length = 0;
+	glGetProgramiv(pid, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	GLenum format;
+	std::vector<char> binary(length);
+	glGetProgramBinary(pid, length, NULL, &format, binary.data());
+
+	// Write to the side and rename, so a crash never leaves a truncated binary
+	std::string temp = path + ".tmp";
+	{
+		std::ofstream file(temp, std::ios::binary);
+		if (!file.is_open())
+			return;
+		file.write((const char *) &format, sizeof(format));
+		file.write(binary.data(), binary.size());
+	}
+
+	std::error_code error;
+	std::filesystem::rename(temp, path, error);
+}
+
+// Points a uniform block at a buffer binding, variants may not use every block
+static void bindBlock(GLuint pid, const std::string &name, GLuint binding)
+{
+	GLuint index = glGetUniformBlockIndex(pid, name.c_str());
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(pid, index, binding);
+}
+
 void Program::setShaderNames(const std::string &v, const std::string &f)
 {
 	vShaderName = v;
 	fShaderName = f;
 }
 
-bool Program::init()
+std::string Program::buildHeader(unsigned mask) const
 {
-	GLint rc;
+	std::string header;
+
+	for (auto &define : defines)
+		header += "#define " + define.first + " " + define.second + "\n";
+
+	for (auto &feature : featureBits)
+	{
+		if (mask & feature.second)
+			header += "#define " + feature.first + "\n";
+	}
+
+	return header;
+}
+
+bool Program::start(unsigned mask, Variant &variant)
+{
+	// Read shader sources and specialize them for this variant
+	std::string header = buildHeader(mask);
+	std::string vShaderString = injectHeader(readFileAsString(vShaderName), header);
+	std::string fShaderString = injectHeader(readFileAsString(fShaderName), header);
+
+	// Reuse the binary linked on a previous run if the driver still accepts it
+	bool cached = !cacheDirectory.empty() && GLAD_GL_ARB_get_program_binary;
+	if (cached)
+	{
+		variant.cachePath = binaryPath(cacheDirectory, vShaderString, fShaderString);
+		variant.pid = loadBinary(variant.cachePath);
+		if (variant.pid)
+		{
+			cacheHits++;
+			variant.cachePath.clear();
+			resolve(variant);
+			return true;
+		}
+	}
+	cacheMisses++;
 
 	// Create shader handles
-	GLuint VS = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FS = glCreateShader(GL_FRAGMENT_SHADER);
+	variant.VS = glCreateShader(GL_VERTEX_SHADER);
+	variant.FS = glCreateShader(GL_FRAGMENT_SHADER);
 
-	// Read shader sources
-	std::string vShaderString = readFileAsString(vShaderName);
-	std::string fShaderString = readFileAsString(fShaderName);
 	const char *vshader = vShaderString.c_str();
 	const char *fshader = fShaderString.c_str();
-	CHECKED_GL_CALL(glShaderSource(VS, 1, &vshader, NULL));
-	CHECKED_GL_CALL(glShaderSource(FS, 1, &fshader, NULL));
+	CHECKED_GL_CALL(glShaderSource(variant.VS, 1, &vshader, NULL));
+	CHECKED_GL_CALL(glShaderSource(variant.FS, 1, &fshader, NULL));
 
-	// Compile vertex shader
-	CHECKED_GL_CALL(glCompileShader(VS));
-	CHECKED_GL_CALL(glGetShaderiv(VS, GL_COMPILE_STATUS, &rc));
-	if (!rc)
+	// Compile and link without asking for the results, which would wait on the driver
+	CHECKED_GL_CALL(glCompileShader(variant.VS));
+	CHECKED_GL_CALL(glCompileShader(variant.FS));
+
+	variant.pid = glCreateProgram();
+	if (cached)
+		CHECKED_GL_CALL(glProgramParameteri(variant.pid, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+	CHECKED_GL_CALL(glAttachShader(variant.pid, variant.VS));
+	CHECKED_GL_CALL(glAttachShader(variant.pid, variant.FS));
+	CHECKED_GL_CALL(glLinkProgram(variant.pid));
+
+	variant.pending = true;
+	return true;
+}
+
+bool Program::finish(Variant &variant)
+{
+	if (!variant.pending)
+		return variant.pid != 0;
+
+	variant.pending = false;
+
+	GLint vsOK, fsOK, linkOK;
+	CHECKED_GL_CALL(glGetShaderiv(variant.VS, GL_COMPILE_STATUS, &vsOK));
+	CHECKED_GL_CALL(glGetShaderiv(variant.FS, GL_COMPILE_STATUS, &fsOK));
+	CHECKED_GL_CALL(glGetProgramiv(variant.pid, GL_LINK_STATUS, &linkOK));
+
+	if (isVerbose())
 	{
-		if (isVerbose())
+		if (!vsOK)
 		{
-			GLSL::printShaderInfoLog(VS);
+			GLSL::printShaderInfoLog(variant.VS);
 			std::cout << "Error compiling vertex shader " << vShaderName << std::endl;
 		}
+		else if (!fsOK)
+		{
+			GLSL::printShaderInfoLog(variant.FS);
+			std::cout << "Error compiling fragment shader " << fShaderName << std::endl;
+		}
+		else if (!linkOK)
+		{
+			GLSL::printProgramInfoLog(variant.pid);
+			std::cout << "Error linking shaders " << vShaderName << " and " << fShaderName << std::endl;
+		}
+	}
+
+	// The shaders are owned by the program from here on
+	glDeleteShader(variant.VS);
+	glDeleteShader(variant.FS);
+	variant.VS = variant.FS = 0;
+
+	if (!vsOK || !fsOK || !linkOK)
+	{
+		glDeleteProgram(variant.pid);
+		variant.pid = 0;
 		return false;
 	}
 
-	// Compile fragment shader
-	CHECKED_GL_CALL(glCompileShader(FS));
-	CHECKED_GL_CALL(glGetShaderiv(FS, GL_COMPILE_STATUS, &rc));
-	if (!rc)
+	if (!variant.cachePath.empty())
 	{
-		if (isVerbose())
+		saveBinary(variant.cachePath, variant.pid);
+		variant.cachePath.clear();
+	}
+
+	resolve(variant);
+	return true;
+}
+
+bool Program::compile(unsigned mask, Variant &variant)
+{
+	return start(mask, variant) && finish(variant);
+}
+
+void Program::resolve(Variant &variant) const
+{
+	// Variants legitimately optimize away inputs, so only plain programs warn
+	bool warn = isVerbose() && featureBits.empty();
+	for (auto &name : attributeNames)
+		variant.attributes[name] = GLSL::getAttribLocation(variant.pid, name.c_str(), warn);
+	for (auto &name : uniformNames)
+		variant.uniforms[name] = GLSL::getUniformLocation(variant.pid, name.c_str(), warn);
+	for (auto &block : uniformBlocks)
+		bindBlock(variant.pid, block.first, block.second);
+}
+
+bool Program::init()
+{
+	clearVariants();
+
+	// Asynchronous programs are only waited on when first bound
+	if (asyncCompile)
+	{
+		Variant &variant = variants[features];
+		if (!start(features, variant))
+			return false;
+		active = &variant;
+		return true;
+	}
+
+	active = getVariant(features);
+	return active != nullptr;
+}
+
+void Program::prepare(unsigned mask)
+{
+	if (variants.find(mask) != variants.end())
+		return;
+
+	Variant &variant = variants[mask];
+	if (!asyncCompile)
+		compile(mask, variant);
+	else
+		start(mask, variant);
+}
+
+bool Program::isReady() const
+{
+	if (!active || !active->pending)
+		return true;
+	if (!GLAD_GL_KHR_parallel_shader_compile)
+		return false;
+
+	GLint done = GL_FALSE;
+	glGetProgramiv(active->pid, GL_COMPLETION_STATUS_KHR, &done);
+	return done == GL_TRUE;
+}
+
+Program::Variant *Program::getVariant(unsigned mask)
+{
+	auto it = variants.find(mask);
+	if (it != variants.end())
+		return finish(it->second) ? &it->second : nullptr;
+
+	// Failed variants are cached too (with no program) so they aren't retried every frame
+	Variant &variant = variants[mask];
+	if (!compile(mask, variant))
+		return nullptr;
+
+	return &variant;
+}
+
+void Program::clearVariants()
+{
+	for (auto &variant : variants)
+	{
+		if (variant.second.pending)
 		{
-			GLSL::printShaderInfoLog(FS);
-			std::cout << "Error compiling fragment shader " << fShaderName << std::endl;
+			glDeleteShader(variant.second.VS);
+			glDeleteShader(variant.second.FS);
 		}
-		return false;
+		GLState::deleteProgram(variant.second.pid);
 	}
 
-	// Create the program and link
-	pid = glCreateProgram();
-	CHECKED_GL_CALL(glAttachShader(pid, VS));
-	CHECKED_GL_CALL(glAttachShader(pid, FS));
-	CHECKED_GL_CALL(glLinkProgram(pid));
-	CHECKED_GL_CALL(glGetProgramiv(pid, GL_LINK_STATUS, &rc));
-	if (!rc)
+	variants.clear();
+	active = nullptr;
+}
+
+void Program::activate(Variant *variant)
+{
+	active = variant;
+	if (bound)
+	{
+		CHECKED_GL_CALL(GLState::useProgram(active->pid));
+		sync(active);
+	}
+}
+
+void Program::sync(Variant *variant)
+{
+	if (variant->synced == version)
+		return;
+
+	for (auto &value : values)
+	{
+		if (value.second.version > variant->synced)
+			write(variant, value.first, value.second);
+	}
+
+	variant->synced = version;
+}
+
+// Bytes of a uniform value that are actually sent for its type
+static size_t valueSize(GLenum type)
+{
+	switch (type)
+	{
+	case GL_FLOAT:      return sizeof(GLfloat);
+	case GL_FLOAT_VEC3: return 3 * sizeof(GLfloat);
+	case GL_FLOAT_MAT4: return 16 * sizeof(GLfloat);
+	default:            return 0;
+	}
+}
+
+void Program::write(Variant *variant, const std::string &name, const UniformValue &value) const
+{
+	auto location = variant->uniforms.find(name);
+	if (location == variant->uniforms.end())
 	{
 		if (isVerbose())
 		{
-			GLSL::printProgramInfoLog(pid);
-			std::cout << "Error linking shaders " << vShaderName << " and " << fShaderName << std::endl;
+			std::cout << name << " is not a uniform variable" << std::endl;
 		}
-		return false;
+		return;
 	}
+	if (location->second < 0)
+		return;
 
-	return true;
+	// Skip values the program already holds, e.g. materials shared by consecutive meshes
+	auto written = variant->written.find(location->second);
+	if (written != variant->written.end() && written->second.type == value.type)
+	{
+		const UniformValue &last = written->second;
+		bool same = (value.type == GL_INT) ? last.i == value.i
+		                                   : memcmp(last.f, value.f, valueSize(value.type)) == 0;
+		if (same)
+		{
+			GLState::countFiltered();
+			return;
+		}
+	}
+	variant->written[location->second] = value;
+	GLState::countIssued();
+
+	switch (value.type)
+	{
+	case GL_INT:
+		glUniform1i(location->second, value.i);
+		break;
+	case GL_FLOAT:
+		glUniform1f(location->second, value.f[0]);
+		break;
+	case GL_FLOAT_VEC3:
+		glUniform3fv(location->second, 1, value.f);
+		break;
+	case GL_FLOAT_MAT4:
+		glUniformMatrix4fv(location->second, 1, GL_FALSE, value.f);
+		break;
+	}
+}
+
+void Program::setDefine(const std::string &name, const std::string &value)
+{
+	auto it = defines.find(name);
+	if (it != defines.end() && it->second == value)
+		return;
+
+	defines[name] = value;
+
+	// Every cached variant was compiled against the old value
+	if (!variants.empty())
+	{
+		bool wasBound = bound;
+		clearVariants();
+		active = getVariant(features);
+		if (wasBound && active)
+			activate(active);
+	}
+}
+
+unsigned Program::addFeature(const std::string &name)
+{
+	auto it = featureBits.find(name);
+	if (it != featureBits.end())
+		return it->second;
+
+	assert(featureBits.size() < 32);
+	unsigned bit = 1u << featureBits.size();
+	featureBits[name] = bit;
+	return bit;
+}
+
+unsigned Program::getFeatureBit(const std::string &name) const
+{
+	auto it = featureBits.find(name);
+	return (it == featureBits.end()) ? 0 : it->second;
+}
+
+void Program::setFeatures(unsigned mask)
+{
+	if (mask == features && active)
+		return;
+
+	Variant *variant = getVariant(mask);
+	if (!variant)
+	{
+		if (isVerbose())
+			std::cout << "Falling back to previous variant of " << fShaderName << std::endl;
+		return;
+	}
+
+	features = mask;
+	if (variant != active)
+		activate(variant);
 }
 
-void Program::bind()
+bool Program::bind()
 {
-	CHECKED_GL_CALL(glUseProgram(pid));
+	// First use of an asynchronously compiled program, wait for it here
+	if (!active || (active->pending && !finish(*active)))
+	{
+		std::cerr << "Variant " << features << " of " << fShaderName << " failed to build" << std::endl;
+
+		// Draw with the featureless variant, or with nothing, never with whatever was current before
+		active = getVariant(0);
+		if (!active)
+		{
+			bound = false;
+			CHECKED_GL_CALL(GLState::useProgram(0));
+			return false;
+		}
+		features = 0;
+	}
+
+	bound = true;
+	CHECKED_GL_CALL(GLState::useProgram(active->pid));
+	sync(active);
+	return true;
 }
 
 void Program::unbind()
 {
-	CHECKED_GL_CALL(glUseProgram(0));
+	// The program stays current in GL, the next bind() of any program replaces it
+	bound = false;
 }
 
 void Program::addAttribute(const std::string &name)
 {
-	attributes[name] = GLSL::getAttribLocation(pid, name.c_str(), isVerbose());
+	attributeNames.push_back(name);
+	for (auto &variant : variants)
+		if (!variant.second.pending && variant.second.pid)
+			variant.second.attributes[name] = GLSL::getAttribLocation(variant.second.pid, name.c_str(), isVerbose() && featureBits.empty());
 }
 
 void Program::addUniform(const std::string &name)
 {
-	uniforms[name] = GLSL::getUniformLocation(pid, name.c_str(), isVerbose());
+	uniformNames.push_back(name);
+	for (auto &variant : variants)
+		if (!variant.second.pending && variant.second.pid)
+			variant.second.uniforms[name] = GLSL::getUniformLocation(variant.second.pid, name.c_str(), isVerbose() && featureBits.empty());
+}
+
+void Program::addUniformBlock(const std::string &name, GLuint binding)
+{
+	uniformBlocks.push_back(std::make_pair(name, binding));
+	for (auto &variant : variants)
+		if (!variant.second.pending && variant.second.pid)
+			bindBlock(variant.second.pid, name, binding);
 }
 
 GLint Program::getAttribute(const std::string &name) const
 {
-	std::map<std::string, GLint>::const_iterator attribute = attributes.find(name.c_str());
-	if (attribute == attributes.end())
+	// No linked variant, init or the last variant failed
+	if (!active)
+		return -1;
+
+	std::map<std::string, GLint>::const_iterator attribute = active->attributes.find(name.c_str());
+	if (attribute == active->attributes.end())
 	{
 		if (isVerbose())
 		{
@@ -131,8 +594,11 @@ GLint Program::getAttribute(const std::string &name) const
 
 GLint Program::getUniform(const std::string &name) const
 {
-	std::map<std::string, GLint>::const_iterator uniform = uniforms.find(name.c_str());
-	if (uniform == uniforms.end())
+	if (!active)
+		return -1;
+
+	std::map<std::string, GLint>::const_iterator uniform = active->uniforms.find(name.c_str());
+	if (uniform == active->uniforms.end())
 	{
 		if (isVerbose())
 		{
@@ -142,3 +608,59 @@ GLint Program::getUniform(const std::string &name) const
 	}
 	return uniform->second;
 }
+
+Program::UniformValue &Program::record(const std::string &name, GLenum type)
+{
+	UniformValue &value = values[name];
+	value.type = type;
+	value.version = ++version;
+	return value;
+}
+
+void Program::setInt(const std::string &name, GLint v)
+{
+	UniformValue &value = record(name, GL_INT);
+	value.i = v;
+
+	if (bound)
+	{
+		write(active, name, value);
+		active->synced = version;
+	}
+}
+
+void Program::setFloat(const std::string &name, GLfloat v)
+{
+	UniformValue &value = record(name, GL_FLOAT);
+	value.f[0] = v;
+
+	if (bound)
+	{
+		write(active, name, value);
+		active->synced = version;
+	}
+}
+
+void Program::setVec3(const std::string &name, const glm::vec3 &v)
+{
+	UniformValue &value = record(name, GL_FLOAT_VEC3);
+	memcpy(value.f, glm::value_ptr(v), 3 * sizeof(GLfloat));
+
+	if (bound)
+	{
+		write(active, name, value);
+		active->synced = version;
+	}
+}
+
+void Program::setMat4(const std::string &name, const glm::mat4 &m)
+{
+	UniformValue &value = record(name, GL_FLOAT_MAT4);
+	memcpy(value.f, glm::value_ptr(m), 16 * sizeof(GLfloat));
+
+	if (bound)
+	{
+		write(active, name, value);
+		active->synced = version;
+	}
+}
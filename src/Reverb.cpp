@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define REVERB_SSE
+#endif
+
+#include "Reverb.h"
+
+// Silence before the tail of a generated response, in seconds
+#define REVERB_PREDELAY 0.01f
+
+// acc += a * b over split complex arrays, count a multiple of four
+static void multiplyAccumulate(float *accRe, float *accIm, const float *aRe, const float *aIm,
+    const float *bRe, const float *bIm, unsigned int count)
+{
+#ifdef REVERB_SSE
+    for (unsigned int i = 0; i < count; i += 4) {
+        __m128 ar = _mm_loadu_ps(aRe + i), ai = _mm_loadu_ps(aIm + i);
+        __m128 br = _mm_loadu_ps(bRe + i), bi = _mm_loadu_ps(bIm + i);
+        __m128 re = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+        __m128 im = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+        _mm_storeu_ps(accRe + i, _mm_add_ps(_mm_loadu_ps(accRe + i), re));
+        _mm_storeu_ps(accIm + i, _mm_add_ps(_mm_loadu_ps(accIm + i), im));
+    }
+#else
+    for (unsigned int i = 0; i < count; i++) {
+        accRe[i] += aRe[i] * bRe[i] - aIm[i] * bIm[i];
+        accIm[i] += aRe[i] * bIm[i] + aIm[i] * bRe[i];
+    }
+#endif
+}
+
+Reverb::Reverb() : fft(REVERB_FFT_SIZE)
+{
+    memset(window, 0, sizeof(window));
+    memset(ready, 0, sizeof(ready));
+}
+
+void Reverb::setImpulse(const vector<float> &frames, unsigned int channels, unsigned int sampleRate,
+    unsigned int outputRate)
+{
+    channels = (std::min)((std::max)(channels, 1u), 2u);
+    unsigned int length = frames.size() / channels;
+
+    // Linear resampling is plenty for a reverb tail
+    double step = (double)sampleRate / outputRate;
+    unsigned int resampled = (unsigned int)(length / step);
+    vector<float> response[2];
+    double energy = 0.0;
+    for (unsigned int c = 0; c < channels; c++) {
+        response[c].resize(resampled);
+        for (unsigned int i = 0; i < resampled; i++) {
+            double position = i * step;
+            unsigned int index = (unsigned int)position;
+            float f = (float)(position - index);
+            float a = frames[index * channels + c];
+            float b = index + 1 < length ? frames[(index + 1) * channels + c] : 0.0f;
+            response[c][i] = a + f * (b - a);
+            energy += response[c][i] * response[c][i];
+        }
+    }
+    if (channels == 1)
+        response[1] = response[0];
+
+    float scale = energy > 0.0 ? (float)(1.0 / sqrt(energy / channels)) : 0.0f;
+
+    partitions = (std::max)((resampled + REVERB_PARTITION - 1) / REVERB_PARTITION, 1u);
+    for (unsigned int c = 0; c < 2; c++) {
+        responseRe[c].assign(partitions * REVERB_BINS_PADDED, 0.0f);
+        responseIm[c].assign(partitions * REVERB_BINS_PADDED, 0.0f);
+
+        // Each piece is zero padded to the transform size, the overlap-save convolution discards the wrap
+        for (unsigned int p = 0; p < partitions; p++) {
+            for (unsigned int i = 0; i < REVERB_FFT_SIZE; i++) {
+                unsigned int index = p * REVERB_PARTITION + i;
+                float value = i < REVERB_PARTITION && index < resampled ? response[c][index] * scale : 0.0f;
+                scratch[i] = complex<float>(value, 0.0f);
+            }
+            fft.forward(scratch);
+
+            for (unsigned int k = 0; k < REVERB_BINS; k++) {
+                responseRe[c][p * REVERB_BINS_PADDED + k] = scratch[k].real();
+                responseIm[c][p * REVERB_BINS_PADDED + k] = scratch[k].imag();
+            }
+        }
+    }
+
+    historyRe.assign(partitions * REVERB_BINS_PADDED, 0.0f);
+    historyIm.assign(partitions * REVERB_BINS_PADDED, 0.0f);
+    head = 0;
+    filled = 0;
+    memset(window, 0, sizeof(window));
+    memset(ready, 0, sizeof(ready));
+}
+
+void Reverb::makeImpulse(vector<float> &frames, float seconds, float decay, unsigned int sampleRate,
+    unsigned int seed)
+{
+    mt19937 rng(seed);
+    uniform_real_distribution<float> noise(-1.0f, 1.0f);
+
+    unsigned int length = (unsigned int)(seconds * sampleRate);
+    unsigned int predelay = (unsigned int)(REVERB_PREDELAY * sampleRate);
+    frames.assign(2 * length, 0.0f);
+
+    // 60 dB down after decay seconds
+    for (unsigned int i = predelay; i < length; i++) {
+        float envelope = expf(-6.9078f * (i - predelay) / (decay * sampleRate));
+        frames[2 * i]     = noise(rng) * envelope;
+        frames[2 * i + 1] = noise(rng) * envelope;
+    }
+}
+
+void Reverb::process(const float *input, float *output, unsigned int frames)
+{
+    unsigned int done = 0;
+    while (done < frames)
+    {
+        unsigned int count = (std::min)(frames - done, REVERB_PARTITION - filled);
+        memcpy(pending + filled, input + done, count * sizeof(float));
+        memcpy(output + 2 * done, ready + 2 * filled, count * 2 * sizeof(float));
+        filled += count;
+        done += count;
+
+        if (filled == REVERB_PARTITION) {
+            convolve();
+            filled = 0;
+        }
+    }
+}
+
+void Reverb::convolve()
+{
+    if (partitions == 0) {
+        memset(ready, 0, sizeof(ready));
+        return;
+    }
+
+    // Last two input partitions, transformed into the newest slot of the delay line
+    memmove(window, window + REVERB_PARTITION, REVERB_PARTITION * sizeof(float));
+    memcpy(window + REVERB_PARTITION, pending, REVERB_PARTITION * sizeof(float));
+    for (unsigned int i = 0; i < REVERB_FFT_SIZE; i++)
+        scratch[i] = complex<float>(window[i], 0.0f);
+    fft.forward(scratch);
+
+    head = (head + partitions - 1) % partitions;
+    float *newestRe = &historyRe[head * REVERB_BINS_PADDED];
+    float *newestIm = &historyIm[head * REVERB_BINS_PADDED];
+    for (unsigned int k = 0; k < REVERB_BINS; k++) {
+        newestRe[k] = scratch[k].real();
+        newestIm[k] = scratch[k].imag();
+    }
+
+    for (unsigned int c = 0; c < 2; c++)
+    {
+        // Partition p of the response meets the input from p blocks ago
+        memset(accumRe, 0, sizeof(accumRe));
+        memset(accumIm, 0, sizeof(accumIm));
+        for (unsigned int p = 0; p < partitions; p++) {
+            unsigned int slot = head + p < partitions ? head + p : head + p - partitions;
+            multiplyAccumulate(accumRe, accumIm,
+                &historyRe[slot * REVERB_BINS_PADDED], &historyIm[slot * REVERB_BINS_PADDED],
+                &responseRe[c][p * REVERB_BINS_PADDED], &responseIm[c][p * REVERB_BINS_PADDED],
+                REVERB_BINS_PADDED);
+        }
+
+        // The rest of the spectrum mirrors the kept half, since the output is real
+        for (unsigned int k = 0; k < REVERB_BINS; k++)
+            scratch[k] = complex<float>(accumRe[k], accumIm[k]);
+        for (unsigned int k = 1; k < REVERB_PARTITION; k++)
+            scratch[REVERB_FFT_SIZE - k] = conj(scratch[k]);
+        fft.inverse(scratch);
+
+        // Overlap-save: the first half wrapped around, the second is this block's output
+        for (unsigned int i = 0; i < REVERB_PARTITION; i++)
+            ready[2 * i + c] = scratch[REVERB_PARTITION + i].real();
+    }
+}
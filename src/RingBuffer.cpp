@@ -0,0 +1,112 @@
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "RingBuffer.h"
+
+using namespace std;
+
+void RingBuffer::init(GLenum target, size_t sectionSize, size_t alignment)
+{
+    this->target = target;
+    this->alignment = alignment > 0 ? alignment : 1;
+    this->sectionSize = (sectionSize + this->alignment - 1) / this->alignment * this->alignment;
+    size_t size = this->sectionSize * RING_BUFFER_FRAMES;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+
+    if (GLAD_GL_ARB_buffer_storage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, size, nullptr, flags);
+        mapped = (char *) glMapBufferRange(target, 0, size, flags);
+    }
+
+    if (!mapped) {
+        cout << "[RingBuffer] Persistent mapping unavailable, using glBufferSubData" << endl;
+        glBufferData(target, size, nullptr, GL_STREAM_DRAW);
+    }
+
+    glBindBuffer(target, 0);
+}
+
+void RingBuffer::destroy()
+{
+    for (auto &fence : fences) {
+        if (fence) glDeleteSync(fence);
+        fence = 0;
+    }
+
+    if (mapped) {
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glBindBuffer(target, 0);
+        mapped = nullptr;
+    }
+
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+}
+
+void RingBuffer::beginFrame()
+{
+    // Last frame ran out of room, nothing is bound yet this frame so the buffer can be replaced
+    if (overflowed) {
+        glFinish();
+        destroy();
+        init(target, sectionSize * 2, alignment);
+        overflowed = false;
+    }
+
+    section = (section + 1) % RING_BUFFER_FRAMES;
+    used = 0;
+
+    // Only stalls when the CPU is a full RING_BUFFER_FRAMES ahead
+    GLsync &fence = fences[section];
+    if (fence) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED)
+            ;
+        glDeleteSync(fence);
+        fence = 0;
+    }
+}
+
+void RingBuffer::endFrame()
+{
+    fences[section] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    if (used > peakUsage)
+        peakUsage = used;
+}
+
+GLintptr RingBuffer::push(const void *data, size_t size)
+{
+    assert(size <= sectionSize);
+
+    // Out of room, let the GPU finish the draws reading this section before starting it over,
+    // and grow the sections at the next beginFrame
+    if (used + size > sectionSize) {
+        if (!overflowed)
+            cerr << "[RingBuffer] Section of " << sectionSize << " bytes is too small, growing it" << endl;
+        overflowed = true;
+        glFinish();
+        used = 0;
+    }
+
+    GLintptr offset = section * sectionSize + used;
+    used += (size + alignment - 1) / alignment * alignment;
+
+    if (mapped) {
+        memcpy(mapped + offset, data, size);
+    } else {
+        glBindBuffer(target, buffer);
+        glBufferSubData(target, offset, size, data);
+    }
+
+    return offset;
+}
+
+void RingBuffer::bindRange(GLuint index, const void *data, size_t size)
+{
+    GLintptr offset = push(data, size);
+    glBindBufferRange(target, index, buffer, offset, size);
+}
@@ -0,0 +1,397 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "Sequencer.h"
+
+Sequencer::~Sequencer()
+{
+    // The mixer has stopped calling schedule by now, everything can be freed here
+    collect();
+    Sequence *sequence;
+    while (incoming.pop(sequence))
+        delete sequence;
+    delete active;
+}
+
+void Sequencer::setPad(unsigned int pad, unsigned int sample, int priority, float gain)
+{
+    if (pad >= DRUM_PAD_COUNT) return;
+    pads[pad] = {true, sample, priority, gain};
+}
+
+// Deletes sequences the mixer thread has finished with
+void Sequencer::collect()
+{
+    Sequence *sequence;
+    while (retired.pop(sequence))
+        delete sequence;
+}
+
+void Sequencer::play(const Sequence &sequence)
+{
+    collect();
+
+    if (sequence.events.empty()) return;
+
+    // The loop has to move forward, or the mixer thread would replay the same tick forever
+    Sequence *copy = new Sequence(sequence);
+    copy->length = max(copy->length, copy->events.back().tick + 1);
+    if (!incoming.push(copy)) {
+        delete copy;
+        return;
+    }
+    playing = true;
+}
+
+void Sequencer::stop()
+{
+    collect();
+    playing = false;
+}
+
+void Sequencer::setTempo(float bpm)
+{
+    tempo = bpm;
+}
+
+double Sequencer::getBeat(const Mixer &mixer)
+{
+    clock.update();
+    const SequencerClock &c = clock.front();
+    if (!c.playing || c.framesPerBeat <= 0.0)
+        return -1.0;
+
+    // The clock was published for a block still ahead of the device, this runs it back
+    double frames = (double)mixer.getPlaybackFrame() - (double)c.frame;
+    return c.beat + frames / c.framesPerBeat;
+}
+
+void Sequencer::setAnchor(double frame, double tick, float bpm)
+{
+    anchorFrame = frame;
+    anchorTick = tick;
+    currentTempo = bpm;
+    framesPerTick = 60.0 * MIXER_SAMPLE_RATE / ((double)bpm * active->ppq);
+}
+
+void Sequencer::schedule(Mixer &mixer, uint64_t blockStart, unsigned int frames)
+{
+    // The newest sequence wins, anything it replaces goes back to be freed. play() empties
+    // retired before every push to incoming, so it can't be full here
+    Sequence *next;
+    while (incoming.pop(next)) {
+        if (active)
+            retired.push(active);
+        active = next;
+        started = false;
+        releaseNotes();
+    }
+
+    SequencerClock &published = clock.back();
+    if (!playing || !active || active->events.empty()) {
+        started = false;
+        releaseNotes();
+        published.playing = false;
+        clock.publish();
+        return;
+    }
+
+    if (!started) {
+        started = true;
+        cursor = 0;
+        loopBase = 0;
+        appliedOverride = 0.0f;
+        setAnchor((double)blockStart, 0.0, active->bpm);
+    }
+
+    // A tempo change from the main thread takes over from the start of this block
+    float override = tempo.load(memory_order_relaxed);
+    if (override > 0.0f && override != appliedOverride) {
+        appliedOverride = override;
+        setAnchor((double)blockStart, anchorTick + (blockStart - anchorFrame) / framesPerTick, override);
+    }
+
+    const vector<SequencerEvent> &events = active->events;
+    uint64_t blockEnd = blockStart + frames;
+    for (;;)
+    {
+        // Each pass starts back at the sequence's own tempo
+        if (cursor == events.size()) {
+            cursor = 0;
+            loopBase += active->length;
+            if (appliedOverride == 0.0f && currentTempo != active->bpm)
+                setAnchor(anchorFrame + (loopBase - anchorTick) * framesPerTick, (double)loopBase, active->bpm);
+        }
+
+        const SequencerEvent &event = events[cursor];
+        double tick = (double)(loopBase + event.tick);
+        double frame = anchorFrame + (tick - anchorTick) * framesPerTick;
+
+        // Rounded to the nearest frame, so every hit lands within half a sample of its time
+        uint64_t target = (uint64_t)llround(frame);
+        if (target >= blockEnd)
+            break;
+        cursor++;
+
+        if (event.type == SEQUENCER_TEMPO) {
+            if (appliedOverride == 0.0f)
+                setAnchor(frame, tick, event.value);
+            continue;
+        }
+
+        unsigned int offset = target > blockStart ? (unsigned int)(target - blockStart) : 0;
+        if (event.type == SEQUENCER_HIT) {
+            const Pad &pad = pads[event.pad];
+            if (pad.set)
+                mixer.startAt(offset, pad.sample, pad.gain * event.value, 0.0f, 1.0f, pad.priority);
+            continue;
+        }
+
+        // Sequences can be built by hand, and a note past 127 would throw from the bitset here
+        if (!piano || event.pad >= heldNotes.size()) continue;
+        if (event.type == SEQUENCER_NOTE_ON) {
+            piano->scheduleEvent(offset, PIANO_NOTE_ON, event.pad, event.value);
+            heldNotes.set(event.pad);
+        }
+        else if (event.type == SEQUENCER_NOTE_OFF) {
+            piano->scheduleEvent(offset, PIANO_NOTE_OFF, event.pad);
+            heldNotes.reset(event.pad);
+        }
+        else if (event.type == SEQUENCER_SUSTAIN) {
+            piano->scheduleEvent(offset, PIANO_SUSTAIN, 0, event.value);
+            heldSustain = event.value > 0.5f;
+        }
+    }
+
+    published.frame = blockStart;
+    published.beat = (anchorTick + (blockStart - anchorFrame) / framesPerTick) / active->ppq;
+    published.framesPerBeat = framesPerTick * active->ppq;
+    published.playing = true;
+    clock.publish();
+}
+
+// Lets go of whatever the sequence still holds down on the piano, at the start of the block
+void Sequencer::releaseNotes()
+{
+    if (!piano || (heldNotes.none() && !heldSustain)) return;
+
+    if (heldSustain)
+        piano->scheduleEvent(0, PIANO_SUSTAIN, 0, 0.0f);
+    for (int note = 0; note < 128; note++) {
+        if (heldNotes[note])
+            piano->scheduleEvent(0, PIANO_NOTE_OFF, note);
+    }
+    heldNotes.reset();
+    heldSustain = false;
+}
+
+// By tick, and where events share one: tempo changes so everything after uses the new tempo,
+// then note-offs so a repeated note is let go before it is struck again
+void Sequencer::sortEvents(Sequence &sequence)
+{
+    auto order = [](const SequencerEvent &e) {
+        return e.type == SEQUENCER_TEMPO ? 0 : e.type == SEQUENCER_NOTE_OFF ? 1 : 2;
+    };
+    stable_sort(sequence.events.begin(), sequence.events.end(), [&](const SequencerEvent &a, const SequencerEvent &b) {
+        return a.tick < b.tick || (a.tick == b.tick && order(a) < order(b));
+    });
+}
+
+// 'x' is a full hit, 'o' a soft one, anything else a rest
+void Sequencer::addSteps(Sequence &sequence, unsigned int pad, const string &steps, unsigned int stepsPerBeat)
+{
+    uint64_t ticksPerStep = sequence.ppq / stepsPerBeat;
+    for (size_t i = 0; i < steps.size(); i++) {
+        if (steps[i] == 'x' || steps[i] == 'o')
+            sequence.events.push_back({i * ticksPerStep, SEQUENCER_HIT, (uint8_t)pad, steps[i] == 'x' ? 1.0f : 0.5f});
+    }
+
+    sequence.length = max(sequence.length, steps.size() * ticksPerStep);
+    sortEvents(sequence);
+}
+
+// Piano notes held together for length ticks
+void Sequencer::addChord(Sequence &sequence, const vector<int> &notes, uint64_t tick, uint64_t length, float velocity)
+{
+    for (int note : notes) {
+        sequence.events.push_back({tick, SEQUENCER_NOTE_ON, (uint8_t)note, velocity});
+        sequence.events.push_back({tick + length, SEQUENCER_NOTE_OFF, (uint8_t)note, 0.0f});
+    }
+
+    sequence.length = max(sequence.length, tick + length);
+    sortEvents(sequence);
+}
+
+/*
+ * Standard MIDI File loading
+ */
+static uint32_t readBigEndian(const vector<unsigned char> &data, size_t pos, int bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value = (value << 8) | data[pos + i];
+    return value;
+}
+
+static bool readVariableLength(const vector<unsigned char> &data, size_t &pos, size_t end, uint32_t &value)
+{
+    value = 0;
+    for (int i = 0; i < 4 && pos < end; i++) {
+        unsigned char byte = data[pos++];
+        value = (value << 7) | (byte & 0x7F);
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// General MIDI percussion notes to pads, -1 for anything the kit doesn't have
+static int drumPad(int note)
+{
+    switch (note) {
+        case 35: case 36:                               return DRUM_PAD_KICK;
+        case 37: case 38: case 39: case 40:             return DRUM_PAD_SNARE_LEFT;
+        case 41: case 43: case 45: case 47: case 48: case 50:
+                                                        return DRUM_PAD_SNARE_RIGHT;
+        case 42: case 44: case 46:                      return DRUM_PAD_HIHAT_LEFT;
+        case 49: case 51: case 52: case 53: case 55: case 57: case 59:
+                                                        return DRUM_PAD_HIHAT_RIGHT;
+    }
+    return -1;
+}
+
+// Percussion (channel 10) as drum hits, notes and the sustain pedal on every other channel for the
+// piano, and tempo changes, from every track
+bool Sequencer::loadMidi(const string &path, Sequence &sequence)
+{
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+        return false;
+    vector<unsigned char> data((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+
+    if (data.size() < 14 || string(data.begin(), data.begin() + 4) != "MThd") {
+        cerr << "[Sequencer] " << path << " is not a MIDI file" << endl;
+        return false;
+    }
+
+    uint32_t headerLength = readBigEndian(data, 4, 4);
+    unsigned int tracks = readBigEndian(data, 10, 2);
+    unsigned int division = readBigEndian(data, 12, 2);
+    if (division & 0x8000) {
+        cerr << "[Sequencer] " << path << " uses SMPTE time, which isn't supported" << endl;
+        return false;
+    }
+    if (division == 0) {
+        cerr << "[Sequencer] " << path << " has no ticks per quarter note" << endl;
+        return false;
+    }
+
+    Sequence result;
+    result.ppq = division;
+    uint64_t lastTick = 0;
+
+    size_t pos = 8 + headerLength;
+    for (unsigned int t = 0; t < tracks && pos + 8 <= data.size(); t++)
+    {
+        if (string(data.begin() + pos, data.begin() + pos + 4) != "MTrk") {
+            cerr << "[Sequencer] " << path << " has a malformed track" << endl;
+            return false;
+        }
+        size_t end = min(pos + 8 + readBigEndian(data, pos + 4, 4), data.size());
+        pos += 8;
+
+        uint64_t tick = 0;
+        unsigned char status = 0;
+        while (pos < end)
+        {
+            uint32_t delta;
+            if (!readVariableLength(data, pos, end, delta) || pos >= end)
+                break;
+            tick += delta;
+
+            // Running status reuses the last channel message's status byte
+            if (data[pos] & 0x80)
+                status = data[pos++];
+            else if (!status)
+                break;
+
+            if (status == 0xFF) {
+                if (pos >= end) break;
+                unsigned char type = data[pos++];
+                uint32_t length;
+                if (!readVariableLength(data, pos, end, length) || pos + length > end)
+                    break;
+
+                // A zero length beat would stop the clock, so it is ignored
+                uint32_t microseconds = type == 0x51 && length == 3 ? readBigEndian(data, pos, 3) : 0;
+                if (microseconds) {
+                    float bpm = 60000000.0f / microseconds;
+                    if (tick == 0)
+                        result.bpm = bpm;
+                    else
+                        result.events.push_back({tick, SEQUENCER_TEMPO, 0, bpm});
+                }
+                pos += length;
+                status = 0;
+                continue;
+            }
+
+            if (status == 0xF0 || status == 0xF7) {
+                uint32_t length;
+                if (!readVariableLength(data, pos, end, length))
+                    break;
+                pos += length;
+                status = 0;
+                continue;
+            }
+
+            unsigned int kind = status & 0xF0;
+            unsigned int bytes = (kind == 0xC0 || kind == 0xD0) ? 1 : 2;
+            if (pos + bytes > end)
+                break;
+
+            // Data bytes are 7 bit, anything else means the rest of the track can't be trusted
+            if ((data[pos] & 0x80) || (bytes == 2 && (data[pos + 1] & 0x80)))
+                break;
+
+            bool percussion = (status & 0x0F) == 9;
+            if (kind == 0x90 && percussion && data[pos + 1] > 0) {
+                int pad = drumPad(data[pos]);
+                if (pad >= 0) {
+                    result.events.push_back({tick, SEQUENCER_HIT, (uint8_t)pad, data[pos + 1] / 127.0f});
+                    lastTick = max(lastTick, tick);
+                }
+            }
+            else if ((kind == 0x90 || kind == 0x80) && !percussion) {
+                // A note-on with no velocity is a note-off
+                if (kind == 0x90 && data[pos + 1] > 0)
+                    result.events.push_back({tick, SEQUENCER_NOTE_ON, data[pos], data[pos + 1] / 127.0f});
+                else
+                    result.events.push_back({tick, SEQUENCER_NOTE_OFF, data[pos], 0.0f});
+                lastTick = max(lastTick, tick);
+            }
+            else if (kind == 0xB0 && !percussion && data[pos] == 64) {
+                result.events.push_back({tick, SEQUENCER_SUSTAIN, 0, data[pos + 1] >= 64 ? 1.0f : 0.0f});
+                lastTick = max(lastTick, tick);
+            }
+            pos += bytes;
+        }
+        pos = end;
+    }
+
+    if (result.events.empty()) {
+        cerr << "[Sequencer] " << path << " has no notes" << endl;
+        return false;
+    }
+    sortEvents(result);
+
+    // Loops on the bar (of four beats) after the last hit
+    uint64_t bar = 4 * (uint64_t)result.ppq;
+    result.length = (lastTick / bar + 1) * bar;
+
+    sequence = result;
+    return true;
+}
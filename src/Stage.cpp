@@ -2,16 +2,17 @@
 
 #include "Stage.h"
 #include "MatrixStack.h"
+#include "DrawData.h"
 
 // Save computation time by setting up the stage beforehand
-void Stage::initStage()
+void Stage::initStage(TransformHierarchy &transforms, bool upload)
 {   
     MatrixStack Model;
     Model.translate(center);
     
     /* Stage planes */
-    ground.init();
-    back_wall.init();
+    ground.init(upload);
+    back_wall.init(upload);
     
     // Ground
     Model.pushMatrix();
@@ -30,122 +31,62 @@ void Stage::initStage()
 
 
     /* Stage trusses */
-    float trussHeight = truss->bb.max.y - truss->bb.min.y;
-
-    // Truss front right
-    Model.pushMatrix();
-        Model.translate(glm::vec3(width/2.0f, 0.0f, -depth/2.0f));
-        for (int i = 0; i < 3; i++) {
-            Model.pushMatrix();
-                Model.translate(glm::vec3(0.0f, i*trussHeight, 0.0f));
-                Model.multMatrix(truss->getTransformMat());
-                trusses_M.push_back(Model.topMatrix());
-            Model.popMatrix();
-        }
-    Model.popMatrix();
-
-    // Truss front left
-    Model.pushMatrix();
-        Model.translate(glm::vec3(-width/2.0f, 0.0f, -depth/2.0f));
-        for (int i = 0; i < 3; i++) {
-            Model.pushMatrix();
-                Model.translate(glm::vec3(0.0f, i*trussHeight, 0.0f));
-                Model.multMatrix(truss->getTransformMat());
-                trusses_M.push_back(Model.topMatrix());
-            Model.popMatrix();
-        }
-    Model.popMatrix();
-
-    // Truss back left
-    Model.pushMatrix();
-        Model.translate(glm::vec3(-width/2.0f, 0.0f, depth/2.0f));
-        for (int i = 0; i < 3; i++) {
-            Model.pushMatrix();
-                Model.translate(glm::vec3(0.0f, i*trussHeight, 0.0f));
-                Model.multMatrix(truss->getTransformMat());
-                trusses_M.push_back(Model.topMatrix());
-            Model.popMatrix();
-        }
-    Model.popMatrix();
-
-    // Truss back right
-    Model.pushMatrix();
-        Model.translate(glm::vec3(width/2.0f, 0.0f, depth/2.0f));
-        for (int i = 0; i < 3; i++) {
-            Model.pushMatrix();
-                Model.translate(glm::vec3(0.0f, i*trussHeight, 0.0f));
-                Model.multMatrix(truss->getTransformMat());
-                trusses_M.push_back(Model.topMatrix());
-            Model.popMatrix();
-        }
-    Model.popMatrix();
-
-    // Truss front top
-    Model.pushMatrix();
-        Model.translate(glm::vec3(width/2.0f, 5.0f, -depth/2.0f));
-        Model.rotate(glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        for (int i = 0; i < width/trussHeight; i++) {
-            Model.pushMatrix();
-                Model.translate(glm::vec3(0.0f, i*trussHeight + 1.0f, 0.0f));
-                Model.multMatrix(truss->getTransformMat());
-                trusses_M.push_back(Model.topMatrix());
-            Model.popMatrix();
-        }
-    Model.popMatrix();
+    this->transforms = &transforms;
+    root = transforms.add();
+    transforms.setTranslation(root, center);
 
-    // Truss back top
-    Model.pushMatrix();
-        Model.translate(glm::vec3(width/2.0f, 5.0f, depth/2.0f));
-        Model.rotate(glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        for (int i = 0; i < width/trussHeight; i++) {
-            Model.pushMatrix();
-                Model.translate(glm::vec3(0.0f, i*trussHeight + 1.0f, 0.0f));
-                Model.multMatrix(truss->getTransformMat());
-                trusses_M.push_back(Model.topMatrix());
-            Model.popMatrix();
-        }
-    Model.popMatrix();
-
-    // Truss right top
-    Model.pushMatrix();
-        Model.translate(glm::vec3(width/2.0f, 5.0f, depth/2.0f));
-        Model.rotate(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        for (int i = 0; i < depth/trussHeight; i++) {
-            Model.pushMatrix();
-                Model.translate(glm::vec3(0.0f, i*trussHeight + 0.2f, 0.0f));
-                Model.multMatrix(truss->getTransformMat());
-                trusses_M.push_back(Model.topMatrix());
-            Model.popMatrix();
-        }
-    Model.popMatrix();
-
-    // Truss left top
-    Model.pushMatrix();
-        Model.translate(glm::vec3(-width/2.0f, 5.0f, depth/2.0f));
-        Model.rotate(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        for (int i = 0; i < depth/trussHeight; i++) {
-            Model.pushMatrix();
-                Model.translate(glm::vec3(0.0f, i*trussHeight + 0.2f, 0.0f));
-                Model.multMatrix(truss->getTransformMat());
-                trusses_M.push_back(Model.topMatrix());
-            Model.popMatrix();
-        }
-    Model.popMatrix();
+    float trussHeight = truss->bb.max.y - truss->bb.min.y;
+    glm::mat4 noRotation = glm::mat4(1.0f);
+    glm::mat4 alongX = glm::rotate(glm::mat4(1.0f), glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 alongZ = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+
+    // Corner columns
+    addTrussRow(glm::vec3( width/2.0f, 0.0f, -depth/2.0f), noRotation, 3.0f, 0.0f, trussHeight);
+    addTrussRow(glm::vec3(-width/2.0f, 0.0f, -depth/2.0f), noRotation, 3.0f, 0.0f, trussHeight);
+    addTrussRow(glm::vec3(-width/2.0f, 0.0f,  depth/2.0f), noRotation, 3.0f, 0.0f, trussHeight);
+    addTrussRow(glm::vec3( width/2.0f, 0.0f,  depth/2.0f), noRotation, 3.0f, 0.0f, trussHeight);
+
+    // Front and back top beams
+    addTrussRow(glm::vec3(width/2.0f, 5.0f, -depth/2.0f), alongX, width/trussHeight, 1.0f, trussHeight);
+    addTrussRow(glm::vec3(width/2.0f, 5.0f,  depth/2.0f), alongX, width/trussHeight, 1.0f, trussHeight);
+
+    // Right and left top beams
+    addTrussRow(glm::vec3( width/2.0f, 5.0f, depth/2.0f), alongZ, depth/trussHeight, 0.2f, trussHeight);
+    addTrussRow(glm::vec3(-width/2.0f, 5.0f, depth/2.0f), alongZ, depth/trussHeight, 0.2f, trussHeight);
+}
 
+// Trusses stacked end to end along the row's local y axis
+void Stage::addTrussRow(glm::vec3 position, glm::mat4 rotation, float length, float start, float trussHeight)
+{
+    TransformNode row = transforms->add(root);
+    transforms->setTranslation(row, position);
+    transforms->setRotation(row, rotation);
+
+    for (int i = 0; i < length; i++) {
+        TransformNode node = transforms->add(row, truss->getTransformMat());
+        transforms->setTranslation(node, glm::vec3(0.0f, i*trussHeight + start, 0.0f));
+        transforms->setBounds(node, truss->meshBB);
+        trussNodes.push_back(node);
+    }
 }
 
-void Stage::renderStage(shared_ptr<Program> prog, bool useMaterials)
+void Stage::renderStage(shared_ptr<Program> prog, bool useMaterials, const LightmapSet *lightmaps)
 {
     /* Render planes */
-    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(ground.M));
+    if (lightmaps) lightmaps->bind(prog, "ground");
+    DrawData::setModel(ground.M);
     ground.render(prog, useMaterials, stage_texture);
 
-    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(back_wall.M));
+    if (lightmaps) lightmaps->bind(prog, "back_wall");
+    DrawData::setModel(back_wall.M);
     back_wall.render(prog, useMaterials);
 
     /* Render trusses */
-    for (auto M : trusses_M) {
-        glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(M));
+    for (unsigned int i = 0; i < trussNodes.size(); i++) {
+        if (lightmaps) lightmaps->bind(prog, "truss" + to_string(i));
+        DrawData::setModel(transforms->getWorld(trussNodes[i]));
         truss->Draw(prog, useMaterials);
     }
+
+    if (lightmaps) lightmaps->unbind(prog);
 }
\ No newline at end of file
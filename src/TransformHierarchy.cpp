@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cassert>
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define TRANSFORM_SSE
+#endif
+
+#include "TransformHierarchy.h"
+
+// Dirty flags, a node's own TRS changed or only something above it did
+#define DIRTY_LOCAL 1
+#define DIRTY_WORLD 2
+
+// out = a * b, one column of the result per four multiply-adds
+static inline void multiply(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out)
+{
+#ifdef TRANSFORM_SSE
+    __m128 a0 = _mm_loadu_ps(&a[0][0]);
+    __m128 a1 = _mm_loadu_ps(&a[1][0]);
+    __m128 a2 = _mm_loadu_ps(&a[2][0]);
+    __m128 a3 = _mm_loadu_ps(&a[3][0]);
+    for (int j = 0; j < 4; j++) {
+        __m128 col = _mm_mul_ps(a0, _mm_set1_ps(b[j][0]));
+        col = _mm_add_ps(col, _mm_mul_ps(a1, _mm_set1_ps(b[j][1])));
+        col = _mm_add_ps(col, _mm_mul_ps(a2, _mm_set1_ps(b[j][2])));
+        col = _mm_add_ps(col, _mm_mul_ps(a3, _mm_set1_ps(b[j][3])));
+        _mm_storeu_ps(&out[j][0], col);
+    }
+#else
+    out = a * b;
+#endif
+}
+
+TransformNode TransformHierarchy::add(TransformNode parent, const glm::mat4 &offset)
+{
+    TransformNode node = (TransformNode)parents.size();
+    assert(parent == TRANSFORM_ROOT || parent < node);
+
+    parents.push_back(parent);
+    translations.push_back(glm::vec3(0.0f));
+    rotations.push_back(glm::mat4(1.0f));
+    scales.push_back(glm::vec3(1.0f));
+    offsets.push_back(offset);
+    locals.push_back(offset);
+    worlds.push_back(glm::mat4(1.0f));
+    localBounds.push_back(Bounds::empty());
+    worldBounds.push_back(Bounds::empty());
+    dirty.push_back(0);
+
+    markDirty(node);
+    return node;
+}
+
+void TransformHierarchy::markDirty(TransformNode node)
+{
+    dirty[node] |= DIRTY_LOCAL;
+    firstDirty = (std::min)(firstDirty, (size_t)node);
+}
+
+void TransformHierarchy::setTranslation(TransformNode node, const glm::vec3 &translation)
+{
+    translations[node] = translation;
+    markDirty(node);
+}
+
+void TransformHierarchy::setRotation(TransformNode node, const glm::mat4 &rotation)
+{
+    rotations[node] = rotation;
+    markDirty(node);
+}
+
+void TransformHierarchy::setScale(TransformNode node, const glm::vec3 &scale)
+{
+    scales[node] = scale;
+    markDirty(node);
+}
+
+void TransformHierarchy::setOffset(TransformNode node, const glm::mat4 &offset)
+{
+    offsets[node] = offset;
+    markDirty(node);
+}
+
+void TransformHierarchy::setBounds(TransformNode node, const BoundingBox &bounds)
+{
+    localBounds[node] = bounds;
+    markDirty(node);
+}
+
+void TransformHierarchy::update()
+{
+    size_t count = parents.size();
+    moved.clear();
+    if (firstDirty >= count)
+        return;
+
+    for (size_t i = firstDirty; i < count; i++) {
+        TransformNode parent = parents[i];
+        if (parent != TRANSFORM_ROOT && dirty[parent])
+            dirty[i] |= DIRTY_WORLD;
+        if (!dirty[i])
+            continue;
+
+        if (dirty[i] & DIRTY_LOCAL) {
+            glm::mat4 TRS = glm::scale(rotations[i], scales[i]);
+            TRS[3] = glm::vec4(translations[i], 1.0f);
+            multiply(TRS, offsets[i], locals[i]);
+        }
+
+        if (parent == TRANSFORM_ROOT)
+            worlds[i] = locals[i];
+        else
+            multiply(worlds[parent], locals[i], worlds[i]);
+
+        worldBounds[i] = Bounds::transform(worlds[i], localBounds[i]);
+        moved.push_back((TransformNode)i);
+    }
+
+    // Flags are only cleared once every descendant has seen them
+    std::fill(dirty.begin() + firstDirty, dirty.end(), 0);
+    firstDirty = count;
+}
@@ -0,0 +1,493 @@
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+#include "Application.h"
+#include "Mixer.h"
+#include "Sequencer.h"
+#include "Reverb.h"
+#include "Piano.h"
+#include "EmitterSystem.h"
+
+using namespace std;
+
+// Seconds of audio mixed per run
+#define MIXER_BENCH_SECONDS 10
+
+// Seconds of audio put through each reverb, and the response lengths tried
+#define REVERB_BENCH_SECONDS 10
+#define REVERB_BENCH_LENGTHS {1.0f, 2.0f, 4.0f, 8.0f}
+
+// Seconds of piano played per run, frames between its notes, and the budgets tried
+#define PIANO_BENCH_SECONDS 10
+#define PIANO_BENCH_SPACING 1200
+#define PIANO_BENCH_BUDGETS {PIANO_VOICE_BUDGET, 32}
+
+// Emitter counts tried, square meters each one gets, and updates per run at 60 per second
+#define EMITTER_BENCH_COUNTS  {1000, 10000, 100000}
+#define EMITTER_BENCH_DENSITY 4.0f
+#define EMITTER_BENCH_UPDATES 600
+
+// Clicks timed per path, frames the loopback device renders at a time while timing them, and the
+// level that counts as heard
+#define AUDIO_BENCH_TRIGGERS  100
+#define AUDIO_BENCH_PERIOD    64
+#define AUDIO_BENCH_THRESHOLD 0.01f
+
+// Seconds rendered under load, looping voices under it, and frames between drum hits
+#define AUDIO_BENCH_SECONDS    10
+#define AUDIO_BENCH_BACKGROUND 32
+#define AUDIO_BENCH_HIT_FRAMES 6000
+
+/*
+ * Measures how many voices one core can mix in real time. Every voice
+ * loops one of the drum or guitar samples at its own pitch and pan, so all
+ * of them stay active and nearly all go through the resampler. Runs
+ * without an audio device (see --bench-mixer in main.cpp); the checksum of
+ * the mixed output is the same on every run of the same build.
+ */
+void Application::benchmarkMixer(const string audioDirectory, unsigned int voices)
+{
+    if (voices == 0 || voices > MIXER_MAX_VOICES) voices = MIXER_MAX_VOICES;
+
+    Mixer mixer;
+    const char *files[4] = { "snare.wav", "hi_hat.wav", "kick.wav", "guitar-riff.wav" };
+    vector<unsigned int> samples;
+    for (auto file : files) {
+        vector<float> frames;
+        unsigned int channels, sampleRate;
+        if (AudioSystem::decodeFile(audioDirectory + "/" + file, frames, channels, sampleRate))
+            samples.push_back(mixer.addSample(frames, channels, sampleRate));
+    }
+    if (samples.empty()) {
+        cerr << "[MixerBench] No samples to mix" << endl;
+        return;
+    }
+
+    for (unsigned int i = 0; i < voices; i++) {
+        float pan = voices > 1 ? 2.0f * i / (voices - 1) - 1.0f : 0.0f;
+        float pitch = 1.0f + 0.01f * (i % 7);
+        mixer.play(samples[i % samples.size()], 1.0f / voices, pan, pitch, 0, MIXER_BUS_SFX, true);
+    }
+
+    const unsigned int frames = MIXER_BENCH_SECONDS * MIXER_SAMPLE_RATE;
+    vector<float> out(MIXER_BLOCK_FRAMES * 2);
+    uint32_t checksum = 2166136261u;
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned int done = 0; done < frames; done += MIXER_BLOCK_FRAMES) {
+        mixer.render(out.data(), MIXER_BLOCK_FRAMES);
+
+        // FNV-1a over the output bits, identical output gives the same value
+        for (float value : out) {
+            uint32_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            checksum = (checksum ^ bits) * 16777619u;
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    double realtime = MIXER_BENCH_SECONDS / elapsed.count();
+    cout << "[MixerBench] " << mixer.getActiveVoices() << " voices, " << MIXER_BENCH_SECONDS
+         << " s mixed in " << elapsed.count() * 1000.0 << " ms (" << realtime << "x real time), "
+         << voices * realtime << " voices per core, checksum " << hex << checksum << dec << endl;
+}
+
+/*
+ * Checks the sequencer's timing end to end. A dense sequence (a hit every
+ * tick, with a tempo change half way) plays single-sample clicks through
+ * the mixer; each click is found in the mixed output and compared with the
+ * frame its tick works out to on paper.
+ */
+void Application::benchmarkSequencer()
+{
+    const float tempos[2] = { 130.0f, 150.0f };        // Fractional and whole frames per tick
+    const unsigned int ppq = 480;
+    const uint64_t half = 4 * 4 * ppq;                 // Four bars at each tempo
+
+    Mixer mixer;
+    Sequencer sequencer;
+    sequencer.setPad(DRUM_PAD_KICK, mixer.addSample(vector<float>(1, 1.0f), 1, MIXER_SAMPLE_RATE), 0, 1.0f);
+    mixer.setScheduler(&sequencer);
+
+    Sequence sequence;
+    sequence.ppq = ppq;
+    sequence.bpm = tempos[0];
+    sequence.length = 2 * half;
+    vector<double> expected;
+    for (uint64_t tick = 0; tick < 2 * half; tick++) {
+        if (tick == half)
+            sequence.events.push_back({tick, SEQUENCER_TEMPO, 0, tempos[1]});
+        sequence.events.push_back({tick, SEQUENCER_HIT, DRUM_PAD_KICK, 1.0f});
+
+        double seconds = tick < half ? tick * 60.0 / (tempos[0] * ppq)
+            : half * 60.0 / (tempos[0] * ppq) + (tick - half) * 60.0 / (tempos[1] * ppq);
+        expected.push_back(seconds * MIXER_SAMPLE_RATE);
+    }
+    sequencer.play(sequence);
+
+    unsigned int frames = (unsigned int)ceil(expected.back()) + MIXER_BLOCK_FRAMES;
+    vector<float> out(2 * frames);
+
+    auto start = chrono::steady_clock::now();
+    mixer.render(out.data(), frames);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    size_t found = 0;
+    double worst = 0.0;
+    for (unsigned int i = 0; i < frames && found < expected.size(); i++) {
+        if (out[2 * i] != 0.0f)
+            worst = (std::max)(worst, fabs(i - expected[found++]));
+    }
+
+    double seconds = (double)frames / MIXER_SAMPLE_RATE;
+    cout << "[SequencerBench] " << found << "/" << expected.size() << " hits at "
+         << expected.size() / seconds << " per second, worst timing error " << worst << " samples, "
+         << seconds / elapsed.count() << "x real time" << endl;
+}
+
+/*
+ * Measures the reverb's cost against the length of its impulse response.
+ * Noise goes through it a mixer block at a time, as on the mixer thread,
+ * for responses from one to eight seconds; the slowest block is compared
+ * with the time a block takes to play.
+ */
+void Application::benchmarkReverb()
+{
+    const float lengths[] = REVERB_BENCH_LENGTHS;
+    const unsigned int frames = REVERB_BENCH_SECONDS * MIXER_SAMPLE_RATE;
+    const double budget = 1000000.0 * MIXER_BLOCK_FRAMES / MIXER_SAMPLE_RATE;     // Microseconds
+
+    mt19937 rng(1);
+    uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    vector<float> input(frames);
+    for (float &sample : input)
+        sample = noise(rng);
+    vector<float> output(2 * MIXER_BLOCK_FRAMES);
+
+    for (float length : lengths)
+    {
+        vector<float> impulse;
+        Reverb::makeImpulse(impulse, length, 0.75f * length, MIXER_SAMPLE_RATE);
+        Reverb reverb;
+        reverb.setImpulse(impulse, 2, MIXER_SAMPLE_RATE, MIXER_SAMPLE_RATE);
+
+        double slowest = 0.0;
+        auto start = chrono::steady_clock::now();
+        for (unsigned int done = 0; done < frames; done += MIXER_BLOCK_FRAMES) {
+            auto blockStart = chrono::steady_clock::now();
+            reverb.process(&input[done], output.data(), MIXER_BLOCK_FRAMES);
+            chrono::duration<double, micro> block = chrono::steady_clock::now() - blockStart;
+            slowest = max(slowest, block.count());
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        cout << "[ReverbBench] " << length << " s response, " << reverb.getPartitionCount() << " partitions: "
+             << REVERB_BENCH_SECONDS / elapsed.count() << "x real time on one core, slowest block "
+             << slowest << " us of " << budget << " us" << endl;
+    }
+}
+
+/*
+ * Measures the piano's voice engine at full polyphony. With the pedal down
+ * a note is struck every PIANO_BENCH_SPACING frames, climbing the keyboard,
+ * so every voice is busy within a few seconds and new notes steal the
+ * quietest; the pedal comes up every few seconds to release everything.
+ * The same notes are then played at a smaller budget, where the voices
+ * it can't afford are shed.
+ */
+void Application::benchmarkPiano()
+{
+    Piano piano;
+    auto synthStart = chrono::steady_clock::now();
+    piano.synthesize();
+    chrono::duration<double> synthTime = chrono::steady_clock::now() - synthStart;
+    cout << "[PianoBench] Synthesized the zones in " << synthTime.count() * 1000.0 << " ms" << endl;
+
+    const unsigned int budgets[] = PIANO_BENCH_BUDGETS;
+    const unsigned int frames = PIANO_BENCH_SECONDS * MIXER_SAMPLE_RATE;
+    const double period = 1000000.0 * MIXER_BLOCK_FRAMES / MIXER_SAMPLE_RATE;     // Microseconds
+    vector<float> out(MIXER_BLOCK_FRAMES * 2);
+
+    for (unsigned int budget : budgets)
+    {
+        piano.setVoiceBudget(budget);
+        unsigned int stolen = piano.voicesStolen, shed = piano.voicesShed;
+        unsigned int note = 0, peak = 0;
+        double voiceBlocks = 0.0, slowest = 0.0;
+
+        auto start = chrono::steady_clock::now();
+        for (unsigned int done = 0; done < frames; done += MIXER_BLOCK_FRAMES)
+        {
+            // Pedal up for a block every four seconds, then straight back down
+            if (done % (4 * MIXER_SAMPLE_RATE) < MIXER_BLOCK_FRAMES) {
+                piano.scheduleEvent(0, PIANO_SUSTAIN, 0, 0.0f);
+                piano.scheduleEvent(MIXER_BLOCK_FRAMES - 1, PIANO_SUSTAIN, 0, 1.0f);
+            }
+
+            // Struck and let go half way to the next, the pedal keeps it ringing
+            for (unsigned int i = 0; i < MIXER_BLOCK_FRAMES; i++) {
+                unsigned int frame = done + i;
+                int key = PIANO_LOWEST_NOTE + (frame / PIANO_BENCH_SPACING) % (PIANO_HIGHEST_NOTE - PIANO_LOWEST_NOTE + 1);
+                if (frame % PIANO_BENCH_SPACING == 0)
+                    piano.scheduleEvent(i, PIANO_NOTE_ON, key, 0.5f + 0.1f * (note++ % 6));
+                else if (frame % PIANO_BENCH_SPACING == PIANO_BENCH_SPACING / 2)
+                    piano.scheduleEvent(i, PIANO_NOTE_OFF, key);
+            }
+
+            memset(out.data(), 0, out.size() * sizeof(float));
+            auto blockStart = chrono::steady_clock::now();
+            piano.render(out.data(), MIXER_BLOCK_FRAMES);
+            chrono::duration<double, micro> block = chrono::steady_clock::now() - blockStart;
+            slowest = max(slowest, block.count());
+
+            peak = max(peak, piano.getActiveVoices());
+            voiceBlocks += piano.getActiveVoices();
+        }
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+        double realtime = PIANO_BENCH_SECONDS / elapsed.count();
+        double average = voiceBlocks / (frames / MIXER_BLOCK_FRAMES);
+        cout << "[PianoBench] Budget " << budget << ": " << peak << " voices at most, " << average
+             << " on average, " << realtime << "x real time, " << average * realtime << " voices per core, slowest block "
+             << slowest << " us of " << period << " us, " << piano.voicesStolen - stolen << " stolen, "
+             << piano.voicesShed - shed << " shed" << endl;
+    }
+}
+
+/*
+ * Measures emitter selection as the scene grows. The emitters are spread
+ * at the same density however many there are, so the ground grows with
+ * them, all looping at random gains and ranges, and the listener walks a
+ * circle through them at 60 updates a second. Only selection runs, there
+ * is no context, so the time per update is the cost of finding what is
+ * near and ranking it; it should stay flat while the total grows.
+ */
+void Application::benchmarkEmitters()
+{
+    const unsigned int counts[] = EMITTER_BENCH_COUNTS;
+    TransformHierarchy transforms;
+    transforms.update();
+
+    for (unsigned int count : counts)
+    {
+        EmitterSystem system;
+        system.init();
+
+        mt19937 rng(1);
+        float side = sqrtf(count * EMITTER_BENCH_DENSITY);
+        uniform_real_distribution<float> place(0.0f, side), gain(0.1f, 1.0f), range(4.0f, EMITTER_MAX_DISTANCE);
+        auto addStart = chrono::steady_clock::now();
+        for (unsigned int i = 0; i < count; i++) {
+            EmitterHandle emitter = system.add(1, 2.0f, glm::vec3(place(rng), 1.0f, place(rng)), gain(rng), 1.0f,
+                                               range(rng), i % 50 == 0 ? 1 : 0);
+            system.play(emitter);
+        }
+        chrono::duration<double, milli> addTime = chrono::steady_clock::now() - addStart;
+
+        unsigned long promotions = system.getStats().promotions;
+        double nearby = 0.0, audible = 0.0, slowest = 0.0;
+        auto start = chrono::steady_clock::now();
+        for (unsigned int i = 0; i < EMITTER_BENCH_UPDATES; i++)
+        {
+            // 1.5 m/s around a circle a third of the way out from the middle
+            double time = i / 60.0;
+            float angle = (float)(time * 1.5 / (side / 3.0f));
+            glm::vec3 listener(side / 2.0f + side / 3.0f * cosf(angle), 1.7f, side / 2.0f + side / 3.0f * sinf(angle));
+            glm::vec3 forward(-sinf(angle), 0.0f, cosf(angle));
+
+            auto updateStart = chrono::steady_clock::now();
+            system.update(transforms, time, listener, forward, glm::vec3(0.0f, 1.0f, 0.0f));
+            chrono::duration<double, micro> update = chrono::steady_clock::now() - updateStart;
+            slowest = max(slowest, update.count());
+
+            nearby += system.getStats().nearby;
+            audible += system.getStats().audible;
+        }
+        chrono::duration<double, micro> elapsed = chrono::steady_clock::now() - start;
+
+        const EmitterStats &stats = system.getStats();
+        cout << "[EmitterBench] " << count << " emitters (added in " << addTime.count() << " ms): "
+             << elapsed.count() / EMITTER_BENCH_UPDATES << " us per update, slowest " << slowest << " us, "
+             << nearby / EMITTER_BENCH_UPDATES << " nearby and " << audible / EMITTER_BENCH_UPDATES
+             << " audible on average, " << stats.real << " real, " << stats.promotions - promotions
+             << " promotions" << endl;
+    }
+}
+
+/*
+ * Runs the whole output path on an OpenAL Soft loopback device, so it needs
+ * no sound card and goes as fast as it can. First a click is played alone,
+ * over and over at random points, through the mixer and then straight
+ * through an OpenAL source, and the frames from the trigger to the first
+ * sample of it in the device's output are counted. Then the device renders
+ * AUDIO_BENCH_SECONDS of looping voices, drum hits and the reverb, timing
+ * the mixer's blocks and OpenAL's rendering of them separately. Everything
+ * rendered can be written to a WAV file to listen to.
+ */
+void Application::benchmarkAudio(const string audioDirectory, const string capturePath)
+{
+    // Declared first, so the mixer is gone before it
+    Reverb reverb;
+
+    AudioSystem audio;
+    if (!audio.init(true)) {
+        cerr << "[AudioBench] No loopback device to render to" << endl;
+        return;
+    }
+
+    vector<float> captured;
+    auto render = [&](float *out, unsigned int frames) {
+        audio.renderLoopback(out, frames);
+        captured.insert(captured.end(), out, out + frames * 2);
+    };
+
+    // The load test services the mixer itself, so each side is timed once
+    auto renderDevice = [&](float *out, unsigned int frames) {
+        audio.renderDevice(out, frames);
+        captured.insert(captured.end(), out, out + frames * 2);
+    };
+
+    // Full level from its first frame: 10 ms of 1 kHz dying away
+    const float pi = 3.14159265f;
+    vector<float> click(MIXER_SAMPLE_RATE / 100);
+    for (unsigned int i = 0; i < click.size(); i++)
+        click[i] = 0.8f * cosf(2.0f * pi * 1000.0f * i / MIXER_SAMPLE_RATE) * expf(-(float)i / (0.002f * MIXER_SAMPLE_RATE));
+    ALuint clickBuffer = audio.createBuffer(click, 1, MIXER_SAMPLE_RATE);
+    int clickSample = audio.getMixerSample(clickBuffer);
+    ALuint direct = audio.createSource(0.0f, 0.0f, 0.0f);
+    alSourcei(direct, AL_SOURCE_RELATIVE, AL_TRUE);
+    audio.bind(direct, clickBuffer);
+
+    const char *paths[2] = { "mixer", "OpenAL source" };
+    vector<float> period(AUDIO_BENCH_PERIOD * 2);
+    mt19937 rng(1);
+    uniform_int_distribution<unsigned int> gap(10, 30);
+    for (unsigned int path = 0; path < 2; path++)
+    {
+        if (path == 0 && clickSample < 0) continue;
+
+        vector<unsigned int> latencies;
+        for (unsigned int trigger = 0; trigger < AUDIO_BENCH_TRIGGERS; trigger++)
+        {
+            // Longer than the click, so the last one has died away
+            for (unsigned int i = gap(rng); i > 0; i--)
+                render(period.data(), AUDIO_BENCH_PERIOD);
+
+            if (path == 0)
+                audio.mixer.play(clickSample);
+            else
+                audio.play(direct);
+
+            // Up to a second for it to come through
+            for (unsigned int waited = 0; waited < MIXER_SAMPLE_RATE; waited += AUDIO_BENCH_PERIOD) {
+                render(period.data(), AUDIO_BENCH_PERIOD);
+                unsigned int frame = 0;
+                while (frame < AUDIO_BENCH_PERIOD && fabsf(period[2 * frame]) < AUDIO_BENCH_THRESHOLD &&
+                       fabsf(period[2 * frame + 1]) < AUDIO_BENCH_THRESHOLD)
+                    frame++;
+                if (frame < AUDIO_BENCH_PERIOD) {
+                    latencies.push_back(waited + frame);
+                    break;
+                }
+            }
+        }
+
+        if (latencies.empty()) {
+            cerr << "[AudioBench] Nothing came through the " << paths[path] << endl;
+            continue;
+        }
+        sort(latencies.begin(), latencies.end());
+        auto ms = [](unsigned int frames) { return 1000.0 * frames / MIXER_SAMPLE_RATE; };
+        cout << "[AudioBench] Trigger to first sample through the " << paths[path] << ": "
+             << ms(latencies.front()) << " ms at best, " << ms(latencies[latencies.size() / 2]) << " median, "
+             << ms(latencies.back()) << " at worst (" << latencies.size() << " of " << AUDIO_BENCH_TRIGGERS
+             << " heard)" << endl;
+    }
+
+    // The game's room, and whatever of its samples are there to keep the mixer busy
+    vector<float> impulse;
+    Reverb::makeImpulse(impulse, 2.5f, 1.8f, MIXER_SAMPLE_RATE);
+    reverb.setImpulse(impulse, 2, MIXER_SAMPLE_RATE, MIXER_SAMPLE_RATE);
+    audio.mixer.setReverbSend(MIXER_BUS_SFX, 0.35f);
+    audio.mixer.setReverbSend(MIXER_BUS_MUSIC, 0.25f);
+    audio.mixer.setReverb(&reverb);
+
+    const char *files[4] = { "snare.wav", "hi_hat.wav", "kick.wav", "guitar-riff.wav" };
+    vector<int> samples;
+    for (auto file : files) {
+        int sample = audio.getMixerSample(audio.loadFile(audioDirectory + "/" + file));
+        if (sample >= 0)
+            samples.push_back(sample);
+    }
+    if (samples.empty() && clickSample >= 0)
+        samples.push_back(clickSample);
+    if (samples.empty()) {
+        cerr << "[AudioBench] The mixer isn't running" << endl;
+        return;
+    }
+
+    for (unsigned int i = 0; i < AUDIO_BENCH_BACKGROUND; i++) {
+        float pan = 2.0f * i / (AUDIO_BENCH_BACKGROUND - 1) - 1.0f;
+        float pitch = 0.75f + 0.5f * i / AUDIO_BENCH_BACKGROUND;
+        audio.mixer.play(samples[i % samples.size()], 0.5f / AUDIO_BENCH_BACKGROUND, pan, pitch, 0, MIXER_BUS_MUSIC, true);
+    }
+
+    const unsigned int blocks = AUDIO_BENCH_SECONDS * MIXER_SAMPLE_RATE / MIXER_BLOCK_FRAMES;
+    const double blockTime = 1000000.0 * MIXER_BLOCK_FRAMES / MIXER_SAMPLE_RATE;    // Microseconds
+    vector<float> block(MIXER_BLOCK_FRAMES * 2);
+    vector<double> mixing, rendering;
+    unsigned int underruns = audio.mixer.underruns, hits = 0;
+
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < blocks; i++)
+    {
+        if (i * MIXER_BLOCK_FRAMES / AUDIO_BENCH_HIT_FRAMES != (i + 1) * MIXER_BLOCK_FRAMES / AUDIO_BENCH_HIT_FRAMES)
+            audio.mixer.play(samples[hits++ % samples.size()], 0.5f, 0.0f, 1.0f, 1);
+
+        // The mixer refills the block the device just played, then the device renders the next
+        auto mixStart = chrono::steady_clock::now();
+        audio.mixer.service();
+        auto renderStart = chrono::steady_clock::now();
+        renderDevice(block.data(), MIXER_BLOCK_FRAMES);
+        auto renderEnd = chrono::steady_clock::now();
+
+        mixing.push_back(chrono::duration<double, micro>(renderStart - mixStart).count());
+        rendering.push_back(chrono::duration<double, micro>(renderEnd - renderStart).count());
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    auto report = [&](const char *name, vector<double> &times) {
+        double total = 0.0;
+        for (double time : times)
+            total += time;
+        sort(times.begin(), times.end());
+        cout << "[AudioBench] " << name << ": " << total / times.size() << " us per block on average, "
+             << times[times.size() * 99 / 100] << " us at the 99th percentile, " << times.back()
+             << " us at worst, of " << blockTime << " us" << endl;
+    };
+    report("Mixer", mixing);
+    report("OpenAL", rendering);
+    cout << "[AudioBench] " << AUDIO_BENCH_SECONDS << " s with " << audio.mixer.getActiveVoices() << " voices and "
+         << hits << " hits rendered at " << AUDIO_BENCH_SECONDS / elapsed.count() << "x real time, "
+         << audio.mixer.underruns - underruns << " underruns" << endl;
+
+    if (!capturePath.empty()) {
+        AudioFile<float> file;
+        unsigned int frames = captured.size() / 2;
+        file.setAudioBufferSize(2, frames);
+        for (unsigned int i = 0; i < frames; i++) {
+            file.samples[0][i] = captured[2 * i];
+            file.samples[1][i] = captured[2 * i + 1];
+        }
+        file.setSampleRate(MIXER_SAMPLE_RATE);
+        file.setBitDepth(16);
+        if (file.save(capturePath))
+            cout << "[AudioBench] Wrote " << (double)frames / MIXER_SAMPLE_RATE << " s to " << capturePath << endl;
+        else
+            cerr << "[AudioBench] Failed to write " << capturePath << endl;
+    }
+}
@@ -0,0 +1,39 @@
+#include <iostream>
+
+#include "Application.h"
+#include "Lightmapper.h"
+#include "common.h"
+
+using namespace std;
+
+/*
+ * Bakes the static lights into lightmaps for the static set pieces. Runs
+ * without a window (see --bake in main.cpp), after initLights, initGeometry
+ * stage.initStage and initTransforms have set up the scene on the CPU.
+ */
+void Application::bakeLightmaps(const string objectDirectory, const string textureDirectory,
+    unsigned int threads, unsigned int samples)
+{
+    Lightmapper lightmapper;
+    lightmapper.threads = threads;
+    lightmapper.samples = samples;
+
+    lightmapper.addLights(lightingSystem);
+
+    transforms.update();
+
+    // Stage
+    lightmapper.addPlane("ground", stage.ground, AverageColorFromFile("stage_floor.jpg", textureDirectory));
+    lightmapper.addPlane("back_wall", stage.back_wall, glm::vec3(0.5f));
+    for (unsigned int i = 0; i < stage.trussNodes.size(); i++)
+        lightmapper.addModel("truss" + to_string(i), *stage.truss, transforms.getWorld(stage.trussNodes[i]));
+
+    // Props
+    lightmapper.addModel("drum_set", *drum_set, transforms.getWorld(drumSetNode));
+    lightmapper.addModel("amplifier1", *amplifier1, transforms.getWorld(amplifier1Node));
+    lightmapper.addModel("amplifier2", *amplifier2, transforms.getWorld(amplifier2Node));
+    lightmapper.addModel("piano", *piano, transforms.getWorld(pianoNode));
+
+    lightmapper.bake();
+    lightmapper.save(objectDirectory + "/lightmaps");
+}
@@ -1,4 +1,13 @@
+#include <iostream>
+
 #include "Application.h"
+#include "GLState.h"
+
+// One octave from C, white keys on the bottom row and black keys above them
+static const int pianoKeys[PIANO_KEYBOARD_KEYS] = {
+    GLFW_KEY_Z, GLFW_KEY_S, GLFW_KEY_X, GLFW_KEY_D, GLFW_KEY_C, GLFW_KEY_V, GLFW_KEY_G,
+    GLFW_KEY_B, GLFW_KEY_H, GLFW_KEY_N, GLFW_KEY_J, GLFW_KEY_M, GLFW_KEY_COMMA
+};
 
 bool updateKeyState(int action) {
     if (action == GLFW_PRESS)   return true;
@@ -11,6 +20,25 @@ void Application::keyCallback(GLFWwindow *window, int key, int scancode, int act
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, GL_TRUE);
 
+    // A replay supplies its own input
+    if (replaying) return;
+
+    if (recording)
+        eventLog.add(currState.tick, EVENT_KEY, key, action, mods);
+    handleKey(key, action, mods);
+}
+
+void Application::mouseCallback(GLFWwindow *window, double xpos, double ypos)
+{
+    if (replaying) return;
+
+    if (recording)
+        eventLog.add(currState.tick, EVENT_CURSOR, 0, 0, 0, (float) xpos, (float) ypos);
+    handleCursor((float) xpos, (float) ypos);
+}
+
+void Application::handleKey(int key, int action, int mods)
+{
     // Camera
     if (key == GLFW_KEY_W)    pressedUp    = updateKeyState(action);
     if (key == GLFW_KEY_S)  pressedDown  = updateKeyState(action);
@@ -21,26 +49,80 @@ void Application::keyCallback(GLFWwindow *window, int key, int scancode, int act
     if (key == GLFW_KEY_E && action == GLFW_PRESS) {
         checkDrumInteraction();
         checkGuitaristInteraction();
+        checkPianoInteraction();
     }
 
     if (key == GLFW_KEY_Q && action == GLFW_PRESS && useDrums) {
         fixedCam = !fixedCam;
     }
+
+    // Drum sequencer, B is a piano key while playing it
+    if (key == GLFW_KEY_B && action == GLFW_PRESS && !usePiano) {
+        if (sequencer.isPlaying()) sequencer.stop();
+        else                       sequencer.play(drumGroove);
+    }
+
+    // Drum hits go straight to the trigger thread
+    if (action == GLFW_PRESS && useDrums) {
+        if (key == GLFW_KEY_F)     drumTrigger.trigger(DRUM_PAD_SNARE_LEFT);
+        if (key == GLFW_KEY_J)     drumTrigger.trigger(DRUM_PAD_SNARE_RIGHT);
+        if (key == GLFW_KEY_D)     drumTrigger.trigger(DRUM_PAD_HIHAT_LEFT);
+        if (key == GLFW_KEY_K)     drumTrigger.trigger(DRUM_PAD_HIHAT_RIGHT);
+        if (key == GLFW_KEY_SPACE) drumTrigger.trigger(DRUM_PAD_KICK);
+    }
+
+    // Piano keys go to the mixer thread, shift plays them harder
+    if (usePiano && action != GLFW_REPEAT) {
+        for (int i = 0; i < PIANO_KEYBOARD_KEYS; i++) {
+            if (key != pianoKeys[i]) continue;
+            if (action == GLFW_PRESS && pianoKeyNotes[i] < 0) {
+                pianoKeyNotes[i] = 60 + 12 * pianoOctave + i;
+                pianoInstrument.noteOn(pianoKeyNotes[i], (mods & GLFW_MOD_SHIFT) ? 1.0f : 0.7f);
+            }
+            else if (action == GLFW_RELEASE && pianoKeyNotes[i] >= 0) {
+                pianoInstrument.noteOff(pianoKeyNotes[i]);
+                pianoKeyNotes[i] = -1;
+            }
+        }
+
+        if (key == GLFW_KEY_SPACE)
+            pianoInstrument.setSustain(action == GLFW_PRESS);
+        if (key == GLFW_KEY_MINUS && action == GLFW_PRESS)
+            pianoOctave = max(pianoOctave - 1, -3);
+        if (key == GLFW_KEY_EQUAL && action == GLFW_PRESS)
+            pianoOctave = min(pianoOctave + 1, 3);
+    }
+
+    // Rendering
+    if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+        useDeferred = !useDeferred;
+        cout << "Renderer: " << (useDeferred ? "deferred" : "forward") << endl;
+    }
+
+    if (key == GLFW_KEY_L && action == GLFW_PRESS) {
+        lightmaps.enabled = !lightmaps.enabled;
+        cout << "Lightmaps: " << (lightmaps.enabled ? "on" : "off") << endl;
+    }
+
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+        useDepthPrepass = !useDepthPrepass;
+        cout << "Depth pre-pass: " << (useDepthPrepass ? "on" : "off") << endl;
+    }
     
 }
 
-void Application::mouseCallback(GLFWwindow *window, double xpos, double ypos)
+void Application::handleCursor(float xpos, float ypos)
 {
-    float xoffset = (float) xpos - lastX;
-    float yoffset = lastY - (float) ypos;
+    float xoffset = xpos - lastX;
+    float yoffset = lastY - ypos;
 
-    lastX = (float) xpos;
-    lastY = (float) ypos; 
+    lastX = xpos;
+    lastY = ypos; 
     
     currCam->look(xoffset, yoffset);
 }
 
 void Application::resizeCallback(GLFWwindow *window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    GLState::viewport(0, 0, width, height);
 }
\ No newline at end of file
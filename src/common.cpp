@@ -2,12 +2,15 @@
 #include <iostream>
 #include <filesystem>
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+#include "GLState.h"
+
 using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory)
@@ -33,7 +36,7 @@ unsigned int TextureFromFile(const char *path, const string &directory)
         else if (nrComponents == 4)
             format = GL_RGBA;
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        GLState::bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -53,6 +56,29 @@ unsigned int TextureFromFile(const char *path, const string &directory)
     return textureID;
 }
 
+// Mean color of an image on disk, without touching the GPU (used by the lightmap baker)
+glm::vec3 AverageColorFromFile(const char *path, const string &directory)
+{
+    string filename = string(path);
+    filesystem::path p(filename);
+    filename = directory + '/' + p.filename().u8string();
+
+    int width, height, nrComponents;
+    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 3);
+    if (!data)
+    {
+        cout << "Texture failed to load at path: " << path << endl;
+        return glm::vec3(0.5f);
+    }
+
+    glm::dvec3 sum = glm::dvec3(0.0);
+    for (int i = 0; i < width * height; i++)
+        sum += glm::dvec3(data[3*i], data[3*i + 1], data[3*i + 2]);
+    stbi_image_free(data);
+
+    return glm::vec3(sum / (255.0 * width * height));
+}
+
 void saveImage(const char *path, int width, int height, unsigned int shadowMaps)
 {
     std::vector<float> buffer(width*height*10);
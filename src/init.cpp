@@ -1,8 +1,11 @@
 #include <iostream>
+#include <fstream>
 #include <glm/gtx/string_cast.hpp>
 
 #include "Application.h"
 #include "GLSL.h"
+#include "GLState.h"
+#include "DrawData.h"
 #include "common.h"
 #include "MatrixStack.h"
 
@@ -17,30 +20,56 @@ void Application::init()
     // Set background color.
     glClearColor(.12f, .34f, .56f, 1.0f);
     // Enable z-buffer test.
-    glEnable(GL_DEPTH_TEST);
+    GLState::enable(GL_DEPTH_TEST);
 
     // Enable alpha transparency
-    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_BLEND);
+    GLState::blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    GLState::enable(GL_BLEND);
+
+    depthTimer.init();
+    litTimer.init();
+    DrawData::init();
 }
 
 void Application::initShaders(const string shaderDirectory)
 {
     // Initialize the GLSL programs
+    double start = glfwGetTime();
 
     prog = make_shared<Program>();
     prog->setVerbose(true);
     prog->setShaderNames(shaderDirectory + "/vert.glsl", shaderDirectory + "/frag.glsl");
+
+    // Specialize the lit shader for the scene's lights (again when they change, see
+    // specializeLights), and let each material pick a variant without the texture fetches it doesn't need
+    unsigned int numLights = lightingSystem.getSlotCount();
+    prog->setDefine("NUM_LIGHTS", to_string(numLights));
+    prog->setDefine("LIGHT_TYPES", lightingSystem.getTypeList());
+    lightLayout = lightingSystem.getLayoutVersion();
+    prog->setDefine("SHADOW_MODE", to_string(SHADOW_MODE_PCF));
+    prog->addFeature("TEXTURE_DIFFUSE");
+    prog->addFeature("TEXTURE_SPECULAR");
+    prog->addFeature("EMISSIVE");
+    prog->addFeature("LIGHTMAP");
+
     prog->init();
-    prog->addUniform("P");
-    prog->addUniform("V");
-    prog->addUniform("M");
+
+    // Materials switch variants mid-frame, so get every one building now
+    if (Program::isAsyncCompile()) {
+        for (unsigned int mask = 1; mask < 16; mask++)
+            prog->prepare(mask);
+    }
+
+    prog->addUniformBlock("FrameData", FRAME_DATA_BINDING);
+    prog->addUniformBlock("DrawData", DRAW_DATA_BINDING);
     prog->addUniform("shadowMaps");
-    prog->addUniform("lightsEnabled");
+    prog->addUniform("lightmap");
 
-    for (unsigned int i = 0; i < 10; i++) {
+    // Every slot there could be, lights spawned later find theirs already looked up
+    for (unsigned int i = 0; i < MAX_LIGHTS; i++) {
         string index = ("[" + to_string(i) + "]");
         prog->addUniform("light" + index + ".valid");
+        prog->addUniform("light" + index + ".baked");
         prog->addUniform("light" + index + ".type");
         prog->addUniform("light" + index + ".position");
         prog->addUniform("light" + index + ".direction");
@@ -57,10 +86,7 @@ void Application::initShaders(const string shaderDirectory)
 
     prog->addUniform("material.diffuse");
     prog->addUniform("material.specular");
-    prog->addUniform("material.emissive");
-    prog->addUniform("material.texture_diffuse_enable");
     prog->addUniform("material.texture_diffuse1");
-    prog->addUniform("material.texture_specular_enable");
     prog->addUniform("material.texture_specular1");
     prog->addUniform("material.shininess");
     
@@ -72,9 +98,8 @@ void Application::initShaders(const string shaderDirectory)
     skyProg->setVerbose(true);
     skyProg->setShaderNames(shaderDirectory + "/sky_vert.glsl", shaderDirectory + "/sky_frag.glsl");
     skyProg->init();
-    skyProg->addUniform("P");
-    skyProg->addUniform("M");
-    skyProg->addUniform("V");
+    skyProg->addUniformBlock("FrameData", FRAME_DATA_BINDING);
+    skyProg->addUniformBlock("DrawData", DRAW_DATA_BINDING);
     skyProg->addUniform("tex");
     skyProg->addAttribute("vertPos");
     skyProg->addAttribute("vertTex");
@@ -83,39 +108,71 @@ void Application::initShaders(const string shaderDirectory)
     shadowProg->setVerbose(true);
     shadowProg->setShaderNames(shaderDirectory + "/shadow_vert.glsl", shaderDirectory + "/shadow_frag.glsl");
     shadowProg->init();
-    shadowProg->addUniform("M");
+    shadowProg->addUniformBlock("DrawData", DRAW_DATA_BINDING);
     shadowProg->addUniform("lightSpaceMatrix");
     shadowProg->addAttribute("vertPos");
+
+    depthProg = make_shared<Program>();
+    depthProg->setVerbose(true);
+    depthProg->setShaderNames(shaderDirectory + "/depth_vert.glsl", shaderDirectory + "/depth_frag.glsl");
+    depthProg->init();
+    depthProg->addUniformBlock("FrameData", FRAME_DATA_BINDING);
+    depthProg->addUniformBlock("DrawData", DRAW_DATA_BINDING);
+    depthProg->addAttribute("vertPos");
+
+    deferred.init(shaderDirectory, numLights, SHADOW_MODE_PCF);
+
+    cout << "Shaders " << (Program::isAsyncCompile() ? "submitted" : "ready") << " in "
+         << 1000.0 * (glfwGetTime() - start) << " ms ("
+         << Program::cacheHits << " cached, " << Program::cacheMisses << " compiled)" << endl;
+}
+
+void Application::specializeLights()
+{
+    // Same values are no-ops in setDefine, only a changed count or type list recompiles
+    unsigned int numLights = lightingSystem.getSlotCount();
+    prog->setDefine("NUM_LIGHTS", to_string(numLights));
+    prog->setDefine("LIGHT_TYPES", lightingSystem.getTypeList());
+    deferred.lightProg->setDefine("NUM_LIGHTS", to_string(numLights > 0 ? numLights : 1));
+    lightLayout = lightingSystem.getLayoutVersion();
+
+    if (Program::isAsyncCompile()) {
+        for (unsigned int mask = 1; mask < 16; mask++)
+            prog->prepare(mask);
+        deferred.lightProg->prepare(deferred.lightProg->getFeatureBit("AMBIENT_PASS"));
+    }
 }
 
 void Application::initGeometry(const string objectDirectory)
 {	
-    // Import models
-    skysphere = make_shared<Model>(objectDirectory + "/skysphere.obj");
+    // Import models, static props get a second UV set for lightmaps
+    unsigned int flags = headless ? MODEL_NO_UPLOAD : 0;
+
+    skysphere = make_shared<Model>(objectDirectory + "/skysphere.obj", flags);
     skysphere->normalize();
     
-    drum_set = make_shared<Model>(objectDirectory + "/drum_set/drum_set.obj");
+    drum_set = make_shared<Model>(objectDirectory + "/drum_set/drum_set.obj", flags | MODEL_LIGHTMAP_UVS);
     drum_set->normalize();
 
-    spotlight = make_shared<Model>(objectDirectory + "/spotlight/spotlight.fbx");
+    spotlight = make_shared<Model>(objectDirectory + "/spotlight/spotlight.fbx", flags);
     spotlight->normalize();
 
-    amplifier1 = make_shared<Model>(objectDirectory + "/amp/Amplifier.obj");
+    amplifier1 = make_shared<Model>(objectDirectory + "/amp/Amplifier.obj", flags | MODEL_LIGHTMAP_UVS);
     amplifier1->normalize();
 
-    amplifier2 = make_shared<Model>(objectDirectory + "/amp/Amplifier.obj");
+    amplifier2 = make_shared<Model>(objectDirectory + "/amp/Amplifier.obj", flags | MODEL_LIGHTMAP_UVS);
     amplifier2->normalize();
 
-    piano = make_shared<Model>(objectDirectory + "/piano/Piano.obj");
+    piano = make_shared<Model>(objectDirectory + "/piano/Piano.obj", flags | MODEL_LIGHTMAP_UVS);
     piano->normalize();
 
-    dummies.model = make_shared<Model>(objectDirectory + "/dummy/Dummy.obj");
+    dummies.model = make_shared<Model>(objectDirectory + "/dummy/Dummy.obj", flags);
     dummies.model->normalize();
 
-    dummies.guitar = make_shared<Model>(objectDirectory + "/guitar/guitar.obj");
+    dummies.guitar = make_shared<Model>(objectDirectory + "/guitar/guitar.obj", flags);
     dummies.guitar->normalize();
 
-    stage.truss = make_shared<Model>(objectDirectory + "/truss.obj");
+    stage.truss = make_shared<Model>(objectDirectory + "/truss.obj", flags | MODEL_LIGHTMAP_UVS);
     stage.truss->normalize();
 
 
@@ -146,58 +203,153 @@ void Application::initGeometry(const string objectDirectory)
     piano->updateBoundingBox();
 }
 
+// Set pieces and light fixtures never move, so their matrices are built once
+void Application::initTransforms()
+{
+    // Props keep their own placement as the node offset
+    drumSetNode = transforms.add(TRANSFORM_ROOT, drum_set->getTransformMat());
+    transforms.setBounds(drumSetNode, drum_set->meshBB);
+    amplifier1Node = transforms.add(TRANSFORM_ROOT, amplifier1->getTransformMat());
+    transforms.setBounds(amplifier1Node, amplifier1->meshBB);
+    amplifier2Node = transforms.add(TRANSFORM_ROOT, amplifier2->getTransformMat());
+    transforms.setBounds(amplifier2Node, amplifier2->meshBB);
+    pianoNode = transforms.add(TRANSFORM_ROOT, piano->getTransformMat());
+    transforms.setBounds(pianoNode, piano->meshBB);
+
+    // Spotlight fixtures hang from the stage
+    glm::vec3 axisX = glm::vec3(1.0f, 0.0f, 0.0f);
+    glm::vec3 axisY = glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::vec3 positions[3] = {
+        glm::vec3(0.0f, stageHeight-0.8f, -stageDepth/2.0f),
+        glm::vec3(-stageWidth/2.0f+1.0f, stageHeight-0.8f, -stageDepth/2.0f),
+        glm::vec3(stageWidth/2.0f-1.0f, stageHeight-0.8f, -stageDepth/2.0f)
+    };
+    glm::mat4 rotations[3] = {
+        glm::rotate(glm::mat4(1.0f), glm::radians(45.0f), axisX),
+        glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(60.0f), axisX), glm::radians(30.0f), axisY),
+        glm::rotate(glm::rotate(glm::mat4(1.0f), glm::radians(60.0f), axisX), glm::radians(-30.0f), axisY)
+    };
+    for (int i = 0; i < 3; i++) {
+        spotlightNodes[i] = transforms.add(stage.root, spotlight->getTransformMat());
+        transforms.setTranslation(spotlightNodes[i], positions[i]);
+        transforms.setRotation(spotlightNodes[i], rotations[i]);
+        transforms.setBounds(spotlightNodes[i], spotlight->meshBB);
+    }
+
+    // Bulbs, in the same order as stageLights
+    glm::vec3 bulbPositions[3] = {
+        glm::vec3(-stageWidth/2.0f+1.05f, stageHeight-1.0f, -stageDepth+0.4f),
+        glm::vec3(stageWidth/2.0f-1.05f, stageHeight-1.0f, -stageDepth+0.4f),
+        glm::vec3(0.0f, stageHeight-1.0f, -stageDepth+0.4f)
+    };
+    for (int i = 0; i < 3; i++) {
+        bulbNodes[i] = transforms.add(TRANSFORM_ROOT, skysphere->getTransformMat());
+        transforms.setTranslation(bulbNodes[i], bulbPositions[i]);
+        transforms.setScale(bulbNodes[i], 0.14f);
+        transforms.setBounds(bulbNodes[i], skysphere->meshBB);
+    }
+}
+
+// Everything the player can bump into, placed by initTransforms
+void Application::initCollisions()
+{
+    transforms.update();
+
+    // Set pieces block the whole column above their footprint
+    auto column = [&](BoundingBox bb) {
+        bb.min.y = -1.0f;
+        bb.max.y = stageHeight + 1.0f;
+        return bb;
+    };
+    collisionWorld.add(column(transforms.getWorldBounds(drumSetNode)));
+    collisionWorld.add(column(transforms.getWorldBounds(amplifier1Node)));
+    collisionWorld.add(column(transforms.getWorldBounds(amplifier2Node)));
+    collisionWorld.add(column(transforms.getWorldBounds(pianoNode)));
+    collisionWorld.add(column(dummies.guitaristBB));
+
+    // Walls just outside the edges of the stage
+    float left   = -stageWidth/2.0f;
+    float right  =  stageWidth/2.0f;
+    float front  = stageCenter.z - stageDepth/2.0f;
+    float back   = stageCenter.z + stageDepth/2.0f;
+    float thick  = 1.0f;
+    collisionWorld.add(column({glm::vec3(left - thick, 0.0f, front - thick), glm::vec3(left, 0.0f, back + thick)}));
+    collisionWorld.add(column({glm::vec3(right, 0.0f, front - thick), glm::vec3(right + thick, 0.0f, back + thick)}));
+    collisionWorld.add(column({glm::vec3(left - thick, 0.0f, front - thick), glm::vec3(right + thick, 0.0f, front)}));
+    collisionWorld.add(column({glm::vec3(left - thick, 0.0f, back), glm::vec3(right + thick, 0.0f, back + thick)}));
+
+    playerCollider = collisionWorld.add(playerBB, true);
+}
+
 void Application::initTextures(const string textureDirectory)
 {
     // Load textures
     string texFile = "/nightSky.png";
     skysphere_texture = TextureFromFile(texFile.c_str(), textureDirectory);
-    glBindTexture(GL_TEXTURE_2D, skysphere_texture);
+    GLState::bindTexture(GL_TEXTURE_2D, skysphere_texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     texFile = "/stage_floor.jpg";
     stage.stage_texture = TextureFromFile(texFile.c_str(), textureDirectory);
-    glBindTexture(GL_TEXTURE_2D, stage.stage_texture);
+    GLState::bindTexture(GL_TEXTURE_2D, stage.stage_texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
     
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLState::bindTexture(GL_TEXTURE_2D, 0);
 }
 
 void Application::initLights()
 {
     // Setup lights
-    unsigned int light0 = lightingSystem.spawnSpotLight(glm::vec3(1.0f), 15, 20, 
+    LightHandle light0 = lightingSystem.spawnSpotLight(glm::vec3(1.0f), 15, 20, 
         glm::vec3(stageCenter.x-stageWidth/2.0f+1.0f, stageHeight, stageCenter.z-stageDepth/2.0f), glm::vec3(0.2f, -0.7f, 0.2f));
     stageLights.push_back(light0);
 
-    unsigned int light1 = lightingSystem.spawnSpotLight(glm::vec3(1.0f), 15, 20, 
+    LightHandle light1 = lightingSystem.spawnSpotLight(glm::vec3(1.0f), 15, 20, 
         glm::vec3(stageCenter.x+stageWidth/2.0f-1.0f, stageHeight, stageCenter.z-stageDepth/2.0f), glm::vec3(-0.2f, -0.7f, 0.2f));
     stageLights.push_back(light1);
 
-    unsigned int light2 = lightingSystem.spawnSpotLight(glm::vec3(1.0f), 20, 25, 
+    LightHandle light2 = lightingSystem.spawnSpotLight(glm::vec3(1.0f), 20, 25, 
         glm::vec3(0.0f, stageHeight, stageCenter.z-stageDepth/2.0f), glm::vec3(0.0f, -0.7f, 1.0f));
     stageLights.push_back(light2);
+
+    // The side lights never move, so they're baked; their color is applied live, so they still
+    // change with the music. The guitarist's light sweeps and stays dynamic
+    lightingSystem.setBaked(light0, true);
+    lightingSystem.setBaked(light1, true);
+
+    // Brightness follows the audio analysis: kick on the left, cymbals on the right, guitar in the middle.
+    // Color only, so the baked side lights reach the lightmapped stage too
+    lightingSystem.addReaction(light0, AUDIO_BAND_BASS, glm::vec3(1.0f), 0.4f);
+    lightingSystem.addReaction(light1, AUDIO_BAND_TREBLE, glm::vec3(1.0f), 0.4f);
+    lightingSystem.addReaction(light2, AUDIO_BAND_LOW_MID, glm::vec3(1.0f), 0.4f);
+}
+
+void Application::initLightmaps(const string objectDirectory)
+{
+    lightmaps.load(objectDirectory + "/lightmaps");
 }
 
 void Application::initShadows()
 {
     // Setup an array of shadow maps
     glGenTextures(1, &shadowMaps);
-    glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMaps);
+    GLState::bindTexture(GL_TEXTURE_2D_ARRAY, shadowMaps);
     glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT,
-        SHADOW_WIDTH, SHADOW_HEIGHT, 10, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        SHADOW_WIDTH, SHADOW_HEIGHT, MAX_LIGHTS, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_GEQUAL);
+    GLDebug::label(GL_TEXTURE, shadowMaps, "Shadow maps");
 
-    glGenFramebuffers(10, &shadowFBO[0]);
+    glGenFramebuffers(MAX_LIGHTS, &shadowFBO[0]);
 
-    // Attach each shadow map layer to an FBO
-    for (unsigned int i = 0; i < 10; i++) {
-        glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO[i]);
+    // Attach each shadow map layer to an FBO, one per light slot
+    for (unsigned int i = 0; i < MAX_LIGHTS; i++) {
+        GLState::bindFramebuffer(GL_FRAMEBUFFER, shadowFBO[i]);
         glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, shadowMaps, 0, i);
     }
 
@@ -205,36 +357,127 @@ void Application::initShadows()
 
 void Application::initAudio(const string audioDirectory)
 {   
-    unsigned int buffer, source;
-    
-    // Setup snare
-    buffer = audioSystem.loadFile(audioDirectory + "/snare.wav");
-    source = audioSystem.createSource(0.0f, 0.0f, 0.0f);
-    audioSystem.bind(source, buffer);
-    snare.source_id = source;
-
-    // Setup hi-hat
-    buffer = audioSystem.loadFile(audioDirectory + "/hi_hat.wav");
-    source = audioSystem.createSource(0.0f, 0.0f, 0.0f);
-    audioSystem.bind(source, buffer);
-    hi_hat.source_id = source;
-
-    // Setup kick
-    buffer = audioSystem.loadFile(audioDirectory + "/kick.wav");
-    source = audioSystem.createSource(0.0f, 0.0f, 0.0f);
-    audioSystem.bind(source, buffer);
-    kick.source_id = source;
+    unsigned int buffer;
 
+    if (!audioSystem.init())
+        exit(2);
+    emitters.init();
+    
+    // Drum hits share the mixer's voices, or the OpenAL voice pool without it; the kick is stolen last
+    if (!audioSystem.mixer.isRunning())
+        audioSystem.initVoices();
+    snare.buffer = audioSystem.loadFile(audioDirectory + "/snare.wav");
+    snare.priority = 1;
+    hi_hat.buffer = audioSystem.loadFile(audioDirectory + "/hi_hat.wav");
+    hi_hat.priority = 0;
+    kick.buffer = audioSystem.loadFile(audioDirectory + "/kick.wav");
+    kick.priority = 2;
+
+    // The riff loops on the music bus from the start, the bus is paused while nobody plays, and it
+    // outranks every drum so it is never stolen. Queued before the trigger thread starts, which
+    // sends every command after that
     buffer = audioSystem.loadFile(audioDirectory + "/guitar-riff.wav");
-    source = audioSystem.createSource(0.0f, 0.0f, 0.0f);
-    audioSystem.bind(source, buffer);
-    guitar_riff = source;
-    alSourcei(guitar_riff, AL_LOOPING, AL_TRUE);
+    int riff = audioSystem.getMixerSample(buffer);
+    if (riff >= 0) {
+        audioSystem.mixer.pauseBus(MIXER_BUS_MUSIC, true);
+        audioSystem.mixer.play(riff, 0.5f, 0.0f, 1.0f, 3, MIXER_BUS_MUSIC, true);
+    }
+    else if (buffer) {
+        // Without the mixer it comes out of the left amp, and always gets a source over the hum
+        guitarRiff = emitters.add(buffer, AudioSystem::getDuration(buffer), glm::vec3(0.0f), 0.5f,
+                                  2.0f, EMITTER_MAX_DISTANCE, 1);
+        emitters.attach(guitarRiff, amplifier1Node, glm::vec3(0.0f, 0.5f, 0.0f));
+        useGuitarEmitter = true;
+    }
+
+    // Both amps hum at 60 Hz with a few harmonics, heard only up close. A second of it loops cleanly
+    const unsigned int humRate = 22050;
+    const float pi = 3.14159265f;
+    vector<float> hum(humRate);
+    for (unsigned int i = 0; i < humRate; i++) {
+        float t = (float)i / humRate;
+        hum[i] = 0.5f * sinf(2.0f * pi * 60.0f * t) + 0.3f * sinf(2.0f * pi * 120.0f * t) +
+                 0.15f * sinf(2.0f * pi * 180.0f * t);
+    }
+    buffer = audioSystem.createBuffer(hum, 1, humRate);
+    TransformNode amps[2] = { amplifier1Node, amplifier2Node };
+    for (TransformNode amp : amps) {
+        EmitterHandle emitter = emitters.add(buffer, 1.0f, glm::vec3(0.0f), 0.08f, 0.5f, 6.0f);
+        emitters.attach(emitter, amp);
+        emitters.play(emitter);
+    }
+
+    // Drum keys play their samples from the trigger thread
+    drumTrigger.setPad(DRUM_PAD_SNARE_LEFT, snare.buffer, snare.priority);
+    drumTrigger.setPad(DRUM_PAD_SNARE_RIGHT, snare.buffer, snare.priority);
+    drumTrigger.setPad(DRUM_PAD_HIHAT_LEFT, hi_hat.buffer, hi_hat.priority);
+    drumTrigger.setPad(DRUM_PAD_HIHAT_RIGHT, hi_hat.buffer, hi_hat.priority);
+    drumTrigger.setPad(DRUM_PAD_KICK, kick.buffer, kick.priority);
+    drumTrigger.start(audioSystem);
+
+    audioAnalyzer.start(audioSystem.mixer);
+
+    // The sequencer plays the same samples from the mixer thread, B starts and stops it
+    if (audioSystem.mixer.isRunning()) {
+        DrumPiece *pieces[DRUM_PAD_COUNT] = { &snare, &snare, &hi_hat, &hi_hat, &kick };
+        for (unsigned int pad = 0; pad < DRUM_PAD_COUNT; pad++)
+            sequencer.setPad(pad, audioSystem.getMixerSample(pieces[pad]->buffer), pieces[pad]->priority);
+        audioSystem.mixer.setScheduler(&sequencer);
+
+        // A measured response of the room if there is one, otherwise a generated 1.8 s tail
+        vector<float> impulse;
+        unsigned int channels, sampleRate;
+        if (!AudioSystem::decodeFile(audioDirectory + "/venue_ir.wav", impulse, channels, sampleRate)) {
+            Reverb::makeImpulse(impulse, 2.5f, 1.8f, MIXER_SAMPLE_RATE);
+            channels = 2;
+            sampleRate = MIXER_SAMPLE_RATE;
+        }
+        venueReverb.setImpulse(impulse, channels, sampleRate, MIXER_SAMPLE_RATE);
+        audioSystem.mixer.setReverbSend(MIXER_BUS_SFX, 0.35f);
+        audioSystem.mixer.setReverbSend(MIXER_BUS_MUSIC, 0.25f);
+        audioSystem.mixer.setReverb(&venueReverb);
+
+        // Recorded notes from piano/<MIDI note>.wav where there are any, otherwise synthesized ones
+        for (int note = PIANO_LOWEST_NOTE; note <= PIANO_HIGHEST_NOTE; note++) {
+            string path = audioDirectory + "/piano/" + to_string(note) + ".wav";
+            if (ifstream(path).good() && AudioSystem::decodeFile(path, impulse, channels, sampleRate))
+                pianoInstrument.addZone(note, impulse, channels, sampleRate);
+        }
+        if (!pianoInstrument.hasZones())
+            pianoInstrument.synthesize();
+        audioSystem.mixer.setReverbSend(MIXER_BUS_INSTRUMENT, 0.3f);
+        audioSystem.mixer.setInstrument(&pianoInstrument);
+        sequencer.setPiano(&pianoInstrument);
+    }
+
+    for (int &note : pianoKeyNotes)
+        note = -1;
+
+    // A General MIDI track if there is one, otherwise a basic rock beat over four chords
+    if (!Sequencer::loadMidi(audioDirectory + "/drums.mid", drumGroove)) {
+        string hats, snares, kicks;
+        for (int bar = 0; bar < 4; bar++) {
+            hats   += "x.o.x.o.x.o.x.o.";
+            snares += "....x.......x...";
+            kicks  += "x.......x.x.....";
+        }
+        Sequencer::addSteps(drumGroove, DRUM_PAD_HIHAT_LEFT, hats);
+        Sequencer::addSteps(drumGroove, DRUM_PAD_SNARE_LEFT, snares);
+        Sequencer::addSteps(drumGroove, DRUM_PAD_KICK,       kicks);
+
+        // C, A minor, F, G, a bar each, let go just before the next
+        const vector<int> chords[4] = { {48, 60, 64, 67}, {45, 60, 64, 69}, {41, 60, 65, 69}, {43, 59, 62, 67} };
+        uint64_t bar = 4 * drumGroove.ppq;
+        for (int i = 0; i < 4; i++)
+            Sequencer::addChord(drumGroove, chords[i], i * bar, bar - drumGroove.ppq / 8);
+    }
 }
 
 void Application::initCameras()
 {
     camera.Position = glm::vec3(0.0f, playerHeight, 0.0f);
+    currState = { camera.Position, 0.0, 0 };
+    prevState = currState;
     drumCam.Position = glm::vec3(0.0f, 0.4f, -1.5f);
     
     stageCam.Position = glm::vec3(0.0f, stageHeight/2.0f, stageCenter.z - stageDepth/2.0f - 3.0f);
@@ -1,8 +1,6 @@
 #include "Application.h"
 #include <glm/gtx/string_cast.hpp>
 
-#define MIN_FRAME_COUNT 8
-
 void Application::checkDrumInteraction()
 {
     glm::vec2 playerPos = glm::vec2(camera.Position.x, camera.Position.z);
@@ -32,161 +30,148 @@ void Application::checkGuitaristInteraction()
 
     if ((CP <= guitaristRadius) && !playGuitar) {
         playGuitar = true;
-        alSourcePlay(guitar_riff);
+        if (audioSystem.mixer.isRunning())
+            audioSystem.mixer.pauseBus(MIXER_BUS_MUSIC, false);
+        else if (useGuitarEmitter)
+            emitters.play(guitarRiff);
     }
     else if ((CP <= guitaristRadius) && playGuitar) {
         playGuitar = false;
-        alSourceStop(guitar_riff);
+        if (audioSystem.mixer.isRunning())
+            audioSystem.mixer.pauseBus(MIXER_BUS_MUSIC, true);
+        else if (useGuitarEmitter)
+            emitters.stop(guitarRiff);
     }
 }
 
-void Application::drumLogic()
+void Application::checkPianoInteraction()
 {
-    // Poll all keys
-    snare.playLeft  = (glfwGetKey(windowManager->getHandle(), GLFW_KEY_F) == GLFW_PRESS);
-    snare.playRight = (glfwGetKey(windowManager->getHandle(), GLFW_KEY_J) == GLFW_PRESS);
-    hi_hat.playLeft  = (glfwGetKey(windowManager->getHandle(), GLFW_KEY_D) == GLFW_PRESS);
-    hi_hat.playRight = (glfwGetKey(windowManager->getHandle(), GLFW_KEY_K) == GLFW_PRESS);
-    kick.playLeft  = (glfwGetKey(windowManager->getHandle(), GLFW_KEY_SPACE) == GLFW_PRESS);
-    kick.playRight = (glfwGetKey(windowManager->getHandle(), GLFW_KEY_SPACE) == GLFW_PRESS);
-
-    /* Snare */
-    if (snare.playLeft && snare.leftFrameCount >= MIN_FRAME_COUNT) {
-        lightingSystem.setColor(stageLights[0], glm::vec3(random(), random(), random()));
-        audioSystem.play(snare.source_id);
-        snare.leftFrameCount = 0;
+    glm::vec2 playerPos = glm::vec2(camera.Position.x, camera.Position.z);
+
+    // Determine whether player is within range to play the piano
+    float CP = glm::distance(playerPos, usePianoCenter);
+
+    if ((CP <= usePianoRadius) && !usePiano) {
+        usePiano = true;
+        freeRoam = false;
+    }
+    else if (usePiano) {
+        usePiano = false;
+        freeRoam = true;
+        releasePianoKeys();
     }
-    else
-        snare.leftFrameCount++;
+}
+
+// Lets go of every key and the pedal, so nothing hangs on after leaving the piano
+void Application::releasePianoKeys()
+{
+    for (int &note : pianoKeyNotes) {
+        if (note >= 0)
+            pianoInstrument.noteOff(note);
+        note = -1;
+    }
+    pianoInstrument.setSustain(false);
+}
+
+// Fully saturated color for a hue between 0 and 1
+static glm::vec3 hueColor(float hue)
+{
+    auto channel = [hue](float offset) {
+        float x = fabsf(fmodf(hue * 6.0f + offset, 6.0f) - 3.0f) - 1.0f;
+        return (std::min)((std::max)(x, 0.0f), 1.0f);
+    };
+    return glm::vec3(channel(0.0f), channel(4.0f), channel(2.0f));
+}
 
-    if (snare.playRight && snare.rightFrameCount >= MIN_FRAME_COUNT) {
-        lightingSystem.setColor(stageLights[1], glm::vec3(random(), random(), random()));
-        audioSystem.play(snare.source_id);
-        snare.rightFrameCount = 0;
+// The stage lights follow the analysis of whatever the mixer is playing
+void Application::audioLogic()
+{
+    // New colors for the side lights on every beat of the sequencer as it is heard, or on every
+    // detected onset without it; golden ratio steps keep the colors apart
+    bool beat = false;
+    double sequencerBeat = sequencer.getBeat(audioSystem.mixer);
+    if (sequencerBeat >= 0.0) {
+        beat = (long)floor(sequencerBeat) != lastSequencerBeat;
+        lastSequencerBeat = (long)floor(sequencerBeat);
     }
-    else
-        snare.rightFrameCount++;
-
-    /* Hi-Hat */
-    if (hi_hat.playLeft && hi_hat.leftFrameCount >= MIN_FRAME_COUNT) {
-        lightingSystem.setColor(stageLights[0], glm::vec3(random(), random(), random()));
-        audioSystem.play(hi_hat.source_id);
-        hi_hat.leftFrameCount = 0;
+
+    if (audioAnalyzer.read(audioFeatures)) {
+        if (audioFeatures.beats != lastBeat) {
+            lastBeat = audioFeatures.beats;
+            beat |= sequencerBeat < 0.0;
+        }
+        lightingSystem.react(audioFeatures.bands);
     }
-    else
-        hi_hat.leftFrameCount++;
 
-    if (hi_hat.playRight && hi_hat.rightFrameCount >= MIN_FRAME_COUNT) {
-        lightingSystem.setColor(stageLights[1], glm::vec3(random(), random(), random()));
-        audioSystem.play(hi_hat.source_id);
-        hi_hat.rightFrameCount = 0;
+    // New colors on the beat, the lightmaps pick them up through the baked lights' channels
+    if (beat) {
+        beatHue = fmodf(beatHue + 0.618f, 1.0f);
+        lightingSystem.setReactionColor(stageLights[0], hueColor(beatHue));
+        lightingSystem.setReactionColor(stageLights[1], hueColor(fmodf(beatHue + 0.5f, 1.0f)));
     }
-    else
-        hi_hat.rightFrameCount++;
 
-    /* Kick */
-    if (kick.playLeft && kick.leftFrameCount >= MIN_FRAME_COUNT) {
-        audioSystem.play(kick.source_id);
-        kick.leftFrameCount = 0;
+    // The guitarist's light sweeps faster the louder the guitar's range is
+    if (playGuitar) {
+        guitarSweep += (float)SIMULATION_STEP * (0.5f + 1.5f * audioFeatures.bands[AUDIO_BAND_LOW_MID]);
+        float t = guitarSweep;
+        lightingSystem.setDirection(stageLights[2], glm::vec3(0.5f*cos(t), -0.7f, 0.5f*sin(t)+0.5f));
+        lightingSystem.setReactionColor(stageLights[2], glm::vec3(cos(0.5f*t)+0.5f, sin(0.5f*t)+0.5f, 1.0f));
     }
-    else
-        kick.leftFrameCount++;
+}
 
-    if (kick.playRight && kick.rightFrameCount >= MIN_FRAME_COUNT) {
-        audioSystem.play(kick.source_id);
-        kick.rightFrameCount = 0;
+// Runs as many fixed ticks as the frame time allows, at most MAX_SIMULATION_STEPS
+void Application::simulate()
+{
+    accumulator += deltaTime;
+
+    int steps = 0;
+    while (accumulator >= SIMULATION_STEP && steps < MAX_SIMULATION_STEPS && !replayFinished()) {
+        step();
+        accumulator -= SIMULATION_STEP;
+        steps++;
     }
-    else
-        kick.rightFrameCount++;
 
+    // Too far behind to catch up, slow the simulation down rather than stall
+    if (steps == MAX_SIMULATION_STEPS)
+        accumulator = (glm::min)(accumulator, SIMULATION_STEP);
 }
 
-bool Application::checkPlayerCollisions()
+// One fixed tick, after any recorded input that landed on it
+void Application::step()
 {
-    // Check if player is colliding w/ drums
-    bool drumCollisionX = drum_set->bb.max.x >= playerBB.min.x &&
-        playerBB.max.x >= drum_set->bb.min.x;
-    bool drumCollisionZ = drum_set->bb.max.z >= playerBB.min.z &&
-        playerBB.max.z >= drum_set->bb.min.z;
-    
-    if (drumCollisionX && drumCollisionZ) 
-        return true;
-
-    // Check if player is colliding w/ stage walls
-    if (playerBB.max.x >= stageWidth/2.0f || playerBB.min.x <= -stageWidth/2.0f)
-        return true;
-
-    if (playerBB.max.z >= (stageCenter.z + stageDepth/2) || 
-        playerBB.min.z <= (stageCenter.z - stageDepth/2))
-        return true;
-
-
-    // Check if player is colliding w/ amplifier 1
-    bool ampCollisionX = amplifier1->bb.max.x >= playerBB.min.x &&
-        playerBB.max.x >= amplifier1->bb.min.x;
-    bool ampCollisionZ = amplifier1->bb.max.z >= playerBB.min.z &&
-        playerBB.max.z >= amplifier1->bb.min.z;
-
-    if (ampCollisionX && ampCollisionZ) 
-        return true;
-
-    // Check if player is colliding w/ amplifier 2
-    ampCollisionX = amplifier2->bb.max.x >= playerBB.min.x &&
-        playerBB.max.x >= amplifier2->bb.min.x;
-    ampCollisionZ = amplifier2->bb.max.z >= playerBB.min.z &&
-        playerBB.max.z >= amplifier2->bb.min.z;
-
-    if (ampCollisionX && ampCollisionZ) 
-        return true;
-
-    // Check if player is colliding w/ guitarist
-    bool guitarCollisionX = dummies.guitaristBB.max.x >= playerBB.min.x &&
-        playerBB.max.x >= dummies.guitaristBB.min.x;
-    bool guitarCollisionZ = dummies.guitaristBB.max.z >= playerBB.min.z &&
-        playerBB.max.z >= dummies.guitaristBB.min.z;
-    if (guitarCollisionX && guitarCollisionZ)
-        return true;
-
-    // Check if player is colliding w/ piano
-    bool pianoCollisionX = piano->bb.max.x >= playerBB.min.x &&
-        playerBB.max.x >= piano->bb.min.x;
-    bool pianoCollisionZ = piano->bb.max.z >= playerBB.min.z &&
-        playerBB.max.z >= piano->bb.min.z;
-    if (pianoCollisionX && pianoCollisionZ)
-        return true;
-
-    return false;
-    
+    prevState = currState;
+    replayTick();
+    sceneLogic();
+    currState.playerPosition = camera.Position;
+    currState.time += SIMULATION_STEP;
+    currState.tick++;
 }
 
 void Application::sceneLogic()
 {
     // Update camera position during free roam
     if (freeRoam) {
-        // Save previous player position and bounding box
+        // Save previous player position
         glm::vec3 prevPos = camera.Position;
-        BoundingBox prevBB = playerBB;
     
         // Get next camera position
-        if (pressedUp)    camera.move(FORWARD, deltaTime);
-        if (pressedDown)  camera.move(BACKWARD, deltaTime);
-        if (pressedLeft)  camera.move(LEFT, deltaTime);
-        if (pressedRight) camera.move(RIGHT, deltaTime);
+        if (pressedUp)    camera.move(FORWARD, SIMULATION_STEP);
+        if (pressedDown)  camera.move(BACKWARD, SIMULATION_STEP);
+        if (pressedLeft)  camera.move(LEFT, SIMULATION_STEP);
+        if (pressedRight) camera.move(RIGHT, SIMULATION_STEP);
         camera.Position.y = playerHeight;
+
+        // Move as far as the colliders allow, sliding along anything in the way
+        glm::vec3 delta = camera.Position - prevPos;
+        camera.Position = prevPos + collisionWorld.slide(playerBB, delta, playerCollider);
         
         // Compute new bounding box
         playerBB.min = glm::vec3(camera.Position.x-playerWidth/2.0f, 0.0f, camera.Position.z-0.2f);
         playerBB.max = glm::vec3(camera.Position.x+playerWidth/2.0f, playerHeight, camera.Position.z+0.2f);
-
-        // If there is a collision, use previous position and bounding box
-        if (checkPlayerCollisions()) {
-            camera.Position = prevPos;
-            playerBB = prevBB;
-        }
+        collisionWorld.update(playerCollider, playerBB);
     }
 
-    if (useDrums)
-        drumLogic();
+    audioLogic();
 
     // Set correct camera
     if (useDrums) currCam = fixedCam ? &stageCam : &drumCam;
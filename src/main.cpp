@@ -8,15 +8,135 @@ int main(int argc, char *argv[])
 {
 	// Where the resources are loaded from
 	string resourceDir = "../../resources";
+
+	// Offline lightmap baking (--bake [--threads N] [--samples N])
+	bool bake = false;
+	unsigned int bakeThreads = 0;
+	unsigned int bakeSamples = 64;
+
+	// Ray tracing benchmark (--bench-rays [--threads N] [--rays N])
+	bool benchRays = false;
+	unsigned int benchRayCount = 1000000;
+
+	// Software mixer benchmark (--bench-mixer [--voices N])
+	bool benchMixer = false;
+	unsigned int benchVoices = MIXER_MAX_VOICES;
+
+	// Sequencer timing check (--bench-sequencer)
+	bool benchSequencer = false;
+
+	// Convolution reverb benchmark (--bench-reverb)
+	bool benchReverb = false;
+
+	// Piano voice engine benchmark (--bench-piano)
+	bool benchPiano = false;
+
+	// Emitter culling benchmark (--bench-emitters)
+	bool benchEmitters = false;
+
+	// Output latency and cost on a loopback device (--bench-audio [--capture file.wav])
+	bool benchAudio = false;
+	string captureFile;
+
+	// Session recording and replay (--record FILE, --replay FILE [--headless])
+	string recordFile, replayFile;
+	bool headlessReplay = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg == "--bake")
+			bake = true;
+		else if (arg == "--threads" && i + 1 < argc)
+			bakeThreads = atoi(argv[++i]);
+		else if (arg == "--samples" && i + 1 < argc)
+			bakeSamples = atoi(argv[++i]);
+		else if (arg == "--bench-rays")
+			benchRays = true;
+		else if (arg == "--rays" && i + 1 < argc)
+			benchRayCount = atoi(argv[++i]);
+		else if (arg == "--bench-mixer")
+			benchMixer = true;
+		else if (arg == "--voices" && i + 1 < argc)
+			benchVoices = atoi(argv[++i]);
+		else if (arg == "--bench-sequencer")
+			benchSequencer = true;
+		else if (arg == "--bench-reverb")
+			benchReverb = true;
+		else if (arg == "--bench-piano")
+			benchPiano = true;
+		else if (arg == "--bench-emitters")
+			benchEmitters = true;
+		else if (arg == "--bench-audio")
+			benchAudio = true;
+		else if (arg == "--capture" && i + 1 < argc)
+			captureFile = argv[++i];
+		else if (arg == "--record" && i + 1 < argc)
+			recordFile = argv[++i];
+		else if (arg == "--replay" && i + 1 < argc)
+			replayFile = argv[++i];
+		else if (arg == "--headless")
+			headlessReplay = true;
+		else
+			resourceDir = arg;
+	}
+
 	string shaderDir   = resourceDir + "/shaders";
 	string textureDir  = resourceDir + "/textures";
 	string objectDir   = resourceDir + "/objects";
 	string audioDir    = resourceDir + "/audio";
+	string cacheDir    = resourceDir + "/cache";
+
+	if (benchMixer || benchSequencer || benchReverb || benchPiano || benchEmitters || benchAudio)
+	{
+		// Mixed straight into memory, no audio device or scene
+		Application application = Application();
+		application.headless = true;
+		if (benchMixer)
+			application.benchmarkMixer(audioDir, benchVoices);
+		if (benchSequencer)
+			application.benchmarkSequencer();
+		if (benchReverb)
+			application.benchmarkReverb();
+		if (benchPiano)
+			application.benchmarkPiano();
+		if (benchEmitters)
+			application.benchmarkEmitters();
+		if (benchAudio)
+			application.benchmarkAudio(audioDir, captureFile);
+		return 0;
+	}
 
+	if (!replayFile.empty() && headlessReplay)
+	{
+		// Only the simulation runs, as fast as it can
+		Application application = Application();
+		application.headless = true;
+		application.initLights();
+		application.initGeometry(objectDir);
+		application.initCameras();
+		application.stage.initStage(application.transforms, false);
+		application.initTransforms();
+		application.initCollisions();
+		if (application.startReplay(replayFile))
+			application.replayHeadless();
+		return 0;
+	}
 
-	if (argc >= 2)
+	if (bake || benchRays)
 	{
-		resourceDir = argv[1];
+		// Headless, the scene only needs to exist on the CPU
+		Application application = Application();
+		application.headless = true;
+		application.initLights();
+		application.initGeometry(objectDir);
+		application.stage.initStage(application.transforms, false);
+		application.initTransforms();
+		if (bake)
+			application.bakeLightmaps(objectDir, textureDir, bakeThreads, bakeSamples);
+		if (benchRays)
+			application.benchmarkRays(benchRayCount, bakeThreads);
+		return 0;
 	}
 
 	Application application = Application();
@@ -29,17 +149,32 @@ int main(int argc, char *argv[])
 
 	// Initilize application
 	application.init();
+	application.initLights();
+	Program::setBinaryCache(cacheDir + "/shaders");
+
+	// Shaders build in the background while the models are imported
+	Program::setAsyncCompile(true);
 	application.initShaders(shaderDir);
 	application.initGeometry(objectDir);
 	application.initTextures(textureDir);
 	application.initAudio(audioDir);
-	application.initLights();
 	application.initShadows();
 	application.initCameras();
-	application.stage.initStage();
+	application.initLightmaps(objectDir);
+	application.stage.initStage(application.transforms);
+	application.initTransforms();
+	application.initCollisions();
 	application.dummies.init();
 
+	// Both start from the state initCameras left, on tick 0
+	if (!recordFile.empty())
+		application.startRecording();
+	if (!replayFile.empty() && !application.startReplay(replayFile))
+		return 1;
+
 	GLFWwindow* window = windowManager.getHandle();
+	unsigned int frames = 0;
+	double start = glfwGetTime();
 
 	// Loop until the user closes the window.
 	while (!glfwWindowShouldClose(window))
@@ -50,8 +185,17 @@ int main(int argc, char *argv[])
 		glfwSwapBuffers(window);
 		// Poll for and process events.
 		glfwPollEvents();
+		frames++;
+
+		// A replay closes the window once every recorded tick has run
+		if (application.replayFinished())
+			glfwSetWindowShouldClose(window, GL_TRUE);
 	}
 
+	if (!recordFile.empty())
+		application.saveRecording(recordFile);
+	application.reportReplay(frames, glfwGetTime() - start);
+
 	// Quit program.
 	windowManager.shutdown();
 	return 0;
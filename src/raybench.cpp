@@ -0,0 +1,116 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#define _USE_MATH_DEFINES
+#include <math.h>
+
+#include "Application.h"
+#include "BVH.h"
+
+using namespace std;
+
+// Rays from a sphere around the bounds, each aimed at a random point inside them
+static void makeRays(const BoundingBox &bb, unsigned int count, vector<glm::vec3> &origins, vector<glm::vec3> &dirs)
+{
+    mt19937 rng(1);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    glm::vec3 center = 0.5f * (bb.min + bb.max);
+    float radius = glm::length(bb.max - bb.min);
+
+    origins.resize(count);
+    dirs.resize(count);
+    for (unsigned int i = 0; i < count; i++) {
+        float z = 2.0f * unit(rng) - 1.0f;
+        float phi = 2.0f * (float)M_PI * unit(rng);
+        float r = sqrtf(1.0f - z * z);
+        origins[i] = center + radius * glm::vec3(r * cosf(phi), z, r * sinf(phi));
+
+        glm::vec3 target = bb.min + (bb.max - bb.min) * glm::vec3(unit(rng), unit(rng), unit(rng));
+        dirs[i] = glm::normalize(target - origins[i]);
+    }
+}
+
+// Closest-hit rays per second over every ray, split across the given threads
+template <typename Scene>
+static double traceRate(const Scene &scene, const vector<glm::vec3> &origins, const vector<glm::vec3> &dirs,
+    unsigned int threads, unsigned int &hits)
+{
+    atomic<unsigned int> hitCount(0);
+    auto worker = [&](unsigned int first, unsigned int last) {
+        unsigned int local = 0;
+        TraceHit hit;
+        for (unsigned int i = first; i < last; i++) {
+            if (scene.trace(origins[i], dirs[i], INFINITY, hit))
+                local++;
+        }
+        hitCount += local;
+    };
+
+    auto start = chrono::steady_clock::now();
+    vector<thread> workers;
+    unsigned int perThread = (unsigned int)(origins.size() + threads - 1) / threads;
+    for (unsigned int t = 0; t < threads; t++) {
+        unsigned int first = (std::min)((unsigned int)origins.size(), t * perThread);
+        unsigned int last = (std::min)((unsigned int)origins.size(), first + perThread);
+        workers.push_back(thread(worker, first, last));
+    }
+    for (auto &w : workers)
+        w.join();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    hits = hitCount;
+    return origins.size() / elapsed.count();
+}
+
+template <typename Scene>
+static void report(const string name, const Scene &scene, const BoundingBox &bb, unsigned int rays,
+    unsigned int threads)
+{
+    vector<glm::vec3> origins, dirs;
+    makeRays(bb, rays, origins, dirs);
+
+    unsigned int hits;
+    double single = traceRate(scene, origins, dirs, 1, hits);
+    double multi = traceRate(scene, origins, dirs, threads, hits);
+    cout << "[RayBench] " << name << ": " << single / 1e6 << " Mrays/s on 1 thread, "
+         << multi / 1e6 << " Mrays/s on " << threads << " threads ("
+         << 100.0 * hits / rays << "% hit)" << endl;
+}
+
+/*
+ * Measures BVH build time and closest-hit ray throughput for the piano and
+ * drum set, alone and placed together in a two-level scene. Runs without a
+ * window (see --bench-rays in main.cpp) after initGeometry and initTransforms.
+ */
+void Application::benchmarkRays(unsigned int rays, unsigned int threads)
+{
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    transforms.update();
+
+    shared_ptr<Model> models[2] = { piano, drum_set };
+    TransformNode placement[2] = { pianoNode, drumSetNode };
+    const char *names[2] = { "piano", "drum_set" };
+    TriangleBVH bvhs[2];
+    SceneBVH scene;
+
+    for (int i = 0; i < 2; i++) {
+        auto start = chrono::steady_clock::now();
+        bvhs[i].build(*models[i], threads);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+
+        cout << "[RayBench] " << names[i] << ": " << bvhs[i].getTriangleCount() << " triangles, "
+             << bvhs[i].getNodeCount() << " nodes, built in " << elapsed.count() << " ms" << endl;
+        report(names[i], bvhs[i], bvhs[i].getBounds(), rays, threads);
+
+        scene.add(&bvhs[i], transforms.getWorld(placement[i]));
+    }
+
+    scene.build();
+    BoundingBox both = Bounds::merge(transforms.getWorldBounds(pianoNode), transforms.getWorldBounds(drumSetNode));
+    report("scene", scene, both, rays, threads);
+}
@@ -7,76 +7,61 @@
 #include <iostream>
 
 #include "Application.h"
-#include "MatrixStack.h"
+#include "GLDebug.h"
+#include "GLState.h"
+#include "DrawData.h"
 
 void Application::renderSkysphere(shared_ptr<Program> prog)
 {
     // Compute model matrix
     glm::mat4 S_o = glm::scale(glm::mat4(1.0f), glm::vec3(0.1f));
-    glm::mat4 T_o = glm::translate(glm::mat4(1.0f), currCam->Position);
+    glm::mat4 T_o = glm::translate(glm::mat4(1.0f), viewPosition);
     glm::mat4 Model = T_o * S_o;
     
     // Setup texture
-    glActiveTexture(GL_TEXTURE0);
-    glUniform1i(prog->getUniform("tex"), 0);
-    glBindTexture(GL_TEXTURE_2D, skysphere_texture);
+    GLState::activeTexture(GL_TEXTURE0);
+    prog->setInt("tex", 0);
+    GLState::bindTexture(GL_TEXTURE_2D, skysphere_texture);
 
     // Render skysphere
-    glDisable(GL_DEPTH_TEST);
-    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model));
+    GLState::disable(GL_DEPTH_TEST);
+    DrawData::setModel(Model);
     skysphere->Draw(prog, false);
-    glEnable(GL_DEPTH_TEST);
+    GLState::enable(GL_DEPTH_TEST);
 }
 
 void Application::renderScene(shared_ptr<Program> prog, bool useMaterials) {
-    stage.renderStage(prog, useMaterials);
+    stage.renderStage(prog, useMaterials, &lightmaps);
 
-    MatrixStack Model;
-    Model.translate(stageCenter);
-    
-    Model.pushMatrix();
-        Model.translate(glm::vec3(0.0f, stageHeight-0.8f, -stageDepth/2.0f));
-        Model.rotate(glm::radians(45.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        Model.multMatrix(spotlight->getTransformMat());
-        glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
-        spotlight->Draw(prog, useMaterials);
-    Model.popMatrix();
-
-    Model.pushMatrix();
-        Model.translate(glm::vec3(-stageWidth/2.0f+1.0f, stageHeight-0.8f, -stageDepth/2.0f));
-        Model.rotate(glm::radians(60.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        Model.rotate(glm::radians(30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        Model.multMatrix(spotlight->getTransformMat());
-        glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
-        spotlight->Draw(prog, useMaterials);
-    Model.popMatrix();
-
-    Model.pushMatrix();
-        Model.translate(glm::vec3(stageWidth/2.0f-1.0f, stageHeight-0.8f, -stageDepth/2.0f));
-        Model.rotate(glm::radians(60.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        Model.rotate(glm::radians(-30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        Model.multMatrix(spotlight->getTransformMat());
-        glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
+    for (int i = 0; i < 3; i++) {
+        DrawData::setModel(transforms.getWorld(spotlightNodes[i]));
         spotlight->Draw(prog, useMaterials);
-    Model.popMatrix();
+    }
 }
 
 void Application::renderObjects(shared_ptr<Program> prog, bool useMaterials)
 {
-    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(drum_set->getTransformMat()));
+    lightmaps.bind(prog, "drum_set");
+    DrawData::setModel(transforms.getWorld(drumSetNode));
     drum_set->Draw(prog, useMaterials);
     
+    // Dummies move, so they're always lit dynamically
+    lightmaps.unbind(prog);
     dummies.renderDummies(prog, playGuitar, useMaterials);
     
-    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(amplifier1->getTransformMat()));
+    lightmaps.bind(prog, "amplifier1");
+    DrawData::setModel(transforms.getWorld(amplifier1Node));
     amplifier1->Draw(prog, useMaterials);
 
-    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(amplifier2->getTransformMat()));
+    lightmaps.bind(prog, "amplifier2");
+    DrawData::setModel(transforms.getWorld(amplifier2Node));
     amplifier2->Draw(prog, useMaterials);
 
-    glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(piano->getTransformMat()));
+    lightmaps.bind(prog, "piano");
+    DrawData::setModel(transforms.getWorld(pianoNode));
     piano->Draw(prog, useMaterials);
 
+    lightmaps.unbind(prog);
 }
 
 
@@ -85,33 +70,178 @@ void Application::renderShadowMaps(float aspect)
     /*
      * Render depth map for each light
      */
+    GLDebug::Group group("Shadow maps");
     
-    shadowProg->bind();
-    glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+    if (!shadowProg->bind())
+        return;
+    GLState::viewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
     
     for (unsigned int i = 0; i < stageLights.size(); i++)
     { 
-        glBindFramebuffer(GL_FRAMEBUFFER, shadowFBO[i]);
+        unsigned int slot = lightingSystem.getSlot(stageLights[i]);
+        if (slot >= MAX_LIGHTS)
+            continue;
+
+        GLState::bindFramebuffer(GL_FRAMEBUFFER, shadowFBO[slot]);
         glDrawBuffer(GL_NONE);
         glReadBuffer(GL_NONE);
         
         // Get light space matrix for a given light
         glm::mat4 LightSpace = lightingSystem.getSpaceMatrix(stageLights[i], aspect);
-        glUniformMatrix4fv(shadowProg->getUniform("lightSpaceMatrix"), 1, GL_FALSE, value_ptr(LightSpace));
+        shadowProg->setMat4("lightSpaceMatrix", LightSpace);
 
         // Setup shadow map
         glClear(GL_DEPTH_BUFFER_BIT);
        
-        glCullFace(GL_FRONT);
+        GLState::cullFace(GL_FRONT);
         // Only render objects
         renderObjects(shadowProg, false);
-        glCullFace(GL_BACK);
+        GLState::cullFace(GL_BACK);
     }
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
     shadowProg->unbind();
 }
 
+void Application::renderLightBulbs(shared_ptr<Program> prog)
+{
+    // Setup spotlights' "lights"
+    GLDebug::Group group("Light bulbs");
+    unsigned int emissiveBit = prog->getFeatureBit("EMISSIVE");
+    prog->setFeatures(prog->getFeatures() | emissiveBit);
+    for (int i = 0; i < 3; i++) {
+        DrawData::setModel(transforms.getWorld(bulbNodes[i]), lightingSystem.getColor(stageLights[i]));
+        skysphere->Draw(prog);
+    }
+    prog->setFeatures(prog->getFeatures() & ~emissiveBit);
+}
+
+void Application::renderForward(const glm::mat4 &P, const glm::mat4 &V, float aspect)
+{
+    int tag = getCameraMode() * 2 + (useDepthPrepass ? 1 : 0);
+
+    // Lay down depth first so the lit shader only runs once per pixel
+    if (useDepthPrepass) {
+        GLDebug::Group group("Depth pre-pass");
+        depthTimer.begin(tag);
+        GLState::colorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        depthProg->bind();
+            renderScene(depthProg, false);
+            renderObjects(depthProg, false);
+        depthProg->unbind();
+        GLState::colorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        depthTimer.end();
+
+        GLState::depthFunc(GL_EQUAL);
+        GLState::depthMask(GL_FALSE);
+    }
+
+    // Render scene w/ lighting
+    GLDebug::pushGroup("Forward lighting");
+    litTimer.begin(tag);
+    prog->bind();
+        for (unsigned int i = 0; i < stageLights.size(); i++) {
+            string index = "[" + to_string(lightingSystem.getSlot(stageLights[i])) + "]";
+            prog->setMat4("lightSpaceMatrix"+index, lightingSystem.getSpaceMatrix(stageLights[i], aspect));
+        }
+
+        lightingSystem.renderLights(prog, V);
+        
+        // Bind shadow maps
+        GLState::activeTexture(GL_TEXTURE0 + 100);
+        prog->setInt("shadowMaps", 100);
+        GLState::bindTexture(GL_TEXTURE_2D_ARRAY, shadowMaps);
+        
+        renderScene(prog);
+        renderObjects(prog);
+        litTimer.end();
+        GLDebug::popGroup();
+
+        // Bulbs aren't in the pre-pass, so they depth test normally
+        GLState::depthFunc(GL_LESS);
+        GLState::depthMask(GL_TRUE);
+        renderLightBulbs(prog);
+    
+    prog->unbind();
+}
+
+int Application::getCameraMode() const
+{
+    if (currCam == &drumCam)  return CAMERA_MODE_DRUMS;
+    if (currCam == &stageCam) return CAMERA_MODE_OVERHEAD;
+    return CAMERA_MODE_FREE;
+}
+
+void Application::collectTimings()
+{
+    double time;
+    int tag;
+
+    while (depthTimer.poll(time, tag)) {
+        PassTiming &timing = passTimings[tag / 2][tag % 2];
+        timing.depthTime += time;
+        timing.depthFrames++;
+    }
+
+    while (litTimer.poll(time, tag)) {
+        PassTiming &timing = passTimings[tag / 2][tag % 2];
+        timing.litTime += time;
+        timing.litFrames++;
+    }
+}
+
+void Application::reportTimings()
+{
+    const char *modeNames[CAMERA_MODE_COUNT] = { "free roam", "drums", "overhead" };
+
+    cout << "Forward pass GPU time (ms/frame):" << endl;
+    for (int mode = 0; mode < CAMERA_MODE_COUNT; mode++) {
+        PassTiming &off = passTimings[mode][0];
+        PassTiming &on  = passTimings[mode][1];
+        if (!off.litFrames && !on.litFrames) continue;
+
+        cout << "  " << modeNames[mode] << ":";
+        if (off.litFrames)
+            cout << " no pre-pass " << off.litTime / off.litFrames;
+        if (on.litFrames) {
+            double depth = on.depthFrames ? on.depthTime / on.depthFrames : 0.0;
+            double lit = on.litTime / on.litFrames;
+            cout << " | pre-pass " << depth << " + lit " << lit << " = " << depth + lit;
+        }
+        cout << endl;
+    }
+
+    // Driver calls the state filter saved on the last frame
+    const GLState::Counters &calls = GLState::lastFrame;
+    unsigned long total = calls.issued + calls.filtered;
+    cout << "GL state/uniform calls last frame: " << calls.issued << " issued, " << calls.filtered
+         << " filtered (" << (total ? 100 * calls.filtered / total : 0) << "% redundant)" << endl;
+    cout << "Draw data ring buffer peak: " << DrawData::getBuffer().peakUsage << " of "
+         << DRAW_DATA_SECTION_SIZE << " bytes per frame" << endl;
+}
+
+void Application::renderDeferred(const glm::mat4 &P, const glm::mat4 &V, float aspect, int width, int height)
+{
+    deferred.resize(width, height);
+
+    // Store surface attributes for everything that is lit
+    deferred.beginGeometryPass(P, V);
+        renderScene(deferred.geometryProg);
+        renderObjects(deferred.geometryProg);
+    deferred.endGeometryPass();
+
+    // Shade on top of the skysphere, one scissored pass per light
+    GLState::viewport(0, 0, width, height);
+    deferred.renderLighting(lightingSystem, stageLights, P, V, aspect, shadowMaps, stageBB);
+
+    // Emissive bulbs don't need lighting, draw them forward against the scene depth
+    deferred.copyDepth();
+    if (prog->bind()) {
+        renderLightBulbs(prog);
+        prog->unbind();
+    }
+}
+
 void Application::render()
 {
     // Frame timing
@@ -125,85 +255,64 @@ void Application::render()
     glfwGetFramebufferSize(windowManager->getHandle(), &width, &height);
     float aspect = width/(float)height;
 
+    // Advance the simulation, then draw it part way to the next tick
+    simulate();
+    float alpha = accumulator / SIMULATION_STEP;
+    viewPosition = currCam->Position;
+    if (currCam == &camera)
+        viewPosition = glm::mix(prevState.playerPosition, currState.playerPosition, alpha);
+    dummies.animationTime = glm::mix(prevState.time, currState.time, (double)alpha);
+
+    // Only nodes that moved since last frame are recomputed
+    transforms.update();
+
+    // Lights spawned or destroyed since the shaders were built
+    if (lightLayout != lightingSystem.getLayoutVersion())
+        specializeLights();
+
+    // The listener is the view, and the sounds nearest it get the real sources
+    emitters.update(transforms, glfwGetTime(), viewPosition, currCam->Front, currCam->Up);
+
+    // Without a sound card nothing plays the loopback device, so it's kept up with the frame
+    if (audioSystem.isLoopback())
+        audioSystem.advanceLoopback(deltaTime);
+
+    // Per-draw data for this frame goes to the next ring buffer section
+    DrawData::beginFrame();
+
     renderShadowMaps(aspect);
 
     /*
      * Render scene normally (skysphere, lighting, shadow mapping)
      */
 
-    glViewport(0, 0, width, height);
+    GLState::viewport(0, 0, width, height);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
     // Compute view and perspective matrices
     glm::mat4 Projection =  glm::perspective(45.0f, aspect, 0.01f, 100.0f);
-    glm::mat4 View = currCam->GetViewMatrix();
+    glm::mat4 View = glm::lookAt(viewPosition, viewPosition + currCam->Front, currCam->Up);
 
     // Render skysphere
-    skyProg->bind();
-        glUniformMatrix4fv(skyProg->getUniform("P"), 1, GL_FALSE, value_ptr(Projection));
-        glUniformMatrix4fv(skyProg->getUniform("V"), 1, GL_FALSE, value_ptr(View));
+    GLDebug::pushGroup("Skysphere");
+    DrawData::setCamera(Projection, View);
+    if (skyProg->bind()) {
         renderSkysphere(skyProg);
-    skyProg->unbind();
+        skyProg->unbind();
+    }
+    GLDebug::popGroup();
 
-    // Render scene w/ lighting
-    prog->bind();
-        glUniformMatrix4fv(prog->getUniform("P"), 1, GL_FALSE, value_ptr(Projection));
-        glUniformMatrix4fv(prog->getUniform("V"), 1, GL_FALSE, value_ptr(View));
-        glUniform3f(prog->getUniform("material.emissive"), 0.0f, 0.0f, 0.0f);
-        glUniform1i(prog->getUniform("lightsEnabled"), 1);
-        
-        for (unsigned int i = 0; i < stageLights.size(); i++) {
-            string index = "[" + to_string(i) + "]";
-            glUniformMatrix4fv(prog->getUniform("lightSpaceMatrix"+index), 1, GL_FALSE, 
-                value_ptr(lightingSystem.getSpaceMatrix(stageLights[i], aspect)));
-        }
-        
+    if (useDeferred)
+        renderDeferred(Projection, View, aspect, width, height);
+    else
+        renderForward(Projection, View, aspect);
 
-        if (playGuitar) {
-            lightingSystem.setDirection(stageLights[2], glm::vec3(0.5f*cos(glfwGetTime()), -0.7f, 0.5f*sin(glfwGetTime())+0.5f));
-            lightingSystem.setColor(stageLights[2], glm::vec3(cos(0.5f*glfwGetTime())+0.5f, sin(0.5f*glfwGetTime())+0.5f, 1.0f));
-        }
-        lightingSystem.renderLights(prog, View);
-        
-        // Bind shadow maps
-        glActiveTexture(GL_TEXTURE0 + 100);
-        glUniform1i(prog->getUniform("shadowMaps"), 100);
-        glBindTexture(GL_TEXTURE_2D_ARRAY, shadowMaps);
-        
-        renderScene(prog);
-        renderObjects(prog);
-
-        // Setup spotlights' "lights"
-        glUniform1i(prog->getUniform("lightsEnabled"), 0);
-        MatrixStack Model;
-        Model.pushMatrix();
-            Model.translate(glm::vec3(0.0f, stageHeight-1.0f, -stageDepth+0.4f));
-            Model.scale(0.14f);
-            Model.multMatrix(skysphere->getTransformMat());
-            glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
-            glUniform3fv(prog->getUniform("material.emissive"), 1, value_ptr(lightingSystem.getColor(stageLights[2])));
-            skysphere->Draw(prog);
-        Model.popMatrix();
-
-        Model.pushMatrix();
-            Model.translate(glm::vec3(-stageWidth/2.0f+1.05f, stageHeight-1.0f, -stageDepth+0.4f));
-            Model.scale(0.14f);
-            Model.multMatrix(skysphere->getTransformMat());
-            glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
-            glUniform3fv(prog->getUniform("material.emissive"), 1, value_ptr(lightingSystem.getColor(stageLights[0])));
-            skysphere->Draw(prog);
-        Model.popMatrix();
-
-        Model.pushMatrix();
-            Model.translate(glm::vec3(stageWidth/2.0f-1.05f, stageHeight-1.0f, -stageDepth+0.4f));
-            Model.scale(0.14f);
-            Model.multMatrix(skysphere->getTransformMat());
-            glUniformMatrix4fv(prog->getUniform("M"), 1, GL_FALSE, value_ptr(Model.topMatrix()));
-            glUniform3fv(prog->getUniform("material.emissive"), 1, value_ptr(lightingSystem.getColor(stageLights[1])));
-            skysphere->Draw(prog);
-        Model.popMatrix();
-    
-    prog->unbind();
+    collectTimings();
+    if (timePassed - lastTimingReport >= TIMING_REPORT_INTERVAL) {
+        reportTimings();
+        lastTimingReport = timePassed;
+    }
 
-    sceneLogic();
+    DrawData::endFrame();
+    GLState::endFrame();
 }
\ No newline at end of file
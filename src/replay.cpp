@@ -0,0 +1,100 @@
+#include <iostream>
+#include <chrono>
+
+#include "Application.h"
+
+using namespace std;
+
+void Application::startRecording()
+{
+    eventLog.clear(SIMULATION_RATE);
+    recording = true;
+}
+
+void Application::saveRecording(const string path)
+{
+    if (!recording) return;
+    recording = false;
+
+    eventLog.length = currState.tick;
+    if (eventLog.save(path))
+        cout << "[Replay] Recorded " << eventLog.length << " ticks, " << eventLog.events.size()
+             << " events to " << path << endl;
+}
+
+bool Application::startReplay(const string path)
+{
+    if (!eventLog.load(path))
+        return false;
+
+    if (eventLog.rate != SIMULATION_RATE) {
+        cerr << "[Replay] " << path << " was recorded at " << eventLog.rate << " ticks per second, not "
+             << SIMULATION_RATE << endl;
+        return false;
+    }
+
+    replaying = true;
+    replayCursor = 0;
+    replayMismatches = 0;
+    return true;
+}
+
+// Start of a tick: checkpoints while recording, the tick's input while replaying
+void Application::replayTick()
+{
+    if (recording && currState.tick % RECORD_CHECKPOINT_TICKS == 0) {
+        eventLog.add(currState.tick, EVENT_CHECKPOINT, 0, 0, 0,
+            camera.Position.x, camera.Position.y, camera.Position.z);
+    }
+
+    if (!replaying) return;
+
+    const vector<LoggedEvent> &events = eventLog.events;
+    while (replayCursor < events.size() && events[replayCursor].tick <= currState.tick)
+    {
+        const LoggedEvent &event = events[replayCursor++];
+        switch (event.type) {
+            case EVENT_KEY:
+                handleKey(event.key, event.action, event.mods);
+                break;
+            case EVENT_CURSOR:
+                handleCursor(event.x, event.y);
+                break;
+            case EVENT_CHECKPOINT:
+                if (camera.Position != glm::vec3(event.x, event.y, event.z)) {
+                    if (replayMismatches == 0)
+                        cerr << "[Replay] Diverged from the recording by tick " << event.tick << endl;
+                    replayMismatches++;
+                }
+                break;
+        }
+    }
+}
+
+/*
+ * Runs a loaded recording's ticks back to back, with no window, audio or
+ * frame pacing, and reports how much faster than real time it went. The
+ * scene must be set up as for the other headless tools, plus initCameras
+ * and initCollisions.
+ */
+void Application::replayHeadless()
+{
+    auto start = chrono::steady_clock::now();
+    while (!replayFinished())
+        step();
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    double played = (double)currState.tick / SIMULATION_RATE;
+    cout << "[Replay] " << currState.tick << " ticks (" << played << " s) simulated in "
+         << elapsed.count() * 1000.0 << " ms, " << played / elapsed.count() << "x real time, "
+         << replayMismatches << " checkpoint mismatches" << endl;
+}
+
+void Application::reportReplay(unsigned int frames, double seconds)
+{
+    if (!replaying || frames == 0) return;
+
+    cout << "[Replay] " << currState.tick << " ticks over " << frames << " frames in " << seconds
+         << " s, " << 1000.0 * seconds / frames << " ms per frame, " << replayMismatches
+         << " checkpoint mismatches" << endl;
+}